@@ -0,0 +1,223 @@
+#include "gitcatfile.h"
+#include <QDebug>
+
+namespace {
+// 连续重启失败超过该次数后，放弃并让所有等待中的请求失败
+const int MaxRestartCount = 3;
+}
+
+GitCatFile::GitCatFile(Mode mode, const QString &repositoryPath, QObject *parent)
+    : QObject(parent),
+      m_mode(mode),
+      m_repositoryPath(repositoryPath),
+      m_process(nullptr),
+      m_offset(0),
+      m_restartCount(0)
+{
+}
+
+GitCatFile::~GitCatFile()
+{
+    shutdown();
+}
+
+void GitCatFile::request(const QString &revision, ObjectCallback callback)
+{
+    Request req;
+    req.revision = revision.toUtf8();
+    req.callback = callback;
+
+    if (req.revision.contains('\n') || req.revision.contains('\0')) {
+        ObjectInfo info;
+        info.oid = req.revision;
+        if (req.callback) req.callback(info, QByteArray());
+        return;
+    }
+
+    // 请求按顺序写入管道，响应按相同顺序返回
+    m_pending.append(req);
+    ensureStarted();
+    // 启动失败可能在start()中同步报告，此时请求已经失败
+    if (m_process) {
+        m_process->write(req.revision + '\n');
+    }
+}
+
+void GitCatFile::shutdown()
+{
+    if (!m_process) {
+        return;
+    }
+
+    disconnect(m_process, nullptr, this, nullptr);
+    m_process->closeWriteChannel();
+    if (!m_process->waitForFinished(1000)) {
+        m_process->kill();
+        m_process->waitForFinished();
+    }
+    delete m_process;
+    m_process = nullptr;
+
+    m_buffer.clear();
+    m_offset = 0;
+    failPendingRequests();
+}
+
+GitCatFile::Mode GitCatFile::mode() const
+{
+    return m_mode;
+}
+
+int GitCatFile::pendingRequestCount() const
+{
+    return m_pending.size();
+}
+
+void GitCatFile::ensureStarted()
+{
+    if (m_process) {
+        return;
+    }
+
+    m_process = new QProcess(this);
+    m_process->setWorkingDirectory(m_repositoryPath);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &GitCatFile::onReadyRead);
+    connect(m_process, &QProcess::finished, this, &GitCatFile::onProcessFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &GitCatFile::onProcessError);
+
+    // 不在GUI线程中等待启动，启动失败时由onProcessError让等待中的请求失败
+    QStringList args;
+    args << "cat-file" << (m_mode == Batch ? "--batch" : "--batch-check");
+    m_process->start("git", args);
+}
+
+void GitCatFile::onReadyRead()
+{
+    // 已消费的数据超过一半时再整体前移，避免每个响应都复制缓冲区
+    if (m_offset > 0 && m_offset * 2 > m_buffer.size()) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+    m_buffer.append(m_process->readAllStandardOutput());
+
+    while (!m_pending.isEmpty() && parseResponse()) {
+    }
+}
+
+bool GitCatFile::parseResponse()
+{
+    int headerEnd = m_buffer.indexOf('\n', m_offset);
+    if (headerEnd < 0) {
+        return false;
+    }
+
+    QByteArray header = m_buffer.mid(m_offset, headerEnd - m_offset);
+    ObjectInfo info;
+    QByteArray content;
+    int next = headerEnd + 1;
+
+    // "<name> missing" 或 "<name> ambiguous"
+    if (header.endsWith(" missing") || header.endsWith(" ambiguous")) {
+        info.oid = header.left(header.lastIndexOf(' '));
+    } else {
+        QList<QByteArray> parts = header.split(' ');
+        if (parts.size() < 3) {
+            // 输出不同步，只能重启进程
+            restartProcess();
+            return false;
+        }
+
+        info.oid = parts[0];
+        info.type = parts[1];
+        info.size = parts[2].toLongLong();
+        info.missing = false;
+
+        if (m_mode == Batch) {
+            // 内容后面还有一个换行符
+            qint64 required = qint64(next) + info.size + 1;
+            if (m_buffer.size() < required) {
+                return false;
+            }
+            content = m_buffer.mid(next, int(info.size));
+            next = int(required);
+        }
+    }
+
+    m_offset = next;
+    m_restartCount = 0;
+
+    Request req = m_pending.takeFirst();
+    if (req.callback) req.callback(info, content);
+    return true;
+}
+
+void GitCatFile::onProcessFinished()
+{
+    if (m_pending.isEmpty()) {
+        // 空闲时退出，下次请求时再启动
+        m_process->deleteLater();
+        m_process = nullptr;
+        m_buffer.clear();
+        m_offset = 0;
+        return;
+    }
+    restartProcess();
+}
+
+void GitCatFile::onProcessError(QProcess::ProcessError error)
+{
+    // 运行中的错误随后会触发finished，只处理启动失败
+    if (error != QProcess::FailedToStart) {
+        return;
+    }
+
+    qDebug() << "无法启动git cat-file:" << m_process->errorString();
+    disconnect(m_process, nullptr, this, nullptr);
+    m_process->deleteLater();
+    m_process = nullptr;
+    m_buffer.clear();
+    m_offset = 0;
+    m_restartCount = 0;
+    failPendingRequests();
+}
+
+void GitCatFile::restartProcess()
+{
+    qDebug() << "git cat-file进程异常，正在重启";
+
+    if (m_process) {
+        disconnect(m_process, nullptr, this, nullptr);
+        m_process->kill();
+        m_process->deleteLater();
+        m_process = nullptr;
+    }
+    m_buffer.clear();
+    m_offset = 0;
+
+    if (++m_restartCount > MaxRestartCount) {
+        m_restartCount = 0;
+        failPendingRequests();
+        return;
+    }
+    ensureStarted();
+    if (!m_process) {
+        return;
+    }
+
+    // 尚未收到完整响应的请求按原顺序重新发送
+    for (const Request &req : m_pending) {
+        m_process->write(req.revision + '\n');
+    }
+}
+
+void GitCatFile::failPendingRequests()
+{
+    QList<Request> pending = m_pending;
+    m_pending.clear();
+
+    for (const Request &req : pending) {
+        ObjectInfo info;
+        info.oid = req.revision;
+        if (req.callback) req.callback(info, QByteArray());
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef GITCATFILE_H
+#define GITCATFILE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QProcess>
+#include <functional>
+
+// 常驻的git cat-file --batch / --batch-check进程，通过管道流水线读取对象
+class GitCatFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Batch,      // 返回对象头和内容
+        BatchCheck  // 只返回对象头（类型和大小）
+    };
+
+    struct ObjectInfo {
+        QByteArray oid;
+        QByteArray type;
+        qint64 size = -1;
+        bool missing = true;
+    };
+
+    using ObjectCallback = std::function<void(const ObjectInfo &info, const QByteArray &content)>;
+
+    GitCatFile(Mode mode, const QString &repositoryPath, QObject *parent = nullptr);
+    ~GitCatFile();
+
+    // revision可以是对象ID，也可以是"HEAD:path"、"<commit>^{tree}"等表达式；
+    // 含换行符或NUL的revision会打乱请求与响应的对应关系，不写入管道，直接按对象不存在回调
+    void request(const QString &revision, ObjectCallback callback);
+    void shutdown();
+
+    Mode mode() const;
+    int pendingRequestCount() const;
+
+private slots:
+    void onReadyRead();
+    void onProcessFinished();
+    void onProcessError(QProcess::ProcessError error);
+
+private:
+    struct Request {
+        QByteArray revision;
+        ObjectCallback callback;
+    };
+
+    // 不等待进程启动，启动前写入的请求由QProcess缓存
+    void ensureStarted();
+    bool parseResponse();
+    void restartProcess();
+    void failPendingRequests();
+
+    Mode m_mode;
+    QString m_repositoryPath;
+    QProcess *m_process;
+    QList<Request> m_pending;
+    QByteArray m_buffer;
+    int m_offset;
+    int m_restartCount;
+};
+
+#endif // GITCATFILE_H
@@ -0,0 +1,404 @@
+#include "gitcommitcache.h"
+#include "gitobjectdatabase.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+
+namespace {
+const char Magic[] = "SCCC";
+const quint32 Version = 1;
+
+// 文件头：魔数、版本、哈希长度、提交数、作者数、字符串区大小，之后是各列的偏移
+enum Section {
+    Oids,           // 排序后的原始对象ID
+    ParentBegin,    // (提交数 + 1)个u32，第i个提交的父提交为[begin[i], begin[i+1])
+    Parents,        // 原始对象ID
+    AuthorIds,      // u32
+    CommitTimes,    // i64
+    AuthorTimes,    // i64
+    TimeZones,      // i32，秒
+    SubjectOffsets, // u32，字符串区中的位置
+    AuthorOffsets,  // 每个作者一个u32
+    Strings,        // 以\0结尾的UTF-8字符串
+    SectionCount
+};
+const int HeaderSize = 24 + SectionCount * 8;
+
+inline quint32 readLE32(const uchar *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+inline qint64 readLE64(const uchar *p)
+{
+    return qFromLittleEndian<qint64>(p);
+}
+
+inline void appendLE32(QByteArray *out, quint32 value)
+{
+    uchar buffer[4];
+    qToLittleEndian<quint32>(value, buffer);
+    out->append(reinterpret_cast<const char *>(buffer), 4);
+}
+
+inline void appendLE64(QByteArray *out, qint64 value)
+{
+    uchar buffer[8];
+    qToLittleEndian<qint64>(value, buffer);
+    out->append(reinterpret_cast<const char *>(buffer), 8);
+}
+
+// 文件中的各列按8字节对齐
+inline qint64 aligned(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+}
+
+GitCommitCache::GitCommitCache(const QString &filePath, int hashSize)
+    : m_filePath(filePath),
+      m_hashSize(hashSize),
+      m_file(nullptr),
+      m_data(nullptr),
+      m_size(0),
+      m_count(0),
+      m_authorCount(0),
+      m_oids(nullptr),
+      m_parentBegin(nullptr),
+      m_parents(nullptr),
+      m_authorIds(nullptr),
+      m_commitTimes(nullptr),
+      m_authorTimes(nullptr),
+      m_timeZones(nullptr),
+      m_subjectOffsets(nullptr),
+      m_authorOffsets(nullptr),
+      m_strings(nullptr),
+      m_stringsSize(0)
+{
+}
+
+GitCommitCache::~GitCommitCache()
+{
+    close();
+}
+
+QString GitCommitCache::cachePath(const QString &gitDir)
+{
+    QString directory = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("commit-cache");
+    QByteArray key = QDir(gitDir).canonicalPath().toUtf8();
+    QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+    return QDir(directory).filePath(QString::fromLatin1(hash) + ".cache");
+}
+
+bool GitCommitCache::parseCommit(const QByteArray &oid, const QByteArray &data, Commit *commit)
+{
+    GitObjectDatabase::CommitHeader header;
+    if (!GitObjectDatabase::parseCommit(data, &header)) {
+        return false;
+    }
+
+    commit->oid = oid;
+    commit->parents = header.parents;
+    commit->commitTime = header.commitTime;
+
+    // Name <email> 1700000000 +0800
+    const QByteArray &author = header.author;
+    int emailStart = author.indexOf(" <");
+    int emailEnd = author.indexOf("> ", emailStart);
+    if (emailStart >= 0 && emailEnd >= 0) {
+        commit->author = QString::fromUtf8(author.left(emailStart));
+        QList<QByteArray> when = author.mid(emailEnd + 2).split(' ');
+        if (when.size() == 2) {
+            int tz = when[1].toInt();
+            commit->authorTime = when[0].toLongLong();
+            commit->authorTimeZone = (qAbs(tz) / 100 * 3600 + qAbs(tz) % 100 * 60) * (tz < 0 ? -1 : 1);
+        }
+    }
+
+    // 与%s一致：取第一段文字，多行以空格连接
+    QByteArray body = data.mid(header.messageOffset);
+    int paragraphEnd = body.indexOf("\n\n");
+    QByteArray subject = paragraphEnd >= 0 ? body.left(paragraphEnd) : body;
+    commit->subject = QString::fromUtf8(subject.trimmed()).replace('\n', ' ');
+    return true;
+}
+
+bool GitCommitCache::load()
+{
+    close();
+
+    m_file = new QFile(m_filePath);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        close();
+        return false;
+    }
+    m_size = m_file->size();
+    m_data = m_size >= HeaderSize ? m_file->map(0, m_size) : nullptr;
+    if (!m_data || !validate(m_size)) {
+        qDebug() << "忽略无效的提交缓存:" << m_filePath;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool GitCommitCache::validate(qint64 size)
+{
+    if (std::memcmp(m_data, Magic, 4) != 0 || readLE32(m_data + 4) != Version
+        || readLE32(m_data + 8) != quint32(m_hashSize)) {
+        return false;
+    }
+    m_count = readLE32(m_data + 12);
+    m_authorCount = readLE32(m_data + 16);
+    m_stringsSize = readLE32(m_data + 20);
+
+    qint64 offsets[SectionCount + 1];
+    for (int i = 0; i < SectionCount; ++i) {
+        offsets[i] = readLE64(m_data + 24 + i * 8);
+        if (offsets[i] < HeaderSize || offsets[i] > size || (i > 0 && offsets[i] < offsets[i - 1])) {
+            return false;
+        }
+    }
+    offsets[SectionCount] = size;
+
+    // 每列都必须放得下，不能与下一列重叠
+    auto fits = [&offsets](int section, qint64 bytes) {
+        return bytes >= 0 && offsets[section] + bytes <= offsets[section + 1];
+    };
+    const qint64 count = m_count;
+    if (!fits(Oids, count * m_hashSize) || !fits(ParentBegin, (count + 1) * 4)) {
+        return false;
+    }
+    m_parentBegin = m_data + offsets[ParentBegin];
+    for (quint32 i = 0; i < m_count; ++i) {
+        if (readLE32(m_parentBegin + i * 4) > readLE32(m_parentBegin + (i + 1) * 4)) {
+            return false;
+        }
+    }
+    const qint64 parentCount = readLE32(m_parentBegin + count * 4);
+    if (!fits(Parents, parentCount * m_hashSize) || !fits(AuthorIds, count * 4)
+        || !fits(CommitTimes, count * 8) || !fits(AuthorTimes, count * 8)
+        || !fits(TimeZones, count * 4) || !fits(SubjectOffsets, count * 4)
+        || !fits(AuthorOffsets, qint64(m_authorCount) * 4) || !fits(Strings, m_stringsSize)) {
+        return false;
+    }
+
+    m_oids = m_data + offsets[Oids];
+    m_parents = m_data + offsets[Parents];
+    m_authorIds = m_data + offsets[AuthorIds];
+    m_commitTimes = m_data + offsets[CommitTimes];
+    m_authorTimes = m_data + offsets[AuthorTimes];
+    m_timeZones = m_data + offsets[TimeZones];
+    m_subjectOffsets = m_data + offsets[SubjectOffsets];
+    m_authorOffsets = m_data + offsets[AuthorOffsets];
+    m_strings = m_data + offsets[Strings];
+    return true;
+}
+
+void GitCommitCache::close()
+{
+    if (m_file) {
+        if (m_data) {
+            m_file->unmap(const_cast<uchar *>(m_data));
+        }
+        delete m_file;
+        m_file = nullptr;
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_authorCount = 0;
+    m_stringsSize = 0;
+}
+
+bool GitCommitCache::isLoaded() const
+{
+    return m_data != nullptr;
+}
+
+int GitCommitCache::count() const
+{
+    return int(m_count) + m_pending.size();
+}
+
+int GitCommitCache::indexOf(const QByteArray &rawOid) const
+{
+    if (!m_data || rawOid.size() != m_hashSize) {
+        return -1;
+    }
+    int low = 0;
+    int high = int(m_count);
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        int cmp = std::memcmp(m_oids + qint64(middle) * m_hashSize, rawOid.constData(), m_hashSize);
+        if (cmp == 0) {
+            return middle;
+        }
+        if (cmp < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+QString GitCommitCache::stringAt(quint32 offset) const
+{
+    if (offset >= m_stringsSize) {
+        return QString();
+    }
+    const char *text = reinterpret_cast<const char *>(m_strings + offset);
+    return QString::fromUtf8(text, int(qstrnlen(text, m_stringsSize - offset)));
+}
+
+GitCommitCache::Commit GitCommitCache::commitAt(int index) const
+{
+    Commit commit;
+    commit.oid = QByteArray(reinterpret_cast<const char *>(m_oids + qint64(index) * m_hashSize), m_hashSize).toHex();
+
+    const quint32 parentBegin = readLE32(m_parentBegin + index * 4);
+    const quint32 parentEnd = readLE32(m_parentBegin + (index + 1) * 4);
+    for (quint32 i = parentBegin; i < parentEnd; ++i) {
+        commit.parents.append(QByteArray(reinterpret_cast<const char *>(m_parents + qint64(i) * m_hashSize), m_hashSize).toHex());
+    }
+
+    commit.commitTime = readLE64(m_commitTimes + qint64(index) * 8);
+    commit.authorTime = readLE64(m_authorTimes + qint64(index) * 8);
+    commit.authorTimeZone = qint32(readLE32(m_timeZones + index * 4));
+    const quint32 authorId = readLE32(m_authorIds + index * 4);
+    if (authorId < m_authorCount) {
+        commit.author = stringAt(readLE32(m_authorOffsets + authorId * 4));
+    }
+    commit.subject = stringAt(readLE32(m_subjectOffsets + index * 4));
+    return commit;
+}
+
+bool GitCommitCache::find(const QByteArray &oid, Commit *commit) const
+{
+    const QByteArray rawOid = QByteArray::fromHex(oid);
+    const int index = indexOf(rawOid);
+    if (index >= 0) {
+        *commit = commitAt(index);
+        return true;
+    }
+    if (m_pending.contains(rawOid)) {
+        *commit = m_pending.value(rawOid);
+        return true;
+    }
+    return false;
+}
+
+void GitCommitCache::add(const Commit &commit)
+{
+    const QByteArray rawOid = QByteArray::fromHex(commit.oid);
+    if (rawOid.size() != m_hashSize || indexOf(rawOid) >= 0) {
+        return;
+    }
+    m_pending.insert(rawOid, commit);
+}
+
+int GitCommitCache::pendingCount() const
+{
+    return m_pending.size();
+}
+
+bool GitCommitCache::save()
+{
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+
+    QList<QByteArray> pendingOids = m_pending.keys();
+    std::sort(pendingOids.begin(), pendingOids.end());
+
+    QByteArray columns[SectionCount];
+    QHash<QString, quint32> authorIds;
+    quint32 parentTotal = 0;
+
+    auto addString = [&columns](const QString &text) {
+        quint32 offset = quint32(columns[Strings].size());
+        columns[Strings].append(text.toUtf8());
+        columns[Strings].append('\0');
+        return offset;
+    };
+    auto appendCommit = [&](const Commit &commit) {
+        columns[Oids].append(QByteArray::fromHex(commit.oid));
+        appendLE32(&columns[ParentBegin], parentTotal);
+        for (const QByteArray &parent : commit.parents) {
+            columns[Parents].append(QByteArray::fromHex(parent));
+        }
+        parentTotal += quint32(commit.parents.size());
+
+        // 作者名重复很多，只保存一份
+        quint32 authorId = authorIds.value(commit.author, quint32(authorIds.size()));
+        if (authorId == quint32(authorIds.size())) {
+            authorIds.insert(commit.author, authorId);
+            appendLE32(&columns[AuthorOffsets], addString(commit.author));
+        }
+        appendLE32(&columns[AuthorIds], authorId);
+        appendLE64(&columns[CommitTimes], commit.commitTime);
+        appendLE64(&columns[AuthorTimes], commit.authorTime);
+        appendLE32(&columns[TimeZones], quint32(commit.authorTimeZone));
+        appendLE32(&columns[SubjectOffsets], addString(commit.subject));
+    };
+
+    // 已有内容和新增提交都按对象ID排序，归并后仍然有序
+    int existing = 0;
+    int added = 0;
+    while (existing < int(m_count) || added < pendingOids.size()) {
+        bool takeExisting = added >= pendingOids.size()
+            || (existing < int(m_count)
+                && std::memcmp(m_oids + qint64(existing) * m_hashSize, pendingOids[added].constData(), m_hashSize) < 0);
+        if (takeExisting) {
+            appendCommit(commitAt(existing++));
+        } else {
+            appendCommit(m_pending.value(pendingOids[added++]));
+        }
+    }
+    appendLE32(&columns[ParentBegin], parentTotal);
+    const quint32 count = quint32(m_count) + quint32(pendingOids.size());
+
+    QByteArray header(Magic, 4);
+    appendLE32(&header, Version);
+    appendLE32(&header, quint32(m_hashSize));
+    appendLE32(&header, count);
+    appendLE32(&header, quint32(authorIds.size()));
+    appendLE32(&header, quint32(columns[Strings].size()));
+    qint64 offset = aligned(HeaderSize);
+    for (int i = 0; i < SectionCount; ++i) {
+        appendLE64(&header, offset);
+        offset = aligned(offset + columns[i].size());
+    }
+
+    // 先释放映射再替换文件，Windows上不能替换仍被映射的文件
+    close();
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "无法写入提交缓存:" << m_filePath;
+        load();
+        return false;
+    }
+    file.write(header);
+    file.write(QByteArray(aligned(header.size()) - header.size(), '\0'));
+    for (int i = 0; i < SectionCount; ++i) {
+        file.write(columns[i]);
+        file.write(QByteArray(aligned(columns[i].size()) - columns[i].size(), '\0'));
+    }
+    if (!file.commit()) {
+        qDebug() << "无法写入提交缓存:" << m_filePath;
+        load();
+        return false;
+    }
+
+    m_pending.clear();
+    return load();
+}
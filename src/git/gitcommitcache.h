@@ -0,0 +1,79 @@
+#ifndef GITCOMMITCACHE_H
+#define GITCOMMITCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+
+class QFile;
+
+// 每个仓库一个的提交元数据缓存文件，按列存储并通过mmap读取：
+// 对象ID（排序后二分查找）、父提交、作者编号、时间和标题偏移。
+// 提交对象不可变，缓存项按对象ID寻址，永远不会过期；重新打开仓库时只需读取缓存中没有的提交
+class GitCommitCache
+{
+public:
+    struct Commit {
+        QByteArray oid;             // 十六进制
+        QList<QByteArray> parents;  // 十六进制
+        qint64 commitTime = 0;
+        qint64 authorTime = 0;
+        int authorTimeZone = 0;     // 相对UTC的秒数
+        QString author;
+        QString subject;            // 与%s一致
+    };
+
+    GitCommitCache(const QString &filePath, int hashSize);
+    ~GitCommitCache();
+
+    // 应用数据目录下的缓存文件路径，按gitDir区分仓库
+    static QString cachePath(const QString &gitDir);
+    static bool parseCommit(const QByteArray &oid, const QByteArray &data, Commit *commit);
+
+    // 文件不存在或格式不符时视为空缓存
+    bool load();
+    void close();
+    bool isLoaded() const;
+    int count() const;
+
+    // 先查映射的文件，再查尚未保存的提交
+    bool find(const QByteArray &oid, Commit *commit) const;
+    void add(const Commit &commit);
+    int pendingCount() const;
+
+    // 把新增的提交与已有内容合并后整体写入，完成后重新映射
+    bool save();
+
+private:
+    int indexOf(const QByteArray &rawOid) const;
+    Commit commitAt(int index) const;
+    QString stringAt(quint32 offset) const;
+    bool validate(qint64 size);
+
+    QString m_filePath;
+    int m_hashSize;
+    QFile *m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    // 映射中各列的位置，load时校验
+    quint32 m_count;
+    quint32 m_authorCount;
+    const uchar *m_oids;
+    const uchar *m_parentBegin;
+    const uchar *m_parents;
+    const uchar *m_authorIds;
+    const uchar *m_commitTimes;
+    const uchar *m_authorTimes;
+    const uchar *m_timeZones;
+    const uchar *m_subjectOffsets;
+    const uchar *m_authorOffsets;
+    const uchar *m_strings;
+    quint32 m_stringsSize;
+
+    // 原始对象ID -> 尚未写入文件的提交
+    QHash<QByteArray, Commit> m_pending;
+};
+
+#endif // GITCOMMITCACHE_H
@@ -0,0 +1,550 @@
+#include "gitcommitgraph.h"
+#include <QFile>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QDebug>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+namespace {
+// 块ID
+const quint32 ChunkOidFanout = 0x4f494446;     // OIDF
+const quint32 ChunkOidLookup = 0x4f49444c;     // OIDL
+const quint32 ChunkCommitData = 0x43444154;    // CDAT
+const quint32 ChunkGenerationData = 0x47444132; // GDA2
+const quint32 ChunkGenerationOverflow = 0x47444f32; // GDO2
+const quint32 ChunkExtraEdges = 0x45444745;    // EDGE
+
+const quint32 ParentNone = 0x70000000;
+const quint32 ExtraEdgesFlag = 0x80000000; // 第二个父提交字段指向EDGE块
+const quint32 LastEdgeFlag = 0x80000000;
+const quint32 OverflowFlag = 0x80000000;   // GDA2中的偏移保存在GDO2中
+
+// 遍历时的标记
+enum WalkFlag {
+    FromFirst = 0x1,
+    FromSecond = 0x2,
+    Stale = 0x4,
+    Queued = 0x8
+};
+
+inline quint32 readBE32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+inline quint64 readBE64(const uchar *p)
+{
+    return (quint64(readBE32(p)) << 32) | readBE32(p + 4);
+}
+
+// 按代数从大到小出队：子提交的代数一定大于父提交，出队时经过它的所有路径都已处理完
+using GenerationQueue = std::priority_queue<std::pair<quint64, quint32>>;
+}
+
+GitCommitGraph::GitCommitGraph(const QString &objectsDir, int hashSize)
+    : m_objectsDir(objectsDir),
+      m_hashSize(hashSize),
+      m_commitCount(0),
+      m_correctedDates(false)
+{
+}
+
+GitCommitGraph::~GitCommitGraph()
+{
+    close();
+}
+
+bool GitCommitGraph::open()
+{
+    close();
+    if (m_objectsDir.isEmpty()) {
+        return false;
+    }
+
+    // 与git一致：优先使用单个文件，其次是拆分链，链文件中基础层在前
+    QDir infoDir(QDir(m_objectsDir).filePath("info"));
+    QStringList paths;
+    if (QFile::exists(infoDir.filePath("commit-graph"))) {
+        paths << infoDir.filePath("commit-graph");
+    } else {
+        QFile chain(infoDir.filePath("commit-graphs/commit-graph-chain"));
+        if (chain.open(QIODevice::ReadOnly)) {
+            const QList<QByteArray> lines = chain.readAll().split('\n');
+            for (const QByteArray &line : lines) {
+                QByteArray hash = line.trimmed();
+                if (!hash.isEmpty()) {
+                    paths << infoDir.filePath("commit-graphs/graph-" + QString::fromLatin1(hash) + ".graph");
+                }
+            }
+        }
+    }
+
+    // 链中某一层无法使用时只保留之前的层，之后的提交由调用方从对象库读取
+    m_correctedDates = true;
+    for (const QString &path : paths) {
+        Layer layer;
+        layer.base = m_commitCount;
+        if (!openLayer(path, &layer) || layer.data[7] != m_layers.size()) {
+            qDebug() << "无法使用commit-graph文件:" << path;
+            releaseLayer(layer);
+            break;
+        }
+        // 混合了不同代数的链只能使用拓扑层级
+        m_correctedDates = m_correctedDates && layer.generationData;
+        m_commitCount += layer.count;
+        m_layers.append(layer);
+    }
+    if (m_layers.isEmpty()) {
+        m_correctedDates = false;
+        return false;
+    }
+    return true;
+}
+
+bool GitCommitGraph::openLayer(const QString &path, Layer *layer)
+{
+    layer->file = new QFile(path);
+    if (!layer->file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    layer->size = layer->file->size();
+    if (layer->size < 8 + 12 + m_hashSize) {
+        return false;
+    }
+    layer->data = layer->file->map(0, layer->size);
+    if (!layer->data) {
+        return false;
+    }
+
+    // 文件头：魔数、版本1、哈希版本、块数、基础层数
+    const uchar *data = layer->data;
+    const int hashVersion = m_hashSize == 32 ? 2 : 1;
+    if (std::memcmp(data, "CGPH", 4) != 0 || data[4] != 1 || data[5] != hashVersion) {
+        return false;
+    }
+    const int chunkCount = data[6];
+    const qint64 end = layer->size - m_hashSize;
+    if (8 + qint64(chunkCount + 1) * 12 > end) {
+        return false;
+    }
+
+    qint64 commitDataSize = 0;
+    qint64 oidLookupSize = 0;
+    qint64 generationDataSize = 0;
+    for (int i = 0; i < chunkCount; ++i) {
+        const uchar *entry = data + 8 + i * 12;
+        quint32 id = readBE32(entry);
+        quint64 offset = readBE64(entry + 4);
+        quint64 next = readBE64(entry + 16);
+        if (offset > next || next > quint64(end)) {
+            return false;
+        }
+        const qint64 size = qint64(next - offset);
+        const uchar *chunk = data + offset;
+        switch (id) {
+        case ChunkOidFanout:
+            if (size != 256 * 4) {
+                return false;
+            }
+            layer->fanout = chunk;
+            break;
+        case ChunkOidLookup:
+            layer->oids = chunk;
+            oidLookupSize = size;
+            break;
+        case ChunkCommitData:
+            layer->commitData = chunk;
+            commitDataSize = size;
+            break;
+        case ChunkGenerationData:
+            layer->generationData = chunk;
+            generationDataSize = size;
+            break;
+        case ChunkGenerationOverflow:
+            layer->generationOverflow = chunk;
+            layer->generationOverflowCount = quint32(size / 8);
+            break;
+        case ChunkExtraEdges:
+            layer->extraEdges = chunk;
+            layer->extraEdgeCount = quint32(size / 4);
+            break;
+        default:
+            // 布隆过滤器等与遍历无关的块
+            break;
+        }
+    }
+
+    if (!layer->fanout || !layer->oids || !layer->commitData) {
+        return false;
+    }
+    layer->count = readBE32(layer->fanout + 255 * 4);
+    if (oidLookupSize < qint64(layer->count) * m_hashSize
+        || commitDataSize < qint64(layer->count) * (m_hashSize + 16)
+        || qint64(layer->base) + layer->count >= NoPosition) {
+        return false;
+    }
+    if (generationDataSize < qint64(layer->count) * 4) {
+        layer->generationData = nullptr;
+    }
+    return true;
+}
+
+void GitCommitGraph::releaseLayer(Layer &layer)
+{
+    if (layer.file) {
+        if (layer.data) {
+            layer.file->unmap(const_cast<uchar *>(layer.data));
+        }
+        delete layer.file;
+    }
+    layer = Layer();
+}
+
+void GitCommitGraph::close()
+{
+    for (Layer &layer : m_layers) {
+        releaseLayer(layer);
+    }
+    m_layers.clear();
+    m_commitCount = 0;
+    m_correctedDates = false;
+}
+
+bool GitCommitGraph::isOpen() const
+{
+    return !m_layers.isEmpty();
+}
+
+quint32 GitCommitGraph::commitCount() const
+{
+    return m_commitCount;
+}
+
+quint32 GitCommitGraph::findCommit(const QByteArray &oid) const
+{
+    const QByteArray raw = QByteArray::fromHex(oid);
+    if (raw.size() != m_hashSize) {
+        return NoPosition;
+    }
+    const uchar first = uchar(raw[0]);
+
+    // 每个提交只出现在链中的一层
+    for (const Layer &layer : m_layers) {
+        quint32 low = first > 0 ? readBE32(layer.fanout + (first - 1) * 4) : 0;
+        quint32 high = qMin(readBE32(layer.fanout + first * 4), layer.count);
+        while (low < high) {
+            quint32 middle = low + (high - low) / 2;
+            int cmp = std::memcmp(layer.oids + qint64(middle) * m_hashSize, raw.constData(), m_hashSize);
+            if (cmp == 0) {
+                return layer.base + middle;
+            }
+            if (cmp < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+    }
+    return NoPosition;
+}
+
+const GitCommitGraph::Layer *GitCommitGraph::layerFor(quint32 position) const
+{
+    for (const Layer &layer : m_layers) {
+        if (position >= layer.base && position - layer.base < layer.count) {
+            return &layer;
+        }
+    }
+    return nullptr;
+}
+
+const uchar *GitCommitGraph::commitEntry(quint32 position, const Layer **layer) const
+{
+    const Layer *found = layerFor(position);
+    if (!found) {
+        return nullptr;
+    }
+    if (layer) {
+        *layer = found;
+    }
+    return found->commitData + qint64(position - found->base) * (m_hashSize + 16);
+}
+
+QByteArray GitCommitGraph::oid(quint32 position) const
+{
+    const Layer *layer = layerFor(position);
+    if (!layer) {
+        return QByteArray();
+    }
+    const char *raw = reinterpret_cast<const char *>(layer->oids + qint64(position - layer->base) * m_hashSize);
+    return QByteArray(raw, m_hashSize).toHex();
+}
+
+QByteArray GitCommitGraph::treeOid(quint32 position) const
+{
+    const uchar *entry = commitEntry(position);
+    if (!entry) {
+        return QByteArray();
+    }
+    return QByteArray(reinterpret_cast<const char *>(entry), m_hashSize).toHex();
+}
+
+qint64 GitCommitGraph::commitTime(quint32 position) const
+{
+    const uchar *entry = commitEntry(position);
+    if (!entry) {
+        return 0;
+    }
+    // 高30位是拓扑层级，其余34位是提交时间
+    quint64 high = readBE32(entry + m_hashSize + 8) & 0x3;
+    return qint64((high << 32) | readBE32(entry + m_hashSize + 12));
+}
+
+quint64 GitCommitGraph::generation(quint32 position) const
+{
+    const Layer *layer = nullptr;
+    const uchar *entry = commitEntry(position, &layer);
+    if (!entry) {
+        return 0;
+    }
+    if (!m_correctedDates) {
+        return readBE32(entry + m_hashSize + 8) >> 2;
+    }
+
+    // 修正的提交时间 = 提交时间 + 偏移，偏移过大时保存在溢出块中
+    quint64 offset = readBE32(layer->generationData + qint64(position - layer->base) * 4);
+    if (offset & OverflowFlag) {
+        quint32 index = quint32(offset & ~OverflowFlag);
+        if (!layer->generationOverflow || index >= layer->generationOverflowCount) {
+            return 0;
+        }
+        offset = readBE64(layer->generationOverflow + qint64(index) * 8);
+    }
+    return quint64(commitTime(position)) + offset;
+}
+
+bool GitCommitGraph::parents(quint32 position, QList<quint32> *parents) const
+{
+    parents->clear();
+    const Layer *layer = nullptr;
+    const uchar *entry = commitEntry(position, &layer);
+    if (!entry) {
+        return false;
+    }
+
+    // 父提交只能在本层或更早的层中
+    const quint32 limit = layer->base + layer->count;
+    quint32 first = readBE32(entry + m_hashSize);
+    if (first == ParentNone) {
+        return true;
+    }
+    if (first >= limit) {
+        return false;
+    }
+    parents->append(first);
+
+    quint32 second = readBE32(entry + m_hashSize + 4);
+    if (second == ParentNone) {
+        return true;
+    }
+    if (!(second & ExtraEdgesFlag)) {
+        if (second >= limit) {
+            return false;
+        }
+        parents->append(second);
+        return true;
+    }
+
+    // 章鱼合并：第二个及之后的父提交在EDGE块中，最后一个带有结束标记
+    for (quint32 index = second & ~ExtraEdgesFlag; ; ++index) {
+        if (!layer->extraEdges || index >= layer->extraEdgeCount) {
+            return false;
+        }
+        quint32 edge = readBE32(layer->extraEdges + qint64(index) * 4);
+        quint32 parent = edge & ~LastEdgeFlag;
+        if (parent >= limit) {
+            return false;
+        }
+        parents->append(parent);
+        if (edge & LastEdgeFlag) {
+            return true;
+        }
+    }
+}
+
+bool GitCommitGraph::isAncestor(quint32 ancestor, quint32 descendant, bool *result) const
+{
+    const quint64 cutoff = generation(ancestor);
+    if (cutoff == 0 || generation(descendant) == 0) {
+        return false;
+    }
+    if (ancestor == descendant) {
+        *result = true;
+        return true;
+    }
+
+    // 代数不大于目标的其他提交不可能到达目标
+    QList<quint32> stack;
+    QSet<quint32> visited;
+    QList<quint32> parentList;
+    stack.append(descendant);
+    visited.insert(descendant);
+    while (!stack.isEmpty()) {
+        quint32 position = stack.takeLast();
+        if (position == ancestor) {
+            *result = true;
+            return true;
+        }
+        quint64 current = generation(position);
+        if (current == 0) {
+            return false;
+        }
+        if (current <= cutoff) {
+            continue;
+        }
+        if (!parents(position, &parentList)) {
+            return false;
+        }
+        for (quint32 parent : parentList) {
+            if (!visited.contains(parent)) {
+                visited.insert(parent);
+                stack.append(parent);
+            }
+        }
+    }
+    *result = false;
+    return true;
+}
+
+bool GitCommitGraph::mergeBases(quint32 first, quint32 second, QList<quint32> *bases) const
+{
+    bases->clear();
+    if (generation(first) == 0 || generation(second) == 0) {
+        return false;
+    }
+    if (first == second) {
+        bases->append(first);
+        return true;
+    }
+
+    // 从两端向下标记：同时带有两个标记的提交是公共祖先，它的祖先都标记为过时，
+    // 队列中只剩过时的提交时结束。按代数出队，后找到的公共祖先不会是先找到的祖先
+    QHash<quint32, int> flags;
+    GenerationQueue queue;
+    int activeCount = 0; // 队列中没有过时的提交数
+    auto mark = [&](quint32 position, int flag) {
+        int old = flags.value(position, 0);
+        int updated = old | flag;
+        if (updated == old) {
+            return true;
+        }
+        flags.insert(position, updated | Queued);
+        if (!(old & Queued)) {
+            quint64 gen = generation(position);
+            if (gen == 0) {
+                return false;
+            }
+            queue.push(std::make_pair(gen, position));
+            if (!(updated & Stale)) {
+                ++activeCount;
+            }
+        } else if ((updated & Stale) && !(old & Stale)) {
+            --activeCount;
+        }
+        return true;
+    };
+    mark(first, FromFirst);
+    mark(second, FromSecond);
+
+    QList<quint32> parentList;
+    while (activeCount > 0 && !queue.empty()) {
+        quint32 position = queue.top().second;
+        queue.pop();
+        int flag = flags.value(position, 0);
+        if (!(flag & Stale)) {
+            --activeCount;
+        }
+        flag &= FromFirst | FromSecond | Stale;
+        if (flag == (FromFirst | FromSecond)) {
+            bases->append(position);
+            flag |= Stale;
+        }
+        if (!parents(position, &parentList)) {
+            return false;
+        }
+        for (quint32 parent : parentList) {
+            if (!mark(parent, flag)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool GitCommitGraph::aheadBehind(quint32 first, quint32 second, int *ahead, int *behind) const
+{
+    *ahead = 0;
+    *behind = 0;
+    if (generation(first) == 0 || generation(second) == 0) {
+        return false;
+    }
+    if (first == second) {
+        return true;
+    }
+
+    // 出队时标记已经确定：只带一个标记的提交计入对应的一侧，
+    // 两侧都能到达的提交的祖先也都是公共的，队列中只剩这类提交时结束
+    const int both = FromFirst | FromSecond;
+    QHash<quint32, int> flags;
+    GenerationQueue queue;
+    int activeCount = 0; // 队列中只带一个标记的提交数
+    auto mark = [&](quint32 position, int flag) {
+        int old = flags.value(position, 0);
+        int updated = old | flag;
+        if (updated == old) {
+            return true;
+        }
+        flags.insert(position, updated | Queued);
+        if (!(old & Queued)) {
+            quint64 gen = generation(position);
+            if (gen == 0) {
+                return false;
+            }
+            queue.push(std::make_pair(gen, position));
+            if ((updated & both) != both) {
+                ++activeCount;
+            }
+        } else if ((updated & both) == both && (old & both) != both) {
+            --activeCount;
+        }
+        return true;
+    };
+    mark(first, FromFirst);
+    mark(second, FromSecond);
+
+    QList<quint32> parentList;
+    while (activeCount > 0 && !queue.empty()) {
+        quint32 position = queue.top().second;
+        queue.pop();
+        int flag = flags.value(position, 0) & both;
+        if (flag == FromFirst) {
+            ++*ahead;
+            --activeCount;
+        } else if (flag == FromSecond) {
+            ++*behind;
+            --activeCount;
+        }
+        if (!parents(position, &parentList)) {
+            return false;
+        }
+        for (quint32 parent : parentList) {
+            if (!mark(parent, flag)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef GITCOMMITGRAPH_H
+#define GITCOMMITGRAPH_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+class QFile;
+
+// objects/info/commit-graph（包括拆分的commit-graphs链）的只读解析器，mmap读取。
+// 提交按在文件中的位置编号，链中各层依次排列；可以直接取得父提交、根树、提交时间和代数，
+// 并在此基础上回答可达性查询：代数小于目标的提交不可能到达目标，遍历可以提前停止
+class GitCommitGraph
+{
+public:
+    static const quint32 NoPosition = 0xffffffff;
+
+    GitCommitGraph(const QString &objectsDir, int hashSize);
+    ~GitCommitGraph();
+
+    // 文件不存在或格式不符时返回false；git写入新文件后需要重新调用
+    bool open();
+    void close();
+    bool isOpen() const;
+    quint32 commitCount() const;
+
+    // oid为十六进制对象ID
+    quint32 findCommit(const QByteArray &oid) const;
+    QByteArray oid(quint32 position) const;
+    QByteArray treeOid(quint32 position) const;
+    qint64 commitTime(quint32 position) const;
+    // 所有层都有GDA2时为修正的提交时间，否则为拓扑层级；0表示写入文件时没有计算
+    quint64 generation(quint32 position) const;
+    // 文件损坏时返回false
+    bool parents(quint32 position, QList<quint32> *parents) const;
+
+    // 可达性查询，文件中缺少代数或数据损坏时返回false，调用方回退到git命令
+    bool isAncestor(quint32 ancestor, quint32 descendant, bool *result) const;
+    // 互不可达的最佳公共祖先，没有公共祖先时为空
+    bool mergeBases(quint32 first, quint32 second, QList<quint32> *bases) const;
+    // ahead为只能从first到达的提交数，behind为只能从second到达的提交数
+    bool aheadBehind(quint32 first, quint32 second, int *ahead, int *behind) const;
+
+private:
+    struct Layer {
+        QFile *file = nullptr;
+        const uchar *data = nullptr;
+        qint64 size = 0;
+        quint32 base = 0;  // 之前各层的提交总数
+        quint32 count = 0;
+        const uchar *fanout = nullptr;
+        const uchar *oids = nullptr;
+        const uchar *commitData = nullptr;
+        const uchar *generationData = nullptr;
+        const uchar *generationOverflow = nullptr;
+        quint32 generationOverflowCount = 0;
+        const uchar *extraEdges = nullptr;
+        quint32 extraEdgeCount = 0;
+    };
+
+    bool openLayer(const QString &path, Layer *layer);
+    void releaseLayer(Layer &layer);
+    const Layer *layerFor(quint32 position) const;
+    const uchar *commitEntry(quint32 position, const Layer **layer = nullptr) const;
+
+    QString m_objectsDir;
+    int m_hashSize;
+    QList<Layer> m_layers; // 基础层在前
+    quint32 m_commitCount;
+    bool m_correctedDates;
+};
+
+#endif // GITCOMMITGRAPH_H
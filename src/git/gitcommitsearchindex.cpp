@@ -0,0 +1,595 @@
+#include "gitcommitsearchindex.h"
+#include "gitcommitcache.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <QDebug>
+
+namespace {
+const char Magic[] = "SCSI";
+const quint32 Version = 1;
+// 每个提交的提交信息最多索引这么多字节，超出部分通常是补丁说明或日志，查找价值不大
+const int MaxMessageBytes = 2048;
+// 片段表每项的大小：key、count、last、保留、offset
+const int TrigramEntrySize = 24;
+
+// 文件头：魔数、版本、哈希长度、提交数、片段数、保留，之后是各列的偏移
+enum Section {
+    Oids,           // 按提交编号排列的原始对象ID
+    OidOrder,       // u32提交编号，按对象ID排序，用于二分查找
+    CommitTimes,    // i64
+    TextOffsets,    // (提交数 + 1)个u64，第i个提交的文本为[offset[i], offset[i+1])
+    Texts,          // 小写化后的文本
+    Trigrams,       // 按key排序的片段表
+    Postings,       // 每个片段的提交编号，第一个为原值，之后为与前一个的差，LEB128编码
+    SectionCount
+};
+const int HeaderSize = 24 + SectionCount * 8;
+
+inline quint32 readLE32(const uchar *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+inline quint64 readLE64(const uchar *p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+inline void appendLE32(QByteArray *out, quint32 value)
+{
+    uchar buffer[4];
+    qToLittleEndian<quint32>(value, buffer);
+    out->append(reinterpret_cast<const char *>(buffer), 4);
+}
+
+inline void appendLE64(QByteArray *out, quint64 value)
+{
+    uchar buffer[8];
+    qToLittleEndian<quint64>(value, buffer);
+    out->append(reinterpret_cast<const char *>(buffer), 8);
+}
+
+inline void appendVarint(QByteArray *out, quint32 value)
+{
+    while (value >= 0x80) {
+        out->append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->append(char(value));
+}
+
+// 文件中的各列按8字节对齐
+inline qint64 aligned(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+}
+
+GitCommitSearchIndex::GitCommitSearchIndex(const QString &filePath, int hashSize)
+    : m_filePath(filePath),
+      m_hashSize(hashSize),
+      m_file(nullptr),
+      m_data(nullptr),
+      m_size(0),
+      m_count(0),
+      m_trigramCount(0),
+      m_oids(nullptr),
+      m_oidOrder(nullptr),
+      m_commitTimes(nullptr),
+      m_textOffsets(nullptr),
+      m_texts(nullptr),
+      m_trigrams(nullptr),
+      m_postings(nullptr),
+      m_postingsSize(0)
+{
+}
+
+GitCommitSearchIndex::~GitCommitSearchIndex()
+{
+    close();
+}
+
+QString GitCommitSearchIndex::indexPath(const QString &gitDir)
+{
+    const QString cachePath = GitCommitCache::cachePath(gitDir);
+    return cachePath.left(cachePath.lastIndexOf('.')) + ".search";
+}
+
+QByteArray GitCommitSearchIndex::documentText(const QByteArray &oid, const QByteArray &author, const QByteArray &message)
+{
+    QByteArray text;
+    text.reserve(oid.size() + author.size() + qMin(message.size(), qsizetype(MaxMessageBytes)) + 2);
+    text.append(oid);
+    text.append('\n');
+    text.append(author);
+    text.append('\n');
+    text.append(message.left(MaxMessageBytes));
+    return normalized(text);
+}
+
+QByteArray GitCommitSearchIndex::normalized(QByteArrayView text)
+{
+    // 只转换ASCII字母，UTF-8的多字节字符保持原样，按字节比较
+    QByteArray result(text.data(), text.size());
+    char *data = result.data();
+    for (qsizetype i = 0; i < result.size(); ++i) {
+        if (data[i] >= 'A' && data[i] <= 'Z') {
+            data[i] = char(data[i] - 'A' + 'a');
+        }
+    }
+    return result;
+}
+
+void GitCommitSearchIndex::addTrigrams(QByteArrayView text, QList<quint32> *keys)
+{
+    keys->clear();
+    const uchar *p = reinterpret_cast<const uchar *>(text.data());
+    for (qsizetype i = 0; i + 3 <= text.size(); ++i) {
+        keys->append(quint32(p[i]) << 16 | quint32(p[i + 1]) << 8 | p[i + 2]);
+    }
+    std::sort(keys->begin(), keys->end());
+    keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+}
+
+bool GitCommitSearchIndex::load()
+{
+    close();
+
+    m_file = new QFile(m_filePath);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        close();
+        return false;
+    }
+    m_size = m_file->size();
+    m_data = m_size >= HeaderSize ? m_file->map(0, m_size) : nullptr;
+    if (!m_data || !validate(m_size)) {
+        qDebug() << "忽略无效的提交搜索索引:" << m_filePath;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool GitCommitSearchIndex::validate(qint64 size)
+{
+    if (std::memcmp(m_data, Magic, 4) != 0 || readLE32(m_data + 4) != Version
+        || readLE32(m_data + 8) != quint32(m_hashSize)) {
+        return false;
+    }
+    m_count = readLE32(m_data + 12);
+    m_trigramCount = readLE32(m_data + 16);
+
+    qint64 offsets[SectionCount + 1];
+    for (int i = 0; i < SectionCount; ++i) {
+        offsets[i] = qint64(readLE64(m_data + 24 + i * 8));
+        if (offsets[i] < HeaderSize || offsets[i] > size || (i > 0 && offsets[i] < offsets[i - 1])) {
+            return false;
+        }
+    }
+    offsets[SectionCount] = size;
+
+    auto fits = [&offsets](int section, qint64 bytes) {
+        return bytes >= 0 && offsets[section] + bytes <= offsets[section + 1];
+    };
+    const qint64 count = m_count;
+    if (!fits(Oids, count * m_hashSize) || !fits(OidOrder, count * 4) || !fits(CommitTimes, count * 8)
+        || !fits(TextOffsets, (count + 1) * 8)
+        || !fits(Trigrams, qint64(m_trigramCount) * TrigramEntrySize)) {
+        return false;
+    }
+    m_oids = m_data + offsets[Oids];
+    m_oidOrder = m_data + offsets[OidOrder];
+    m_commitTimes = m_data + offsets[CommitTimes];
+    m_textOffsets = m_data + offsets[TextOffsets];
+    m_texts = m_data + offsets[Texts];
+    m_trigrams = m_data + offsets[Trigrams];
+    m_postings = m_data + offsets[Postings];
+    m_postingsSize = quint64(size - offsets[Postings]);
+
+    // 文本和倒排表都按顺序连续存放，后一项的起点就是前一项的终点
+    const quint64 textsSize = quint64(offsets[Texts + 1] - offsets[Texts]);
+    for (quint32 i = 0; i < m_count; ++i) {
+        if (readLE32(m_oidOrder + i * 4) >= m_count
+            || readLE64(m_textOffsets + qint64(i) * 8) > readLE64(m_textOffsets + qint64(i + 1) * 8)) {
+            return false;
+        }
+    }
+    if (readLE64(m_textOffsets + count * 8) > textsSize) {
+        return false;
+    }
+    for (quint32 i = 0; i < m_trigramCount; ++i) {
+        const TrigramEntry entry = trigramEntry(int(i));
+        if (entry.offset > m_postingsSize || entry.count == 0 || entry.last >= m_count
+            || (i > 0 && (entry.key <= trigramEntry(int(i) - 1).key || entry.offset < trigramEntry(int(i) - 1).offset))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GitCommitSearchIndex::close()
+{
+    if (m_file) {
+        if (m_data) {
+            m_file->unmap(const_cast<uchar *>(m_data));
+        }
+        delete m_file;
+        m_file = nullptr;
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_count = 0;
+    m_trigramCount = 0;
+    m_postingsSize = 0;
+}
+
+bool GitCommitSearchIndex::isLoaded() const
+{
+    return m_data != nullptr;
+}
+
+int GitCommitSearchIndex::count() const
+{
+    return int(m_count) + m_pendingOids.size();
+}
+
+int GitCommitSearchIndex::pendingCount() const
+{
+    return m_pendingOids.size();
+}
+
+int GitCommitSearchIndex::indexOf(const QByteArray &rawOid) const
+{
+    if (!m_data || rawOid.size() != m_hashSize) {
+        return -1;
+    }
+    int low = 0;
+    int high = int(m_count);
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const quint32 id = readLE32(m_oidOrder + middle * 4);
+        const int cmp = std::memcmp(m_oids + qint64(id) * m_hashSize, rawOid.constData(), m_hashSize);
+        if (cmp == 0) {
+            return int(id);
+        }
+        if (cmp < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+bool GitCommitSearchIndex::contains(const QByteArray &oid) const
+{
+    const QByteArray rawOid = QByteArray::fromHex(oid);
+    return indexOf(rawOid) >= 0 || m_pendingIndex.contains(rawOid);
+}
+
+void GitCommitSearchIndex::add(const QByteArray &oid, qint64 commitTime, const QByteArray &text)
+{
+    const QByteArray rawOid = QByteArray::fromHex(oid);
+    if (rawOid.size() != m_hashSize || indexOf(rawOid) >= 0 || m_pendingIndex.contains(rawOid)) {
+        return;
+    }
+    const quint32 id = m_count + quint32(m_pendingOids.size());
+    m_pendingIndex.insert(rawOid, m_pendingOids.size());
+    m_pendingOids.append(rawOid);
+    m_pendingTimes.append(commitTime);
+    m_pendingTexts.append(text);
+
+    QList<quint32> keys;
+    addTrigrams(text, &keys);
+    for (quint32 key : keys) {
+        m_pendingPostings[key].append(id);
+    }
+}
+
+GitCommitSearchIndex::TrigramEntry GitCommitSearchIndex::trigramEntry(int index) const
+{
+    const uchar *p = m_trigrams + qint64(index) * TrigramEntrySize;
+    TrigramEntry entry;
+    entry.key = readLE32(p);
+    entry.count = readLE32(p + 4);
+    entry.last = readLE32(p + 8);
+    entry.offset = readLE64(p + 16);
+    return entry;
+}
+
+int GitCommitSearchIndex::findTrigram(quint32 key) const
+{
+    int low = 0;
+    int high = int(m_trigramCount);
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const quint32 middleKey = readLE32(m_trigrams + qint64(middle) * TrigramEntrySize);
+        if (middleKey == key) {
+            return middle;
+        }
+        if (middleKey < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+QList<quint32> GitCommitSearchIndex::postings(quint32 key) const
+{
+    QList<quint32> ids;
+    const int index = m_data ? findTrigram(key) : -1;
+    if (index >= 0) {
+        const TrigramEntry entry = trigramEntry(index);
+        ids.reserve(entry.count);
+        const uchar *p = m_postings + entry.offset;
+        const uchar *end = m_postings + m_postingsSize;
+        quint32 id = 0;
+        for (quint32 i = 0; i < entry.count; ++i) {
+            quint32 delta = 0;
+            int shift = 0;
+            while (p < end && shift < 32 && (*p & 0x80)) {
+                delta |= quint32(*p++ & 0x7f) << shift;
+                shift += 7;
+            }
+            if (p >= end || shift >= 32) {
+                break; // 文件损坏，只返回已经解码的部分
+            }
+            delta |= quint32(*p++) << shift;
+            id = i == 0 ? delta : id + delta;
+            if (id >= m_count) {
+                break;
+            }
+            ids.append(id);
+        }
+    }
+    // 尚未保存的提交编号都大于已映射的编号，直接追加
+    ids.append(m_pendingPostings.value(key));
+    return ids;
+}
+
+QByteArrayView GitCommitSearchIndex::documentAt(quint32 id) const
+{
+    if (id < m_count) {
+        const quint64 begin = readLE64(m_textOffsets + qint64(id) * 8);
+        const quint64 end = readLE64(m_textOffsets + qint64(id + 1) * 8);
+        return QByteArrayView(reinterpret_cast<const char *>(m_texts + begin), qsizetype(end - begin));
+    }
+    return m_pendingTexts.at(int(id - m_count));
+}
+
+qint64 GitCommitSearchIndex::commitTimeAt(quint32 id) const
+{
+    if (id < m_count) {
+        return qint64(readLE64(m_commitTimes + qint64(id) * 8));
+    }
+    return m_pendingTimes.at(int(id - m_count));
+}
+
+QByteArray GitCommitSearchIndex::oidAt(quint32 id) const
+{
+    if (id < m_count) {
+        return QByteArray(reinterpret_cast<const char *>(m_oids + qint64(id) * m_hashSize), m_hashSize).toHex();
+    }
+    return m_pendingOids.at(int(id - m_count)).toHex();
+}
+
+QList<QByteArray> GitCommitSearchIndex::search(const QString &query, int limit) const
+{
+    QList<QByteArray> result;
+    const QByteArray needle = normalized(query.toUtf8());
+    if (needle.isEmpty() || limit <= 0) {
+        return result;
+    }
+
+    QList<quint32> candidates;
+    if (needle.size() < 3) {
+        // 没有完整的片段可用，所有提交都是候选
+        const quint32 total = m_count + quint32(m_pendingOids.size());
+        candidates.reserve(total);
+        for (quint32 id = 0; id < total; ++id) {
+            candidates.append(id);
+        }
+    } else {
+        QList<quint32> keys;
+        addTrigrams(needle, &keys);
+        QList<QList<quint32>> lists;
+        for (quint32 key : keys) {
+            lists.append(postings(key));
+            if (lists.last().isEmpty()) {
+                return result;
+            }
+        }
+        // 从最短的倒排表开始求交集，候选集合只会越来越小
+        std::sort(lists.begin(), lists.end(), [](const QList<quint32> &a, const QList<quint32> &b) {
+            return a.size() < b.size();
+        });
+        candidates = lists.first();
+        for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+            QList<quint32> intersection;
+            std::set_intersection(candidates.cbegin(), candidates.cend(), lists[i].cbegin(), lists[i].cend(),
+                                  std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+    }
+
+    // 所有片段都出现不代表它们相邻，还要在文本中确认。候选按提交时间分批取出最新的部分，
+    // 每批只对这一部分排序和确认，凑够limit个结果后不再处理更旧的候选
+    auto newer = [this](quint32 a, quint32 b) {
+        const qint64 timeA = commitTimeAt(a);
+        const qint64 timeB = commitTimeAt(b);
+        return timeA != timeB ? timeA > timeB : a > b;
+    };
+    qsizetype begin = 0;
+    qsizetype batch = limit;
+    while (begin < candidates.size() && result.size() < limit) {
+        const qsizetype end = qMin(candidates.size(), begin + batch);
+        std::partial_sort(candidates.begin() + begin, candidates.begin() + end, candidates.end(), newer);
+        for (qsizetype i = begin; i < end && result.size() < limit; ++i) {
+            if (documentAt(candidates[i]).indexOf(needle) >= 0) {
+                result.append(oidAt(candidates[i]));
+            }
+        }
+        begin = end;
+        batch *= 4;
+    }
+    return result;
+}
+
+bool GitCommitSearchIndex::save()
+{
+    if (m_pendingOids.isEmpty()) {
+        return true;
+    }
+
+    const quint32 pendingTotal = quint32(m_pendingOids.size());
+    const quint32 count = m_count + pendingTotal;
+    QByteArray columns[SectionCount];
+
+    // 新的提交追加在已有提交之后，已有内容的编号不变
+    if (m_count > 0) {
+        columns[Oids].append(reinterpret_cast<const char *>(m_oids), qsizetype(m_count) * m_hashSize);
+    }
+    for (const QByteArray &rawOid : m_pendingOids) {
+        columns[Oids].append(rawOid);
+    }
+
+    if (m_count > 0) {
+        columns[CommitTimes].append(reinterpret_cast<const char *>(m_commitTimes), qsizetype(m_count) * 8);
+    }
+    for (qint64 time : m_pendingTimes) {
+        appendLE64(&columns[CommitTimes], quint64(time));
+    }
+
+    // 已有的顺序和新增的对象ID都有序，归并即可
+    QList<quint32> pendingOrder;
+    pendingOrder.reserve(pendingTotal);
+    for (quint32 i = 0; i < pendingTotal; ++i) {
+        pendingOrder.append(i);
+    }
+    std::sort(pendingOrder.begin(), pendingOrder.end(), [this](quint32 a, quint32 b) {
+        return m_pendingOids[a] < m_pendingOids[b];
+    });
+    quint32 existing = 0;
+    int added = 0;
+    while (existing < m_count || added < pendingOrder.size()) {
+        const quint32 existingId = existing < m_count ? readLE32(m_oidOrder + existing * 4) : 0;
+        const bool takeExisting = added >= pendingOrder.size()
+            || (existing < m_count
+                && std::memcmp(m_oids + qint64(existingId) * m_hashSize,
+                               m_pendingOids[pendingOrder[added]].constData(), m_hashSize) < 0);
+        if (takeExisting) {
+            appendLE32(&columns[OidOrder], existingId);
+            ++existing;
+        } else {
+            appendLE32(&columns[OidOrder], m_count + pendingOrder[added++]);
+        }
+    }
+
+    const quint64 existingTextsSize = m_count > 0 ? readLE64(m_textOffsets + qint64(m_count) * 8) : 0;
+    if (m_count > 0) {
+        columns[TextOffsets].append(reinterpret_cast<const char *>(m_textOffsets), qsizetype(m_count) * 8);
+        columns[Texts].append(reinterpret_cast<const char *>(m_texts), qsizetype(existingTextsSize));
+    }
+    for (const QByteArray &text : m_pendingTexts) {
+        appendLE64(&columns[TextOffsets], quint64(columns[Texts].size()));
+        columns[Texts].append(text);
+    }
+    appendLE64(&columns[TextOffsets], quint64(columns[Texts].size()));
+
+    // 片段表按key归并：已有的倒排表原样复制，新的编号以差值接在后面
+    QList<quint32> pendingKeys = m_pendingPostings.keys();
+    std::sort(pendingKeys.begin(), pendingKeys.end());
+    quint32 trigramCount = 0;
+    auto appendEntry = [&columns, &trigramCount](const TrigramEntry &entry) {
+        appendLE32(&columns[Trigrams], entry.key);
+        appendLE32(&columns[Trigrams], entry.count);
+        appendLE32(&columns[Trigrams], entry.last);
+        appendLE32(&columns[Trigrams], 0);
+        appendLE64(&columns[Trigrams], entry.offset);
+        ++trigramCount;
+    };
+    auto appendPending = [&columns](TrigramEntry *entry, const QList<quint32> &ids) {
+        for (quint32 id : ids) {
+            appendVarint(&columns[Postings], entry->count == 0 ? id : id - entry->last);
+            entry->last = id;
+            ++entry->count;
+        }
+    };
+    quint32 existingTrigram = 0;
+    int addedTrigram = 0;
+    while (existingTrigram < m_trigramCount || addedTrigram < pendingKeys.size()) {
+        TrigramEntry entry;
+        const bool hasExisting = existingTrigram < m_trigramCount;
+        const TrigramEntry old = hasExisting ? trigramEntry(int(existingTrigram)) : TrigramEntry();
+        const bool takeExisting = hasExisting && (addedTrigram >= pendingKeys.size() || old.key <= pendingKeys[addedTrigram]);
+        const bool takePending = addedTrigram < pendingKeys.size() && (!hasExisting || pendingKeys[addedTrigram] <= old.key);
+
+        entry.offset = quint64(columns[Postings].size());
+        if (takeExisting) {
+            const quint64 end = existingTrigram + 1 < m_trigramCount ? trigramEntry(int(existingTrigram) + 1).offset
+                                                                     : m_postingsSize;
+            columns[Postings].append(reinterpret_cast<const char *>(m_postings + old.offset), qsizetype(end - old.offset));
+            entry.key = old.key;
+            entry.count = old.count;
+            entry.last = old.last;
+            ++existingTrigram;
+        }
+        if (takePending) {
+            entry.key = pendingKeys[addedTrigram];
+            appendPending(&entry, m_pendingPostings.value(pendingKeys[addedTrigram]));
+            ++addedTrigram;
+        }
+        appendEntry(entry);
+    }
+
+    QByteArray header(Magic, 4);
+    appendLE32(&header, Version);
+    appendLE32(&header, quint32(m_hashSize));
+    appendLE32(&header, count);
+    appendLE32(&header, trigramCount);
+    appendLE32(&header, 0);
+    qint64 offset = aligned(HeaderSize);
+    for (int i = 0; i < SectionCount; ++i) {
+        appendLE64(&header, quint64(offset));
+        // 倒排表区到文件末尾为止，不补齐
+        offset = i + 1 < SectionCount ? aligned(offset + columns[i].size()) : offset + columns[i].size();
+    }
+
+    // 先释放映射再替换文件，Windows上不能替换仍被映射的文件
+    close();
+    QDir().mkpath(QFileInfo(m_filePath).absolutePath());
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "无法写入提交搜索索引:" << m_filePath;
+        load();
+        return false;
+    }
+    file.write(header);
+    file.write(QByteArray(aligned(header.size()) - header.size(), '\0'));
+    for (int i = 0; i < SectionCount; ++i) {
+        file.write(columns[i]);
+        if (i + 1 < SectionCount) {
+            file.write(QByteArray(aligned(columns[i].size()) - columns[i].size(), '\0'));
+        }
+    }
+    if (!file.commit()) {
+        qDebug() << "无法写入提交搜索索引:" << m_filePath;
+        load();
+        return false;
+    }
+
+    m_pendingOids.clear();
+    m_pendingTimes.clear();
+    m_pendingTexts.clear();
+    m_pendingIndex.clear();
+    m_pendingPostings.clear();
+    return load();
+}
@@ -0,0 +1,92 @@
+#ifndef GITCOMMITSEARCHINDEX_H
+#define GITCOMMITSEARCHINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QHash>
+
+class QFile;
+
+// 提交的全文索引：每个提交的对象ID、作者和提交信息（ASCII转为小写）拆成连续三个字节的片段，
+// 倒排表记录包含每个片段的提交编号。查询时取各片段倒排表的交集，再在候选提交的文本中确认。
+// 与GitCommitCache一样按仓库保存在应用数据目录中并通过mmap读取；新增的提交先保存在内存中，
+// 保存时已有的倒排表原样复制，只在末尾追加新的编号
+class GitCommitSearchIndex
+{
+public:
+    GitCommitSearchIndex(const QString &filePath, int hashSize);
+    ~GitCommitSearchIndex();
+
+    // 与提交缓存放在同一目录，文件名相同、扩展名不同
+    static QString indexPath(const QString &gitDir);
+    // 参与索引的文本；提交信息只取开头的一部分，限制索引大小
+    static QByteArray documentText(const QByteArray &oid, const QByteArray &author, const QByteArray &message);
+
+    // 文件不存在或格式不符时视为空索引
+    bool load();
+    void close();
+    bool isLoaded() const;
+    int count() const;
+
+    bool contains(const QByteArray &oid) const;
+    // text由documentText生成；提交时间用于按从新到旧排列结果
+    void add(const QByteArray &oid, qint64 commitTime, const QByteArray &text);
+    int pendingCount() const;
+
+    // 不区分ASCII大小写的子串查找，按提交时间从新到旧返回最多limit个十六进制对象ID；
+    // 不足三个字节的查询没有可用的片段，逐个比较文本
+    QList<QByteArray> search(const QString &query, int limit) const;
+
+    // 把新增的提交与已有内容合并后整体写入，完成后重新映射
+    bool save();
+
+private:
+    // 片段表中的一项，按key排序
+    struct TrigramEntry {
+        quint32 key = 0;
+        quint32 count = 0;
+        quint32 last = 0;     // 最后一个提交编号，追加时据此计算差值
+        quint64 offset = 0;   // 在倒排表区中的位置
+    };
+
+    static QByteArray normalized(QByteArrayView text);
+    static void addTrigrams(QByteArrayView text, QList<quint32> *keys);
+    int indexOf(const QByteArray &rawOid) const;
+    TrigramEntry trigramEntry(int index) const;
+    int findTrigram(quint32 key) const;
+    // 已映射和尚未保存的编号，升序
+    QList<quint32> postings(quint32 key) const;
+    QByteArrayView documentAt(quint32 id) const;
+    qint64 commitTimeAt(quint32 id) const;
+    QByteArray oidAt(quint32 id) const;
+    bool validate(qint64 size);
+
+    QString m_filePath;
+    int m_hashSize;
+    QFile *m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    // 映射中各列的位置，load时校验
+    quint32 m_count;
+    quint32 m_trigramCount;
+    const uchar *m_oids;
+    const uchar *m_oidOrder;
+    const uchar *m_commitTimes;
+    const uchar *m_textOffsets;
+    const uchar *m_texts;
+    const uchar *m_trigrams;
+    const uchar *m_postings;
+    quint64 m_postingsSize;
+
+    // 尚未写入文件的提交，编号从m_count开始
+    QList<QByteArray> m_pendingOids;   // 原始对象ID
+    QList<qint64> m_pendingTimes;
+    QList<QByteArray> m_pendingTexts;
+    QHash<QByteArray, int> m_pendingIndex;
+    QHash<quint32, QList<quint32>> m_pendingPostings;
+};
+
+#endif // GITCOMMITSEARCHINDEX_H
@@ -0,0 +1,173 @@
+#include "gitdiffparser.h"
+
+namespace {
+const QByteArrayView DiffHeader("diff --git ");
+const QByteArrayView UnmergedHeader("* Unmerged path ");
+}
+
+QByteArrayView GitDiff::patch(const File &file) const
+{
+    return QByteArrayView(output.constData() + file.offset, file.size);
+}
+
+qsizetype GitDiff::patchSize() const
+{
+    qsizetype total = 0;
+    for (const File &file : files) {
+        total += file.size;
+    }
+    return total;
+}
+
+GitDiffParser::GitDiffParser()
+    : m_offset(0),
+      m_rawDone(false),
+      m_patchCount(0)
+{
+}
+
+void GitDiffParser::feed(const QByteArray &chunk)
+{
+    // 补丁按偏移引用输出，已解析的数据不能前移，只追加
+    m_diff.output.append(chunk);
+
+    while (!m_rawDone && parseRawRecord()) {
+    }
+    while (m_rawDone && parsePatchLine()) {
+    }
+}
+
+bool GitDiffParser::finish()
+{
+    while (!m_rawDone && parseRawRecord()) {
+    }
+    while (m_rawDone && parsePatchLine()) {
+    }
+
+    const QByteArray &output = m_diff.output;
+    bool complete = true;
+    if (!m_rawDone) {
+        // 没有任何差异时输出为空
+        complete = m_offset == output.size();
+    } else if (m_offset < output.size()) {
+        // 最后一行没有换行符
+        QByteArrayView line(output.constData() + m_offset, output.size() - m_offset);
+        if (line.startsWith(DiffHeader) || line.startsWith(UnmergedHeader)) {
+            beginPatch(m_offset);
+        }
+        m_offset = output.size();
+    }
+
+    endPatch(output.size());
+    if (m_rawDone && m_patchCount != m_diff.files.size()) {
+        complete = false;
+    }
+    return complete;
+}
+
+const GitDiff &GitDiffParser::diff() const
+{
+    return m_diff;
+}
+
+GitDiff GitDiffParser::takeDiff()
+{
+    GitDiff diff = std::move(m_diff);
+    m_diff = GitDiff();
+    m_offset = 0;
+    m_rawDone = false;
+    m_patchCount = 0;
+    return diff;
+}
+
+bool GitDiffParser::parseRawRecord()
+{
+    const QByteArray &output = m_diff.output;
+    if (m_offset >= output.size()) {
+        return false;
+    }
+
+    // 空记录把--raw部分和补丁分开
+    if (output[m_offset] == '\0') {
+        ++m_offset;
+        m_rawDone = true;
+        return true;
+    }
+    if (output[m_offset] != ':') {
+        m_rawDone = true;
+        return true;
+    }
+
+    // ":100644 100644 <oid> <oid> R100\0<路径>\0[<新路径>\0]"
+    const qsizetype headerEnd = output.indexOf('\0', m_offset);
+    if (headerEnd < 0) {
+        return false;
+    }
+    QByteArrayView header(output.constData() + m_offset, headerEnd - m_offset);
+    const qsizetype statusPos = header.lastIndexOf(' ');
+    if (statusPos < 0 || statusPos + 1 >= header.size()) {
+        m_rawDone = true;
+        return true;
+    }
+    const char status = header[statusPos + 1];
+    const bool twoPaths = status == 'R' || status == 'C';
+
+    const qsizetype pathEnd = output.indexOf('\0', headerEnd + 1);
+    if (pathEnd < 0) {
+        return false;
+    }
+    qsizetype recordEnd = pathEnd;
+    if (twoPaths) {
+        recordEnd = output.indexOf('\0', pathEnd + 1);
+        if (recordEnd < 0) {
+            return false;
+        }
+    }
+
+    GitDiff::File file;
+    file.status = status;
+    QString path = QString::fromUtf8(output.constData() + headerEnd + 1, pathEnd - headerEnd - 1);
+    if (twoPaths) {
+        file.oldPath = path;
+        file.path = QString::fromUtf8(output.constData() + pathEnd + 1, recordEnd - pathEnd - 1);
+    } else {
+        file.path = path;
+    }
+    m_diff.files.append(file);
+    m_offset = recordEnd + 1;
+    return true;
+}
+
+bool GitDiffParser::parsePatchLine()
+{
+    const QByteArray &output = m_diff.output;
+    const qsizetype lineEnd = output.indexOf('\n', m_offset);
+    if (lineEnd < 0) {
+        return false;
+    }
+
+    // 补丁内容行都有' '、'+'、'-'或'\\'前缀，行首的文件头不会与内容混淆
+    QByteArrayView line(output.constData() + m_offset, lineEnd - m_offset);
+    if (line.startsWith(DiffHeader) || line.startsWith(UnmergedHeader)) {
+        beginPatch(m_offset);
+    }
+    m_offset = lineEnd + 1;
+    return true;
+}
+
+void GitDiffParser::beginPatch(qsizetype offset)
+{
+    endPatch(offset);
+    if (m_patchCount < m_diff.files.size()) {
+        m_diff.files[m_patchCount].offset = offset;
+    }
+    ++m_patchCount;
+}
+
+void GitDiffParser::endPatch(qsizetype offset)
+{
+    if (m_patchCount > 0 && m_patchCount <= m_diff.files.size()) {
+        GitDiff::File &current = m_diff.files[m_patchCount - 1];
+        current.size = offset - current.offset;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef GITDIFFPARSER_H
+#define GITDIFFPARSER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+
+// 一次git diff调用得到的完整差异：所有补丁保存在同一块输出中，每个文件只记录偏移和长度
+struct GitDiff
+{
+    struct File {
+        QString path;
+        QString oldPath;     // 重命名或复制前的路径
+        char status = ' ';   // --raw中的状态字母：A、M、D、R、C、T、U
+        qsizetype offset = 0;
+        qsizetype size = 0;  // 补丁的字节数，没有补丁时为0
+    };
+
+    QByteArray output;
+    QList<File> files;
+
+    // 视图指向output，在GitDiff销毁或修改之前有效
+    QByteArrayView patch(const File &file) const;
+    qsizetype patchSize() const;
+};
+
+// git diff --raw -z -p的增量解析器：输出可以按任意边界分块传入。
+// 先读取NUL分隔的--raw记录得到文件列表（路径不经过引号转义），
+// 再按行首的"diff --git "或"* Unmerged path "把补丁依次分给各个文件
+class GitDiffParser
+{
+public:
+    GitDiffParser();
+
+    void feed(const QByteArray &chunk);
+    // 输出结束时调用，记录不完整或补丁数与文件数不符时返回false
+    bool finish();
+
+    const GitDiff &diff() const;
+    GitDiff takeDiff();
+
+private:
+    bool parseRawRecord();
+    bool parsePatchLine();
+    // 上一个文件的补丁在offset处结束，下一个文件的补丁从这里开始
+    void beginPatch(qsizetype offset);
+    void endPatch(qsizetype offset);
+
+    GitDiff m_diff;
+    qsizetype m_offset;
+    bool m_rawDone;
+    int m_patchCount;
+};
+
+#endif // GITDIFFPARSER_H
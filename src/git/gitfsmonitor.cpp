@@ -0,0 +1,282 @@
+#include "gitfsmonitor.h"
+#include "gitworktreewatcher.h"
+#include <QThread>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QVariant>
+#include <QDebug>
+
+namespace {
+const char HookProgram[] = "summercake-fsmonitor-hook";
+const char TokenPrefix[] = "summercake:";
+// 日志中的路径超过该数量时清空，更早的令牌只能回答全部变化
+const int MaxJournalEntries = 100000;
+// 变化的路径太多时git逐个检查不如直接扫描
+const int MaxReportedPaths = 50000;
+
+QString shellQuote(const QString &value)
+{
+    QString quoted = value;
+    quoted.replace('\'', "'\\''");
+    return '\'' + quoted + '\'';
+}
+}
+
+GitFsMonitor::GitFsMonitor(QObject *parent)
+    : QObject(parent),
+      m_thread(nullptr),
+      m_generation(0)
+{
+}
+
+GitFsMonitor::~GitFsMonitor()
+{
+    stop();
+}
+
+bool GitFsMonitor::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+QString GitFsMonitor::hookCommand(const QString &gitDir)
+{
+    QString program = QDir(QCoreApplication::applicationDirPath()).filePath(HookProgram);
+    return shellQuote(program) + ' ' + shellQuote(socketPath(gitDir));
+}
+
+QString GitFsMonitor::socketPath(const QString &gitDir)
+{
+    // 套接字路径长度有限制，用gitDir的哈希命名；运行时目录只有当前用户可以访问
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (directory.isEmpty()) {
+        directory = QDir::tempPath();
+    }
+    QByteArray key = QDir(gitDir).canonicalPath().toUtf8();
+    QByteArray hash = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+    return QDir(directory).filePath("summercake-fsmonitor-" + QString::fromLatin1(hash));
+}
+
+void GitFsMonitor::start(const QString &workTree, const QString &gitDir, std::function<void(bool)> callback)
+{
+    stop();
+    if (!isSupported()) {
+        if (callback) callback(false);
+        return;
+    }
+
+    // 服务对象在监视线程中创建监视器和套接字，线程结束时释放
+    GitFsMonitorServer *server = new GitFsMonitorServer(workTree, gitDir, socketPath(gitDir));
+    m_thread = new QThread(this);
+    m_thread->setObjectName("GitFsMonitor");
+    server->moveToThread(m_thread);
+    connect(m_thread, &QThread::started, server, &GitFsMonitorServer::start);
+    connect(m_thread, &QThread::finished, server, &QObject::deleteLater);
+    // 在GUI线程中回调；服务在回调之前已被停止时不再回调
+    const quint64 generation = ++m_generation;
+    connect(server, &GitFsMonitorServer::started, this, [this, generation, callback](bool serving) {
+        if (generation == m_generation && callback) callback(serving);
+    });
+    m_thread->start();
+}
+
+void GitFsMonitor::stop()
+{
+    ++m_generation;
+    if (!m_thread) {
+        return;
+    }
+    m_thread->quit();
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+bool GitFsMonitor::isActive() const
+{
+    return m_thread && m_thread->isRunning();
+}
+
+GitFsMonitorServer::GitFsMonitorServer(const QString &workTree, const QString &gitDir, const QString &socketPath)
+    : QObject(nullptr),
+      m_workTree(workTree),
+      m_gitDir(gitDir),
+      m_socketPath(socketPath),
+      m_server(nullptr),
+      m_watcher(nullptr),
+      m_instance(QByteArray::number(QRandomGenerator::global()->generate64(), 16)),
+      m_sequence(0),
+      m_floorSequence(0)
+{
+}
+
+void GitFsMonitorServer::start()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // 不排除被忽略的目录：git根据回答跳过检查，漏报会让git status给出错误的结果
+    m_watcher = new GitWorkTreeWatcher(this);
+    connect(m_watcher, &GitWorkTreeWatcher::pathChanged, this, &GitFsMonitorServer::onPathChanged);
+    connect(m_watcher, &GitWorkTreeWatcher::eventsLost, this, &GitFsMonitorServer::onEventsLost);
+    if (!m_watcher->start(m_workTree, m_gitDir)) {
+        emit started(false);
+        return;
+    }
+
+    // 监视建立之后才接受查询，之前git连接失败会自行扫描整个工作树
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &GitFsMonitorServer::onNewConnection);
+    bool serving = listen();
+    if (m_server->isListening()) {
+        qDebug() << "fsmonitor服务已启动:" << m_socketPath << "耗时" << timer.elapsed() << "ms";
+    } else {
+        // 没有本进程的服务时不需要继续监视
+        m_watcher->stop();
+    }
+    emit started(serving);
+}
+
+// 返回套接字上是否有可用的服务
+bool GitFsMonitorServer::listen()
+{
+    if (m_server->listen(m_socketPath)) {
+        return true;
+    }
+    if (m_server->serverError() == QAbstractSocket::AddressInUseError) {
+        // 可能是另一个SummerCake实例正在服务同一个仓库，也可能是崩溃后残留的套接字文件
+        QLocalSocket probe;
+        probe.connectToServer(m_socketPath);
+        if (probe.waitForConnected(500)) {
+            qDebug() << "同一仓库的fsmonitor服务已在其他进程中运行:" << m_socketPath;
+            return true;
+        }
+        QLocalServer::removeServer(m_socketPath);
+        if (m_server->listen(m_socketPath)) {
+            return true;
+        }
+    }
+    qDebug() << "无法启动fsmonitor服务:" << m_server->errorString();
+    return false;
+}
+
+void GitFsMonitorServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            readRequest(socket);
+        });
+        readRequest(socket);
+    }
+}
+
+void GitFsMonitorServer::readRequest(QLocalSocket *socket)
+{
+    // 请求为"<版本>\0<令牌>\0"
+    QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+    const qsizetype versionEnd = request.indexOf('\0');
+    const qsizetype tokenEnd = versionEnd < 0 ? -1 : request.indexOf('\0', versionEnd + 1);
+    if (tokenEnd < 0) {
+        socket->setProperty("request", request);
+        return;
+    }
+    socket->setProperty("request", QVariant());
+
+    if (request.left(versionEnd) == "2") {
+        socket->write(answerQuery(request.mid(versionEnd + 1, tokenEnd - versionEnd - 1)));
+    }
+    socket->disconnectFromServer();
+}
+
+QByteArray GitFsMonitorServer::answerQuery(const QByteArray &token)
+{
+    // git启动前完成的写入已经在内核队列中，先读出来
+    m_watcher->synchronize();
+
+    QByteArray response = currentToken();
+    response.append('\0');
+
+    // 第一次查询、服务重启前的令牌或有目录没有被监视时，无法给出准确的变化列表
+    bool complete = false;
+    quint64 since = 0;
+    const QByteArray prefix = TokenPrefix + m_instance + ':';
+    if (m_watcher->isExact() && token.startsWith(prefix)) {
+        bool ok = false;
+        since = token.mid(prefix.size()).toULongLong(&ok);
+        complete = ok && since >= m_floorSequence && since <= m_sequence;
+    }
+
+    QList<QByteArray> paths;
+    if (complete) {
+        // git之后只会用这个令牌或这次返回的新令牌查询，更早的变化不再需要，从日志中删除
+        m_floorSequence = since;
+        for (auto it = m_changes.begin(); it != m_changes.end();) {
+            if (it.value() <= since) {
+                it = m_changes.erase(it);
+            } else {
+                paths.append(QFile::encodeName(it.key()));
+                ++it;
+            }
+        }
+        complete = paths.size() <= MaxReportedPaths;
+    }
+    if (!complete) {
+        // 平凡回答：所有路径都可能变化
+        response.append('/');
+        response.append('\0');
+        return response;
+    }
+
+    // 嵌套仓库没有被监视，每次都让git检查
+    const QStringList nested = m_watcher->nestedRepositories();
+    for (const QString &path : nested) {
+        paths.append(QFile::encodeName(path) + '/');
+    }
+    for (const QByteArray &path : paths) {
+        response.append(path);
+        response.append('\0');
+    }
+    return response;
+}
+
+QByteArray GitFsMonitorServer::currentToken() const
+{
+    return TokenPrefix + m_instance + ':' + QByteArray::number(m_sequence);
+}
+
+void GitFsMonitorServer::onPathChanged(const QString &path, bool directory)
+{
+    // 目录的变化（新建、删除、移动）影响其中所有内容，以/结尾表示整个子树
+    QString key = path;
+    if (directory) {
+        if (key.isEmpty()) {
+            onEventsLost();
+            return;
+        }
+        key.append('/');
+    }
+
+    if (m_changes.size() >= MaxJournalEntries) {
+        onEventsLost();
+    }
+    m_changes.insert(key, ++m_sequence);
+}
+
+void GitFsMonitorServer::onEventsLost()
+{
+    m_changes.clear();
+    m_floorSequence = ++m_sequence;
+}
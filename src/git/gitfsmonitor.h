@@ -0,0 +1,85 @@
+#ifndef GITFSMONITOR_H
+#define GITFSMONITOR_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <functional>
+
+class QThread;
+class QLocalServer;
+class QLocalSocket;
+class GitWorkTreeWatcher;
+
+// 内置的文件系统监视服务，回答git core.fsmonitor钩子（协议版本2）的查询：
+// 返回新令牌和自上次令牌以来变化的路径，git只需检查这些路径而不必遍历整个工作树。
+// 钩子程序summercake-fsmonitor-hook通过本地套接字转发查询。服务运行在单独的线程中，
+// GUI线程同步等待git命令时钩子也能得到回答
+class GitFsMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GitFsMonitor(QObject *parent = nullptr);
+    ~GitFsMonitor();
+
+    // 目前只在Linux上使用inotify实现
+    static bool isSupported();
+    // 写入core.fsmonitor的命令，git执行时会在后面追加协议版本和令牌
+    static QString hookCommand(const QString &gitDir);
+    static QString socketPath(const QString &gitDir);
+
+    // 建立监视需要遍历整个工作树，在监视线程中完成后回调；
+    // 同一仓库的服务已在其他SummerCake进程中运行时也视为成功
+    void start(const QString &workTree, const QString &gitDir, std::function<void(bool)> callback = nullptr);
+    void stop();
+    bool isActive() const;
+
+private:
+    QThread *m_thread;
+    quint64 m_generation; // 每次启动和停止时递增，丢弃已停止的服务排队中的回调
+};
+
+// 在监视线程中运行：维护路径变化日志并回答钩子的查询
+class GitFsMonitorServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    GitFsMonitorServer(const QString &workTree, const QString &gitDir, const QString &socketPath);
+
+public slots:
+    void start();
+
+signals:
+    // serving为true表示套接字上已有服务（本进程或其他进程）可以回答查询
+    void started(bool serving);
+
+private slots:
+    void onNewConnection();
+
+private:
+    void onPathChanged(const QString &path, bool directory);
+    void onEventsLost();
+    void readRequest(QLocalSocket *socket);
+    QByteArray answerQuery(const QByteArray &token);
+    QByteArray currentToken() const;
+    bool listen();
+
+    QString m_workTree;
+    QString m_gitDir;
+    QString m_socketPath;
+    QLocalServer *m_server;
+    GitWorkTreeWatcher *m_watcher;
+
+    // 令牌为"summercake:<实例>:<序号>"；服务重启后旧令牌的实例不同，只能回答全部变化
+    QByteArray m_instance;
+    quint64 m_sequence;
+    quint64 m_floorSequence;         // 小于该序号的令牌之后的变化已不完整
+    // 路径（目录以/结尾）-> 最后一次变化的序号；回答查询时删除不晚于所查令牌的条目
+    QHash<QString, quint64> m_changes;
+};
+
+#endif // GITFSMONITOR_H
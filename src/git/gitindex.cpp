@@ -0,0 +1,370 @@
+#include "gitindex.h"
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// 条目固定部分：10个32位的stat字段
+const int EntryStatSize = 40;
+
+inline quint32 readBE32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+inline quint16 readBE16(const uchar *p)
+{
+    return quint16((p[0] << 8) | p[1]);
+}
+
+// v4路径前缀压缩使用的变长整数，编码方式与包文件中的OFS_DELTA偏移相同
+bool readVarint(const uchar *data, qint64 end, qint64 *offset, quint64 *value)
+{
+    if (*offset >= end) {
+        return false;
+    }
+    uchar c = data[(*offset)++];
+    quint64 result = c & 0x7f;
+    while (c & 0x80) {
+        if (*offset >= end || (result >> 56) != 0) {
+            return false;
+        }
+        c = data[(*offset)++];
+        result = ((result + 1) << 7) | (c & 0x7f);
+    }
+    *value = result;
+    return true;
+}
+
+bool entryLessThan(const GitIndex::Entry &entry, const QByteArray &path)
+{
+    return entry.path < path;
+}
+}
+
+GitIndex::GitIndex()
+    : m_version(0),
+      m_hashSize(20),
+      m_loaded(false),
+      m_split(false),
+      m_sparse(false)
+{
+}
+
+bool GitIndex::load(const QString &indexPath, int hashSize)
+{
+    clear();
+    m_hashSize = hashSize;
+
+    QFile file(indexPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    qint64 size = file.size();
+    if (size < 12 + m_hashSize) {
+        return false;
+    }
+    const uchar *data = file.map(0, size);
+    if (!data) {
+        return false;
+    }
+
+    bool ok = false;
+    if (memcmp(data, "DIRC", 4) == 0) {
+        m_version = int(readBE32(data + 4));
+        quint32 count = readBE32(data + 8);
+        qint64 end = size - m_hashSize;
+        qint64 offset = 12;
+
+        if (m_version >= 2 && m_version <= 4 && parseEntries(data, end, &offset, count)) {
+            ok = parseExtensions(data, end, offset);
+        } else {
+            qDebug() << "不支持的索引格式:" << indexPath << "版本" << m_version;
+        }
+        if (ok) {
+            m_checksum = QByteArray(reinterpret_cast<const char *>(data + end), m_hashSize).toHex();
+        }
+    }
+
+    // 解析结果都是深拷贝，映射可以立即释放
+    file.unmap(const_cast<uchar *>(data));
+    if (!ok) {
+        clear();
+        return false;
+    }
+    m_loaded = true;
+    return true;
+}
+
+void GitIndex::clear()
+{
+    m_version = 0;
+    m_loaded = false;
+    m_split = false;
+    m_sparse = false;
+    m_entries.clear();
+    m_cacheTree.clear();
+    m_fsmonitorToken.clear();
+    m_checksum.clear();
+}
+
+bool GitIndex::isLoaded() const
+{
+    return m_loaded;
+}
+
+int GitIndex::version() const
+{
+    return m_version;
+}
+
+const QList<GitIndex::Entry> &GitIndex::entries() const
+{
+    return m_entries;
+}
+
+int GitIndex::findEntry(const QByteArray &path) const
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), path, entryLessThan);
+    if (it == m_entries.end() || it->path != path) {
+        return -1;
+    }
+    return int(it - m_entries.begin());
+}
+
+QPair<int, int> GitIndex::entryRange(const QByteArray &path) const
+{
+    if (path.isEmpty()) {
+        return qMakePair(0, int(m_entries.size()));
+    }
+
+    // "dir"和"dir/..."之间可能夹着"dir-x"、"dir.txt"等条目，分两段查找
+    auto first = std::lower_bound(m_entries.begin(), m_entries.end(), path, entryLessThan);
+    auto last = first;
+    while (last != m_entries.end() && last->path == path) {
+        ++last;
+    }
+    if (last != first) {
+        return qMakePair(int(first - m_entries.begin()), int(last - m_entries.begin()));
+    }
+
+    QByteArray prefix = path.endsWith('/') ? path : path + '/';
+    first = std::lower_bound(m_entries.begin(), m_entries.end(), prefix, entryLessThan);
+    last = first;
+    while (last != m_entries.end() && last->path.startsWith(prefix)) {
+        ++last;
+    }
+    return qMakePair(int(first - m_entries.begin()), int(last - m_entries.begin()));
+}
+
+const QList<GitIndex::CacheTreeNode> &GitIndex::cacheTree() const
+{
+    return m_cacheTree;
+}
+
+QByteArray GitIndex::cacheTreeOid(const QByteArray &path) const
+{
+    for (const CacheTreeNode &node : m_cacheTree) {
+        if (node.path == path) {
+            return node.entryCount >= 0 ? node.oid : QByteArray();
+        }
+    }
+    return QByteArray();
+}
+
+bool GitIndex::isSplit() const
+{
+    return m_split;
+}
+
+bool GitIndex::isSparse() const
+{
+    return m_sparse;
+}
+
+QByteArray GitIndex::fsmonitorToken() const
+{
+    return m_fsmonitorToken;
+}
+
+QByteArray GitIndex::checksum() const
+{
+    return m_checksum;
+}
+
+bool GitIndex::parseEntries(const uchar *data, qint64 end, qint64 *offset, quint32 count)
+{
+    const qint64 fixedSize = EntryStatSize + m_hashSize + 2;
+    m_entries.reserve(count);
+    QByteArray previousPath;
+
+    for (quint32 i = 0; i < count; ++i) {
+        const qint64 start = *offset;
+        if (start + fixedSize > end) {
+            return false;
+        }
+        const uchar *p = data + start;
+
+        Entry entry;
+        entry.ctimeSeconds = readBE32(p);
+        entry.ctimeNanoseconds = readBE32(p + 4);
+        entry.mtimeSeconds = readBE32(p + 8);
+        entry.mtimeNanoseconds = readBE32(p + 12);
+        entry.dev = readBE32(p + 16);
+        entry.ino = readBE32(p + 20);
+        entry.mode = readBE32(p + 24);
+        entry.uid = readBE32(p + 28);
+        entry.gid = readBE32(p + 32);
+        entry.size = readBE32(p + 36);
+        entry.oid = QByteArray(reinterpret_cast<const char *>(p + EntryStatSize), m_hashSize).toHex();
+        entry.flags = readBE16(p + EntryStatSize + m_hashSize);
+
+        qint64 pos = start + fixedSize;
+        if (entry.flags & Extended) {
+            if (m_version < 3 || pos + 2 > end) {
+                return false;
+            }
+            entry.extendedFlags = readBE16(data + pos);
+            pos += 2;
+        }
+
+        if (m_version == 4) {
+            // 先去掉上一条路径末尾的若干字节，再拼接以NUL结尾的后缀
+            quint64 strip = 0;
+            if (!readVarint(data, end, &pos, &strip) || strip > quint64(previousPath.size())) {
+                return false;
+            }
+            const void *nul = memchr(data + pos, '\0', size_t(end - pos));
+            if (!nul) {
+                return false;
+            }
+            qint64 suffixLength = static_cast<const uchar *>(nul) - (data + pos);
+            entry.path = previousPath.left(previousPath.size() - int(strip));
+            entry.path.append(reinterpret_cast<const char *>(data + pos), int(suffixLength));
+            *offset = pos + suffixLength + 1;
+        } else {
+            const void *nul = memchr(data + pos, '\0', size_t(end - pos));
+            if (!nul) {
+                return false;
+            }
+            qint64 nameLength = static_cast<const uchar *>(nul) - (data + pos);
+            entry.path = QByteArray(reinterpret_cast<const char *>(data + pos), int(nameLength));
+            // 条目以1~8个NUL补齐到8字节边界
+            *offset = start + ((pos - start + nameLength + 8) & ~qint64(7));
+            if (*offset > end) {
+                return false;
+            }
+        }
+
+        if ((entry.mode & TypeMask) == Directory) {
+            m_sparse = true;
+        }
+        previousPath = entry.path;
+        m_entries.append(entry);
+    }
+    return true;
+}
+
+bool GitIndex::parseExtensions(const uchar *data, qint64 end, qint64 offset)
+{
+    while (offset + 8 <= end) {
+        const uchar *header = data + offset;
+        quint32 length = readBE32(header + 4);
+        const uchar *payload = header + 8;
+        if (offset + 8 + qint64(length) > end) {
+            return false;
+        }
+
+        if (memcmp(header, "TREE", 4) == 0) {
+            if (!parseCacheTree(payload, length)) {
+                // 缓存树只用于加速，解析失败时丢弃即可
+                m_cacheTree.clear();
+            }
+        } else if (memcmp(header, "link", 4) == 0) {
+            m_split = true;
+        } else if (memcmp(header, "sdir", 4) == 0) {
+            m_sparse = true;
+        } else if (memcmp(header, "FSMN", 4) == 0) {
+            // v2: 版本号后跟以NUL结尾的token；v1只有纳秒时间戳，不保存
+            if (length >= 4 && readBE32(payload) == 2) {
+                const void *nul = memchr(payload + 4, '\0', length - 4);
+                if (nul) {
+                    m_fsmonitorToken = QByteArray(reinterpret_cast<const char *>(payload + 4),
+                                                  int(static_cast<const uchar *>(nul) - (payload + 4)));
+                }
+            }
+        } else if (header[0] < 'A' || header[0] > 'Z') {
+            // 小写开头的扩展是必须理解的，遇到未知的只能放弃
+            qDebug() << "不支持的索引扩展:" << QByteArray(reinterpret_cast<const char *>(header), 4);
+            return false;
+        }
+        // REUC、UNTR、EOIE、IEOT等可选扩展在这里用不到，直接跳过
+
+        offset += 8 + qint64(length);
+    }
+    return offset == end;
+}
+
+bool GitIndex::parseCacheTree(const uchar *data, qint64 size)
+{
+    struct Frame {
+        QByteArray path;
+        int remainingSubtrees;
+    };
+    QList<Frame> stack;
+    qint64 pos = 0;
+
+    // 节点按前序排列：名称\0条目数 子树数\n[oid]
+    while (pos < size) {
+        const void *nul = memchr(data + pos, '\0', size_t(size - pos));
+        if (!nul) {
+            return false;
+        }
+        qint64 nameEnd = static_cast<const uchar *>(nul) - data;
+        QByteArray name(reinterpret_cast<const char *>(data + pos), int(nameEnd - pos));
+        pos = nameEnd + 1;
+
+        const void *newline = memchr(data + pos, '\n', size_t(size - pos));
+        if (!newline) {
+            return false;
+        }
+        qint64 lineEnd = static_cast<const uchar *>(newline) - data;
+        QList<QByteArray> counts = QByteArray(reinterpret_cast<const char *>(data + pos), int(lineEnd - pos)).split(' ');
+        pos = lineEnd + 1;
+        if (counts.size() != 2) {
+            return false;
+        }
+
+        CacheTreeNode node;
+        bool entryOk = false;
+        bool subtreeOk = false;
+        node.entryCount = counts[0].toInt(&entryOk);
+        node.subtreeCount = counts[1].toInt(&subtreeOk);
+        if (!entryOk || !subtreeOk || node.subtreeCount < 0) {
+            return false;
+        }
+        if (node.entryCount >= 0) {
+            if (pos + m_hashSize > size) {
+                return false;
+            }
+            node.oid = QByteArray(reinterpret_cast<const char *>(data + pos), m_hashSize).toHex();
+            pos += m_hashSize;
+        }
+
+        while (!stack.isEmpty() && stack.last().remainingSubtrees == 0) {
+            stack.removeLast();
+        }
+        if (!stack.isEmpty()) {
+            Frame &parent = stack.last();
+            node.path = parent.path.isEmpty() ? name : parent.path + '/' + name;
+            --parent.remainingSubtrees;
+        } else if (!m_cacheTree.isEmpty()) {
+            return false;
+        }
+
+        stack.append({node.path, node.subtreeCount});
+        m_cacheTree.append(node);
+    }
+    return true;
+}
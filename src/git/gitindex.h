@@ -0,0 +1,102 @@
+#ifndef GITINDEX_H
+#define GITINDEX_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+
+// .git/index的只读解析器，支持v2/v3/v4格式以及TREE、FSMN等扩展
+class GitIndex
+{
+public:
+    enum EntryFlag {
+        AssumeValid = 0x8000,
+        Extended = 0x4000,
+        StageMask = 0x3000
+    };
+
+    enum ExtendedFlag {
+        SkipWorktree = 0x4000,
+        IntentToAdd = 0x2000
+    };
+
+    // 文件模式中的类型位，与git保持一致
+    enum ModeType {
+        TypeMask = 0170000,
+        RegularFile = 0100000,
+        Symlink = 0120000,
+        Directory = 0040000,
+        Gitlink = 0160000
+    };
+
+    struct Entry {
+        quint32 ctimeSeconds = 0;
+        quint32 ctimeNanoseconds = 0;
+        quint32 mtimeSeconds = 0;
+        quint32 mtimeNanoseconds = 0;
+        quint32 dev = 0;
+        quint32 ino = 0;
+        quint32 mode = 0;
+        quint32 uid = 0;
+        quint32 gid = 0;
+        quint32 size = 0;       // 文件大小的低32位
+        QByteArray oid;         // 十六进制
+        quint16 flags = 0;
+        quint16 extendedFlags = 0;
+        QByteArray path;        // 相对于工作树根目录，'/'分隔
+
+        int stage() const { return (flags & StageMask) >> 12; }
+        bool assumeValid() const { return flags & AssumeValid; }
+        bool skipWorktree() const { return extendedFlags & SkipWorktree; }
+        bool intentToAdd() const { return extendedFlags & IntentToAdd; }
+    };
+
+    // TREE扩展中的一个目录节点；entryCount为-1表示该节点已失效
+    struct CacheTreeNode {
+        QByteArray path;        // 根目录为空
+        int entryCount = -1;
+        int subtreeCount = 0;
+        QByteArray oid;
+    };
+
+    GitIndex();
+
+    bool load(const QString &indexPath, int hashSize);
+    void clear();
+    bool isLoaded() const;
+
+    int version() const;
+    const QList<Entry> &entries() const;
+
+    // 条目按路径（字节序）和stage排序，返回第一个匹配的下标，找不到时返回-1
+    int findEntry(const QByteArray &path) const;
+    // 路径本身或其下所有文件对应的条目区间[first, last)
+    QPair<int, int> entryRange(const QByteArray &path) const;
+
+    const QList<CacheTreeNode> &cacheTree() const;
+    QByteArray cacheTreeOid(const QByteArray &path = QByteArray()) const;
+
+    // 拆分索引和稀疏索引的条目不完整，调用方需要回退到git命令
+    bool isSplit() const;
+    bool isSparse() const;
+    QByteArray fsmonitorToken() const;
+    QByteArray checksum() const;
+
+private:
+    bool parseEntries(const uchar *data, qint64 size, qint64 *offset, quint32 count);
+    bool parseExtensions(const uchar *data, qint64 end, qint64 offset);
+    bool parseCacheTree(const uchar *data, qint64 size);
+
+    int m_version;
+    int m_hashSize;
+    bool m_loaded;
+    bool m_split;
+    bool m_sparse;
+    QList<Entry> m_entries;
+    QList<CacheTreeNode> m_cacheTree;
+    QByteArray m_fsmonitorToken;
+    QByteArray m_checksum;
+};
+
+#endif // GITINDEX_H
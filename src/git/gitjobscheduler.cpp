@@ -0,0 +1,288 @@
+#include "gitjobscheduler.h"
+
+GitJobScheduler::GitJobScheduler(QObject *parent)
+    : QObject(parent),
+      m_maxConcurrent(4),
+      m_nextId(1),
+      m_submittedMutations(0),
+      m_finishedMutations(0),
+      m_readBarrier(0),
+      m_mutationRunning(false)
+{
+    // 只读命令不获取可选锁，避免与变更命令争用.git/index.lock
+    m_readEnvironment = QProcessEnvironment::systemEnvironment();
+    m_readEnvironment.insert("GIT_OPTIONAL_LOCKS", "0");
+}
+
+GitJobScheduler::~GitJobScheduler()
+{
+    cancelAll();
+}
+
+quint64 GitJobScheduler::submit(const Job &job, JobCallback callback)
+{
+    const bool mergeable = !job.mutating && !job.outputCallback && job.input.isEmpty();
+    if (mergeable) {
+        // 相同的只读任务已在排队或运行时，直接合并
+        QString key = makeDedupKey(job);
+        Entry *existing = m_readJobs.value(key, nullptr);
+        if (existing) {
+            existing->callbacks.append(callback);
+
+            // 交互任务合并到排队中的后台任务时，提升其优先级
+            if (job.priority == Interactive && existing->job.priority == Background && !existing->process) {
+                m_backgroundQueue.removeOne(existing);
+                existing->job.priority = Interactive;
+                m_interactiveQueue.append(existing);
+                schedule();
+            }
+            return existing->id;
+        }
+    }
+
+    Entry *entry = new Entry;
+    entry->id = m_nextId++;
+    entry->job = job;
+    entry->callbacks.append(callback);
+    entry->process = nullptr;
+
+    if (job.mutating) {
+        entry->mutationSequence = ++m_submittedMutations;
+        if (job.blocksReads) {
+            // 之后提交的只读任务必须看到这次修改，不能再合并到之前的任务上
+            m_readBarrier = entry->mutationSequence;
+            m_readJobs.clear();
+        }
+    } else {
+        entry->mutationSequence = m_readBarrier;
+        if (mergeable) {
+            entry->dedupKey = makeDedupKey(job);
+            m_readJobs.insert(entry->dedupKey, entry);
+        }
+    }
+
+    if (job.priority == Interactive) {
+        m_interactiveQueue.append(entry);
+    } else {
+        m_backgroundQueue.append(entry);
+    }
+
+    schedule();
+    return entry->id;
+}
+
+bool GitJobScheduler::cancel(quint64 id)
+{
+    Entry *entry = nullptr;
+    for (Entry *candidate : m_interactiveQueue + m_backgroundQueue + m_running) {
+        if (candidate->id == id) {
+            entry = candidate;
+            break;
+        }
+    }
+    if (!entry || entry->job.mutating || entry->callbacks.size() > 1) {
+        return false;
+    }
+
+    if (!entry->dedupKey.isEmpty() && m_readJobs.value(entry->dedupKey, nullptr) == entry) {
+        m_readJobs.remove(entry->dedupKey);
+    }
+
+    if (entry->process) {
+        // 不等待进程退出，退出后自行释放
+        m_running.removeOne(entry);
+        QProcess *process = entry->process;
+        disconnect(process, nullptr, this, nullptr);
+        connect(process, &QProcess::finished, process, &QObject::deleteLater);
+        process->kill();
+        delete entry;
+        schedule();
+    } else {
+        m_interactiveQueue.removeOne(entry);
+        m_backgroundQueue.removeOne(entry);
+        delete entry;
+    }
+    return true;
+}
+
+void GitJobScheduler::cancelAll()
+{
+    for (Entry *entry : m_running) {
+        disconnect(entry->process, nullptr, this, nullptr);
+        entry->process->kill();
+        entry->process->waitForFinished();
+        delete entry->process;
+        delete entry;
+    }
+    m_running.clear();
+
+    qDeleteAll(m_interactiveQueue);
+    m_interactiveQueue.clear();
+    qDeleteAll(m_backgroundQueue);
+    m_backgroundQueue.clear();
+    m_readJobs.clear();
+
+    m_submittedMutations = 0;
+    m_finishedMutations = 0;
+    m_readBarrier = 0;
+    m_mutationRunning = false;
+}
+
+void GitJobScheduler::setMaxConcurrentProcesses(int count)
+{
+    m_maxConcurrent = qMax(1, count);
+    schedule();
+}
+
+int GitJobScheduler::maxConcurrentProcesses() const
+{
+    return m_maxConcurrent;
+}
+
+int GitJobScheduler::runningJobCount() const
+{
+    return m_running.size();
+}
+
+int GitJobScheduler::pendingJobCount() const
+{
+    return m_interactiveQueue.size() + m_backgroundQueue.size();
+}
+
+bool GitJobScheduler::canStart(const Entry *entry) const
+{
+    if (entry->job.mutating) {
+        // 变更任务之间严格按提交顺序串行执行
+        return !m_mutationRunning && entry->mutationSequence == m_finishedMutations + 1;
+    }
+
+    // 只读任务需要等待在它之前提交的变更任务完成
+    return entry->mutationSequence <= m_finishedMutations;
+}
+
+GitJobScheduler::Entry *GitJobScheduler::takeNextRunnable()
+{
+    for (int i = 0; i < m_interactiveQueue.size(); ++i) {
+        if (canStart(m_interactiveQueue[i])) {
+            return m_interactiveQueue.takeAt(i);
+        }
+    }
+
+    // 为交互任务保留一个进程名额，后台刷新不会挡住用户操作
+    int backgroundRunning = 0;
+    for (const Entry *entry : m_running) {
+        if (entry->job.priority == Background) {
+            ++backgroundRunning;
+        }
+    }
+    if (backgroundRunning >= qMax(1, m_maxConcurrent - 1)) {
+        return nullptr;
+    }
+
+    for (int i = 0; i < m_backgroundQueue.size(); ++i) {
+        if (canStart(m_backgroundQueue[i])) {
+            return m_backgroundQueue.takeAt(i);
+        }
+    }
+    return nullptr;
+}
+
+void GitJobScheduler::schedule()
+{
+    while (m_running.size() < m_maxConcurrent) {
+        Entry *entry = takeNextRunnable();
+        if (!entry) {
+            break;
+        }
+        start(entry);
+    }
+}
+
+void GitJobScheduler::start(Entry *entry)
+{
+    QProcess *process = new QProcess(this);
+    if (!entry->job.workingDirectory.isEmpty()) {
+        process->setWorkingDirectory(entry->job.workingDirectory);
+    }
+    if (!entry->job.mutating) {
+        process->setProcessEnvironment(m_readEnvironment);
+    }
+
+    entry->process = process;
+    m_running.append(entry);
+    if (entry->job.mutating) {
+        m_mutationRunning = true;
+    }
+
+    if (entry->job.outputCallback) {
+        connect(process, &QProcess::readyReadStandardOutput, this, [entry]() {
+            entry->job.outputCallback(entry->process->readAllStandardOutput());
+        });
+    }
+
+    // finished和errorOccurred(FailedToStart)只会有一个生效，finish中会去重
+    connect(process, &QProcess::finished, this, [this, entry](int exitCode, QProcess::ExitStatus exitStatus) {
+        finish(entry, exitStatus == QProcess::NormalExit && exitCode == 0);
+    });
+    connect(process, &QProcess::errorOccurred, this, [this, entry](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            finish(entry, false);
+        }
+    });
+
+    process->start("git", entry->job.args);
+    if (!entry->job.input.isEmpty()) {
+        // 进程启动前写入的数据由QProcess缓存，启动后依次写出
+        process->write(entry->job.input);
+        process->closeWriteChannel();
+    }
+}
+
+void GitJobScheduler::finish(Entry *entry, bool success)
+{
+    if (!m_running.removeOne(entry)) {
+        return;
+    }
+
+    QByteArray output = entry->process->readAllStandardOutput();
+    if (entry->job.outputCallback) {
+        // 流式任务的剩余输出也交给输出回调
+        if (!output.isEmpty()) {
+            entry->job.outputCallback(output);
+        }
+        output.clear();
+    }
+    QString error;
+    if (!success) {
+        error = QString::fromUtf8(entry->process->readAllStandardError());
+        if (error.isEmpty()) {
+            error = entry->process->errorString();
+        }
+    }
+
+    if (entry->job.mutating) {
+        m_mutationRunning = false;
+        m_finishedMutations = entry->mutationSequence;
+    } else if (!entry->dedupKey.isEmpty() && m_readJobs.value(entry->dedupKey, nullptr) == entry) {
+        m_readJobs.remove(entry->dedupKey);
+    }
+
+    entry->process->deleteLater();
+
+    // 回调中可能提交新任务，先把任务从调度器中摘除
+    QStringList args = entry->job.args;
+    QList<JobCallback> callbacks = entry->callbacks;
+    delete entry;
+
+    emit jobFinished(args, success, output, error);
+    for (const JobCallback &callback : callbacks) {
+        if (callback) callback(success, output);
+    }
+
+    schedule();
+}
+
+QString GitJobScheduler::makeDedupKey(const Job &job)
+{
+    return job.workingDirectory + QChar('\0') + job.args.join(QChar('\0'));
+}
@@ -0,0 +1,92 @@
+#ifndef GITJOBSCHEDULER_H
+#define GITJOBSCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <functional>
+
+// Git命令调度器：按优先级排队，限制同时运行的git进程数量
+class GitJobScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority {
+        Interactive, // 用户操作触发，优先调度
+        Background   // 后台刷新
+    };
+
+    using JobCallback = std::function<void(bool success, const QByteArray &output)>;
+    using OutputCallback = std::function<void(const QByteArray &chunk)>;
+
+    struct Job {
+        QStringList args;
+        QString workingDirectory;
+        Priority priority = Interactive;
+        bool mutating = false; // 修改仓库的命令（add、reset、commit、checkout等）
+        // 变更任务之后提交的只读任务是否要等它完成。push、fetch只更新远程跟踪引用，
+        // 耗时取决于网络，设为false：仍与其他变更任务串行，但不挡住之后的只读任务
+        bool blocksReads = true;
+        // 设置后标准输出在进程运行期间分块交给它，JobCallback收到的output为空；这类任务不参与合并
+        OutputCallback outputCallback;
+        // 启动后写入标准输入并关闭，例如--pathspec-from-file=-的路径列表；这类任务也不参与合并
+        QByteArray input;
+    };
+
+    explicit GitJobScheduler(QObject *parent = nullptr);
+    ~GitJobScheduler();
+
+    // 提交任务，返回任务ID；相同的只读任务会合并为一次执行
+    quint64 submit(const Job &job, JobCallback callback);
+    // 取消排队中或运行中的只读任务，不再触发回调和jobFinished；
+    // 变更任务、已经结束的任务和合并了多个调用方的任务返回false
+    bool cancel(quint64 id);
+    void cancelAll();
+
+    void setMaxConcurrentProcesses(int count);
+    int maxConcurrentProcesses() const;
+    int runningJobCount() const;
+    int pendingJobCount() const;
+
+signals:
+    void jobFinished(const QStringList &args, bool success, const QByteArray &output, const QString &error);
+
+private:
+    struct Entry {
+        quint64 id;
+        Job job;
+        QList<JobCallback> callbacks;
+        // 变更任务：自身的变更序号；只读任务：提交时最后一个挡住只读任务的变更任务的序号
+        quint64 mutationSequence;
+        QString dedupKey;
+        QProcess *process;
+    };
+
+    bool canStart(const Entry *entry) const;
+    Entry *takeNextRunnable();
+    void schedule();
+    void start(Entry *entry);
+    void finish(Entry *entry, bool success);
+    static QString makeDedupKey(const Job &job);
+
+    QList<Entry*> m_interactiveQueue;
+    QList<Entry*> m_backgroundQueue;
+    QList<Entry*> m_running;
+    QHash<QString, Entry*> m_readJobs; // 可合并的只读任务（排队中或运行中）
+
+    QProcessEnvironment m_readEnvironment;
+    int m_maxConcurrent;
+    quint64 m_nextId;
+    quint64 m_submittedMutations;
+    quint64 m_finishedMutations;
+    quint64 m_readBarrier; // 最后一个blocksReads的变更任务的序号，之后提交的只读任务等它完成
+    bool m_mutationRunning;
+};
+
+#endif // GITJOBSCHEDULER_H
@@ -0,0 +1,911 @@
+#include "gitlinediff.h"
+#include <QString>
+#include <climits>
+
+namespace {
+// 与git的FIRST_FEW_BYTES相同
+const qsizetype BinaryCheckSize = 8000;
+// histogram算法只把出现次数不超过这么多的行作为锚点
+const int MaxChainLength = 64;
+// histogram递归过深时剩下的区间交给Myers
+const int MaxHistogramDepth = 1024;
+// 以下与xdiff相同：Myers算法代价上限的下限，实际上限取两边行数之和的平方根
+const int MinMaxCost = 256;
+// 代价超过这个值后，遇到足够长的蛇就可以提前分割
+const int HeuristicMinCost = 256;
+const int SnakeLength = 20;
+const int HeuristicFactor = 4;
+// 行在另一边出现这么多次以上算作多次匹配，上限为行数的平方根
+const int MaxEqualLimit = 1024;
+// 判断多次匹配的行是否去掉时，向前后最多查看的行数
+const int SimilarScanWindow = 100;
+// 缩进启发的权重，与xdiff相同
+const int MaxIndent = 200;
+const int MaxBlanks = 20;
+const int StartOfFilePenalty = 1;
+const int EndOfFilePenalty = 21;
+const int TotalBlankWeight = -30;
+const int PostBlankWeight = 6;
+const int RelativeIndentPenalty = -4;
+const int RelativeIndentWithBlankPenalty = 10;
+const int RelativeOutdentPenalty = 24;
+const int RelativeOutdentWithBlankPenalty = 17;
+const int RelativeDedentPenalty = 23;
+const int RelativeDedentWithBlankPenalty = 17;
+const int IndentWeight = 60;
+const int IndentMaxSliding = 100;
+// 与git相同，@@行后的函数名最多80字节
+const int FunctionContextLength = 80;
+
+// 与xdiff的xdl_bogosqrt相同，不小于平方根的2的幂
+int bogoSqrt(int n)
+{
+    int i = 1;
+    for (; n > 0; n >>= 2) {
+        i <<= 1;
+    }
+    return i;
+}
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+QByteArray hunkRange(int begin, int count)
+{
+    // 与git相同：一行时省略行数，空区间的起点为前一行
+    if (count == 1) {
+        return QByteArray::number(begin + 1);
+    }
+    return QByteArray::number(count == 0 ? begin : begin + 1) + ',' + QByteArray::number(count);
+}
+
+// FNV-1a，行内容相同时哈希相同
+quint64 hashLine(QByteArrayView line)
+{
+    quint64 hash = 14695981039346656037ull;
+    for (char c : line) {
+        hash = (hash ^ uchar(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// 行首空白的宽度，制表符按8列对齐；只有空白的行为-1
+int lineIndent(QByteArrayView line)
+{
+    int indent = 0;
+    for (char c : line) {
+        if (!isSpace(c)) {
+            return indent;
+        }
+        if (c == ' ') {
+            indent += 1;
+        } else if (c == '\t') {
+            indent += 8 - indent % 8;
+        }
+        if (indent >= MaxIndent) {
+            return MaxIndent;
+        }
+    }
+    return -1;
+}
+
+// 在某一行之前分割时周围的情况
+struct SplitMeasurement {
+    bool endOfFile = false;
+    int indent = -1;
+    int preBlank = 0;
+    int preIndent = -1;
+    int postBlank = 0;
+    int postIndent = -1;
+};
+
+struct SplitScore {
+    int effectiveIndent = 0;
+    int penalty = 0;
+};
+
+void addSplitScore(const SplitMeasurement &m, SplitScore *score)
+{
+    if (m.preIndent == -1 && m.preBlank == 0) {
+        score->penalty += StartOfFilePenalty;
+    }
+    if (m.endOfFile) {
+        score->penalty += EndOfFilePenalty;
+    }
+    const int postBlank = m.indent == -1 ? 1 + m.postBlank : 0;
+    const int totalBlank = m.preBlank + postBlank;
+    score->penalty += TotalBlankWeight * totalBlank;
+    score->penalty += PostBlankWeight * postBlank;
+
+    const int indent = m.indent != -1 ? m.indent : m.postIndent;
+    const bool anyBlanks = totalBlank != 0;
+    score->effectiveIndent += indent;
+    if (indent == -1 || m.preIndent == -1 || indent == m.preIndent) {
+        return;
+    }
+    if (indent > m.preIndent) {
+        score->penalty += anyBlanks ? RelativeIndentWithBlankPenalty : RelativeIndentPenalty;
+    } else if (m.postIndent != -1 && m.postIndent > indent) {
+        score->penalty += anyBlanks ? RelativeOutdentWithBlankPenalty : RelativeOutdentPenalty;
+    } else {
+        score->penalty += anyBlanks ? RelativeDedentWithBlankPenalty : RelativeDedentPenalty;
+    }
+}
+
+int compareScores(const SplitScore &a, const SplitScore &b)
+{
+    const int indents = (a.effectiveIndent > b.effectiveIndent) - (a.effectiveIndent < b.effectiveIndent);
+    return IndentWeight * indents + (a.penalty - b.penalty);
+}
+
+// 与xdiff一样，每个未修改的行之间都有一组修改（可以为空），两边的组一一对应
+struct Group {
+    int start = 0;
+    int end = 0;
+};
+}
+
+GitLineDiff::GitLineDiff(const QByteArray &oldData, const QByteArray &newData)
+    : m_lineKinds(0),
+      m_maxCost(0)
+{
+    m_old.data = oldData;
+    m_new.data = newData;
+    splitLines(&m_old);
+    splitLines(&m_new);
+
+    // 两边共用一张开放寻址表给行编号，之后只比较整数；表中只存哈希、编号和行的位置，不复制内容
+    struct Slot {
+        quint64 hash = 0;
+        int id = 0; // 0为空槽
+        const Side *side = nullptr;
+        int line = 0;
+    };
+    const qsizetype total = m_old.lineOffsets.size() + m_new.lineOffsets.size();
+    qsizetype capacity = 16;
+    while (capacity < total * 2) {
+        capacity *= 2;
+    }
+    std::vector<Slot> table;
+    table.resize(size_t(capacity));
+    int nextId = 1;
+    for (Side *side : { &m_old, &m_new }) {
+        const int count = int(side->lineOffsets.size()) - 1;
+        side->ids.resize(size_t(count));
+        side->changed.assign(size_t(count) + 1, 0);
+        for (int i = 0; i < count; ++i) {
+            const QByteArrayView line = lineAt(*side, i);
+            const quint64 hash = hashLine(line);
+            size_t index = size_t(hash) & size_t(capacity - 1);
+            while (table[index].id != 0
+                   && (table[index].hash != hash || lineAt(*table[index].side, table[index].line) != line)) {
+                index = (index + 1) & size_t(capacity - 1);
+            }
+            if (table[index].id == 0) {
+                table[index] = { hash, nextId++, side, i };
+            }
+            side->ids[size_t(i)] = table[index].id;
+        }
+    }
+    m_lineKinds = nextId;
+}
+
+void GitLineDiff::compute(Algorithm algorithm)
+{
+    const int oldCount = int(m_old.ids.size());
+    const int newCount = int(m_new.ids.size());
+    std::fill(m_old.changed.begin(), m_old.changed.end(), 0);
+    std::fill(m_new.changed.begin(), m_new.changed.end(), 0);
+    m_oldCounts.assign(size_t(m_lineKinds), 0);
+    m_newCounts.assign(size_t(m_lineKinds), 0);
+    if (algorithm == Histogram) {
+        m_occurrences.assign(size_t(m_lineKinds), 0);
+        m_firstPosition.assign(size_t(m_lineKinds), -1);
+        m_nextPosition.assign(size_t(oldCount), -1);
+        histogram(0, oldCount, 0, newCount, 0);
+    } else {
+        classicDiff(0, oldCount, 0, newCount);
+    }
+    compact(&m_old, &m_new);
+    compact(&m_new, &m_old);
+}
+
+QByteArray GitLineDiff::unifiedHunks(int context) const
+{
+    const int oldCount = int(m_old.ids.size());
+    const int newCount = int(m_new.ids.size());
+
+    // 连续的修改行为一组，组内先删除后添加
+    struct Change {
+        int oldStart, oldEnd, newStart, newEnd;
+    };
+    QList<Change> changes;
+    int i = 0;
+    int j = 0;
+    while (i < oldCount || j < newCount) {
+        if (!m_old.changed[size_t(i)] && !m_new.changed[size_t(j)]) {
+            ++i;
+            ++j;
+            continue;
+        }
+        Change change{ i, i, j, j };
+        while (m_old.changed[size_t(i)]) {
+            ++i;
+        }
+        while (m_new.changed[size_t(j)]) {
+            ++j;
+        }
+        change.oldEnd = i;
+        change.newEnd = j;
+        changes.append(change);
+    }
+
+    QByteArray out;
+    auto appendLine = [&out](char prefix, QByteArrayView line) {
+        out.append(prefix);
+        out.append(line.data(), line.size());
+        if (!line.endsWith('\n')) {
+            out.append("\n\\ No newline at end of file\n");
+        }
+    };
+
+    // 间隔不超过两倍上下文的组合并为一个块
+    qsizetype first = 0;
+    while (first < changes.size()) {
+        qsizetype last = first;
+        while (last + 1 < changes.size() && changes[last + 1].oldStart - changes[last].oldEnd <= 2 * context) {
+            ++last;
+        }
+        const int before = qMin(context, changes[first].oldStart);
+        const int after = qMin(context, oldCount - changes[last].oldEnd);
+        const int oldBegin = changes[first].oldStart - before;
+        const int newBegin = changes[first].newStart - before;
+        const int oldEnd = changes[last].oldEnd + after;
+        const int newEnd = changes[last].newEnd + after;
+
+        out.append("@@ -" + hunkRange(oldBegin, oldEnd - oldBegin) + " +" + hunkRange(newBegin, newEnd - newBegin) + " @@");
+        const QByteArray function = functionContext(oldBegin - 1);
+        if (!function.isEmpty()) {
+            out.append(' ');
+            out.append(function);
+        }
+        out.append('\n');
+
+        int oldLine = oldBegin;
+        for (qsizetype c = first; c <= last; ++c) {
+            for (; oldLine < changes[c].oldStart; ++oldLine) {
+                appendLine(' ', lineAt(m_old, oldLine));
+            }
+            for (int k = changes[c].oldStart; k < changes[c].oldEnd; ++k) {
+                appendLine('-', lineAt(m_old, k));
+            }
+            for (int k = changes[c].newStart; k < changes[c].newEnd; ++k) {
+                appendLine('+', lineAt(m_new, k));
+            }
+            oldLine = changes[c].oldEnd;
+        }
+        for (; oldLine < oldEnd; ++oldLine) {
+            appendLine(' ', lineAt(m_old, oldLine));
+        }
+        first = last + 1;
+    }
+    return out;
+}
+
+QByteArray GitLineDiff::fileDiff(const FileHeader &header, const QByteArray &oldData, const QByteArray &newData,
+                                 Algorithm algorithm, int context)
+{
+    if (oldData == newData) {
+        return QByteArray();
+    }
+
+    QByteArray out = "diff --git a/" + header.path + " b/" + header.path + '\n';
+    out += "index " + header.oldOid.left(7) + ".." + header.newOid.left(7) + ' '
+         + QByteArray::number(header.mode, 8) + '\n';
+    if (isBinary(oldData) || isBinary(newData)) {
+        out += "Binary files a/" + header.path + " and b/" + header.path + " differ\n";
+        return out;
+    }
+
+    GitLineDiff diff(oldData, newData);
+    diff.compute(algorithm);
+    // 与git相同，路径中有空格时在文件名后加制表符，便于patch区分文件名和时间戳
+    const QByteArray separator = header.path.contains(' ') ? "\t\n" : "\n";
+    out += "--- a/" + header.path + separator + "+++ b/" + header.path + separator;
+    out += diff.unifiedHunks(context);
+    return out;
+}
+
+bool GitLineDiff::isBinary(const QByteArray &data)
+{
+    return QByteArrayView(data).first(qMin(data.size(), BinaryCheckSize)).contains('\0');
+}
+
+GitLineDiff::Algorithm GitLineDiff::algorithmFromName(const QString &name)
+{
+    return name.compare("histogram", Qt::CaseInsensitive) == 0 ? Histogram : Myers;
+}
+
+void GitLineDiff::splitLines(Side *side)
+{
+    const QByteArrayView data = side->data;
+    side->lineOffsets.clear();
+    qsizetype offset = 0;
+    while (offset < data.size()) {
+        side->lineOffsets.append(offset);
+        const qsizetype newline = data.indexOf('\n', offset);
+        offset = newline < 0 ? data.size() : newline + 1;
+    }
+    side->lineOffsets.append(data.size());
+}
+
+QByteArrayView GitLineDiff::lineAt(const Side &side, int line) const
+{
+    const qsizetype begin = side.lineOffsets[line];
+    return side.data.sliced(begin, side.lineOffsets[line + 1] - begin);
+}
+
+bool GitLineDiff::trim(int *oldBegin, int *oldEnd, int *newBegin, int *newEnd)
+{
+    while (*oldBegin < *oldEnd && *newBegin < *newEnd && m_old.ids[size_t(*oldBegin)] == m_new.ids[size_t(*newBegin)]) {
+        ++*oldBegin;
+        ++*newBegin;
+    }
+    while (*oldEnd > *oldBegin && *newEnd > *newBegin && m_old.ids[size_t(*oldEnd - 1)] == m_new.ids[size_t(*newEnd - 1)]) {
+        --*oldEnd;
+        --*newEnd;
+    }
+    if (*oldBegin == *oldEnd || *newBegin == *newEnd) {
+        std::fill(m_old.changed.begin() + *oldBegin, m_old.changed.begin() + *oldEnd, 1);
+        std::fill(m_new.changed.begin() + *newBegin, m_new.changed.begin() + *newEnd, 1);
+        return false;
+    }
+    return true;
+}
+
+void GitLineDiff::classicDiff(int oldBegin, int oldEnd, int newBegin, int newEnd)
+{
+    // 与xdiff相同，出现次数在整个区间内统计，包括随后去掉的两端
+    for (int i = oldBegin; i < oldEnd; ++i) {
+        ++m_oldCounts[size_t(m_old.ids[size_t(i)])];
+    }
+    for (int j = newBegin; j < newEnd; ++j) {
+        ++m_newCounts[size_t(m_new.ids[size_t(j)])];
+    }
+    const int oldLimit = qMin(bogoSqrt(oldEnd - oldBegin), MaxEqualLimit);
+    const int newLimit = qMin(bogoSqrt(newEnd - newBegin), MaxEqualLimit);
+    const int oldRangeBegin = oldBegin;
+    const int oldRangeEnd = oldEnd;
+    const int newRangeBegin = newBegin;
+    const int newRangeEnd = newEnd;
+
+    if (trim(&oldBegin, &oldEnd, &newBegin, &newEnd)) {
+        // 另一边没有的行一定是修改，不参与比较；在另一边出现很多次的行夹在这样的行中间时也去掉
+        std::vector<char> oldKinds(size_t(oldEnd - oldBegin));
+        for (int i = oldBegin; i < oldEnd; ++i) {
+            const int count = m_newCounts[size_t(m_old.ids[size_t(i)])];
+            oldKinds[size_t(i - oldBegin)] = count == 0 ? NoMatch : count >= oldLimit ? ManyMatches : Matched;
+        }
+        std::vector<char> newKinds(size_t(newEnd - newBegin));
+        for (int j = newBegin; j < newEnd; ++j) {
+            const int count = m_oldCounts[size_t(m_new.ids[size_t(j)])];
+            newKinds[size_t(j - newBegin)] = count == 0 ? NoMatch : count >= newLimit ? ManyMatches : Matched;
+        }
+        m_a.clear();
+        m_b.clear();
+        for (int i = oldBegin; i < oldEnd; ++i) {
+            const char kind = oldKinds[size_t(i - oldBegin)];
+            if (kind == Matched || (kind == ManyMatches && !discardMultipleMatch(oldKinds, i - oldBegin))) {
+                m_a.push_back({ m_old.ids[size_t(i)], i });
+            } else {
+                m_old.changed[size_t(i)] = 1;
+            }
+        }
+        for (int j = newBegin; j < newEnd; ++j) {
+            const char kind = newKinds[size_t(j - newBegin)];
+            if (kind == Matched || (kind == ManyMatches && !discardMultipleMatch(newKinds, j - newBegin))) {
+                m_b.push_back({ m_new.ids[size_t(j)], j });
+            } else {
+                m_new.changed[size_t(j)] = 1;
+            }
+        }
+        m_maxCost = qMax(MinMaxCost, bogoSqrt(int(m_a.size() + m_b.size()) + 3));
+        m_forward.resize(m_a.size() + m_b.size() + 3);
+        m_backward.resize(m_a.size() + m_b.size() + 3);
+        myers(0, int(m_a.size()), 0, int(m_b.size()), false);
+    }
+
+    for (int i = oldRangeBegin; i < oldRangeEnd; ++i) {
+        m_oldCounts[size_t(m_old.ids[size_t(i)])] = 0;
+    }
+    for (int j = newRangeBegin; j < newRangeEnd; ++j) {
+        m_newCounts[size_t(m_new.ids[size_t(j)])] = 0;
+    }
+}
+
+bool GitLineDiff::discardMultipleMatch(const std::vector<char> &kinds, int i)
+{
+    // 与xdiff的xdl_clean_mmatch相同：前后都有无匹配的行，且多次匹配的行不到四分之一时去掉
+    const int first = qMax(0, i - SimilarScanWindow);
+    const int last = qMin(int(kinds.size()) - 1, i + SimilarScanWindow);
+    int noMatchBefore = 0;
+    int manyBefore = 1;
+    for (int r = i - 1; r >= first; --r) {
+        if (kinds[size_t(r)] == NoMatch) {
+            ++noMatchBefore;
+        } else if (kinds[size_t(r)] == ManyMatches) {
+            ++manyBefore;
+        } else {
+            break;
+        }
+    }
+    if (noMatchBefore == 0) {
+        return false;
+    }
+    int noMatchAfter = 0;
+    int manyAfter = 1;
+    for (int r = i + 1; r <= last; ++r) {
+        if (kinds[size_t(r)] == NoMatch) {
+            ++noMatchAfter;
+        } else if (kinds[size_t(r)] == ManyMatches) {
+            ++manyAfter;
+        } else {
+            break;
+        }
+    }
+    if (noMatchAfter == 0) {
+        return false;
+    }
+    const int noMatch = noMatchBefore + noMatchAfter;
+    const int many = manyBefore + manyAfter;
+    return many * 4 < many + noMatch;
+}
+
+void GitLineDiff::myers(int aBegin, int aEnd, int bBegin, int bEnd, bool minimal)
+{
+    // 在去掉无匹配行后的序列上比较，结果按原行号写回
+    while (aBegin < aEnd && bBegin < bEnd && m_a[size_t(aBegin)].id == m_b[size_t(bBegin)].id) {
+        ++aBegin;
+        ++bBegin;
+    }
+    while (aEnd > aBegin && bEnd > bBegin && m_a[size_t(aEnd - 1)].id == m_b[size_t(bEnd - 1)].id) {
+        --aEnd;
+        --bEnd;
+    }
+    if (aBegin == aEnd || bBegin == bEnd) {
+        markChanged(aBegin, aEnd, bBegin, bEnd);
+        return;
+    }
+
+    const Split split = findSplit(aBegin, aEnd, bBegin, bEnd, minimal);
+    myers(aBegin, split.a, bBegin, split.b, split.minimalBefore);
+    myers(split.a, aEnd, split.b, bEnd, split.minimalAfter);
+}
+
+void GitLineDiff::markChanged(int aBegin, int aEnd, int bBegin, int bEnd)
+{
+    for (int i = aBegin; i < aEnd; ++i) {
+        m_old.changed[size_t(m_a[size_t(i)].line)] = 1;
+    }
+    for (int j = bBegin; j < bEnd; ++j) {
+        m_new.changed[size_t(m_b[size_t(j)].line)] = 1;
+    }
+}
+
+GitLineDiff::Split GitLineDiff::findSplit(int aBegin, int aEnd, int bBegin, int bEnd, bool minimal)
+{
+    // 与xdiff的xdl_split相同：对角线k = a - b，前向记录每条对角线上最远的a，后向记录最小的a；
+    // 对角线的范围到达边界时反向收缩，保证前后两端同奇偶
+    const Record *a = m_a.data();
+    const Record *b = m_b.data();
+    const int offset = int(m_b.size()) + 1;
+    int *forward = m_forward.data() + offset;
+    int *backward = m_backward.data() + offset;
+
+    const int minDiagonal = aBegin - bEnd;
+    const int maxDiagonal = aEnd - bBegin;
+    const int forwardMid = aBegin - bBegin;
+    const int backwardMid = aEnd - bEnd;
+    const bool odd = (forwardMid - backwardMid) & 1;
+    int forwardMin = forwardMid;
+    int forwardMax = forwardMid;
+    int backwardMin = backwardMid;
+    int backwardMax = backwardMid;
+    forward[forwardMid] = aBegin;
+    backward[backwardMid] = aEnd;
+
+    Split split;
+    for (int cost = 1;; ++cost) {
+        bool gotSnake = false;
+
+        if (forwardMin > minDiagonal) {
+            forward[--forwardMin - 1] = -1;
+        } else {
+            ++forwardMin;
+        }
+        if (forwardMax < maxDiagonal) {
+            forward[++forwardMax + 1] = -1;
+        } else {
+            --forwardMax;
+        }
+        for (int d = forwardMax; d >= forwardMin; d -= 2) {
+            int i = forward[d - 1] >= forward[d + 1] ? forward[d - 1] + 1 : forward[d + 1];
+            const int start = i;
+            int j = i - d;
+            while (i < aEnd && j < bEnd && a[i].id == b[j].id) {
+                ++i;
+                ++j;
+            }
+            if (i - start > SnakeLength) {
+                gotSnake = true;
+            }
+            forward[d] = i;
+            if (odd && backwardMin <= d && d <= backwardMax && backward[d] <= i) {
+                return { i, j, true, true };
+            }
+        }
+
+        if (backwardMin > minDiagonal) {
+            backward[--backwardMin - 1] = INT_MAX;
+        } else {
+            ++backwardMin;
+        }
+        if (backwardMax < maxDiagonal) {
+            backward[++backwardMax + 1] = INT_MAX;
+        } else {
+            --backwardMax;
+        }
+        for (int d = backwardMax; d >= backwardMin; d -= 2) {
+            int i = backward[d - 1] < backward[d + 1] ? backward[d - 1] : backward[d + 1] - 1;
+            const int start = i;
+            int j = i - d;
+            while (i > aBegin && j > bBegin && a[i - 1].id == b[j - 1].id) {
+                --i;
+                --j;
+            }
+            if (start - i > SnakeLength) {
+                gotSnake = true;
+            }
+            backward[d] = i;
+            if (!odd && forwardMin <= d && d <= forwardMax && i <= forward[d]) {
+                return { i, j, true, true };
+            }
+        }
+
+        if (minimal) {
+            continue;
+        }
+
+        // 代价已经很高时，接受一条足够长的蛇作为分割点，这一侧不再要求最短
+        if (gotSnake && cost > HeuristicMinCost) {
+            int best = 0;
+            for (int d = forwardMax; d >= forwardMin; d -= 2) {
+                const int distance = d > forwardMid ? d - forwardMid : forwardMid - d;
+                const int i = forward[d];
+                const int j = i - d;
+                const int value = (i - aBegin) + (j - bBegin) - distance;
+                if (value > HeuristicFactor * cost && value > best
+                    && aBegin + SnakeLength <= i && i < aEnd && bBegin + SnakeLength <= j && j < bEnd) {
+                    for (int k = 1; a[i - k].id == b[j - k].id; ++k) {
+                        if (k == SnakeLength) {
+                            best = value;
+                            split = { i, j, true, false };
+                            break;
+                        }
+                    }
+                }
+            }
+            if (best > 0) {
+                return split;
+            }
+
+            for (int d = backwardMax; d >= backwardMin; d -= 2) {
+                const int distance = d > backwardMid ? d - backwardMid : backwardMid - d;
+                const int i = backward[d];
+                const int j = i - d;
+                const int value = (aEnd - i) + (bEnd - j) - distance;
+                if (value > HeuristicFactor * cost && value > best
+                    && aBegin < i && i <= aEnd - SnakeLength && bBegin < j && j <= bEnd - SnakeLength) {
+                    for (int k = 0; a[i + k].id == b[j + k].id; ++k) {
+                        if (k == SnakeLength - 1) {
+                            best = value;
+                            split = { i, j, false, true };
+                            break;
+                        }
+                    }
+                }
+            }
+            if (best > 0) {
+                return split;
+            }
+        }
+
+        // 超过代价上限：取前向或后向走得最远的点，结果不再是最短的差异
+        if (cost >= m_maxCost) {
+            int forwardBest = -1;
+            int forwardBestA = -1;
+            for (int d = forwardMax; d >= forwardMin; d -= 2) {
+                int i = qMin(forward[d], aEnd);
+                int j = i - d;
+                if (bEnd < j) {
+                    i = bEnd + d;
+                    j = bEnd;
+                }
+                if (forwardBest < i + j) {
+                    forwardBest = i + j;
+                    forwardBestA = i;
+                }
+            }
+            int backwardBest = INT_MAX;
+            int backwardBestA = INT_MAX;
+            for (int d = backwardMax; d >= backwardMin; d -= 2) {
+                int i = qMax(aBegin, backward[d]);
+                int j = i - d;
+                if (j < bBegin) {
+                    i = bBegin + d;
+                    j = bBegin;
+                }
+                if (i + j < backwardBest) {
+                    backwardBest = i + j;
+                    backwardBestA = i;
+                }
+            }
+            if ((aEnd + bEnd) - backwardBest < forwardBest - (aBegin + bBegin)) {
+                return { forwardBestA, forwardBest - forwardBestA, true, false };
+            }
+            return { backwardBestA, backwardBest - backwardBestA, false, true };
+        }
+    }
+}
+
+void GitLineDiff::histogram(int oldBegin, int oldEnd, int newBegin, int newEnd, int depth)
+{
+    // 与xdiff的histogram一样不去掉两端相同的行，锚点的选择因此与git一致
+    if (oldBegin == oldEnd || newBegin == newEnd) {
+        std::fill(m_old.changed.begin() + oldBegin, m_old.changed.begin() + oldEnd, 1);
+        std::fill(m_new.changed.begin() + newBegin, m_new.changed.begin() + newEnd, 1);
+        return;
+    }
+    if (depth > MaxHistogramDepth) {
+        classicDiff(oldBegin, oldEnd, newBegin, newEnd);
+        return;
+    }
+
+    // 旧区间中每种行的出现次数和按位置递增的链表，编号是连续的整数，直接用数组
+    for (int i = oldEnd - 1; i >= oldBegin; --i) {
+        const int id = m_old.ids[size_t(i)];
+        m_nextPosition[size_t(i)] = m_firstPosition[size_t(id)];
+        m_firstPosition[size_t(id)] = i;
+        ++m_occurrences[size_t(id)];
+    }
+
+    // 以出现次数少的公共行为锚点，向两边扩展成相同的区间；区间更长或其中最少的出现次数更少时替换
+    int bestCount = MaxChainLength + 1;
+    int bestOld = -1;
+    int bestNew = -1;
+    int bestLength = 0;
+    for (int j = newBegin; j < newEnd;) {
+        int next = j + 1;
+        const int id = m_new.ids[size_t(j)];
+        const int occurrences = m_occurrences[size_t(id)];
+        if (occurrences > 0 && occurrences <= bestCount) {
+            for (int i = m_firstPosition[size_t(id)]; i >= 0; i = m_nextPosition[size_t(i)]) {
+                int oldStart = i;
+                int newStart = j;
+                int count = occurrences;
+                while (oldStart > oldBegin && newStart > newBegin
+                       && m_old.ids[size_t(oldStart - 1)] == m_new.ids[size_t(newStart - 1)]) {
+                    --oldStart;
+                    --newStart;
+                    count = qMin(count, m_occurrences[size_t(m_old.ids[size_t(oldStart)])]);
+                }
+                int length = j - newStart + 1;
+                while (oldStart + length < oldEnd && newStart + length < newEnd
+                       && m_old.ids[size_t(oldStart + length)] == m_new.ids[size_t(newStart + length)]) {
+                    count = qMin(count, m_occurrences[size_t(m_old.ids[size_t(oldStart + length)])]);
+                    ++length;
+                }
+                next = qMax(next, newStart + length);
+                if (bestOld < 0 || length > bestLength || count < bestCount) {
+                    bestCount = count;
+                    bestOld = oldStart;
+                    bestNew = newStart;
+                    bestLength = length;
+                }
+            }
+        }
+        j = next;
+    }
+
+    // 递归前清空本区间用到的项
+    for (int i = oldBegin; i < oldEnd; ++i) {
+        const int id = m_old.ids[size_t(i)];
+        m_firstPosition[size_t(id)] = -1;
+        m_occurrences[size_t(id)] = 0;
+    }
+
+    // 公共行都出现得太多次，交给Myers
+    if (bestOld < 0) {
+        classicDiff(oldBegin, oldEnd, newBegin, newEnd);
+        return;
+    }
+    histogram(oldBegin, bestOld, newBegin, bestNew, depth + 1);
+    histogram(bestOld + bestLength, oldEnd, bestNew + bestLength, newEnd, depth + 1);
+}
+
+void GitLineDiff::compact(Side *side, Side *other)
+{
+    // 与xdiff的xdl_change_compact相同（包括git默认打开的缩进启发），changed末尾有一个哨兵
+    const int count = int(side->ids.size());
+    const int otherCount = int(other->ids.size());
+    std::vector<char> &changed = side->changed;
+    std::vector<char> &otherChanged = other->changed;
+
+    auto initGroup = [](const std::vector<char> &flags, Group *group) {
+        group->start = 0;
+        group->end = 0;
+        while (flags[size_t(group->end)]) {
+            ++group->end;
+        }
+    };
+    auto nextGroup = [](const std::vector<char> &flags, int total, Group *group) {
+        if (group->end == total) {
+            return false;
+        }
+        group->start = group->end + 1;
+        group->end = group->start;
+        while (flags[size_t(group->end)]) {
+            ++group->end;
+        }
+        return true;
+    };
+    auto previousGroup = [](const std::vector<char> &flags, Group *group) {
+        if (group->start == 0) {
+            return false;
+        }
+        group->end = group->start - 1;
+        group->start = group->end;
+        while (group->start > 0 && flags[size_t(group->start - 1)]) {
+            --group->start;
+        }
+        return true;
+    };
+    auto slideDown = [side, count, &changed](Group *group) {
+        if (group->end >= count || side->ids[size_t(group->start)] != side->ids[size_t(group->end)]) {
+            return false;
+        }
+        changed[size_t(group->start++)] = 0;
+        changed[size_t(group->end++)] = 1;
+        while (changed[size_t(group->end)]) {
+            ++group->end;
+        }
+        return true;
+    };
+    auto slideUp = [side, &changed](Group *group) {
+        if (group->start == 0 || side->ids[size_t(group->start - 1)] != side->ids[size_t(group->end - 1)]) {
+            return false;
+        }
+        changed[size_t(--group->start)] = 1;
+        changed[size_t(--group->end)] = 0;
+        while (group->start > 0 && changed[size_t(group->start - 1)]) {
+            --group->start;
+        }
+        return true;
+    };
+
+    // 在split行之前分割时，该行和前后非空行的缩进以及中间的空行数
+    auto measureSplit = [this, side, count](int split) {
+        SplitMeasurement m;
+        if (split >= count) {
+            m.endOfFile = true;
+        } else {
+            m.indent = lineIndent(lineAt(*side, split));
+        }
+        for (int i = split - 1; i >= 0; --i) {
+            m.preIndent = lineIndent(lineAt(*side, i));
+            if (m.preIndent != -1) {
+                break;
+            }
+            if (++m.preBlank == MaxBlanks) {
+                m.preIndent = 0;
+                break;
+            }
+        }
+        for (int i = split + 1; i < count; ++i) {
+            m.postIndent = lineIndent(lineAt(*side, i));
+            if (m.postIndent != -1) {
+                break;
+            }
+            if (++m.postBlank == MaxBlanks) {
+                m.postIndent = 0;
+                break;
+            }
+        }
+        return m;
+    };
+
+    Group group;
+    Group otherGroup;
+    initGroup(changed, &group);
+    initGroup(otherChanged, &otherGroup);
+    while (true) {
+        if (group.end != group.start) {
+            int size;
+            int earliestEnd;
+            int endMatchingOther;
+            do {
+                size = group.end - group.start;
+                endMatchingOther = -1;
+                // 先尽量上移，合并途中遇到的组
+                while (slideUp(&group)) {
+                    previousGroup(otherChanged, &otherGroup);
+                }
+                earliestEnd = group.end;
+                if (otherGroup.end > otherGroup.start) {
+                    endMatchingOther = group.end;
+                }
+                // 再尽量下移
+                while (slideDown(&group)) {
+                    nextGroup(otherChanged, otherCount, &otherGroup);
+                    if (otherGroup.end > otherGroup.start) {
+                        endMatchingOther = group.end;
+                    }
+                }
+            } while (size != group.end - group.start);
+
+            if (group.end == earliestEnd) {
+                // 无法移动
+            } else if (endMatchingOther != -1) {
+                // 能与另一边的修改相邻时回到那个位置，两边的修改显示在一起
+                while (otherGroup.end == otherGroup.start) {
+                    slideUp(&group);
+                    previousGroup(otherChanged, &otherGroup);
+                }
+            } else {
+                // 缩进启发：按组前后两个分割点的缩进和空行评分，移到得分最低的位置
+                int shift = qMax(earliestEnd, qMax(group.end - size - 1, group.end - IndentMaxSliding));
+                int bestShift = -1;
+                SplitScore bestScore;
+                for (; shift <= group.end; ++shift) {
+                    SplitScore score;
+                    addSplitScore(measureSplit(shift), &score);
+                    addSplitScore(measureSplit(shift - size), &score);
+                    if (bestShift == -1 || compareScores(score, bestScore) <= 0) {
+                        bestScore = score;
+                        bestShift = shift;
+                    }
+                }
+                while (group.end > bestShift) {
+                    slideUp(&group);
+                    previousGroup(otherChanged, &otherGroup);
+                }
+            }
+        }
+        if (!nextGroup(changed, count, &group)) {
+            break;
+        }
+        nextGroup(otherChanged, otherCount, &otherGroup);
+    }
+}
+
+QByteArray GitLineDiff::functionContext(int line) const
+{
+    // 与git默认的规则相同：向上找到第一行以字母、下划线或$开头的行
+    for (int i = line; i >= 0; --i) {
+        const QByteArrayView text = lineAt(m_old, i);
+        if (text.isEmpty()) {
+            continue;
+        }
+        const char c = text[0];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$') {
+            qsizetype length = qMin<qsizetype>(text.size(), FunctionContextLength);
+            while (length > 0 && isSpace(text[length - 1])) {
+                --length;
+            }
+            return text.first(length).toByteArray();
+        }
+    }
+    return QByteArray();
+}
@@ -0,0 +1,111 @@
+#ifndef GITLINEDIFF_H
+#define GITLINEDIFF_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QList>
+#include <vector>
+
+// 进程内的逐行差异：两边的行先按内容编号，比较只在整数序列上进行。
+// Myers算法用线性空间的中间蛇分治，编辑距离过大时在最远点截断；
+// histogram算法以出现次数最少的公共行为锚点递归，找不到锚点的区间交给Myers。
+// 输出与git diff相同格式的补丁，供DiffView直接显示
+class GitLineDiff
+{
+public:
+    enum Algorithm {
+        Myers,
+        Histogram
+    };
+
+    // 文件头需要的信息，oid为十六进制对象ID
+    struct FileHeader {
+        QByteArray path;
+        QByteArray oldOid;
+        QByteArray newOid;
+        quint32 mode = 0100644;
+    };
+
+    // 不复制数据，两边的内容在对象销毁前必须保持有效
+    GitLineDiff(const QByteArray &oldData, const QByteArray &newData);
+
+    void compute(Algorithm algorithm);
+    // 从第一个@@行开始的补丁正文，两边相同时为空
+    QByteArray unifiedHunks(int context = 3) const;
+
+    // 与git diff的输出相同：diff --git文件头加上补丁，二进制文件只有一行说明
+    static QByteArray fileDiff(const FileHeader &header, const QByteArray &oldData, const QByteArray &newData,
+                               Algorithm algorithm, int context = 3);
+    // 与git相同，前8000字节中有NUL即视为二进制
+    static bool isBinary(const QByteArray &data);
+    static Algorithm algorithmFromName(const QString &name);
+
+private:
+    // 行在另一边的匹配情况
+    enum MatchKind : char {
+        NoMatch,
+        Matched,
+        ManyMatches
+    };
+
+    // 参与Myers比较的行：编号和原来的行号
+    struct Record {
+        int id;
+        int line;
+    };
+
+    // 分割点，以及两侧的子问题是否必须求最短差异
+    struct Split {
+        int a = 0;
+        int b = 0;
+        bool minimalBefore = false;
+        bool minimalAfter = false;
+    };
+
+    struct Side {
+        QByteArrayView data;
+        QList<qsizetype> lineOffsets; // 每行的起始偏移，最后一项为数据长度
+        std::vector<int> ids;         // 内容相同的行编号相同，从1开始
+        std::vector<char> changed;
+    };
+
+    void splitLines(Side *side);
+    QByteArrayView lineAt(const Side &side, int line) const;
+
+    // 区间为[oldBegin, oldEnd)和[newBegin, newEnd)，结果写入changed
+    void histogram(int oldBegin, int oldEnd, int newBegin, int newEnd, int depth);
+    // 与xdiff相同：去掉两端相同的行和另一边没有的行，剩下的交给Myers
+    void classicDiff(int oldBegin, int oldEnd, int newBegin, int newEnd);
+    static bool discardMultipleMatch(const std::vector<char> &kinds, int i);
+    // 去掉区间两端相同的行，有一边为空时直接标记另一边，返回是否还需要比较
+    bool trim(int *oldBegin, int *oldEnd, int *newBegin, int *newEnd);
+    // 以下在m_a、m_b的下标上进行；minimal为false时允许在代价过高时放弃最短
+    void myers(int aBegin, int aEnd, int bBegin, int bEnd, bool minimal);
+    Split findSplit(int aBegin, int aEnd, int bBegin, int bEnd, bool minimal);
+    void markChanged(int aBegin, int aEnd, int bBegin, int bEnd);
+    // 与git相同，把每组修改尽量下移，能与另一边的修改对齐时停在对齐的位置，
+    // 否则按前后的缩进和空行选择位置
+    void compact(Side *side, Side *other);
+    QByteArray functionContext(int line) const;
+
+    Side m_old;
+    Side m_new;
+    int m_lineKinds;
+    // Myers比较的两个序列，各层递归共用
+    std::vector<Record> m_a;
+    std::vector<Record> m_b;
+    int m_maxCost;
+    // 中间蛇搜索的前向和后向最远点，按对角线编号存放，下标偏移m_b.size() + 1
+    std::vector<int> m_forward;
+    std::vector<int> m_backward;
+    // 按行编号索引：区间内在两边各出现的次数
+    std::vector<int> m_oldCounts;
+    std::vector<int> m_newCounts;
+    // histogram算法按行编号索引的出现次数和第一个位置，以及旧文件中同一编号的下一个位置
+    std::vector<int> m_occurrences;
+    std::vector<int> m_firstPosition;
+    std::vector<int> m_nextPosition;
+};
+
+#endif // GITLINEDIFF_H
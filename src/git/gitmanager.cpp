@@ -1,15 +1,215 @@
 #include "gitmanager.h"
+#include "gitlinediff.h"
 #include <QDir>
+#include <QSettings>
+#include <QDateTime>
+#include <QTimeZone>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+#include <QCryptographicHash>
+#include <queue>
+#include <memory>
 #include <QDebug>
 
+namespace {
+// 增量刷新状态时最多传给git的路径数，超过后直接全量刷新
+const int MaxIncrementalStatusPaths = 200;
+// 需要git计算领先/落后的分支超过这个数时不再逐个列出，直接查询全部本地分支
+const int MaxTrackingRefPatterns = 200;
+// 领先/落后缓存的条目上限，超过后清空重新积累
+const int MaxAheadBehindCacheEntries = 4096;
+// 标签的标签最多解引用的层数
+const int MaxTagPeelDepth = 10;
+// 工作树停止变化这么久（毫秒）后推进fsmonitor令牌
+const int FsmonitorTokenDelay = 5000;
+
+// 与--date=short一致，使用作者所在时区的日期
+QString shortDate(qint64 time, int offsetSeconds)
+{
+    return QDateTime::fromSecsSinceEpoch(time, QTimeZone::fromSecondsAheadOfUtc(offsetSeconds)).toString("yyyy-MM-dd");
+}
+
+// 文件的修改时间和大小，文件不存在时同样记录
+void appendFileStamp(QByteArray *fingerprint, const QString &path)
+{
+    const QFileInfo info(path);
+    fingerprint->append(QByteArray::number(info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1));
+    fingerprint->append(':');
+    fingerprint->append(QByteArray::number(info.size()));
+    fingerprint->append(';');
+}
+
+// 分页历史中比当前位置新这么多（秒）的已输出提交不再保留，容忍这个范围内的时钟偏差
+const qint64 HistoryEmittedSlack = 24 * 3600;
+
+// 只由大写字母和下划线组成的名称，git先在gitDir中按伪引用查找
+bool isPseudoRefName(const QString &name)
+{
+    if (name.isEmpty()) {
+        return false;
+    }
+    for (QChar c : name) {
+        if (!((c >= 'A' && c <= 'Z') || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 进程内差异的任务ID从这里开始，与调度器分配的ID不会重复
+const quint64 FirstNativeDiffJob = quint64(1) << 63;
+
+// 在差异线程中比较所需的全部信息，不引用GitManager的成员
+struct NativeDiffRequest {
+    QString fullPath;
+    GitLineDiff::FileHeader header;
+    QByteArray oldData;
+    GitLineDiff::Algorithm algorithm = GitLineDiff::Myers;
+};
+
+// 与core.quotePath的默认值一致，git会给这些路径加引号和转义，交给git输出
+bool needsQuoting(const QByteArray &path)
+{
+    for (char c : path) {
+        const uchar byte = uchar(c);
+        if (byte < 0x20 || byte >= 0x7f || c == '"' || c == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 读取工作树文件并计算差异，文件读取失败时返回false
+bool runNativeDiff(NativeDiffRequest request, QByteArray *diff)
+{
+    QFile file(request.fullPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray newData = file.readAll();
+    if (file.error() != QFileDevice::NoError) {
+        return false;
+    }
+
+    QCryptographicHash hash(request.header.oldOid.size() == 64 ? QCryptographicHash::Sha256 : QCryptographicHash::Sha1);
+    hash.addData("blob " + QByteArray::number(newData.size()) + '\0');
+    hash.addData(newData);
+    request.header.newOid = hash.result().toHex();
+    *diff = GitLineDiff::fileDiff(request.header, request.oldData, newData, request.algorithm);
+    return true;
+}
+}
+
+// 分页遍历提交历史的状态：队列中只保存尚未输出的提交，每页从上次停下的位置继续
+struct GitManager::HistoryWalk {
+    struct QueuedCommit {
+        qint64 commitTime;
+        quint64 order;
+        GitCommitCache::Commit commit;
+        bool loaded; // 只从commit-graph取得父提交和时间时为false，输出前再读取作者和标题
+    };
+    // 与git log默认顺序一致：按提交时间从新到旧，时间相同时先入队的优先
+    struct Later {
+        bool operator()(const QueuedCommit &a, const QueuedCommit &b) const
+        {
+            if (a.commitTime != b.commitTime) {
+                return a.commitTime < b.commitTime;
+            }
+            return a.order > b.order;
+        }
+    };
+
+    quint64 generation = 0;
+    bool native = false;  // 进程内遍历失败后由git log从边界继续
+    int produced = 0;     // 已输出的提交数
+    bool finished = false;
+    std::priority_queue<QueuedCommit, std::vector<QueuedCommit>, Later> queue;
+    QSet<QByteArray> seen;
+    quint64 order = 0;
+    // 已输出的提交（-> 提交时间）和边界（子提交已输出而自身还没有输出的提交）。git log每页只从边界开始遍历，
+    // 不必像--skip那样重新走过之前所有的提交；时钟偏差时git可能再次输出已输出的提交，按emitted过滤
+    QHash<QByteArray, qint64> emitted;
+    QSet<QByteArray> frontier;
+
+    // 历史按提交时间从新到旧输出，祖先不会比后代新；比当前位置新出一段的提交不会再从边界到达，
+    // 删除它们，emitted只保留当前位置附近的提交
+    void pruneEmitted(qint64 position)
+    {
+        for (auto it = emitted.begin(); it != emitted.end();) {
+            if (it.value() > position + HistoryEmittedSlack) {
+                it = emitted.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
 GitManager::GitManager(QObject *parent)
-    : QObject(parent), m_process(new QProcess(this))
+    : QObject(parent),
+      m_process(new QProcess(this)),
+      m_scheduler(new GitJobScheduler(this)),
+      m_repositoryGeneration(0),
+      m_catFile(nullptr),
+      m_catFileCheck(nullptr),
+      m_objectDatabase(nullptr),
+      m_refDatabase(nullptr),
+      m_commitCache(nullptr),
+      m_searchIndex(nullptr),
+      m_commitGraph(nullptr),
+      m_statusEngine(nullptr),
+      m_watcher(new GitWorkTreeWatcher(this)),
+      m_historyWalkGeneration(0),
+      m_fsmonitor(new GitFsMonitor(this)),
+      m_fsmonitorEnabled(false),
+      m_fsmonitorTokenTimer(new QTimer(this)),
+      m_diffThread(new QThread(this)),
+      m_diffWorker(new QObject),
+      m_nextNativeDiffJob(FirstNativeDiffJob)
 {
     m_process->setProcessChannelMode(QProcess::MergedChannels);
+
+    QSettings settings;
+    m_scheduler->setMaxConcurrentProcesses(settings.value("git/max_concurrent_processes", 4).toInt());
+    connect(m_scheduler, &GitJobScheduler::jobFinished, this, &GitManager::onJobFinished);
+
+    connect(m_watcher, &GitWorkTreeWatcher::workTreeChanged, this, [this](const QStringList &paths) {
+        refreshFileStatusAsync(paths);
+        if (m_fsmonitorEnabled) {
+            m_fsmonitorTokenTimer->start();
+        }
+    });
+    m_fsmonitorTokenTimer->setSingleShot(true);
+    m_fsmonitorTokenTimer->setInterval(FsmonitorTokenDelay);
+    connect(m_fsmonitorTokenTimer, &QTimer::timeout, this, &GitManager::advanceFsmonitorToken);
+    connect(m_watcher, &GitWorkTreeWatcher::repositoryChanged, this, &GitManager::repositoryStateChanged);
+
+    m_diffThread->setObjectName("NativeDiff");
+    m_diffWorker->moveToThread(m_diffThread);
+    connect(m_diffThread, &QThread::finished, m_diffWorker, &QObject::deleteLater);
+    m_diffThread->start();
 }
 
 GitManager::~GitManager()
 {
+    // 等待正在计算的差异结束，之后排队的结果随本对象一起丢弃
+    m_diffThread->quit();
+    m_diffThread->wait();
+    // 调度器析构时终止所有git进程，且不再触发回调
+    delete m_scheduler;
+    delete m_catFile;
+    delete m_catFileCheck;
+    delete m_statusEngine;
+    saveCommitCache();
+    delete m_commitCache;
+    delete m_searchIndex;
+    delete m_commitGraph;
+    delete m_objectDatabase;
+    delete m_refDatabase;
     delete m_process;
 }
 
@@ -22,6 +222,89 @@ bool GitManager::openRepository(const QString &path)
     }
 
     m_currentRepository = path;
+    ++m_repositoryGeneration;
+    m_historyWalk.reset();
+    m_snapshot = RepositorySnapshot();
+    m_aheadBehindCache.clear();
+
+    // cat-file进程绑定到仓库，切换仓库时重建
+    delete m_catFile;
+    delete m_catFileCheck;
+    m_catFile = new GitCatFile(GitCatFile::Batch, path, this);
+    m_catFileCheck = new GitCatFile(GitCatFile::BatchCheck, path, this);
+
+    // 对象库打开失败时，所有读取都回退到git命令；状态引擎引用对象库，先释放
+    delete m_statusEngine;
+    m_statusEngine = nullptr;
+    saveCommitCache();
+    delete m_commitCache;
+    m_commitCache = nullptr;
+    delete m_searchIndex;
+    m_searchIndex = nullptr;
+    delete m_commitGraph;
+    m_commitGraph = nullptr;
+    delete m_objectDatabase;
+    delete m_refDatabase;
+    m_gitDir = GitObjectDatabase::resolveGitDir(path);
+    m_refDatabase = new GitRefDatabase(m_gitDir);
+    m_objectDatabase = new GitObjectDatabase(m_gitDir);
+    if (m_objectDatabase->open()) {
+        // 缓存中的提交不必再从对象库读取和解析，重新打开时历史可以直接显示
+        m_commitCache = new GitCommitCache(GitCommitCache::cachePath(m_gitDir), m_objectDatabase->hashSize());
+        m_commitCache->load();
+        m_searchIndex = new GitCommitSearchIndex(GitCommitSearchIndex::indexPath(m_gitDir), m_objectDatabase->hashSize());
+        m_searchIndex->load();
+        // 没有commit-graph文件时保持关闭，提交关系查询使用git命令
+        m_commitGraph = new GitCommitGraph(m_objectDatabase->objectsDirectory(), m_objectDatabase->hashSize());
+        m_commitGraph->open();
+    } else {
+        qDebug() << "无法打开对象库，将使用git命令读取对象:" << m_gitDir;
+    }
+    m_statusEngine = new GitStatusEngine(path, m_gitDir, m_objectDatabase);
+
+    // 被忽略的目录（构建输出等）变化频繁且与状态无关，先列出来再开始监视
+    m_watcher->stop();
+    QStringList ignoredArgs;
+    ignoredArgs << "ls-files" << "--others" << "--ignored" << "--exclude-standard" << "--directory" << "-z";
+    executeCommandAsync(ignoredArgs, [this, path](bool success, const QByteArray &output) {
+        QStringList ignoredDirectories;
+        if (success) {
+            const QList<QByteArray> entries = output.split('\0');
+            for (const QByteArray &entry : entries) {
+                if (entry.endsWith('/')) {
+                    ignoredDirectories.append(QString::fromUtf8(entry));
+                }
+            }
+        }
+        m_watcher->start(path, m_gitDir, ignoredDirectories);
+    }, GitJobScheduler::Background);
+
+    // 仓库配置了本程序的fsmonitor钩子时启动服务
+    m_fsmonitor->stop();
+    m_fsmonitorTokenTimer->stop();
+    m_fsmonitorEnabled = false;
+    emit fsmonitorStateChanged(false);
+    if (GitFsMonitor::isSupported()) {
+        QStringList fsmonitorArgs;
+        fsmonitorArgs << "config" << "--local" << "--default" << "" << "--get" << "core.fsmonitor";
+        executeCommandAsync(fsmonitorArgs, [this, path](bool success, const QByteArray &output) {
+            const QString command = QString::fromUtf8(output).trimmed();
+            if (!success || !command.contains("summercake-fsmonitor-hook")) {
+                return;
+            }
+            // 程序位置变化后钩子命令也要更新
+            const QString hookCommand = GitFsMonitor::hookCommand(m_gitDir);
+            if (command != hookCommand) {
+                QStringList args;
+                args << "config" << "--local" << "core.fsmonitor" << hookCommand;
+                executeMutationAsync(args, nullptr);
+            }
+            m_fsmonitor->start(path, m_gitDir);
+            m_fsmonitorEnabled = true;
+            emit fsmonitorStateChanged(true);
+        }, GitJobScheduler::Background);
+    }
+
     emit repositoryOpened(path);
     return true;
 }
@@ -107,161 +390,1604 @@ QString GitManager::executeCommand(const QStringList &args, bool *success)
     return output;
 }
 
-GitManager::FileStatus GitManager::parseFileStatus(const QString &statusCode)
+QByteArray GitManager::executeReadCommand(const QStringList &args, bool *success)
+{
+    if (m_currentRepository.isEmpty()) {
+        if (success) *success = false;
+        emit errorOccurred("未打开任何仓库");
+        return QByteArray();
+    }
+
+    // m_process合并了标准输出和标准错误，解析二进制输出时单独启动进程，与调度器中的只读任务一样不获取可选锁
+    QProcess process;
+    QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+    environment.insert("GIT_OPTIONAL_LOCKS", "0");
+    process.setProcessEnvironment(environment);
+    process.setWorkingDirectory(m_currentRepository);
+    process.start("git", args);
+
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        if (success) *success = false;
+        QString error = QString::fromUtf8(process.readAllStandardError());
+        if (error.isEmpty()) {
+            error = process.errorString();
+        }
+        emit errorOccurred(error);
+        return QByteArray();
+    }
+
+    if (success) *success = true;
+    return process.readAllStandardOutput();
+}
+
+void GitManager::executeCommandAsync(const QStringList &args, CommandCallback callback,
+                                     GitJobScheduler::Priority priority, bool mutating, const QByteArray &input)
+{
+    if (m_currentRepository.isEmpty()) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(false, QByteArray());
+        return;
+    }
+
+    GitJobScheduler::Job job;
+    job.args = args;
+    job.workingDirectory = m_currentRepository;
+    job.priority = priority;
+    job.mutating = mutating;
+    job.input = input;
+
+    // 仓库在命令执行期间被切换时，丢弃旧仓库的结果
+    const quint64 generation = m_repositoryGeneration;
+    m_scheduler->submit(job, [this, generation, callback](bool success, const QByteArray &output) {
+        if (generation != m_repositoryGeneration) {
+            return;
+        }
+        if (callback) callback(success, output);
+    });
+}
+
+quint64 GitManager::executeStreamingAsync(const QStringList &args, GitJobScheduler::OutputCallback outputCallback,
+                                          CommandCallback callback, GitJobScheduler::Priority priority)
+{
+    if (m_currentRepository.isEmpty()) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(false, QByteArray());
+        return 0;
+    }
+
+    const quint64 generation = m_repositoryGeneration;
+    GitJobScheduler::Job job;
+    job.args = args;
+    job.workingDirectory = m_currentRepository;
+    job.priority = priority;
+    job.outputCallback = [this, generation, outputCallback](const QByteArray &chunk) {
+        if (generation == m_repositoryGeneration && outputCallback) {
+            outputCallback(chunk);
+        }
+    };
+
+    return m_scheduler->submit(job, [this, generation, callback](bool success, const QByteArray &output) {
+        if (generation != m_repositoryGeneration) {
+            return;
+        }
+        if (callback) callback(success, output);
+    });
+}
+
+void GitManager::executeMutationAsync(const QStringList &args, std::function<void(bool)> callback,
+                                      const QByteArray &input)
+{
+    // 自己修改的索引和引用由调用方刷新，不需要监视器再触发全量刷新
+    m_watcher->beginRepositoryUpdate();
+    executeCommandAsync(args, [this, callback](bool success, const QByteArray &) {
+        m_watcher->endRepositoryUpdate();
+        // 自己执行的修改不依赖事件计数，直接作废快照
+        m_snapshot = RepositorySnapshot();
+
+        // 变更可能产生新的包文件，重新扫描对象库
+        if (m_objectDatabase && m_objectDatabase->isOpen()) {
+            m_objectDatabase->open();
+        }
+        if (callback) callback(success);
+    }, GitJobScheduler::Interactive, true, input);
+}
+
+void GitManager::executeRemoteAsync(const QStringList &args, std::function<void(bool)> callback)
+{
+    if (m_currentRepository.isEmpty()) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(false);
+        return;
+    }
+
+    GitJobScheduler::Job job;
+    job.args = args;
+    job.workingDirectory = m_currentRepository;
+    job.priority = GitJobScheduler::Interactive;
+    job.mutating = true;
+    job.blocksReads = false;
+
+    const quint64 generation = m_repositoryGeneration;
+    m_scheduler->submit(job, [this, generation, callback](bool success, const QByteArray &) {
+        if (generation != m_repositoryGeneration) {
+            return;
+        }
+        // 远程跟踪引用变了，fetch还可能带来新的包文件
+        m_snapshot = RepositorySnapshot();
+        if (m_objectDatabase && m_objectDatabase->isOpen()) {
+            m_objectDatabase->open();
+        }
+        if (callback) callback(success);
+    });
+}
+
+void GitManager::executePathspecMutationAsync(const QStringList &args, const QStringList &paths,
+                                              std::function<void(bool)> callback)
+{
+    if (paths.isEmpty()) {
+        if (callback) callback(true);
+        return;
+    }
+
+    // 路径按字面匹配，以\0分隔，不受命令行长度限制
+    QByteArray input;
+    for (const QString &path : paths) {
+        input.append(path.toUtf8());
+        input.append('\0');
+    }
+    QStringList fullArgs;
+    fullArgs << "--literal-pathspecs" << args << "--pathspec-from-file=-" << "--pathspec-file-nul";
+    executeMutationAsync(fullArgs, callback, input);
+}
+
+void GitManager::onJobFinished(const QStringList &args, bool success, const QByteArray &output, const QString &error)
+{
+    if (success) {
+        emit commandExecuted("git " + args.join(" "), QString::fromUtf8(output));
+    } else {
+        emit errorOccurred(error);
+    }
+}
+
+bool GitManager::cancelJob(quint64 jobId)
+{
+    if (m_nativeDiffJobs.remove(jobId)) {
+        return true;
+    }
+    return jobId != 0 && m_scheduler->cancel(jobId);
+}
+
+void GitManager::setMaxConcurrentProcesses(int count)
 {
-    if (statusCode == "M") return Modified;
-    if (statusCode == "A") return Staged;
-    if (statusCode == "??") return Untracked;
-    if (statusCode == "D") return Deleted;
-    if (statusCode == "R") return Renamed;
-    if (statusCode == "!!") return Ignored;
+    m_scheduler->setMaxConcurrentProcesses(count);
+}
+
+int GitManager::maxConcurrentProcesses() const
+{
+    return m_scheduler->maxConcurrentProcesses();
+}
+
+GitManager::FileStatus GitManager::parseFileStatus(char index, char worktree)
+{
+    if (index == '?') return Untracked;
+    if (index == '!') return Ignored;
+    if (index == 'R' || index == 'C') return Renamed;
+    if (index == 'U' || worktree == 'U' || (index == 'A' && worktree == 'A') || (index == 'D' && worktree == 'D')) return Unknown;
+    if (index == 'D' || worktree == 'D') return Deleted;
+    if (index == 'A' || worktree == 'A') return Staged;
+    if (index == 'M' || worktree == 'M' || index == 'T' || worktree == 'T') return Modified;
     return Unknown;
 }
 
-QList<GitManager::FileInfo> GitManager::getFileStatus()
-{
-    QList<FileInfo> fileList;
+QStringList GitManager::fileStatusArgs() const
+{
+    QStringList args;
+    args << "status" << "--porcelain=v2" << "-z" << "--branch" << "--ignore-submodules";
+    return args;
+}
+
+GitManager::FileInfo GitManager::fileInfoFromRecord(const GitStatusParser::Record &record)
+{
+    FileInfo file;
+    file.path = QString::fromUtf8(record.path);
+    if (!record.originalPath.isEmpty()) {
+        file.oldPath = QString::fromUtf8(record.originalPath);
+    }
+    file.indexStatus = record.index;
+    file.worktreeStatus = record.worktree;
+    file.status = parseFileStatus(record.index, record.worktree);
+    return file;
+}
+
+QList<GitManager::FileInfo> GitManager::getFileStatus()
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasStatus);
+    if (snapshot && snapshot->hasStatus) {
+        return snapshot->status;
+    }
+
+    // 与异步接口一样把原始字节直接交给解析器，路径不经过QString往返
+    bool success;
+    const QByteArray output = executeReadCommand(fileStatusArgs(), &success);
+    if (!success) return QList<FileInfo>();
+
+    QList<FileInfo> fileList;
+    GitStatusParser parser([&fileList](const GitStatusParser::Record &record) {
+        fileList.append(fileInfoFromRecord(record));
+    });
+    parser.feed(output);
+    if (parser.finish() && snapshot) {
+        snapshot->hasStatus = true;
+        snapshot->status = fileList;
+        snapshot->branchStatus = parser.branchStatus();
+    }
+    return fileList;
+}
+
+void GitManager::getFileStatusAsync(std::function<void(const QList<FileInfo> &)> callback)
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasStatus);
+    if (snapshot && snapshot->hasStatus) {
+        const quint64 generation = m_repositoryGeneration;
+        const QList<FileInfo> fileList = snapshot->status;
+        const GitStatusParser::BranchStatus branch = snapshot->branchStatus;
+        QMetaObject::invokeMethod(this, [this, generation, fileList, branch, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            emit branchStatusReady(branch.head, branch.upstream, branch.ahead, branch.behind);
+            if (callback) callback(fileList);
+            emit fileStatusReady(fileList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const QByteArray fingerprint = snapshot ? snapshot->fingerprint : QByteArray();
+
+    // 边读取边解析，大量文件时不必等待全部输出，也不需要保留完整的输出
+    auto fileList = std::make_shared<QList<FileInfo>>();
+    auto parser = std::make_shared<GitStatusParser>([fileList](const GitStatusParser::Record &record) {
+        fileList->append(fileInfoFromRecord(record));
+    });
+
+    executeStreamingAsync(fileStatusArgs(), [parser](const QByteArray &chunk) {
+        parser->feed(chunk);
+    }, [this, parser, fileList, fingerprint, callback](bool success, const QByteArray &) {
+        if (!parser->finish() || !success) {
+            fileList->clear();
+        } else {
+            const GitStatusParser::BranchStatus &branch = parser->branchStatus();
+            if (RepositorySnapshot *snapshot = snapshotFor(fingerprint)) {
+                snapshot->hasStatus = true;
+                snapshot->status = *fileList;
+                snapshot->branchStatus = branch;
+            }
+            emit branchStatusReady(branch.head, branch.upstream, branch.ahead, branch.behind);
+        }
+        if (callback) callback(*fileList);
+        emit fileStatusReady(*fileList);
+    });
+}
+
+void GitManager::refreshFileStatusAsync(const QStringList &paths,
+                                        std::function<void(const QStringList &, const QList<FileInfo> &)> callback)
+{
+    // 没有具体路径时退回全量刷新，结果通过fileStatusReady返回
+    if (paths.isEmpty()) {
+        getFileStatusAsync();
+        return;
+    }
+
+    const quint64 generation = m_repositoryGeneration;
+
+    // 都是已跟踪的文件时只需要lstat，不启动git进程；批量暂存后的大量路径也走这里
+    QList<FileInfo> tracked;
+    if (m_statusEngine && m_statusEngine->isTracked(paths) && getTrackedFileStatus(paths, &tracked)) {
+        QMetaObject::invokeMethod(this, [this, generation, paths, tracked, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(paths, tracked);
+            emit fileStatusUpdated(paths, tracked);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    // 包含目录或新文件时，用pathspec限定git status的范围，仍能发现未跟踪文件；
+    // pathspec放在命令行上，路径太多时退回全量刷新
+    if (paths.size() > MaxIncrementalStatusPaths) {
+        getFileStatusAsync();
+        return;
+    }
+    QStringList args;
+    args << "--literal-pathspecs" << "status" << "--porcelain=v2" << "-z" << "--ignore-submodules" << "--";
+    args << paths;
+
+    auto fileList = std::make_shared<QList<FileInfo>>();
+    auto parser = std::make_shared<GitStatusParser>([fileList](const GitStatusParser::Record &record) {
+        fileList->append(fileInfoFromRecord(record));
+    });
+    executeStreamingAsync(args, [parser](const QByteArray &chunk) {
+        parser->feed(chunk);
+    }, [this, parser, fileList, paths, callback](bool success, const QByteArray &) {
+        if (!parser->finish() || !success) {
+            return;
+        }
+        if (callback) callback(paths, *fileList);
+        emit fileStatusUpdated(paths, *fileList);
+    }, GitJobScheduler::Background);
+}
+
+bool GitManager::getTrackedFileStatus(const QStringList &paths, QList<FileInfo> *fileStatus)
+{
+    if (!m_statusEngine) {
+        return false;
+    }
+
+    // 只有HEAD确实指向还没有提交的分支时才按空的HEAD树比较，其他解析失败交给git
+    const QByteArray head = resolveRevisionNative("HEAD");
+    const bool unborn = head.isEmpty() && m_refDatabase && m_refDatabase->isUnbornHead();
+    QList<GitStatusEngine::Change> changes;
+    if (!m_statusEngine->status(head, unborn, paths, &changes)) {
+        return false;
+    }
+
+    fileStatus->clear();
+    for (const GitStatusEngine::Change &change : changes) {
+        FileInfo file;
+        file.path = QString::fromUtf8(change.path);
+        file.oldPath = QString::fromUtf8(change.oldPath);
+        file.indexStatus = change.index;
+        file.worktreeStatus = change.worktree;
+        file.status = parseFileStatus(change.index, change.worktree);
+        fileStatus->append(file);
+    }
+    return true;
+}
+
+bool GitManager::isFsmonitorSupported() const
+{
+    return GitFsMonitor::isSupported();
+}
+
+bool GitManager::isFsmonitorEnabled() const
+{
+    return m_fsmonitorEnabled;
+}
+
+void GitManager::setFsmonitorEnabledAsync(bool enabled, std::function<void(bool)> callback)
+{
+    if (m_currentRepository.isEmpty()) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(false);
+        return;
+    }
+    if (enabled && !GitFsMonitor::isSupported()) {
+        emit errorOccurred("当前平台不支持内置的文件系统监视");
+        if (callback) callback(false);
+        return;
+    }
+    if (enabled == m_fsmonitorEnabled) {
+        if (callback) callback(true);
+        return;
+    }
+
+    if (!enabled) {
+        // 先停止服务再删除配置，期间git钩子连接失败会自行扫描工作树；
+        // 未跟踪文件缓存不依赖fsmonitor，保留
+        m_fsmonitor->stop();
+        m_fsmonitorTokenTimer->stop();
+        m_fsmonitorEnabled = false;
+        emit fsmonitorStateChanged(false);
+        QStringList args;
+        args << "config" << "--local" << "--unset" << "core.fsmonitor";
+        executeMutationAsync(args, callback);
+        return;
+    }
+
+    m_fsmonitorEnabled = true;
+    emit fsmonitorStateChanged(true);
+
+    // 未跟踪文件缓存配合fsmonitor，git status才能跳过没有变化的目录
+    QStringList cacheArgs;
+    cacheArgs << "config" << "--local" << "core.untrackedCache" << "true";
+    executeMutationAsync(cacheArgs, nullptr);
+
+    const quint64 generation = m_repositoryGeneration;
+    m_fsmonitor->start(m_currentRepository, m_gitDir, [this, generation, callback](bool serving) {
+        if (generation != m_repositoryGeneration) {
+            return;
+        }
+        if (!serving) {
+            m_fsmonitorEnabled = false;
+            emit fsmonitorStateChanged(false);
+            emit errorOccurred("无法启动文件系统监视服务");
+            if (callback) callback(false);
+            return;
+        }
+
+        QStringList configArgs;
+        configArgs << "config" << "--local" << "core.fsmonitor" << GitFsMonitor::hookCommand(m_gitDir);
+        executeMutationAsync(configArgs, [this, callback](bool success) {
+            if (!success) {
+                m_fsmonitor->stop();
+                m_fsmonitorEnabled = false;
+                emit fsmonitorStateChanged(false);
+                if (callback) callback(false);
+                return;
+            }
+            // 执行一次允许写回索引的status，把令牌和未跟踪文件缓存记录到索引中；
+            // 只读命令不写索引，之后由advanceFsmonitorToken定期推进
+            executeMutationAsync(fileStatusArgs(), callback);
+        });
+    });
+}
+
+void GitManager::advanceFsmonitorToken()
+{
+    if (!m_fsmonitorEnabled || m_currentRepository.isEmpty()) {
+        return;
+    }
+
+    // 界面的状态查询都不获取可选锁，git不会把新令牌写回索引，钩子每次都要从旧令牌回答，
+    // 变化日志也无法清理。这里的status按变更任务执行，允许写索引；只与其他变更任务串行，不挡住只读任务
+    GitJobScheduler::Job job;
+    job.args = fileStatusArgs();
+    job.workingDirectory = m_currentRepository;
+    job.priority = GitJobScheduler::Background;
+    job.mutating = true;
+    job.blocksReads = false;
+
+    // 写索引只是更新缓存，不需要监视器再触发全量刷新
+    m_watcher->beginRepositoryUpdate();
+    const quint64 generation = m_repositoryGeneration;
+    m_scheduler->submit(job, [this, generation](bool, const QByteArray &) {
+        if (generation != m_repositoryGeneration) {
+            return;
+        }
+        m_watcher->endRepositoryUpdate();
+    });
+}
+
+void GitManager::measureFsmonitorSpeedupAsync(std::function<void(qint64, qint64)> callback)
+{
+    // 交替执行两轮，各取较快的一次，减少页缓存冷热不同的影响
+    QStringList baselineArgs;
+    baselineArgs << "-c" << "core.fsmonitor=false" << "-c" << "core.untrackedCache=false" << fileStatusArgs();
+    const QStringList monitoredArgs = fileStatusArgs();
+
+    // 每轮的回调持有runNext，最后一轮结束后自动释放
+    auto results = std::make_shared<QList<qint64>>();
+    auto runNext = std::make_shared<std::function<void()>>();
+    std::weak_ptr<std::function<void()>> weakNext = runNext;
+    *runNext = [this, baselineArgs, monitoredArgs, results, weakNext, callback]() {
+        const int round = results->size();
+        if (round == 4) {
+            const qint64 baseline = qMin(results->at(0), results->at(2));
+            const qint64 monitored = qMin(results->at(1), results->at(3));
+            qDebug() << "git status耗时（毫秒）: 不使用fsmonitor" << baseline << "使用fsmonitor" << monitored;
+            emit fsmonitorSpeedupMeasured(baseline, monitored);
+            if (callback) callback(baseline, monitored);
+            return;
+        }
+
+        auto next = weakNext.lock();
+        auto timer = std::make_shared<QElapsedTimer>();
+        timer->start();
+        executeCommandAsync(round % 2 == 0 ? baselineArgs : monitoredArgs,
+                            [this, results, next, timer, callback](bool success, const QByteArray &) {
+            if (!success || !next) {
+                // 任一轮失败时无法比较，报告-1让调用方结束等待
+                emit fsmonitorSpeedupMeasured(-1, -1);
+                if (callback) callback(-1, -1);
+                return;
+            }
+            results->append(timer->elapsed());
+            (*next)();
+        }, GitJobScheduler::Background);
+    };
+    (*runNext)();
+}
+
+bool GitManager::stageFile(const QString &filePath)
+{
+    QStringList args;
+    args << "add" << filePath;
+    
+    bool success;
+    executeCommand(args, &success);
+    return success;
+}
+
+bool GitManager::unstageFile(const QString &filePath)
+{
+    QStringList args;
+    args << "reset" << "HEAD" << filePath;
+    
+    bool success;
+    executeCommand(args, &success);
+    return success;
+}
+
+bool GitManager::commit(const QString &message)
+{
+    QStringList args;
+    args << "commit" << "-m" << message;
+    
+    bool success;
+    executeCommand(args, &success);
+    return success;
+}
+
+bool GitManager::discardChanges(const QString &filePath)
+{
+    QStringList args;
+    args << "checkout" << "--" << filePath;
+    
+    bool success;
+    executeCommand(args, &success);
+    return success;
+}
+
+QStringList GitManager::commitHistoryArgs(int limit) const
+{
+    QStringList args;
+    args << "log" << QString("--pretty=format:%H|%P|%an|%ad|%ct|%s") << "--date=short" << QString("-n%1").arg(limit);
+    return args;
+}
+
+QList<GitManager::CommitInfo> GitManager::getCommitHistory(int limit)
+{
+    QList<CommitInfo> commitList;
+    if (readCommitHistoryNative(limit, &commitList)) {
+        return commitList;
+    }
+
+    bool success;
+    QString output = executeCommand(commitHistoryArgs(limit), &success);
+    if (!success) return QList<CommitInfo>();
+    
+    return parseCommitHistoryOutput(output);
+}
+
+void GitManager::getCommitHistoryAsync(int limit, std::function<void(const QList<CommitInfo> &)> callback)
+{
+    // 优先在进程内遍历提交，结果仍异步返回，与git命令路径保持一致
+    QList<CommitInfo> nativeList;
+    if (readCommitHistoryNative(limit, &nativeList)) {
+        const quint64 generation = m_repositoryGeneration;
+        QMetaObject::invokeMethod(this, [this, generation, nativeList, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(nativeList);
+            emit commitHistoryReady(nativeList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    // 历史记录较慢，作为后台任务执行，不挡住交互操作
+    executeCommandAsync(commitHistoryArgs(limit), [this, callback](bool success, const QByteArray &output) {
+        QList<CommitInfo> commitList;
+        if (success) {
+            commitList = parseCommitHistoryOutput(QString::fromUtf8(output));
+        }
+        if (callback) callback(commitList);
+        emit commitHistoryReady(commitList);
+    }, GitJobScheduler::Background);
+}
+
+void GitManager::getCommitHistoryPageAsync(int pageSize, bool restart,
+                                           std::function<void(const QList<CommitInfo> &, bool)> callback)
+{
+    if (restart || !m_historyWalk) {
+        // git gc、fetch等可能写入了新的commit-graph
+        if (m_commitGraph) {
+            m_commitGraph->open();
+        }
+        m_historyWalk.reset(new HistoryWalk);
+        m_historyWalk->generation = ++m_historyWalkGeneration;
+        m_historyWalk->native = startHistoryWalkNative(m_historyWalk.get());
+    }
+    HistoryWalk *walk = m_historyWalk.get();
+    const quint64 walkGeneration = walk->generation;
+
+    auto deliver = [this, walkGeneration, restart, callback](const QList<CommitInfo> &commits, bool hasMore) {
+        if (!m_historyWalk || m_historyWalk->generation != walkGeneration) {
+            return;
+        }
+        indexCommitsForSearch(commits);
+        if (callback) callback(commits, hasMore);
+        emit commitHistoryPageReady(commits, restart, hasMore);
+    };
+
+    QList<CommitInfo> page;
+    if (walk->finished) {
+        QMetaObject::invokeMethod(this, [deliver, page]() {
+            deliver(page, false);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (walk->native) {
+        if (readHistoryPageNative(walk, pageSize, &page)) {
+            const bool hasMore = !walk->finished;
+            QMetaObject::invokeMethod(this, [deliver, page, hasMore]() {
+                deliver(page, hasMore);
+            }, Qt::QueuedConnection);
+            return;
+        }
+        // 之后的页都由git继续：队列中等待输出的提交就是边界
+        walk->native = false;
+        while (!walk->queue.empty()) {
+            walk->frontier.insert(walk->queue.top().commit.oid);
+            walk->queue.pop();
+        }
+        for (auto it = walk->emitted.cbegin(); it != walk->emitted.cend(); ++it) {
+            walk->frontier.remove(it.key());
+        }
+        walk->seen.clear();
+    }
+
+    // 还没有输出任何提交时从HEAD开始，否则边界为空说明已经到底
+    QStringList args = commitHistoryArgs(pageSize - page.size());
+    QByteArray input;
+    if (!walk->frontier.isEmpty()) {
+        args << "--stdin";
+        for (const QByteArray &oid : std::as_const(walk->frontier)) {
+            input += oid + '\n';
+        }
+    } else if (walk->produced > 0) {
+        walk->finished = true;
+        QMetaObject::invokeMethod(this, [deliver, page]() {
+            deliver(page, false);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    const int remaining = pageSize - page.size();
+    executeCommandAsync(args, [this, walkGeneration, page, remaining, deliver](bool success, const QByteArray &output) {
+        if (!m_historyWalk || m_historyWalk->generation != walkGeneration) {
+            return;
+        }
+        HistoryWalk *walk = m_historyWalk.get();
+        if (!success) {
+            // 错误已由onJobFinished报告；边界保持不变，滚动到底部时可以重试
+            deliver(page, true);
+            return;
+        }
+        const QList<CommitInfo> fetched = parseCommitHistoryOutput(QString::fromUtf8(output));
+
+        QList<CommitInfo> result = page;
+        for (const CommitInfo &commit : fetched) {
+            const QByteArray oid = commit.hash.toLatin1();
+            if (walk->emitted.contains(oid)) {
+                continue;
+            }
+            walk->emitted.insert(oid, commit.commitTime);
+            walk->frontier.remove(oid);
+            for (const QString &parent : commit.parents) {
+                const QByteArray parentOid = parent.toLatin1();
+                if (!walk->emitted.contains(parentOid)) {
+                    walk->frontier.insert(parentOid);
+                }
+            }
+            result.append(commit);
+        }
+        walk->produced += result.size() - page.size();
+        walk->finished = fetched.size() < remaining || walk->frontier.isEmpty();
+        if (!fetched.isEmpty()) {
+            walk->pruneEmitted(fetched.last().commitTime);
+        }
+        deliver(result, !walk->finished);
+    }, GitJobScheduler::Background, false, input);
+}
+
+QList<GitManager::CommitInfo> GitManager::parseCommitHistoryOutput(const QString &output)
+{
+    QList<CommitInfo> commitList;
+    QStringList lines = output.split("\n", Qt::SkipEmptyParts);
+    for (const QString &line : lines) {
+        QStringList parts = line.split("|");
+        if (parts.size() < 6) continue;
+        
+        CommitInfo commit;
+        commit.hash = parts[0];
+        commit.parents = parts[1].split(' ', Qt::SkipEmptyParts);
+        commit.author = parts[2];
+        commit.date = parts[3];
+        commit.commitTime = parts[4].toLongLong();
+        // 提交信息中可能包含分隔符
+        commit.message = line.section('|', 5);
+        
+        commitList.append(commit);
+    }
+    
+    return commitList;
+}
+
+QString GitManager::getCommitDiff(const QString &commitHash)
+{
+    QStringList args;
+    args << "show" << commitHash;
+    
+    bool success;
+    QString output = executeCommand(args, &success);
+    return success ? output : "";
+}
+
+GitManager::CommitInfo GitManager::getCommitInfo(const QString &commitHash)
+{
+    if (isFullObjectId(commitHash)) {
+        GitObjectDatabase::Object object = readObjectNative(commitHash.toLatin1());
+        if (object.type == GitObjectDatabase::Commit) {
+            return parseCommitObject(commitHash.toLatin1(), object.data);
+        }
+    }
+
+    CommitInfo commit;
+    QStringList args;
+    args << "show" << commitHash << "--pretty=format:%H|%an|%ad|%s" << "--date=short" << "-s";
+    
+    bool success;
+    QString output = executeCommand(args, &success);
+    if (!success) return commit;
+    
+    QStringList parts = output.split("|");
+    if (parts.size() >= 4) {
+        commit.hash = parts[0];
+        commit.author = parts[1];
+        commit.date = parts[2];
+        commit.message = parts[3];
+    }
+    
+    return commit;
+}
+
+void GitManager::getCommitInfoAsync(const QString &commitHash, std::function<void(const CommitInfo &)> callback)
+{
+    // getObjectAsync对完整对象ID直接读取对象库，否则交给cat-file解析
+    getObjectAsync(commitHash + "^{commit}", [this, commitHash, callback](const QByteArray &data) {
+        CommitInfo commit;
+        if (!data.isEmpty()) {
+            commit = parseCommitObject(commitHash.toLatin1(), data);
+        }
+        if (callback) callback(commit);
+        emit commitInfoReady(commit);
+    });
+}
+
+void GitManager::getCommitDiffAsync(const QString &commitHash, std::function<void(const QString &)> callback)
+{
+    // 只取差异部分，提交信息通过getCommitInfoAsync读取
+    QStringList args;
+    args << "show" << "--format=" << commitHash;
+
+    executeCommandAsync(args, [callback](bool success, const QByteArray &output) {
+        if (callback) callback(success ? QString::fromUtf8(output) : QString());
+    });
+}
+
+void GitManager::getObjectAsync(const QString &revision, std::function<void(const QByteArray &)> callback)
+{
+    // "<oid>^{commit}"这类表达式中的对象ID也可以直接读取
+    QString oid = revision.endsWith("^{commit}") ? revision.left(revision.length() - 9) : revision;
+    if (isFullObjectId(oid)) {
+        GitObjectDatabase::Object object = readObjectNative(oid.toLatin1());
+        bool typeMatches = oid == revision || object.type == GitObjectDatabase::Commit;
+        if (object.isValid() && typeMatches) {
+            const quint64 generation = m_repositoryGeneration;
+            QMetaObject::invokeMethod(this, [this, generation, object, callback]() {
+                if (generation != m_repositoryGeneration) {
+                    return;
+                }
+                if (callback) callback(object.data);
+            }, Qt::QueuedConnection);
+            return;
+        }
+    }
+
+    if (!m_catFile) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(QByteArray());
+        return;
+    }
+
+    m_catFile->request(revision, [callback](const GitCatFile::ObjectInfo &, const QByteArray &content) {
+        if (callback) callback(content);
+    });
+}
+
+void GitManager::getObjectInfoAsync(const QString &revision, std::function<void(const GitCatFile::ObjectInfo &)> callback)
+{
+    if (!m_catFileCheck) {
+        emit errorOccurred("未打开任何仓库");
+        if (callback) callback(GitCatFile::ObjectInfo());
+        return;
+    }
+
+    m_catFileCheck->request(revision, [callback](const GitCatFile::ObjectInfo &info, const QByteArray &) {
+        if (callback) callback(info);
+    });
+}
+
+void GitManager::getAheadBehindAsync(const QString &revision, const QString &upstream,
+                                     std::function<void(bool, int, int)> callback)
+{
+    const quint32 first = commitGraphPosition(revision);
+    const quint32 second = commitGraphPosition(upstream);
+    int ahead = 0;
+    int behind = 0;
+    if (first != GitCommitGraph::NoPosition && second != GitCommitGraph::NoPosition
+        && m_commitGraph->aheadBehind(first, second, &ahead, &behind)) {
+        const quint64 generation = m_repositoryGeneration;
+        QMetaObject::invokeMethod(this, [this, generation, ahead, behind, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(true, ahead, behind);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    QStringList args;
+    args << "rev-list" << "--left-right" << "--count" << revision + "..." + upstream;
+    executeCommandAsync(args, [callback](bool success, const QByteArray &output) {
+        // 输出为"<领先>\t<落后>"
+        QList<QByteArray> counts = output.trimmed().split('\t');
+        bool ok = success && counts.size() == 2;
+        if (callback) callback(ok, ok ? counts[0].toInt() : 0, ok ? counts[1].toInt() : 0);
+    }, GitJobScheduler::Background);
+}
+
+void GitManager::getBranchTrackingAsync(std::function<void(const QList<BranchTracking> &)> callback)
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasTracking);
+    if (snapshot && snapshot->hasTracking) {
+        const quint64 generation = m_repositoryGeneration;
+        const QList<BranchTracking> trackingList = snapshot->tracking;
+        QMetaObject::invokeMethod(this, [this, generation, trackingList, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(trackingList);
+            emit branchTrackingReady(trackingList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const QByteArray fingerprint = snapshot ? snapshot->fingerprint : QByteArray();
+
+    // 只读取分支和上游的名称，不让git计算领先/落后
+    QStringList args;
+    args << "for-each-ref" << "--format=%(refname)%00%(objectname)%00%(upstream)%00%(upstream:short)" << "refs/heads";
+    executeCommandAsync(args, [this, fingerprint, callback](bool success, const QByteArray &output) {
+        QList<BranchTracking> trackingList;
+        // 缓存和commit-graph都无法回答的分支：引用名、缓存键和在trackingList中的位置
+        QList<QByteArray> pendingRefs;
+        QList<QByteArray> pendingKeys;
+        QList<int> pendingRows;
+        const QList<QByteArray> lines = success ? output.split('\n') : QList<QByteArray>();
+        for (const QByteArray &line : lines) {
+            const QList<QByteArray> fields = line.split('\0');
+            if (fields.size() != 4 || fields[2].isEmpty()) {
+                continue;
+            }
+            BranchTracking tracking;
+            tracking.branch = QString::fromUtf8(fields[0].mid(11));
+            tracking.upstream = QString::fromUtf8(fields[3]);
+            if (!m_refDatabase || !m_refDatabase->isSupported()) {
+                // 读不到上游引用时全部交给git计算，不放入缓存
+                pendingRefs.append(fields[0]);
+                pendingKeys.append(QByteArray());
+                pendingRows.append(trackingList.size());
+                trackingList.append(tracking);
+                continue;
+            }
+            const QByteArray upstreamTip = m_refDatabase->resolve(fields[2]);
+            if (upstreamTip.isEmpty()) {
+                tracking.gone = true;
+                trackingList.append(tracking);
+                continue;
+            }
+
+            const QByteArray key = fields[1] + ' ' + upstreamTip;
+            auto cached = m_aheadBehindCache.constFind(key);
+            if (cached != m_aheadBehindCache.cend()) {
+                tracking.ahead = cached.value().first;
+                tracking.behind = cached.value().second;
+            } else if (aheadBehindNative(fields[1], upstreamTip, &tracking.ahead, &tracking.behind)) {
+                m_aheadBehindCache.insert(key, qMakePair(tracking.ahead, tracking.behind));
+            } else {
+                pendingRefs.append(fields[0]);
+                pendingKeys.append(key);
+                pendingRows.append(trackingList.size());
+            }
+            trackingList.append(tracking);
+        }
+        if (pendingRefs.isEmpty()) {
+            deliverBranchTracking(fingerprint, trackingList, callback);
+            return;
+        }
+
+        // 剩下的分支合并为一次查询，由git计算领先/落后
+        QStringList trackArgs;
+        trackArgs << "for-each-ref" << "--format=%(refname)%00%(objectname)%00%(upstream:track,nobracket)";
+        if (pendingRefs.size() <= MaxTrackingRefPatterns) {
+            for (const QByteArray &ref : pendingRefs) {
+                trackArgs << QString::fromUtf8(ref);
+            }
+        } else {
+            trackArgs << "refs/heads";
+        }
+        executeCommandAsync(trackArgs, [this, fingerprint, callback, trackingList, pendingRefs, pendingKeys, pendingRows]
+                            (bool success, const QByteArray &output) mutable {
+            QHash<QByteArray, QList<QByteArray>> trackByRef;
+            const QList<QByteArray> lines = success ? output.split('\n') : QList<QByteArray>();
+            for (const QByteArray &line : lines) {
+                const QList<QByteArray> fields = line.split('\0');
+                if (fields.size() == 3) {
+                    trackByRef.insert(fields[0], fields);
+                }
+            }
+            for (int i = 0; i < pendingRefs.size(); ++i) {
+                const QList<QByteArray> fields = trackByRef.value(pendingRefs[i]);
+                if (fields.isEmpty()) {
+                    continue;
+                }
+                BranchTracking &tracking = trackingList[pendingRows[i]];
+                parseTrackOutput(fields[2], &tracking);
+                // 两次查询之间分支移动过时结果对应的是新提交，不放入缓存
+                if (!tracking.gone && pendingKeys[i].startsWith(fields[1] + ' ')) {
+                    m_aheadBehindCache.insert(pendingKeys[i], qMakePair(tracking.ahead, tracking.behind));
+                }
+            }
+            deliverBranchTracking(fingerprint, trackingList, callback);
+        }, GitJobScheduler::Background);
+    }, GitJobScheduler::Background);
+}
+
+void GitManager::deliverBranchTracking(const QByteArray &fingerprint, const QList<BranchTracking> &trackingList,
+                                       std::function<void(const QList<BranchTracking> &)> callback)
+{
+    if (m_aheadBehindCache.size() > MaxAheadBehindCacheEntries) {
+        m_aheadBehindCache.clear();
+    }
+    if (RepositorySnapshot *snapshot = snapshotFor(fingerprint)) {
+        snapshot->hasTracking = true;
+        snapshot->tracking = trackingList;
+    }
+    if (callback) callback(trackingList);
+    emit branchTrackingReady(trackingList);
+}
+
+void GitManager::parseTrackOutput(const QByteArray &track, BranchTracking *tracking)
+{
+    // 与上游相同时为空
+    tracking->gone = track == "gone";
+    const QList<QByteArray> parts = track.split(',');
+    for (const QByteArray &part : parts) {
+        const QByteArray item = part.trimmed();
+        if (item.startsWith("ahead ")) {
+            tracking->ahead = item.mid(6).toInt();
+        } else if (item.startsWith("behind ")) {
+            tracking->behind = item.mid(7).toInt();
+        }
+    }
+}
+
+void GitManager::isAncestorAsync(const QString &ancestor, const QString &revision, std::function<void(bool)> callback)
+{
+    const quint32 first = commitGraphPosition(ancestor);
+    const quint32 second = commitGraphPosition(revision);
+    bool result = false;
+    if (first != GitCommitGraph::NoPosition && second != GitCommitGraph::NoPosition
+        && m_commitGraph->isAncestor(first, second, &result)) {
+        const quint64 generation = m_repositoryGeneration;
+        QMetaObject::invokeMethod(this, [this, generation, result, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(result);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    // merge-base --is-ancestor用退出码表示结果，这里改为计数：ancestor中没有revision之外的提交
+    QStringList args;
+    args << "rev-list" << "--count" << revision + ".." + ancestor;
+    executeCommandAsync(args, [callback](bool success, const QByteArray &output) {
+        if (callback) callback(success && output.trimmed() == "0");
+    }, GitJobScheduler::Background);
+}
+
+void GitManager::getMergeBaseAsync(const QString &first, const QString &second, std::function<void(const QString &)> callback)
+{
+    const quint32 firstPosition = commitGraphPosition(first);
+    const quint32 secondPosition = commitGraphPosition(second);
+    QList<quint32> bases;
+    if (firstPosition != GitCommitGraph::NoPosition && secondPosition != GitCommitGraph::NoPosition
+        && m_commitGraph->mergeBases(firstPosition, secondPosition, &bases)) {
+        const QString base = bases.isEmpty() ? QString() : QString::fromLatin1(m_commitGraph->oid(bases.first()));
+        const quint64 generation = m_repositoryGeneration;
+        QMetaObject::invokeMethod(this, [this, generation, base, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(base);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    QStringList args;
+    args << "merge-base" << first << second;
+    executeCommandAsync(args, [callback](bool success, const QByteArray &output) {
+        if (callback) callback(success ? QString::fromLatin1(output.trimmed()) : QString());
+    }, GitJobScheduler::Background);
+}
+
+GitObjectDatabase::Object GitManager::readObjectNative(const QByteArray &oid)
+{
+    if (!m_objectDatabase || !m_objectDatabase->isOpen()) {
+        return GitObjectDatabase::Object();
+    }
+
+    GitObjectDatabase::Object object = m_objectDatabase->readObject(oid);
+    if (!object.isValid()) {
+        // 可能是外部fetch或gc产生了新的包文件，重新扫描后再试一次
+        m_objectDatabase->open();
+        object = m_objectDatabase->readObject(oid);
+    }
+    return object;
+}
+
+QByteArray GitManager::resolveRevisionNative(const QString &revision) const
+{
+    if (isFullObjectId(revision)) {
+        return revision.toLatin1().toLower();
+    }
+    if (!m_refDatabase || !m_refDatabase->isSupported()) {
+        return QByteArray();
+    }
+    if (revision == "HEAD") {
+        return m_refDatabase->head();
+    }
+    // FETCH_HEAD、MERGE_HEAD等伪引用的格式各不相同，交给git
+    if (isPseudoRefName(revision)) {
+        return QByteArray();
+    }
+
+    // 与git的refs.c中ref_rev_parse_rules的顺序一致：同名的标签优先于分支
+    const QByteArray name = revision.toUtf8();
+    QList<QByteArray> candidates;
+    if (name.startsWith("refs/")) {
+        candidates << name;
+    }
+    candidates << "refs/" + name << "refs/tags/" + name << "refs/heads/" + name
+               << "refs/remotes/" + name << "refs/remotes/" + name + "/HEAD";
+    for (const QByteArray &candidate : std::as_const(candidates)) {
+        const QByteArray oid = m_refDatabase->resolve(candidate);
+        if (!oid.isEmpty()) {
+            // 附注标签解引用到提交；读不到对象时返回空，由git处理
+            return peelTagNative(oid);
+        }
+    }
+    return QByteArray();
+}
+
+QByteArray GitManager::peelTagNative(const QByteArray &oid) const
+{
+    QByteArray current = oid;
+    for (int depth = 0; depth < MaxTagPeelDepth; ++depth) {
+        if (m_commitGraph && m_commitGraph->isOpen() && m_commitGraph->findCommit(current) != GitCommitGraph::NoPosition) {
+            return current;
+        }
+        if (!m_objectDatabase || !m_objectDatabase->isOpen()) {
+            return QByteArray();
+        }
+        const GitObjectDatabase::Object object = m_objectDatabase->readObject(current);
+        if (object.type != GitObjectDatabase::Tag) {
+            return object.isValid() ? current : QByteArray();
+        }
+        // 标签对象的第一行为"object <对象ID>"
+        if (!object.data.startsWith("object ")) {
+            return QByteArray();
+        }
+        const qsizetype lineEnd = object.data.indexOf('\n');
+        current = object.data.mid(7, lineEnd < 0 ? -1 : lineEnd - 7);
+    }
+    return QByteArray();
+}
+
+bool GitManager::readBranchesNative(QList<BranchInfo> *branches) const
+{
+    // 没有打开仓库或reftable格式的仓库读不到引用，不能当作没有分支
+    if (!m_refDatabase || !m_refDatabase->isSupported()) {
+        return false;
+    }
+
+    branches->clear();
+    QByteArray headTarget;
+    const QByteArray head = m_refDatabase->head(&headTarget);
+    if (headTarget.isEmpty() && !head.isEmpty()) {
+        BranchInfo detached;
+        detached.name = "(HEAD detached at " + QString::fromLatin1(head.left(7)) + ")";
+        detached.isCurrent = true;
+        detached.isRemote = false;
+        branches->append(detached);
+    }
+
+    const QList<GitRefDatabase::Ref> localRefs = m_refDatabase->refs("refs/heads/");
+    for (const GitRefDatabase::Ref &ref : localRefs) {
+        BranchInfo branch;
+        branch.name = QString::fromUtf8(ref.name.mid(11));
+        branch.isCurrent = ref.name == headTarget;
+        branch.isRemote = false;
+        branches->append(branch);
+    }
+
+    // 远程的HEAD是符号引用，与git branch -a一样显示它指向的分支
+    const QList<GitRefDatabase::Ref> remoteRefs = m_refDatabase->refs("refs/remotes/");
+    for (const GitRefDatabase::Ref &ref : remoteRefs) {
+        BranchInfo branch;
+        branch.name = QString::fromUtf8(ref.name.mid(13));
+        if (ref.symbolicTarget.startsWith("refs/remotes/")) {
+            branch.name += " -> " + QString::fromUtf8(ref.symbolicTarget.mid(13));
+        }
+        branch.isCurrent = false;
+        branch.isRemote = true;
+        branches->append(branch);
+    }
+    return true;
+}
+
+quint32 GitManager::commitGraphPosition(const QString &revision) const
+{
+    if (!m_commitGraph || !m_commitGraph->isOpen()) {
+        return GitCommitGraph::NoPosition;
+    }
+    QByteArray oid = resolveRevisionNative(revision);
+    return oid.isEmpty() ? GitCommitGraph::NoPosition : m_commitGraph->findCommit(oid);
+}
+
+bool GitManager::aheadBehindNative(const QByteArray &first, const QByteArray &second, int *ahead, int *behind) const
+{
+    if (!m_commitGraph || !m_commitGraph->isOpen()) {
+        return false;
+    }
+    const quint32 firstPosition = m_commitGraph->findCommit(first);
+    const quint32 secondPosition = m_commitGraph->findCommit(second);
+    return firstPosition != GitCommitGraph::NoPosition && secondPosition != GitCommitGraph::NoPosition
+           && m_commitGraph->aheadBehind(firstPosition, secondPosition, ahead, behind);
+}
+
+bool GitManager::startHistoryWalkNative(HistoryWalk *walk)
+{
+    if (!m_objectDatabase || !m_objectDatabase->isOpen()) {
+        return false;
+    }
+
+    QByteArray head = resolveRevisionNative("HEAD");
+    if (head.isEmpty()) {
+        return false;
+    }
+    return enqueueHistoryCommit(walk, head);
+}
+
+bool GitManager::enqueueHistoryCommit(HistoryWalk *walk, const QByteArray &oid)
+{
+    if (walk->seen.contains(oid)) {
+        return true;
+    }
+    walk->seen.insert(oid);
+
+    // 缓存中没有的提交先从commit-graph取得排序需要的时间和父提交，真正输出时才读取对象
+    GitCommitCache::Commit commit;
+    if (m_commitCache && m_commitCache->find(oid, &commit)) {
+        walk->queue.push({ commit.commitTime, walk->order++, commit, true });
+        return true;
+    }
+
+    const quint32 position = m_commitGraph ? m_commitGraph->findCommit(oid) : GitCommitGraph::NoPosition;
+    QList<quint32> parents;
+    if (position != GitCommitGraph::NoPosition && m_commitGraph->parents(position, &parents)) {
+        commit.oid = oid;
+        commit.commitTime = m_commitGraph->commitTime(position);
+        for (quint32 parent : parents) {
+            commit.parents.append(m_commitGraph->oid(parent));
+        }
+        walk->queue.push({ commit.commitTime, walk->order++, commit, false });
+        return true;
+    }
+
+    if (!loadCommitNative(oid, &commit)) {
+        return false;
+    }
+    walk->queue.push({ commit.commitTime, walk->order++, commit, true });
+    return true;
+}
+
+bool GitManager::loadCommitNative(const QByteArray &oid, GitCommitCache::Commit *commit)
+{
+    // 读到的提交加入缓存，下次打开仓库时不必再读取
+    GitObjectDatabase::Object object = readObjectNative(oid);
+    if (object.type != GitObjectDatabase::Commit || !GitCommitCache::parseCommit(oid, object.data, commit)) {
+        return false;
+    }
+    if (m_commitCache) {
+        m_commitCache->add(*commit);
+    }
+    return true;
+}
+
+bool GitManager::readHistoryPageNative(HistoryWalk *walk, int count, QList<CommitInfo> *commits)
+{
+    // 失败时commits中保留已经按顺序输出的提交，其余由调用方交给git
+    while (!walk->queue.empty() && commits->size() < count) {
+        HistoryWalk::QueuedCommit current = walk->queue.top();
+        walk->queue.pop();
+        if (!current.loaded && !loadCommitNative(current.commit.oid, &current.commit)) {
+            walk->frontier.insert(current.commit.oid);
+            return false;
+        }
+        commits->append(commitInfoFromCache(current.commit));
+        walk->emitted.insert(current.commit.oid, current.commit.commitTime);
+        ++walk->produced;
+
+        for (const QByteArray &parent : current.commit.parents) {
+            // 浅克隆等情况下父提交可能不存在，交给git处理；没有入队的父提交放入边界
+            if (!enqueueHistoryCommit(walk, parent)) {
+                for (const QByteArray &pending : current.commit.parents) {
+                    walk->frontier.insert(pending);
+                }
+                return false;
+            }
+        }
+    }
+    walk->finished = walk->queue.empty();
+    if (!commits->isEmpty()) {
+        walk->pruneEmitted(commits->last().commitTime);
+    }
+    return true;
+}
+
+bool GitManager::readCommitHistoryNative(int limit, QList<CommitInfo> *commits)
+{
+    HistoryWalk walk;
+    if (!startHistoryWalkNative(&walk)) {
+        return false;
+    }
+
+    QList<CommitInfo> result;
+    if (!readHistoryPageNative(&walk, limit, &result)) {
+        return false;
+    }
+    *commits = result;
+    return true;
+}
+
+GitManager::CommitInfo GitManager::commitInfoFromCache(const GitCommitCache::Commit &cached)
+{
+    CommitInfo commit;
+    commit.hash = QString::fromLatin1(cached.oid);
+    for (const QByteArray &parent : cached.parents) {
+        commit.parents.append(QString::fromLatin1(parent));
+    }
+    commit.commitTime = cached.commitTime;
+    commit.author = cached.author;
+    commit.date = shortDate(cached.authorTime, cached.authorTimeZone);
+    commit.message = cached.subject;
+    return commit;
+}
+
+void GitManager::saveCommitCache()
+{
+    if (m_commitCache && m_commitCache->pendingCount() > 0) {
+        QElapsedTimer timer;
+        timer.start();
+        int added = m_commitCache->pendingCount();
+        if (m_commitCache->save()) {
+            qDebug() << "提交缓存新增" << added << "个提交，共" << m_commitCache->count() << "个，耗时" << timer.elapsed() << "ms";
+        }
+    }
+    if (m_searchIndex && m_searchIndex->pendingCount() > 0) {
+        QElapsedTimer timer;
+        timer.start();
+        int added = m_searchIndex->pendingCount();
+        if (m_searchIndex->save()) {
+            qDebug() << "搜索索引新增" << added << "个提交，共" << m_searchIndex->count() << "个，耗时" << timer.elapsed() << "ms";
+        }
+    }
+}
+
+void GitManager::indexCommitsForSearch(const QList<CommitInfo> &commits)
+{
+    if (!m_searchIndex) {
+        return;
+    }
+    for (const CommitInfo &info : commits) {
+        const QByteArray oid = info.hash.toLatin1();
+        if (m_searchIndex->contains(oid)) {
+            continue;
+        }
+        // 提交缓存只有标题，正文要从对象中读取
+        const GitObjectDatabase::Object object = readObjectNative(oid);
+        GitObjectDatabase::CommitHeader header;
+        if (object.type != GitObjectDatabase::Commit || !GitObjectDatabase::parseCommit(object.data, &header)) {
+            continue;
+        }
+        // 作者行去掉末尾的时间和时区，保留姓名和邮箱
+        QByteArray author = header.author;
+        const qsizetype emailEnd = author.lastIndexOf('>');
+        if (emailEnd >= 0) {
+            author.truncate(emailEnd + 1);
+        }
+        m_searchIndex->add(oid, header.commitTime,
+                           GitCommitSearchIndex::documentText(oid, author, object.data.mid(header.messageOffset)));
+    }
+}
+
+bool GitManager::searchCommits(const QString &query, int limit, QList<CommitInfo> *commits)
+{
+    commits->clear();
+    if (!m_searchIndex) {
+        return false;
+    }
+
+    const QList<QByteArray> oids = m_searchIndex->search(query, limit);
+    for (const QByteArray &oid : oids) {
+        GitCommitCache::Commit commit;
+        if ((m_commitCache && m_commitCache->find(oid, &commit)) || loadCommitNative(oid, &commit)) {
+            commits->append(commitInfoFromCache(commit));
+        }
+    }
+    return true;
+}
+
+bool GitManager::isFullObjectId(const QString &revision)
+{
+    if (revision.length() != 40 && revision.length() != 64) {
+        return false;
+    }
+    for (const QChar &c : revision) {
+        ushort u = c.unicode();
+        if (!((u >= '0' && u <= '9') || (u >= 'a' && u <= 'f') || (u >= 'A' && u <= 'F'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+GitManager::CommitInfo GitManager::parseCommitObject(const QByteArray &oid, const QByteArray &data) const
+{
+    CommitInfo commit;
+    commit.hash = QString::fromLatin1(oid);
+
+    int headerEnd = data.indexOf("\n\n");
+    QByteArray headers = headerEnd >= 0 ? data.left(headerEnd) : data;
+
+    for (const QByteArray &line : headers.split('\n')) {
+        // 父提交行都在author之前
+        if (line.startsWith("parent ")) {
+            commit.parents.append(QString::fromLatin1(line.mid(7).trimmed()));
+            continue;
+        }
+        if (!line.startsWith("author ")) {
+            continue;
+        }
+
+        // author Name <email> 1700000000 +0800
+        int emailStart = line.indexOf(" <");
+        int emailEnd = line.indexOf("> ", emailStart);
+        if (emailStart < 0 || emailEnd < 0) {
+            break;
+        }
+        commit.author = QString::fromUtf8(line.mid(7, emailStart - 7));
+
+        QList<QByteArray> when = line.mid(emailEnd + 2).split(' ');
+        if (when.size() == 2) {
+            int tz = when[1].toInt();
+            int offset = (qAbs(tz) / 100 * 3600 + qAbs(tz) % 100 * 60) * (tz < 0 ? -1 : 1);
+            commit.date = shortDate(when[0].toLongLong(), offset);
+        }
+        break;
+    }
+
+    // 与%s一致：取第一段文字，多行以空格连接
+    if (headerEnd >= 0) {
+        QByteArray body = data.mid(headerEnd + 2);
+        int paragraphEnd = body.indexOf("\n\n");
+        QByteArray subject = paragraphEnd >= 0 ? body.left(paragraphEnd) : body;
+        commit.message = QString::fromUtf8(subject.trimmed()).replace('\n', ' ');
+    }
+
+    return commit;
+}
+
+QList<GitManager::BranchInfo> GitManager::getBranches()
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasBranches);
+    if (snapshot && snapshot->hasBranches) {
+        return snapshot->branches;
+    }
+
+    QList<BranchInfo> branchList;
+    if (!readBranchesNative(&branchList)) {
+        QStringList args;
+        args << "branch" << "-a";
+
+        bool success;
+        QString output = executeCommand(args, &success);
+        if (!success) return QList<BranchInfo>();
+        branchList = parseBranchesOutput(output);
+    }
+    if (snapshot) {
+        snapshot->hasBranches = true;
+        snapshot->branches = branchList;
+    }
+    return branchList;
+}
+
+void GitManager::getBranchesAsync(std::function<void(const QList<BranchInfo> &)> callback)
+{
+    // 快照中已有或可以直接从引用文件读取时，结果仍异步返回
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasBranches);
+    QList<BranchInfo> nativeList;
+    bool ready = snapshot && snapshot->hasBranches;
+    if (ready) {
+        nativeList = snapshot->branches;
+    } else if (readBranchesNative(&nativeList)) {
+        ready = true;
+        if (snapshot) {
+            snapshot->hasBranches = true;
+            snapshot->branches = nativeList;
+        }
+    }
+    if (ready) {
+        const quint64 generation = m_repositoryGeneration;
+        QMetaObject::invokeMethod(this, [this, generation, nativeList, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(nativeList);
+            emit branchesReady(nativeList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const QByteArray fingerprint = snapshot ? snapshot->fingerprint : QByteArray();
+
     QStringList args;
-    args << "status" << "--porcelain" << "--ignore-submodules";
-    
-    bool success;
-    QString output = executeCommand(args, &success);
-    if (!success) return fileList;
-    
-    QStringList lines = output.split("\n", Qt::SkipEmptyParts);
-    for (const QString &line : lines) {
-        if (line.length() < 3) continue;
-        
-        FileInfo file;
-        QString statusCode = line.left(2).trimmed();
-        
-        if (statusCode.startsWith("R")) {
-            // 重命名的文件格式: R  oldpath -> newpath
-            QStringList parts = line.mid(3).split(" -> ", Qt::SkipEmptyParts);
-            if (parts.size() == 2) {
-                file.oldPath = parts[0].trimmed();
-                file.path = parts[1].trimmed();
-                file.status = Renamed;
+    args << "branch" << "-a";
+
+    executeCommandAsync(args, [this, fingerprint, callback](bool success, const QByteArray &output) {
+        QList<BranchInfo> branchList;
+        if (success) {
+            branchList = parseBranchesOutput(QString::fromUtf8(output));
+            if (RepositorySnapshot *snapshot = snapshotFor(fingerprint)) {
+                snapshot->hasBranches = true;
+                snapshot->branches = branchList;
             }
-        } else {
-            file.path = line.mid(3).trimmed();
-            file.status = parseFileStatus(statusCode);
         }
-        
-        fileList.append(file);
-    }
-    
-    return fileList;
+        if (callback) callback(branchList);
+        emit branchesReady(branchList);
+    });
 }
 
-bool GitManager::stageFile(const QString &filePath)
+QString GitManager::currentBranch()
 {
-    QStringList args;
-    args << "add" << filePath;
-    
-    bool success;
-    executeCommand(args, &success);
-    return success;
+    if (!m_refDatabase) {
+        return QString();
+    }
+    if (!m_refDatabase->isSupported()) {
+        QStringList args;
+        args << "symbolic-ref" << "--quiet" << "--short" << "HEAD";
+        bool success;
+        const QByteArray output = executeReadCommand(args, &success);
+        return success ? QString::fromUtf8(output.trimmed()) : QString();
+    }
+
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasHead);
+    QByteArray target;
+    if (snapshot && snapshot->hasHead) {
+        target = snapshot->headTarget;
+    } else {
+        m_refDatabase->head(&target);
+        if (snapshot) {
+            snapshot->hasHead = true;
+            snapshot->headTarget = target;
+        }
+    }
+    return target.startsWith("refs/heads/") ? QString::fromUtf8(target.mid(11)) : QString();
 }
 
-bool GitManager::unstageFile(const QString &filePath)
+int GitManager::stashCount()
 {
-    QStringList args;
-    args << "reset" << "HEAD" << filePath;
-    
-    bool success;
-    executeCommand(args, &success);
-    return success;
+    if (!m_refDatabase) {
+        return 0;
+    }
+
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasStashCount);
+    if (snapshot && snapshot->hasStashCount) {
+        return snapshot->stashCount;
+    }
+
+    // refs/stash的引用日志每行一个贮藏，与git stash list的条目一一对应
+    int count = 0;
+    QFile reflog(QDir(m_refDatabase->commonDir()).filePath("logs/refs/stash"));
+    if (reflog.open(QIODevice::ReadOnly)) {
+        count = reflog.readAll().count('\n');
+    }
+    if (snapshot) {
+        snapshot->hasStashCount = true;
+        snapshot->stashCount = count;
+    }
+    return count;
 }
 
-bool GitManager::commit(const QString &message)
+GitManager::SnapshotStatistics GitManager::snapshotStatistics() const
 {
-    QStringList args;
-    args << "commit" << "-m" << message;
-    
-    bool success;
-    executeCommand(args, &success);
-    return success;
+    return m_snapshotStatistics;
 }
 
-bool GitManager::discardChanges(const QString &filePath)
+QByteArray GitManager::repositoryFingerprint()
 {
-    QStringList args;
-    args << "checkout" << "--" << filePath;
-    
-    bool success;
-    executeCommand(args, &success);
-    return success;
+    // 监视器可能漏掉文件的原地修改时不缓存，否则刷新也只能得到旧的文件状态；
+    // reftable的引用不在下面的文件中，同样不缓存
+    if (!m_refDatabase || !m_refDatabase->isSupported() || !m_watcher->isExact()) {
+        return QByteArray();
+    }
+
+    // 先读出内核中已排队的事件，刚刚发生的修改也能反映在计数中
+    m_watcher->synchronize();
+    const QDir gitDir(m_refDatabase->gitDir());
+    const QDir commonDir(m_refDatabase->commonDir());
+    QByteArray fingerprint;
+    appendFileStamp(&fingerprint, gitDir.filePath("HEAD"));
+    appendFileStamp(&fingerprint, gitDir.filePath("index"));
+    appendFileStamp(&fingerprint, commonDir.filePath("packed-refs"));
+    appendFileStamp(&fingerprint, commonDir.filePath("config"));
+    appendFileStamp(&fingerprint, commonDir.filePath("logs/refs/stash"));
+    fingerprint.append(QByteArray::number(m_watcher->generation()));
+    return fingerprint;
 }
 
-QList<GitManager::CommitInfo> GitManager::getCommitHistory(int limit)
+GitManager::RepositorySnapshot *GitManager::currentSnapshot()
 {
-    QList<CommitInfo> commitList;
-    QStringList args;
-    args << "log" << QString("--pretty=format:%H|%an|%ad|%s") << "--date=short" << QString("-n%1").arg(limit);
-    
-    bool success;
-    QString output = executeCommand(args, &success);
-    if (!success) return commitList;
-    
-    QStringList lines = output.split("\n", Qt::SkipEmptyParts);
-    for (const QString &line : lines) {
-        QStringList parts = line.split("|");
-        if (parts.size() < 4) continue;
-        
-        CommitInfo commit;
-        commit.hash = parts[0];
-        commit.author = parts[1];
-        commit.date = parts[2];
-        commit.message = parts[3];
-        
-        commitList.append(commit);
+    const QByteArray fingerprint = repositoryFingerprint();
+    if (fingerprint.isEmpty()) {
+        m_snapshot = RepositorySnapshot();
+        return nullptr;
     }
-    
-    return commitList;
+    if (fingerprint != m_snapshot.fingerprint) {
+        m_snapshot = RepositorySnapshot();
+        m_snapshot.fingerprint = fingerprint;
+        ++m_snapshotStatistics.epochs;
+    }
+    return &m_snapshot;
 }
 
-QString GitManager::getCommitDiff(const QString &commitHash)
+GitManager::RepositorySnapshot *GitManager::snapshotFor(const QByteArray &fingerprint)
 {
-    QStringList args;
-    args << "show" << commitHash;
-    
-    bool success;
-    QString output = executeCommand(args, &success);
-    return success ? output : "";
+    return !fingerprint.isEmpty() && fingerprint == m_snapshot.fingerprint ? &m_snapshot : nullptr;
 }
 
-GitManager::CommitInfo GitManager::getCommitInfo(const QString &commitHash)
+void GitManager::recordSnapshotLookup(bool hit)
 {
-    CommitInfo commit;
-    QStringList args;
-    args << "show" << commitHash << "--pretty=format:%H|%an|%ad|%s" << "--date=short" << "-s";
-    
-    bool success;
-    QString output = executeCommand(args, &success);
-    if (!success) return commit;
-    
-    QStringList parts = output.split("|");
-    if (parts.size() >= 4) {
-        commit.hash = parts[0];
-        commit.author = parts[1];
-        commit.date = parts[2];
-        commit.message = parts[3];
+    if (hit) {
+        ++m_snapshotStatistics.hits;
+    } else {
+        ++m_snapshotStatistics.misses;
     }
-    
-    return commit;
 }
 
-QList<GitManager::BranchInfo> GitManager::getBranches()
+QList<GitManager::BranchInfo> GitManager::parseBranchesOutput(const QString &output)
 {
     QList<BranchInfo> branchList;
-    QStringList args;
-    args << "branch" << "-a";
-    
-    bool success;
-    QString output = executeCommand(args, &success);
-    if (!success) return branchList;
-    
     QStringList lines = output.split("\n", Qt::SkipEmptyParts);
     for (const QString &line : lines) {
         BranchInfo branch;
@@ -329,14 +2055,65 @@ bool GitManager::deleteBranch(const QString &branchName)
 
 QList<GitManager::RemoteInfo> GitManager::getRemotes()
 {
-    QList<RemoteInfo> remoteList;
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasRemotes);
+    if (snapshot && snapshot->hasRemotes) {
+        return snapshot->remotes;
+    }
+
     QStringList args;
     args << "remote" << "-v";
     
     bool success;
     QString output = executeCommand(args, &success);
-    if (!success) return remoteList;
+    if (!success) return QList<RemoteInfo>();
     
+    QList<RemoteInfo> remoteList = parseRemotesOutput(output);
+    if (snapshot) {
+        snapshot->hasRemotes = true;
+        snapshot->remotes = remoteList;
+    }
+    return remoteList;
+}
+
+void GitManager::getRemotesAsync(std::function<void(const QList<RemoteInfo> &)> callback)
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasRemotes);
+    if (snapshot && snapshot->hasRemotes) {
+        const quint64 generation = m_repositoryGeneration;
+        const QList<RemoteInfo> remoteList = snapshot->remotes;
+        QMetaObject::invokeMethod(this, [this, generation, remoteList, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(remoteList);
+            emit remotesReady(remoteList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const QByteArray fingerprint = snapshot ? snapshot->fingerprint : QByteArray();
+
+    QStringList args;
+    args << "remote" << "-v";
+
+    executeCommandAsync(args, [this, fingerprint, callback](bool success, const QByteArray &output) {
+        QList<RemoteInfo> remoteList;
+        if (success) {
+            remoteList = parseRemotesOutput(QString::fromUtf8(output));
+            if (RepositorySnapshot *snapshot = snapshotFor(fingerprint)) {
+                snapshot->hasRemotes = true;
+                snapshot->remotes = remoteList;
+            }
+        }
+        if (callback) callback(remoteList);
+        emit remotesReady(remoteList);
+    });
+}
+
+QList<GitManager::RemoteInfo> GitManager::parseRemotesOutput(const QString &output)
+{
+    QList<RemoteInfo> remoteList;
     QStringList lines = output.split("\n", Qt::SkipEmptyParts);
     for (const QString &line : lines) {
         QStringList parts = line.split("\t", Qt::SkipEmptyParts);
@@ -405,6 +2182,118 @@ bool GitManager::pull(const QString &remoteName, const QString &branchName)
     return success;
 }
 
+void GitManager::pushAsync(const QString &remoteName, const QString &branchName, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "push" << remoteName << branchName;
+
+    // 推送不修改工作树和索引，等待网络期间只读查询和监视器照常工作
+    executeRemoteAsync(args, [this, callback](bool success) {
+        if (callback) callback(success);
+        emit pushFinished(success);
+    });
+}
+
+void GitManager::pullAsync(const QString &remoteName, const QString &branchName, std::function<void(bool)> callback)
+{
+    // 拆成两步：fetch等待网络期间不挡住只读查询，之后只有本地的合并或变基按变更任务执行
+    QStringList fetchArgs;
+    fetchArgs << "fetch" << remoteName << branchName;
+
+    executeRemoteAsync(fetchArgs, [this, callback](bool success) {
+        if (!success) {
+            if (callback) callback(false);
+            emit pullFinished(false);
+            return;
+        }
+
+        // 与git pull一样按pull.rebase选择变基或合并
+        QStringList configArgs;
+        configArgs << "config" << "--type=bool" << "--default" << "false" << "--get" << "pull.rebase";
+        executeCommandAsync(configArgs, [this, callback](bool success, const QByteArray &output) {
+            QStringList args;
+            if (success && output.trimmed() == "true") {
+                args << "rebase" << "FETCH_HEAD";
+            } else {
+                args << "merge" << "--no-edit" << "FETCH_HEAD";
+            }
+            executeMutationAsync(args, [this, callback](bool success) {
+                if (callback) callback(success);
+                emit pullFinished(success);
+            });
+        });
+    });
+}
+
+void GitManager::cloneRepositoryAsync(const QString &url, const QString &destPath, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "clone" << url << destPath;
+
+    GitJobScheduler::Job job;
+    job.args = args;
+    job.mutating = true;
+
+    // 克隆时尚未打开仓库，不受仓库切换影响
+    m_scheduler->submit(job, [this, destPath, callback](bool success, const QByteArray &) {
+        if (success) {
+            success = openRepository(destPath);
+        }
+        if (callback) callback(success);
+        emit cloneFinished(destPath, success);
+    });
+}
+
+void GitManager::stageFileAsync(const QString &filePath, std::function<void(bool)> callback)
+{
+    stageFilesAsync(QStringList(filePath), callback);
+}
+
+void GitManager::unstageFileAsync(const QString &filePath, std::function<void(bool)> callback)
+{
+    unstageFilesAsync(QStringList(filePath), callback);
+}
+
+void GitManager::discardChangesAsync(const QString &filePath, std::function<void(bool)> callback)
+{
+    discardFilesAsync(QStringList(filePath), callback);
+}
+
+void GitManager::stageFilesAsync(const QStringList &paths, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "add";
+    executePathspecMutationAsync(args, paths, callback);
+}
+
+void GitManager::unstageFilesAsync(const QStringList &paths, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "reset" << "-q" << "HEAD";
+    executePathspecMutationAsync(args, paths, callback);
+}
+
+void GitManager::discardFilesAsync(const QStringList &paths, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "checkout";
+    executePathspecMutationAsync(args, paths, callback);
+}
+
+void GitManager::commitAsync(const QString &message, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "commit" << "-m" << message;
+    executeMutationAsync(args, callback);
+}
+
+void GitManager::checkoutBranchAsync(const QString &branchName, std::function<void(bool)> callback)
+{
+    QStringList args;
+    args << "checkout" << branchName;
+    executeMutationAsync(args, callback);
+}
+
 QString GitManager::getDiff(const QString &filePath)
 {
     QStringList args;
@@ -425,6 +2314,152 @@ QString GitManager::getStagedDiff(const QString &filePath)
     return success ? output : "";
 }
 
+void GitManager::getDiffAsync(const QString &filePath, bool staged, std::function<void(const QString &)> callback)
+{
+    QStringList args;
+    args << "diff";
+    if (staged) {
+        args << "--staged";
+    }
+    args << filePath;
+
+    executeCommandAsync(args, [this, filePath, callback](bool success, const QByteArray &output) {
+        QString diff = success ? QString::fromUtf8(output) : QString();
+        if (callback) callback(diff);
+        emit diffReady(filePath, diff);
+    });
+}
+
+quint64 GitManager::getDiffStreamAsync(const QString &filePath, bool staged,
+                                       std::function<void(const QByteArray &)> outputCallback,
+                                       std::function<void(bool)> callback)
+{
+    if (!staged) {
+        const quint64 nativeJob = startNativeDiffAsync(filePath, outputCallback, callback);
+        if (nativeJob != 0) {
+            return nativeJob;
+        }
+    }
+
+    QStringList args;
+    args << "diff" << "--no-color";
+    if (staged) {
+        args << "--staged";
+    }
+    args << "--" << filePath;
+
+    return executeStreamingAsync(args, outputCallback, [callback](bool success, const QByteArray &) {
+        if (callback) callback(success);
+    });
+}
+
+quint64 GitManager::startNativeDiffAsync(const QString &filePath, std::function<void(const QByteArray &)> outputCallback,
+                                         std::function<void(bool)> callback)
+{
+    // 换行符转换、过滤器、冲突和模式变化等情况由状态引擎排除，交给git
+    GitIndex::Entry entry;
+    if (!m_statusEngine || !m_statusEngine->worktreeDiffEntry(filePath, &entry) || needsQuoting(entry.path)) {
+        return 0;
+    }
+    // 对象库中没有该blob（如部分克隆）时也交给git
+    const GitObjectDatabase::Object blob = readObjectNative(entry.oid);
+    if (blob.type != GitObjectDatabase::Blob) {
+        return 0;
+    }
+
+    NativeDiffRequest request;
+    request.fullPath = QDir(m_currentRepository).filePath(QString::fromUtf8(entry.path));
+    request.header.path = entry.path;
+    request.header.oldOid = entry.oid;
+    request.header.mode = entry.mode;
+    request.oldData = blob.data;
+    request.algorithm = GitLineDiff::algorithmFromName(QSettings().value("git/diff_algorithm", "myers").toString());
+
+    const quint64 jobId = m_nextNativeDiffJob++;
+    const quint64 generation = m_repositoryGeneration;
+    m_nativeDiffJobs.insert(jobId);
+    QMetaObject::invokeMethod(m_diffWorker, [this, jobId, generation, request, outputCallback, callback]() {
+        QByteArray diff;
+        const bool success = runNativeDiff(request, &diff);
+        // 回到GUI线程交付；析构时会先等待本线程结束
+        QMetaObject::invokeMethod(this, [this, jobId, generation, success, diff, outputCallback, callback]() {
+            if (!m_nativeDiffJobs.remove(jobId) || generation != m_repositoryGeneration) {
+                return;
+            }
+            if (!diff.isEmpty() && outputCallback) {
+                outputCallback(diff);
+            }
+            if (callback) callback(success);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+    return jobId;
+}
+
+void GitManager::measureNativeDiffSpeedupAsync(const QString &filePath, std::function<void(qint64, qint64)> callback)
+{
+    // 先运行git diff再在进程内计算，两者都包含读取文件的时间；同时检查两边的补丁正文是否一致
+    auto timer = std::make_shared<QElapsedTimer>();
+    timer->start();
+    QStringList args;
+    args << "diff" << "--no-color" << "--" << filePath;
+    executeCommandAsync(args, [this, filePath, callback, timer](bool success, const QByteArray &gitOutput) {
+        if (!success) {
+            qDebug() << "git diff失败，无法测量:" << filePath;
+            if (callback) callback(-1, -1);
+            return;
+        }
+        const qint64 gitMs = timer->elapsed();
+        auto nativeOutput = std::make_shared<QByteArray>();
+        timer->start();
+        const quint64 job = startNativeDiffAsync(filePath, [nativeOutput](const QByteArray &chunk) {
+            nativeOutput->append(chunk);
+        }, [filePath, callback, timer, gitMs, gitOutput, nativeOutput](bool) {
+            const qint64 nativeMs = timer->elapsed();
+            // index行的缩写长度可能不同，只比较第一个@@之后的部分
+            auto hunks = [](const QByteArray &diff) {
+                const qsizetype start = diff.indexOf("\n@@");
+                return start < 0 ? QByteArray() : diff.mid(start + 1);
+            };
+            qDebug() << "git diff耗时（毫秒）:" << filePath << "git" << gitMs << "进程内" << nativeMs
+                     << (hunks(gitOutput) == hunks(*nativeOutput) ? "输出一致" : "输出不一致");
+            if (callback) callback(gitMs, nativeMs);
+        });
+        if (job == 0) {
+            qDebug() << "该文件不能在进程内比较:" << filePath;
+            if (callback) callback(gitMs, -1);
+        }
+    }, GitJobScheduler::Background);
+}
+
+void GitManager::getDiffStatAsync(const QString &filePath, bool staged, std::function<void(const QByteArray &)> callback)
+{
+    QStringList args;
+    args << "diff" << "--no-color" << "--stat=200";
+    if (staged) {
+        args << "--staged";
+    }
+    args << "--" << filePath;
+
+    executeCommandAsync(args, [callback](bool success, const QByteArray &output) {
+        if (callback) callback(success ? output : QByteArray());
+    });
+}
+
+void GitManager::getStagedDiffAsync(std::function<void(bool, const GitDiff &)> callback)
+{
+    // --raw -z给出未转义的路径和状态，-p的补丁按同样的顺序跟在后面
+    QStringList args;
+    args << "diff" << "--cached" << "--no-color" << "--no-ext-diff" << "--find-renames" << "--raw" << "-z" << "-p";
+
+    auto parser = std::make_shared<GitDiffParser>();
+    executeStreamingAsync(args, [parser](const QByteArray &chunk) {
+        parser->feed(chunk);
+    }, [parser, callback](bool success, const QByteArray &) {
+        const bool complete = parser->finish();
+        if (callback) callback(success && complete, parser->diff());
+    });
+}
+
 QList<QString> GitManager::getTags()
 {
     QList<QString> tagList;
@@ -443,6 +2478,118 @@ QList<QString> GitManager::getTags()
     return tagList;
 }
 
+void GitManager::getTagsAsync(std::function<void(const QList<TagInfo> &)> callback)
+{
+    RepositorySnapshot *snapshot = currentSnapshot();
+    recordSnapshotLookup(snapshot && snapshot->hasTags);
+    if (snapshot && snapshot->hasTags) {
+        const quint64 generation = m_repositoryGeneration;
+        const QList<TagInfo> tagList = snapshot->tags;
+        QMetaObject::invokeMethod(this, [this, generation, tagList, callback]() {
+            if (generation != m_repositoryGeneration) {
+                return;
+            }
+            if (callback) callback(tagList);
+            emit tagsReady(tagList);
+        }, Qt::QueuedConnection);
+        return;
+    }
+    const QByteArray fingerprint = snapshot ? snapshot->fingerprint : QByteArray();
+
+    auto deliver = [this, fingerprint, callback](const QList<TagInfo> &tagList, bool complete) {
+        if (complete) {
+            if (RepositorySnapshot *snapshot = snapshotFor(fingerprint)) {
+                snapshot->hasTags = true;
+                snapshot->tags = tagList;
+            }
+        }
+        if (callback) callback(tagList);
+        emit tagsReady(tagList);
+    };
+
+    executeCommandAsync(tagArgs(), [this, deliver](bool success, const QByteArray &output) {
+        QList<int> nestedTags;
+        const QList<TagInfo> tagList = success ? parseTagsOutput(output, &nestedTags) : QList<TagInfo>();
+        if (nestedTags.isEmpty()) {
+            deliver(tagList, success);
+            return;
+        }
+
+        // 标签的标签很少见，for-each-ref只解引用一层，剩下的合并为一次cat-file查询解引用到底
+        QByteArray input;
+        for (int row : nestedTags) {
+            input += tagList[row].target.toLatin1() + "^{}\n";
+        }
+        QStringList peelArgs;
+        peelArgs << "cat-file" << "--batch-check=%(objectname)";
+        executeCommandAsync(peelArgs, [deliver, tagList, nestedTags](bool success, const QByteArray &output) mutable {
+            // 每个请求一行，对象不存在时为"<请求> missing"，保留解引用一层的结果
+            const QList<QByteArray> lines = success ? output.split('\n') : QList<QByteArray>();
+            for (int i = 0; i < nestedTags.size() && i < lines.size(); ++i) {
+                if (!lines[i].isEmpty() && !lines[i].endsWith(" missing")) {
+                    tagList[nestedTags[i]].target = QString::fromLatin1(lines[i]);
+                }
+            }
+            deliver(tagList, success);
+        }, GitJobScheduler::Interactive, false, input);
+    });
+}
+
+QStringList GitManager::tagArgs()
+{
+    // 附注标签的creatordate是打标签的时间，轻量标签是提交时间；字段以NUL分隔，说明中的任何字符都不影响解析
+    QStringList args;
+    args << "for-each-ref"
+         << "--format=%(refname:strip=2)%00%(objectname)%00%(*objectname)%00%(*objecttype)%00%(creatordate:unix)%00%(contents:subject)"
+         << "refs/tags";
+    return args;
+}
+
+QList<GitManager::TagInfo> GitManager::parseTagsOutput(const QByteArray &output, QList<int> *nestedTags)
+{
+    // 每行依次为名称、标签对象、解引用一层后的对象及其类型（轻量标签为空）、日期和说明
+    const int fieldCount = 6;
+    QList<TagInfo> tagList;
+    tagList.reserve(output.count('\n'));
+    qsizetype lineStart = 0;
+    while (lineStart < output.size()) {
+        qsizetype lineEnd = output.indexOf('\n', lineStart);
+        if (lineEnd < 0) {
+            lineEnd = output.size();
+        }
+        const QByteArrayView line(output.constData() + lineStart, lineEnd - lineStart);
+        lineStart = lineEnd + 1;
+
+        QByteArrayView fields[fieldCount];
+        int field = 0;
+        qsizetype fieldStart = 0;
+        for (; field < fieldCount - 1; ++field) {
+            const qsizetype fieldEnd = line.indexOf('\0', fieldStart);
+            if (fieldEnd < 0) {
+                break;
+            }
+            fields[field] = line.sliced(fieldStart, fieldEnd - fieldStart);
+            fieldStart = fieldEnd + 1;
+        }
+        if (field != fieldCount - 1) {
+            continue;
+        }
+        fields[field] = line.sliced(fieldStart);
+
+        TagInfo tag;
+        tag.name = QString::fromUtf8(fields[0]);
+        tag.annotated = !fields[2].isEmpty();
+        tag.target = QString::fromLatin1(tag.annotated ? fields[2] : fields[1]);
+        tag.date = fields[4].toLongLong();
+        tag.subject = QString::fromUtf8(fields[5]);
+        if (nestedTags && fields[3] == "tag") {
+            nestedTags->append(tagList.size());
+        }
+        tagList.append(tag);
+    }
+    return tagList;
+}
+
 bool GitManager::createTag(const QString &tagName, const QString &commitHash)
 {
     QStringList args;
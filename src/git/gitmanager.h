@@ -7,6 +7,25 @@
 #include <QList>
 #include <QMap>
 #include <QPair>
+#include <QHash>
+#include <QSet>
+#include <functional>
+#include <memory>
+#include "gitjobscheduler.h"
+#include "gitcatfile.h"
+#include "gitobjectdatabase.h"
+#include "gitcommitcache.h"
+#include "gitcommitsearchindex.h"
+#include "gitcommitgraph.h"
+#include "gitrefdatabase.h"
+#include "gitdiffparser.h"
+#include "gitstatusengine.h"
+#include "gitstatusparser.h"
+#include "gitworktreewatcher.h"
+#include "gitfsmonitor.h"
+
+class QThread;
+class QTimer;
 
 class GitManager : public QObject
 {
@@ -27,6 +46,8 @@ public:
         QString path;
         FileStatus status;
         QString oldPath; // For renamed files
+        char indexStatus = ' ';    // 暂存区状态列（porcelain中的X）
+        char worktreeStatus = ' '; // 工作树状态列（porcelain中的Y）
     };
 
     struct CommitInfo {
@@ -34,6 +55,8 @@ public:
         QString author;
         QString date;
         QString message;
+        QStringList parents; // 父提交哈希，用于绘制提交图
+        qint64 commitTime = 0; // 提交者时间（Unix时间戳）
     };
 
     struct BranchInfo {
@@ -47,6 +70,30 @@ public:
         QString url;
     };
 
+    // 本地分支相对上游的领先/落后提交数
+    struct BranchTracking {
+        QString branch;
+        QString upstream;   // 上游的简称，如origin/main
+        int ahead = 0;
+        int behind = 0;
+        bool gone = false;  // 配置了上游，但上游引用已不存在
+    };
+
+    struct TagInfo {
+        QString name;
+        QString target;      // 标签最终指向的对象，标签的标签也解引用到非标签对象
+        qint64 date = 0;     // 附注标签为打标签的时间，轻量标签为提交时间（Unix秒）
+        QString subject;     // 附注标签说明的第一行，轻量标签为提交信息的第一行
+        bool annotated = false;
+    };
+
+    // 仓库快照的命中情况：同一指纹下重复的只读查询直接返回快照中的结果
+    struct SnapshotStatistics {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 epochs = 0; // 指纹变化的次数
+    };
+
     explicit GitManager(QObject *parent = nullptr);
     ~GitManager();
 
@@ -70,6 +117,8 @@ public:
 
     // 分支操作
     QList<BranchInfo> getBranches();
+    // 当前分支名，直接读取HEAD文件；分离HEAD或未打开仓库时为空
+    QString currentBranch();
     bool createBranch(const QString &branchName);
     bool checkoutBranch(const QString &branchName);
     bool mergeBranch(const QString &branchName);
@@ -86,23 +135,263 @@ public:
     QString getDiff(const QString &filePath);
     QString getStagedDiff(const QString &filePath);
 
+    // 贮藏的数量，直接读取stash的引用日志
+    int stashCount();
+
     // 标签操作
     QList<QString> getTags();
     bool createTag(const QString &tagName, const QString &commitHash = "");
     bool deleteTag(const QString &tagName);
 
+    // 异步接口：不阻塞GUI线程，结果同时通过回调和对应信号返回
+    void getFileStatusAsync(std::function<void(const QList<FileInfo> &)> callback = nullptr);
+    void getCommitHistoryAsync(int limit = 100, std::function<void(const QList<CommitInfo> &)> callback = nullptr);
+    // 分页读取提交历史：restart为true时从HEAD重新开始，否则从上一页结束处继续。
+    // 回调的hasMore为false表示已经到底；restart之后旧遍历的结果会被丢弃
+    void getCommitHistoryPageAsync(int pageSize, bool restart,
+                                   std::function<void(const QList<CommitInfo> &, bool)> callback = nullptr);
+    void getBranchesAsync(std::function<void(const QList<BranchInfo> &)> callback = nullptr);
+    void getRemotesAsync(std::function<void(const QList<RemoteInfo> &)> callback = nullptr);
+    // 一次git for-each-ref读取全部标签的指向、日期和说明
+    void getTagsAsync(std::function<void(const QList<TagInfo> &)> callback = nullptr);
+    void getDiffAsync(const QString &filePath, bool staged = false, std::function<void(const QString &)> callback = nullptr);
+    // 边运行边把未解码的差异分块交给outputCallback，返回的任务ID可用于cancelJob。
+    // 工作树与索引的差异在可能时于进程内计算，输出格式与git diff相同
+    quint64 getDiffStreamAsync(const QString &filePath, bool staged,
+                               std::function<void(const QByteArray &)> outputCallback,
+                               std::function<void(bool)> callback = nullptr);
+    // 在搜索索引中查找提交信息、作者或对象ID包含query的提交，按提交时间从新到旧返回最多limit个。
+    // 索引只包含浏览历史时加载过的提交；没有可用的索引（对象库打开失败）时返回false
+    bool searchCommits(const QString &query, int limit, QList<CommitInfo> *commits);
+    // git diff --stat的摘要，大文件先显示它，用户确认后再读取完整差异
+    void getDiffStatAsync(const QString &filePath, bool staged, std::function<void(const QByteArray &)> callback);
+    // 一次git diff --cached读取全部暂存的差异，按文件切分但不复制补丁；失败时ok为false
+    void getStagedDiffAsync(std::function<void(bool ok, const GitDiff &diff)> callback);
+    void pushAsync(const QString &remoteName, const QString &branchName, std::function<void(bool)> callback = nullptr);
+    void pullAsync(const QString &remoteName, const QString &branchName, std::function<void(bool)> callback = nullptr);
+    void cloneRepositoryAsync(const QString &url, const QString &destPath, std::function<void(bool)> callback = nullptr);
+    void stageFileAsync(const QString &filePath, std::function<void(bool)> callback = nullptr);
+    void unstageFileAsync(const QString &filePath, std::function<void(bool)> callback = nullptr);
+    void discardChangesAsync(const QString &filePath, std::function<void(bool)> callback = nullptr);
+    // 批量操作：所有路径经标准输入（--pathspec-from-file）一次交给git，只启动一个进程
+    void stageFilesAsync(const QStringList &paths, std::function<void(bool)> callback = nullptr);
+    void unstageFilesAsync(const QStringList &paths, std::function<void(bool)> callback = nullptr);
+    void discardFilesAsync(const QStringList &paths, std::function<void(bool)> callback = nullptr);
+    void commitAsync(const QString &message, std::function<void(bool)> callback = nullptr);
+    void checkoutBranchAsync(const QString &branchName, std::function<void(bool)> callback = nullptr);
+
+    // 对象读取：通过常驻的git cat-file进程，不再为每次查询启动新进程
+    void getCommitInfoAsync(const QString &commitHash, std::function<void(const CommitInfo &)> callback = nullptr);
+    void getCommitDiffAsync(const QString &commitHash, std::function<void(const QString &)> callback = nullptr);
+    void getObjectAsync(const QString &revision, std::function<void(const QByteArray &)> callback);
+    void getObjectInfoAsync(const QString &revision, std::function<void(const GitCatFile::ObjectInfo &)> callback);
+
+    // 提交关系查询：两端都在commit-graph中时在进程内按代数剪枝计算，否则执行git命令；结果只通过回调返回。
+    // ahead为只在revision中的提交数，behind为只在upstream中的提交数；ok为false表示无法比较
+    void getAheadBehindAsync(const QString &revision, const QString &upstream,
+                             std::function<void(bool ok, int ahead, int behind)> callback);
+    // 所有配置了上游的本地分支：一次for-each-ref读出分支和上游，领先/落后数按（分支提交，上游提交）缓存，
+    // 只计算提交变化过的分支；两端都在commit-graph中时在进程内计算，其余合并为一次%(upstream:track)查询
+    void getBranchTrackingAsync(std::function<void(const QList<BranchTracking> &)> callback = nullptr);
+    void isAncestorAsync(const QString &ancestor, const QString &revision, std::function<void(bool)> callback);
+    // 没有公共祖先时回调空字符串
+    void getMergeBaseAsync(const QString &first, const QString &second, std::function<void(const QString &)> callback);
+
+    // 进程内计算已跟踪文件的状态，只做lstat比较，不启动git进程；结果不含未跟踪文件。
+    // paths为空时检查全部文件；仓库不支持时（拆分索引、换行符转换等）返回false，调用方应回退到getFileStatus
+    bool getTrackedFileStatus(const QStringList &paths, QList<FileInfo> *fileStatus);
+
+    // 只刷新指定路径（文件或目录）的状态，结果通过回调和fileStatusUpdated返回；
+    // 路径都是已跟踪文件时在进程内比较，否则用pathspec限定git status的范围
+    void refreshFileStatusAsync(const QStringList &paths,
+                                std::function<void(const QStringList &, const QList<FileInfo> &)> callback = nullptr);
+
+    // 内置fsmonitor：git命令（包括在终端中执行的）通过钩子查询变化的路径，不再遍历整个工作树。
+    // 开关保存在仓库配置的core.fsmonitor中，打开仓库时自动恢复
+    bool isFsmonitorSupported() const;
+    bool isFsmonitorEnabled() const;
+    void setFsmonitorEnabledAsync(bool enabled, std::function<void(bool)> callback = nullptr);
+    // 分别在不使用和使用fsmonitor时执行git status，回调耗时（毫秒）；git status失败时都为-1
+    void measureFsmonitorSpeedupAsync(std::function<void(qint64, qint64)> callback = nullptr);
+    // 分别用git diff和进程内引擎比较该文件的工作树与索引，回调耗时（毫秒）；不能在进程内比较时进程内耗时为-1，git diff失败时都为-1
+    void measureNativeDiffSpeedupAsync(const QString &filePath, std::function<void(qint64, qint64)> callback = nullptr);
+
+    SnapshotStatistics snapshotStatistics() const;
+
+    // 同时运行的git进程数量上限
+    void setMaxConcurrentProcesses(int count);
+    int maxConcurrentProcesses() const;
+    // 取消流式读取等只读任务，之后不再触发其回调
+    bool cancelJob(quint64 jobId);
+
 signals:
     void repositoryOpened(const QString &path);
     void repositoryClosed();
     void commandExecuted(const QString &command, const QString &output);
     void errorOccurred(const QString &error);
 
+    // 异步接口结果
+    void fileStatusReady(const QList<GitManager::FileInfo> &fileStatus);
+    void branchStatusReady(const QString &branch, const QString &upstream, int ahead, int behind);
+    // paths范围内的文件状态，替换模型中这些路径原有的状态
+    void fileStatusUpdated(const QStringList &paths, const QList<GitManager::FileInfo> &fileStatus);
+    // 在外部修改了索引、HEAD或引用，需要全量刷新
+    void repositoryStateChanged();
+    void fsmonitorStateChanged(bool enabled);
+    void fsmonitorSpeedupMeasured(qint64 withoutMonitorMs, qint64 withMonitorMs);
+    void commitHistoryReady(const QList<GitManager::CommitInfo> &commitHistory);
+    void commitHistoryPageReady(const QList<GitManager::CommitInfo> &commits, bool restart, bool hasMore);
+    void branchesReady(const QList<GitManager::BranchInfo> &branches);
+    void branchTrackingReady(const QList<GitManager::BranchTracking> &tracking);
+    void remotesReady(const QList<GitManager::RemoteInfo> &remotes);
+    void tagsReady(const QList<GitManager::TagInfo> &tags);
+    void diffReady(const QString &filePath, const QString &diff);
+    void commitInfoReady(const GitManager::CommitInfo &commit);
+    void pushFinished(bool success);
+    void pullFinished(bool success);
+    void cloneFinished(const QString &destPath, bool success);
+
 private:
+    using CommandCallback = std::function<void(bool success, const QByteArray &output)>;
+
     QString executeCommand(const QStringList &args, bool *success = nullptr);
-    FileStatus parseFileStatus(const QString &statusCode);
+    // 只读命令的原始标准输出，不解码、不混入标准错误；失败时返回空并通过errorOccurred报告
+    QByteArray executeReadCommand(const QStringList &args, bool *success = nullptr);
+    void executeCommandAsync(const QStringList &args, CommandCallback callback,
+                             GitJobScheduler::Priority priority = GitJobScheduler::Interactive,
+                             bool mutating = false, const QByteArray &input = QByteArray());
+    quint64 executeStreamingAsync(const QStringList &args, GitJobScheduler::OutputCallback outputCallback,
+                                  CommandCallback callback,
+                                  GitJobScheduler::Priority priority = GitJobScheduler::Interactive);
+    void executeMutationAsync(const QStringList &args, std::function<void(bool)> callback,
+                              const QByteArray &input = QByteArray());
+    // push、fetch：与其他变更任务串行，但不挡住只读任务，也不暂停监视器，网络很慢时界面照常刷新
+    void executeRemoteAsync(const QStringList &args, std::function<void(bool)> callback);
+    void executePathspecMutationAsync(const QStringList &args, const QStringList &paths, std::function<void(bool)> callback);
+    void onJobFinished(const QStringList &args, bool success, const QByteArray &output, const QString &error);
+    static FileStatus parseFileStatus(char index, char worktree);
+
+    // 输出解析，同步和异步接口共用
+    QStringList fileStatusArgs() const;
+    static FileInfo fileInfoFromRecord(const GitStatusParser::Record &record);
+    QList<CommitInfo> parseCommitHistoryOutput(const QString &output);
+    QList<BranchInfo> parseBranchesOutput(const QString &output);
+    QList<RemoteInfo> parseRemotesOutput(const QString &output);
+    static QStringList tagArgs();
+    // nestedTags中为指向另一个标签对象的附注标签在结果中的位置，它们的target还需要继续解引用
+    static QList<TagInfo> parseTagsOutput(const QByteArray &output, QList<int> *nestedTags = nullptr);
+    // %(upstream:track,nobracket)的输出，如"ahead 2, behind 1"或"gone"
+    static void parseTrackOutput(const QByteArray &track, BranchTracking *tracking);
+    QStringList commitHistoryArgs(int limit) const;
+    CommitInfo parseCommitObject(const QByteArray &oid, const QByteArray &data) const;
+
+    // 进程内对象库读取，失败时调用方回退到git命令
+    GitObjectDatabase::Object readObjectNative(const QByteArray &oid);
+    // 引用名按git的查找顺序解析并解引用标签；表达式、伪引用和读取失败时返回空，由git处理
+    QByteArray resolveRevisionNative(const QString &revision) const;
+    // 与git branch -a的输出相同：当前分支或分离HEAD、本地分支、远程跟踪分支依次排列
+    bool readBranchesNative(QList<BranchInfo> *branches) const;
+
+    // 仓库状态快照，各项在第一次查询时填入；指纹不同的快照整体作废
+    struct RepositorySnapshot {
+        QByteArray fingerprint;
+        bool hasHead = false;
+        QByteArray headTarget; // HEAD指向的引用名，分离HEAD时为空
+        bool hasBranches = false;
+        QList<BranchInfo> branches;
+        bool hasRemotes = false;
+        QList<RemoteInfo> remotes;
+        bool hasTags = false;
+        QList<TagInfo> tags;
+        bool hasTracking = false;
+        QList<BranchTracking> tracking;
+        bool hasStatus = false;
+        QList<FileInfo> status;
+        GitStatusParser::BranchStatus branchStatus;
+        bool hasStashCount = false;
+        int stashCount = 0;
+    };
+    // HEAD、packed-refs、索引、配置和贮藏日志的修改时间与大小，加上监视器的事件计数；
+    // 监视器不完整时无法发现松散引用和工作树的变化，返回空，不使用快照
+    QByteArray repositoryFingerprint();
+    // 与当前指纹对应的快照，指纹变化时清空；不能使用快照时返回nullptr
+    RepositorySnapshot *currentSnapshot();
+    // 查询开始时的指纹仍是快照的指纹时返回快照，供保存查询结果；否则结果可能已过期，返回nullptr
+    RepositorySnapshot *snapshotFor(const QByteArray &fingerprint);
+    void recordSnapshotLookup(bool hit);
+    // 附注标签（包括标签的标签）解引用到最终指向的对象，对象库读不到时返回空
+    QByteArray peelTagNative(const QByteArray &oid) const;
+    quint32 commitGraphPosition(const QString &revision) const;
+    // first和second为十六进制对象ID，任一不在commit-graph中时返回false
+    bool aheadBehindNative(const QByteArray &first, const QByteArray &second, int *ahead, int *behind) const;
+    void deliverBranchTracking(const QByteArray &fingerprint, const QList<BranchTracking> &trackingList,
+                               std::function<void(const QList<BranchTracking> &)> callback);
+    bool loadCommitNative(const QByteArray &oid, GitCommitCache::Commit *commit);
+    bool readCommitHistoryNative(int limit, QList<CommitInfo> *commits);
+    struct HistoryWalk;
+    bool startHistoryWalkNative(HistoryWalk *walk);
+    bool enqueueHistoryCommit(HistoryWalk *walk, const QByteArray &oid);
+    bool readHistoryPageNative(HistoryWalk *walk, int count, QList<CommitInfo> *commits);
+    static CommitInfo commitInfoFromCache(const GitCommitCache::Commit &cached);
+    void saveCommitCache();
+    // 把读到的一页历史加入搜索索引，已经索引的提交跳过
+    void indexCommitsForSearch(const QList<CommitInfo> &commits);
+    static bool isFullObjectId(const QString &revision);
+    // 在差异线程中比较工作树与索引，不能在进程内比较时返回0，由调用方回退到git diff
+    quint64 startNativeDiffAsync(const QString &filePath, std::function<void(const QByteArray &)> outputCallback,
+                                 std::function<void(bool)> callback);
+    // 执行一次允许写回索引的git status，把fsmonitor令牌推进到当前
+    void advanceFsmonitorToken();
 
     QString m_currentRepository;
     QProcess *m_process;
+
+    // 异步命令调度器；仓库切换后旧仓库的结果会被丢弃
+    GitJobScheduler *m_scheduler;
+    quint64 m_repositoryGeneration;
+
+    // 每个仓库一组常驻的cat-file进程
+    GitCatFile *m_catFile;
+    GitCatFile *m_catFileCheck;
+
+    // 只读的进程内对象库，用于历史浏览
+    QString m_gitDir;
+    GitObjectDatabase *m_objectDatabase;
+    // HEAD、松散引用和packed-refs，不依赖对象库
+    GitRefDatabase *m_refDatabase;
+    // 提交元数据的持久缓存，对象库打开失败时为空
+    GitCommitCache *m_commitCache;
+    // 提交信息的全文索引，与提交缓存一起创建和保存
+    GitCommitSearchIndex *m_searchIndex;
+    // objects/info/commit-graph，仓库没有该文件时未打开
+    GitCommitGraph *m_commitGraph;
+
+    // 基于索引stat信息的工作树状态比较
+    GitStatusEngine *m_statusEngine;
+
+    // 工作树变化时只刷新变化的路径
+    GitWorkTreeWatcher *m_watcher;
+
+    // 当前的分页历史遍历，定义在gitmanager.cpp中
+    std::unique_ptr<HistoryWalk> m_historyWalk;
+    quint64 m_historyWalkGeneration;
+
+    // 回答git fsmonitor钩子查询的服务
+    GitFsMonitor *m_fsmonitor;
+    bool m_fsmonitorEnabled;
+    // 工作树安静下来后推进索引中的fsmonitor令牌
+    QTimer *m_fsmonitorTokenTimer;
+
+    RepositorySnapshot m_snapshot;
+    SnapshotStatistics m_snapshotStatistics;
+    // 键为"分支提交 上游提交"，提交不可变，结果不会过期，只在条目过多或切换仓库时清空
+    QHash<QByteArray, QPair<int, int>> m_aheadBehindCache;
+
+    // 进程内差异在这个线程中计算；取消的任务从m_nativeDiffJobs中删除，结果到达后丢弃
+    QThread *m_diffThread;
+    QObject *m_diffWorker;
+    quint64 m_nextNativeDiffJob;
+    QSet<quint64> m_nativeDiffJobs;
 };
 
 #endif // GITMANAGER_H
@@ -0,0 +1,681 @@
+#include "gitobjectdatabase.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstring>
+#include <climits>
+#include <zlib.h>
+
+namespace {
+// 防止损坏或循环的增量链
+const int MaxDeltaChainLength = 10000;
+// alternates最多嵌套层数，与git一致
+const int MaxAlternateDepth = 5;
+
+inline quint32 readBE32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+inline quint64 readBE64(const uchar *p)
+{
+    return (quint64(readBE32(p)) << 32) | readBE32(p + 4);
+}
+
+inline quint64 cacheKey(int packIndex, quint64 offset)
+{
+    return (quint64(packIndex) << 48) | offset;
+}
+}
+
+GitObjectDatabase::GitObjectDatabase(const QString &gitDir)
+    : m_gitDir(gitDir),
+      m_hashSize(20),
+      m_open(false)
+{
+    setDeltaCacheLimit(32 * 1024 * 1024);
+}
+
+GitObjectDatabase::~GitObjectDatabase()
+{
+    close();
+}
+
+bool GitObjectDatabase::open()
+{
+    close();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_gitDir.isEmpty()) {
+        return false;
+    }
+
+    // 工作树的对象库位于commondir中
+    QString commonDir = m_gitDir;
+    QFile commonDirFile(QDir(m_gitDir).filePath("commondir"));
+    if (commonDirFile.open(QIODevice::ReadOnly)) {
+        QString relative = QString::fromUtf8(commonDirFile.readAll()).trimmed();
+        commonDir = QDir::cleanPath(QDir(m_gitDir).absoluteFilePath(relative));
+    }
+
+    m_hashSize = 20;
+    QFile config(QDir(commonDir).filePath("config"));
+    if (config.open(QIODevice::ReadOnly)) {
+        static const QRegularExpression sha256(R"(objectformat\s*=\s*sha256)", QRegularExpression::CaseInsensitiveOption);
+        if (sha256.match(QString::fromUtf8(config.readAll())).hasMatch()) {
+            m_hashSize = 32;
+        }
+    }
+
+    QString objectsDir = QDir(commonDir).filePath("objects");
+    if (!QFileInfo(objectsDir).isDir()) {
+        return false;
+    }
+
+    loadObjectDirectory(objectsDir, 0);
+    m_open = true;
+    return true;
+}
+
+void GitObjectDatabase::close()
+{
+    QMutexLocker locker(&m_mutex);
+    for (PackFile &pack : m_packs) {
+        releasePack(pack);
+    }
+    m_packs.clear();
+    m_objectDirs.clear();
+    m_deltaBaseCache.clear();
+    m_open = false;
+}
+
+bool GitObjectDatabase::isOpen() const
+{
+    return m_open;
+}
+
+GitObjectDatabase::Object GitObjectDatabase::readObject(const QByteArray &oid)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open || oid.size() != m_hashSize * 2) {
+        return Object();
+    }
+
+    QByteArray rawOid = QByteArray::fromHex(oid);
+    if (rawOid.size() != m_hashSize) {
+        return Object();
+    }
+
+    int packIndex;
+    quint64 offset;
+    if (findPacked(rawOid, &packIndex, &offset)) {
+        Object object = readPacked(packIndex, offset);
+        if (object.isValid()) {
+            return object;
+        }
+    }
+    return readLoose(oid.toLower());
+}
+
+bool GitObjectDatabase::hasObject(const QByteArray &oid)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open || oid.size() != m_hashSize * 2) {
+        return false;
+    }
+
+    int packIndex;
+    quint64 offset;
+    if (findPacked(QByteArray::fromHex(oid), &packIndex, &offset)) {
+        return true;
+    }
+
+    QByteArray hex = oid.toLower();
+    for (const QString &dir : m_objectDirs) {
+        QString path = dir + "/" + QString::fromLatin1(hex.left(2)) + "/" + QString::fromLatin1(hex.mid(2));
+        if (QFileInfo::exists(path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GitObjectDatabase::setDeltaCacheLimit(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_deltaBaseCache.setMaxCost(qMax<qint64>(0, bytes));
+}
+
+int GitObjectDatabase::hashSize() const
+{
+    return m_hashSize;
+}
+
+QString GitObjectDatabase::objectsDirectory() const
+{
+    return m_objectDirs.value(0);
+}
+
+QString GitObjectDatabase::resolveGitDir(const QString &repositoryPath)
+{
+    QFileInfo dotGit(QDir(repositoryPath).filePath(".git"));
+    if (dotGit.isDir()) {
+        return dotGit.absoluteFilePath();
+    }
+
+    // 工作树和子模块中.git是一个文件："gitdir: <路径>"
+    if (dotGit.isFile()) {
+        QFile file(dotGit.absoluteFilePath());
+        if (file.open(QIODevice::ReadOnly)) {
+            QString content = QString::fromUtf8(file.readAll()).trimmed();
+            if (content.startsWith("gitdir:")) {
+                QString path = content.mid(7).trimmed();
+                return QDir::cleanPath(QDir(repositoryPath).absoluteFilePath(path));
+            }
+        }
+    }
+    return QString();
+}
+
+bool GitObjectDatabase::parseCommit(const QByteArray &data, CommitHeader *header)
+{
+    int pos = 0;
+    while (pos < data.size()) {
+        int eol = data.indexOf('\n', pos);
+        if (eol < 0) {
+            eol = data.size();
+        }
+
+        // 空行之后是提交信息
+        if (eol == pos) {
+            header->messageOffset = eol + 1;
+            return !header->tree.isEmpty();
+        }
+
+        const char *line = data.constData() + pos;
+        int length = eol - pos;
+        if (length > 5 && std::memcmp(line, "tree ", 5) == 0) {
+            header->tree = QByteArray(line + 5, length - 5);
+        } else if (length > 7 && std::memcmp(line, "parent ", 7) == 0) {
+            header->parents.append(QByteArray(line + 7, length - 7));
+        } else if (length > 7 && std::memcmp(line, "author ", 7) == 0) {
+            header->author = QByteArray(line + 7, length - 7);
+        } else if (length > 10 && std::memcmp(line, "committer ", 10) == 0) {
+            header->committer = QByteArray(line + 10, length - 10);
+            int emailEnd = header->committer.lastIndexOf("> ");
+            if (emailEnd >= 0) {
+                QByteArray when = header->committer.mid(emailEnd + 2);
+                int space = when.indexOf(' ');
+                header->commitTime = (space >= 0 ? when.left(space) : when).toLongLong();
+            }
+        }
+
+        pos = eol + 1;
+    }
+
+    header->messageOffset = data.size();
+    return !header->tree.isEmpty();
+}
+
+const char *GitObjectDatabase::typeName(ObjectType type)
+{
+    switch (type) {
+    case Commit:
+        return "commit";
+    case Tree:
+        return "tree";
+    case Blob:
+        return "blob";
+    case Tag:
+        return "tag";
+    default:
+        return "";
+    }
+}
+
+void GitObjectDatabase::loadObjectDirectory(const QString &objectsDir, int depth)
+{
+    QString canonical = QFileInfo(objectsDir).canonicalFilePath();
+    if (canonical.isEmpty() || m_objectDirs.contains(canonical)) {
+        return;
+    }
+    m_objectDirs.append(canonical);
+
+    // 较新的包文件优先，查找时命中率更高
+    QDir packDir(QDir(canonical).filePath("pack"));
+    const QStringList idxFiles = packDir.entryList(QStringList() << "*.idx", QDir::Files, QDir::Time);
+    for (const QString &idxFile : idxFiles) {
+        if (!openPack(packDir.filePath(idxFile))) {
+            qDebug() << "无法读取包文件索引:" << idxFile;
+        }
+    }
+
+    if (depth >= MaxAlternateDepth) {
+        return;
+    }
+
+    QFile alternates(QDir(canonical).filePath("info/alternates"));
+    if (!alternates.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QList<QByteArray> lines = alternates.readAll().split('\n');
+    for (const QByteArray &line : lines) {
+        QString path = QString::fromUtf8(line).trimmed();
+        if (path.isEmpty() || path.startsWith('#')) {
+            continue;
+        }
+        loadObjectDirectory(QDir(canonical).absoluteFilePath(path), depth + 1);
+    }
+}
+
+bool GitObjectDatabase::openPack(const QString &idxPath)
+{
+    PackFile pack;
+
+    pack.idxFile = new QFile(idxPath);
+    if (!pack.idxFile->open(QIODevice::ReadOnly)) {
+        releasePack(pack);
+        return false;
+    }
+    pack.idxSize = pack.idxFile->size();
+    pack.idx = pack.idxFile->map(0, pack.idxSize);
+
+    // 只支持v2索引：魔数 "\377tOc" + 版本号2
+    static const uchar idxMagic[4] = { 0xff, 't', 'O', 'c' };
+    if (!pack.idx || pack.idxSize < 8 + 256 * 4
+        || std::memcmp(pack.idx, idxMagic, 4) != 0 || readBE32(pack.idx + 4) != 2) {
+        releasePack(pack);
+        return false;
+    }
+
+    pack.fanout = pack.idx + 8;
+    pack.objectCount = readBE32(pack.fanout + 255 * 4);
+
+    // 布局：扇出表、对象ID、CRC32、32位偏移、64位偏移、两个校验和
+    qint64 minimumSize = 8 + 256 * 4 + qint64(pack.objectCount) * (m_hashSize + 8) + 2 * m_hashSize;
+    if (pack.idxSize < minimumSize) {
+        releasePack(pack);
+        return false;
+    }
+    pack.oids = pack.fanout + 256 * 4;
+    pack.offsets = pack.oids + qint64(pack.objectCount) * (m_hashSize + 4);
+    pack.largeOffsets = pack.offsets + qint64(pack.objectCount) * 4;
+    pack.largeOffsetCount = quint32((pack.idxSize - minimumSize) / 8);
+
+    pack.packPath = idxPath.left(idxPath.length() - 4) + ".pack";
+    pack.packFile = new QFile(pack.packPath);
+    if (!pack.packFile->open(QIODevice::ReadOnly)) {
+        releasePack(pack);
+        return false;
+    }
+    pack.packSize = pack.packFile->size();
+    pack.pack = pack.packFile->map(0, pack.packSize);
+    if (!pack.pack || pack.packSize < 12 + m_hashSize || std::memcmp(pack.pack, "PACK", 4) != 0) {
+        releasePack(pack);
+        return false;
+    }
+
+    m_packs.append(pack);
+    return true;
+}
+
+void GitObjectDatabase::releasePack(PackFile &pack)
+{
+    if (pack.idxFile) {
+        if (pack.idx) {
+            pack.idxFile->unmap(const_cast<uchar *>(pack.idx));
+        }
+        delete pack.idxFile;
+    }
+    if (pack.packFile) {
+        if (pack.pack) {
+            pack.packFile->unmap(const_cast<uchar *>(pack.pack));
+        }
+        delete pack.packFile;
+    }
+    pack = PackFile();
+}
+
+bool GitObjectDatabase::findPacked(const QByteArray &rawOid, int *packIndex, quint64 *offset) const
+{
+    if (rawOid.size() != m_hashSize) {
+        return false;
+    }
+
+    const uchar *oid = reinterpret_cast<const uchar *>(rawOid.constData());
+    for (int i = 0; i < m_packs.size(); ++i) {
+        if (findInPack(m_packs.at(i), oid, offset)) {
+            *packIndex = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GitObjectDatabase::findInPack(const PackFile &pack, const uchar *rawOid, quint64 *offset) const
+{
+    // 扇出表给出首字节对应的区间，区间内二分查找
+    quint32 lo = rawOid[0] == 0 ? 0 : readBE32(pack.fanout + (rawOid[0] - 1) * 4);
+    quint32 hi = readBE32(pack.fanout + rawOid[0] * 4);
+
+    while (lo < hi) {
+        quint32 mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(pack.oids + qint64(mid) * m_hashSize, rawOid, m_hashSize);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid;
+        } else {
+            quint32 value = readBE32(pack.offsets + qint64(mid) * 4);
+            if (value & 0x80000000u) {
+                // 最高位置位时，低31位是64位偏移表中的下标
+                quint32 large = value & 0x7fffffffu;
+                if (large >= pack.largeOffsetCount) {
+                    return false;
+                }
+                *offset = readBE64(pack.largeOffsets + qint64(large) * 8);
+            } else {
+                *offset = value;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+GitObjectDatabase::Object GitObjectDatabase::readPacked(int packIndex, quint64 offset)
+{
+    struct DeltaStep {
+        int packIndex;
+        quint64 offset;
+        QByteArray delta;
+    };
+
+    // 沿增量链找到基础对象（或缓存命中），再自底向上依次应用增量
+    QList<DeltaStep> chain;
+    Object base;
+    int currentPack = packIndex;
+    quint64 current = offset;
+
+    for (;;) {
+        if (chain.size() > MaxDeltaChainLength) {
+            return Object();
+        }
+
+        if (!chain.isEmpty()) {
+            if (Object *cached = m_deltaBaseCache.object(cacheKey(currentPack, current))) {
+                base = *cached;
+                break;
+            }
+        }
+
+        const PackFile &pack = m_packs.at(currentPack);
+        const uchar *end = pack.pack + pack.packSize - m_hashSize;
+        if (current < 12 || current >= quint64(pack.packSize - m_hashSize)) {
+            return Object();
+        }
+        const uchar *p = pack.pack + current;
+
+        // 对象头：类型3位，长度为小端变长整数
+        uchar c = *p++;
+        int type = (c >> 4) & 7;
+        quint64 size = c & 0x0f;
+        int shift = 4;
+        while (c & 0x80) {
+            if (p >= end || shift > 57) {
+                return Object();
+            }
+            c = *p++;
+            size |= quint64(c & 0x7f) << shift;
+            shift += 7;
+        }
+
+        if (type >= Commit && type <= Tag) {
+            base.type = ObjectType(type);
+            if (!inflateData(p, end - p, qint64(size), &base.data)) {
+                return Object();
+            }
+            if (!chain.isEmpty()) {
+                m_deltaBaseCache.insert(cacheKey(currentPack, current), new Object(base), base.data.size());
+            }
+            break;
+        }
+
+        DeltaStep step;
+        step.packIndex = currentPack;
+        step.offset = current;
+
+        if (type == OfsDelta) {
+            // 基础对象的相对偏移，git特有的变长编码
+            if (p >= end) {
+                return Object();
+            }
+            c = *p++;
+            quint64 distance = c & 0x7f;
+            while (c & 0x80) {
+                if (p >= end || distance > (quint64(1) << 56)) {
+                    return Object();
+                }
+                c = *p++;
+                distance = ((distance + 1) << 7) | (c & 0x7f);
+            }
+            if (distance == 0 || distance > current) {
+                return Object();
+            }
+            if (!inflateData(p, end - p, qint64(size), &step.delta)) {
+                return Object();
+            }
+            chain.append(step);
+            current -= distance;
+        } else if (type == RefDelta) {
+            if (end - p < m_hashSize) {
+                return Object();
+            }
+            QByteArray baseOid(reinterpret_cast<const char *>(p), m_hashSize);
+            p += m_hashSize;
+            if (!inflateData(p, end - p, qint64(size), &step.delta)) {
+                return Object();
+            }
+            chain.append(step);
+            if (!findPacked(baseOid, &currentPack, &current)) {
+                // 瘦包的基础对象可能是松散对象
+                base = readLoose(baseOid.toHex());
+                if (!base.isValid()) {
+                    return Object();
+                }
+                break;
+            }
+        } else {
+            return Object();
+        }
+    }
+
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        QByteArray result;
+        if (!applyDelta(base.data, chain[i].delta, &result)) {
+            return Object();
+        }
+        base.data = result;
+
+        // 中间结果是上一层增量的基础对象
+        if (i > 0) {
+            m_deltaBaseCache.insert(cacheKey(chain[i].packIndex, chain[i].offset), new Object(base), base.data.size());
+        }
+    }
+    return base;
+}
+
+GitObjectDatabase::Object GitObjectDatabase::readLoose(const QByteArray &oid) const
+{
+    QString name = QString::fromLatin1(oid.left(2)) + "/" + QString::fromLatin1(oid.mid(2));
+    for (const QString &dir : m_objectDirs) {
+        QFile file(dir + "/" + name);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        QByteArray compressed = file.readAll();
+        QByteArray data;
+        if (!inflateAll(reinterpret_cast<const uchar *>(compressed.constData()), compressed.size(), &data)) {
+            return Object();
+        }
+
+        // 松散对象头："<type> <size>\0"
+        int nul = data.indexOf('\0');
+        if (nul < 0) {
+            return Object();
+        }
+        QByteArray header = data.left(nul);
+        int space = header.indexOf(' ');
+        if (space < 0 || header.mid(space + 1).toLongLong() != data.size() - nul - 1) {
+            return Object();
+        }
+
+        Object object;
+        QByteArray type = header.left(space);
+        for (ObjectType candidate : { Commit, Tree, Blob, Tag }) {
+            if (type == typeName(candidate)) {
+                object.type = candidate;
+            }
+        }
+        if (object.type != Invalid) {
+            object.data = data.mid(nul + 1);
+        }
+        return object;
+    }
+    return Object();
+}
+
+bool GitObjectDatabase::inflateData(const uchar *data, qint64 available, qint64 expectedSize, QByteArray *out)
+{
+    if (expectedSize < 0 || available <= 0) {
+        return false;
+    }
+
+    // 多分配一个字节，确保zlib能读到流结束标记
+    out->resize(expectedSize + 1);
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef *>(data);
+    stream.avail_in = uInt(qMin<qint64>(available, UINT_MAX));
+    stream.next_out = reinterpret_cast<Bytef *>(out->data());
+    stream.avail_out = uInt(qMin<qint64>(expectedSize + 1, UINT_MAX));
+
+    int ret = ::inflate(&stream, Z_FINISH);
+    bool ok = ret == Z_STREAM_END && qint64(stream.total_out) == expectedSize;
+    inflateEnd(&stream);
+
+    out->resize(ok ? expectedSize : 0);
+    return ok;
+}
+
+bool GitObjectDatabase::inflateAll(const uchar *data, qint64 available, QByteArray *out)
+{
+    if (available <= 0) {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef *>(data);
+    stream.avail_in = uInt(qMin<qint64>(available, UINT_MAX));
+
+    out->resize(qMax<qint64>(available * 4, 256));
+    int ret;
+    do {
+        if (qint64(stream.total_out) == out->size()) {
+            out->resize(out->size() * 2);
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(out->data()) + stream.total_out;
+        stream.avail_out = uInt(out->size() - qint64(stream.total_out));
+        ret = ::inflate(&stream, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+
+    bool ok = ret == Z_STREAM_END;
+    out->resize(ok ? qint64(stream.total_out) : 0);
+    inflateEnd(&stream);
+    return ok;
+}
+
+bool GitObjectDatabase::applyDelta(const QByteArray &base, const QByteArray &delta, QByteArray *out)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(delta.constData());
+    const uchar *end = p + delta.size();
+
+    auto readSize = [&p, end](quint64 *value) {
+        quint64 result = 0;
+        int shift = 0;
+        uchar c;
+        do {
+            if (p >= end || shift > 63) {
+                return false;
+            }
+            c = *p++;
+            result |= quint64(c & 0x7f) << shift;
+            shift += 7;
+        } while (c & 0x80);
+        *value = result;
+        return true;
+    };
+
+    quint64 sourceSize;
+    quint64 targetSize;
+    if (!readSize(&sourceSize) || !readSize(&targetSize) || sourceSize != quint64(base.size())) {
+        return false;
+    }
+
+    out->resize(qint64(targetSize));
+    uchar *dst = reinterpret_cast<uchar *>(out->data());
+    uchar *dstEnd = dst + targetSize;
+    const uchar *src = reinterpret_cast<const uchar *>(base.constData());
+
+    while (p < end) {
+        uchar cmd = *p++;
+        if (cmd & 0x80) {
+            // 从基础对象复制：低4位标记偏移字节，接下来3位标记长度字节
+            quint64 copyOffset = 0;
+            quint64 copySize = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (cmd & (1 << i)) {
+                    if (p >= end) return false;
+                    copyOffset |= quint64(*p++) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (cmd & (0x10 << i)) {
+                    if (p >= end) return false;
+                    copySize |= quint64(*p++) << (8 * i);
+                }
+            }
+            if (copySize == 0) {
+                copySize = 0x10000;
+            }
+            if (copyOffset + copySize > sourceSize || copySize > quint64(dstEnd - dst)) {
+                return false;
+            }
+            std::memcpy(dst, src + copyOffset, copySize);
+            dst += copySize;
+        } else if (cmd) {
+            // 插入增量中的cmd个字节
+            if (cmd > end - p || cmd > dstEnd - dst) {
+                return false;
+            }
+            std::memcpy(dst, p, cmd);
+            p += cmd;
+            dst += cmd;
+        } else {
+            return false;
+        }
+    }
+    return dst == dstEnd;
+}
@@ -0,0 +1,105 @@
+#ifndef GITOBJECTDATABASE_H
+#define GITOBJECTDATABASE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QCache>
+#include <QMutex>
+
+class QFile;
+
+// 进程内的只读对象库：mmap读取.pack/.idx，解压松散对象，解析OFS/REF增量
+class GitObjectDatabase
+{
+public:
+    enum ObjectType {
+        Invalid = 0,
+        Commit = 1,
+        Tree = 2,
+        Blob = 3,
+        Tag = 4,
+        OfsDelta = 6,
+        RefDelta = 7
+    };
+
+    struct Object {
+        ObjectType type = Invalid;
+        QByteArray data;
+
+        bool isValid() const { return type != Invalid; }
+    };
+
+    // 提交对象的头部信息
+    struct CommitHeader {
+        QByteArray tree;
+        QList<QByteArray> parents;
+        QByteArray author;      // "Name <email> 1700000000 +0800"
+        QByteArray committer;
+        qint64 commitTime = 0;
+        int messageOffset = -1; // 提交信息在对象数据中的起始位置
+    };
+
+    explicit GitObjectDatabase(const QString &gitDir);
+    ~GitObjectDatabase();
+
+    // 扫描对象目录和包文件，包文件变化（gc、fetch）后需要重新调用
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    // oid为十六进制对象ID
+    Object readObject(const QByteArray &oid);
+    bool hasObject(const QByteArray &oid);
+
+    void setDeltaCacheLimit(qint64 bytes);
+    int hashSize() const;
+    // 仓库自己的objects目录（不含alternates），未打开时为空
+    QString objectsDirectory() const;
+
+    static QString resolveGitDir(const QString &repositoryPath);
+    static bool parseCommit(const QByteArray &data, CommitHeader *header);
+    static const char *typeName(ObjectType type);
+
+private:
+    struct PackFile {
+        QString packPath;
+        QFile *idxFile = nullptr;
+        QFile *packFile = nullptr;
+        const uchar *idx = nullptr;
+        qint64 idxSize = 0;
+        const uchar *pack = nullptr;
+        qint64 packSize = 0;
+        quint32 objectCount = 0;
+        const uchar *fanout = nullptr;
+        const uchar *oids = nullptr;
+        const uchar *offsets = nullptr;
+        const uchar *largeOffsets = nullptr;
+        quint32 largeOffsetCount = 0;
+    };
+
+    void loadObjectDirectory(const QString &objectsDir, int depth);
+    bool openPack(const QString &idxPath);
+    void releasePack(PackFile &pack);
+    bool findPacked(const QByteArray &rawOid, int *packIndex, quint64 *offset) const;
+    bool findInPack(const PackFile &pack, const uchar *rawOid, quint64 *offset) const;
+    Object readPacked(int packIndex, quint64 offset);
+    Object readLoose(const QByteArray &oid) const;
+
+    static bool inflateData(const uchar *data, qint64 available, qint64 expectedSize, QByteArray *out);
+    static bool inflateAll(const uchar *data, qint64 available, QByteArray *out);
+    static bool applyDelta(const QByteArray &base, const QByteArray &delta, QByteArray *out);
+
+    QString m_gitDir;
+    QStringList m_objectDirs; // 包括alternates
+    QList<PackFile> m_packs;
+    int m_hashSize;
+    bool m_open;
+
+    // 增量基础对象缓存，按字节数限制大小，key为(包序号 << 48 | 偏移)
+    QCache<quint64, Object> m_deltaBaseCache;
+    QMutex m_mutex;
+};
+
+#endif // GITOBJECTDATABASE_H
@@ -0,0 +1,495 @@
+#include "gitrefdatabase.h"
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+// 与git一致，符号引用最多跟随的层数
+const int MaxSymrefDepth = 5;
+
+const QByteArray PackedRefsHeader = "# pack-refs with:";
+
+bool isObjectId(QByteArrayView text)
+{
+    if (text.size() != 40 && text.size() != 64) {
+        return false;
+    }
+    for (char c : text) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 仓库配置中的extensions.refStorage，或者git init --ref-format=reftable创建的reftable目录
+bool usesReftable(const QString &commonDir)
+{
+    if (QFileInfo(QDir(commonDir).filePath("reftable")).isDir()) {
+        return true;
+    }
+    QFile config(QDir(commonDir).filePath("config"));
+    if (!config.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    bool inExtensions = false;
+    while (!config.atEnd()) {
+        const QByteArray line = config.readLine().trimmed();
+        if (line.startsWith('[')) {
+            inExtensions = line.mid(1, line.indexOf(']') - 1).trimmed().toLower() == "extensions";
+            continue;
+        }
+        const int equals = line.indexOf('=');
+        if (inExtensions && equals > 0 && line.left(equals).trimmed().toLower() == "refstorage") {
+            return line.mid(equals + 1).trimmed().toLower() == "reftable";
+        }
+    }
+    return false;
+}
+
+// 不允许引用名跳出仓库目录
+bool isSafeRefName(const QByteArray &name)
+{
+    return !name.isEmpty() && !name.startsWith('/') && !name.contains("..") && !name.contains('\\');
+}
+
+// 按字节比较，与packed-refs的排序一致
+int compareNames(QByteArrayView a, QByteArrayView b)
+{
+    const int result = std::memcmp(a.data(), b.data(), size_t(std::min(a.size(), b.size())));
+    if (result != 0) {
+        return result;
+    }
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+// p所在行的开头，begin必须是某一行的开头
+const char *lineStart(const char *begin, const char *p)
+{
+    while (p > begin && p[-1] != '\n') {
+        --p;
+    }
+    return p;
+}
+
+const char *lineEnd(const char *p, const char *end)
+{
+    const char *newline = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+    return newline ? newline : end;
+}
+}
+
+GitRefDatabase::GitRefDatabase(const QString &gitDir)
+    : m_gitDir(gitDir),
+      m_commonDir(gitDir),
+      m_supported(false),
+      m_packedFile(nullptr),
+      m_packedSize(-1),
+      m_packedBegin(nullptr),
+      m_packedEnd(nullptr)
+{
+    // 链接的工作树中commondir给出公共目录，可以是相对路径
+    QFile commonDirFile(QDir(gitDir).filePath("commondir"));
+    if (commonDirFile.open(QIODevice::ReadOnly)) {
+        const QString commonDir = QString::fromUtf8(commonDirFile.readAll()).trimmed();
+        if (!commonDir.isEmpty()) {
+            m_commonDir = QDir::cleanPath(QDir(gitDir).absoluteFilePath(commonDir));
+        }
+    }
+    m_supported = !gitDir.isEmpty() && !usesReftable(m_commonDir);
+}
+
+GitRefDatabase::~GitRefDatabase()
+{
+    releasePackedRefs();
+}
+
+QString GitRefDatabase::gitDir() const
+{
+    return m_gitDir;
+}
+
+QString GitRefDatabase::commonDir() const
+{
+    return m_commonDir;
+}
+
+bool GitRefDatabase::isSupported() const
+{
+    return m_supported;
+}
+
+QByteArray GitRefDatabase::head(QByteArray *target) const
+{
+    if (target) {
+        target->clear();
+    }
+
+    QByteArray value;
+    switch (readLooseRef("HEAD", &value)) {
+    case LooseObject:
+        return value;
+    case LooseSymbolic:
+        if (target) {
+            *target = value;
+        }
+        return resolveDepth(value, 1);
+    case LooseMissing:
+        break;
+    }
+    return QByteArray();
+}
+
+bool GitRefDatabase::isUnbornHead() const
+{
+    QByteArray target;
+    if (readLooseRef("HEAD", &target) != LooseSymbolic || !target.startsWith("refs/heads/")) {
+        return false;
+    }
+    // 分支既没有松散引用文件也不在packed-refs中
+    if (QFileInfo::exists(refPath(target))) {
+        return false;
+    }
+    if (!refreshPackedRefs()) {
+        // packed-refs存在却无法读取时不能确定
+        return !QFileInfo::exists(QDir(m_commonDir).filePath("packed-refs"));
+    }
+    const char *record = lowerBound(target);
+    return record == m_packedEnd || recordName(record) != QByteArrayView(target);
+}
+
+QByteArray GitRefDatabase::currentBranch() const
+{
+    QByteArray target;
+    if (readLooseRef("HEAD", &target) != LooseSymbolic || !target.startsWith("refs/heads/")) {
+        return QByteArray();
+    }
+    return target.mid(11);
+}
+
+QByteArray GitRefDatabase::resolve(const QByteArray &refName) const
+{
+    return resolveDepth(refName, 0);
+}
+
+QByteArray GitRefDatabase::resolveDepth(const QByteArray &refName, int depth) const
+{
+    if (depth > MaxSymrefDepth) {
+        return QByteArray();
+    }
+
+    QByteArray value;
+    switch (readLooseRef(refName, &value)) {
+    case LooseObject:
+        return value;
+    case LooseSymbolic:
+        return resolveDepth(value, depth + 1);
+    case LooseMissing:
+        break;
+    }
+
+    // packed-refs中只有公共目录中refs/下的引用
+    if (!refName.startsWith("refs/") || isPerWorktreeRef(refName) || !refreshPackedRefs()) {
+        return QByteArray();
+    }
+    const char *record = lowerBound(refName);
+    if (record == m_packedEnd || recordName(record) != QByteArrayView(refName)) {
+        return QByteArray();
+    }
+    Ref ref;
+    readRecord(record, &ref);
+    return ref.oid;
+}
+
+QList<GitRefDatabase::Ref> GitRefDatabase::refs(const QByteArray &prefix) const
+{
+    if (!m_supported) {
+        return QList<Ref>();
+    }
+
+    // 从prefix所在的目录开始遍历，不必扫描整个refs目录
+    const QByteArray dirName = prefix.left(prefix.lastIndexOf('/') + 1);
+    QMap<QByteArray, Ref> loose;
+    if (dirName.startsWith("refs/") && isSafeRefName(dirName)) {
+        const QString dirPath = QString::fromUtf8(dirName);
+        if (m_commonDir == m_gitDir) {
+            collectLooseRefs(QDir(m_gitDir).filePath(dirPath), dirName, prefix, AllRefs, &loose);
+        } else {
+            collectLooseRefs(QDir(m_commonDir).filePath(dirPath), dirName, prefix, SharedRefs, &loose);
+            collectLooseRefs(QDir(m_gitDir).filePath(dirPath), dirName, prefix, WorktreeRefs, &loose);
+        }
+    }
+
+    // 两边都已按名称排序，合并时同名的松散引用覆盖packed-refs中的记录
+    QList<Ref> result;
+    const char *record = refreshPackedRefs() ? lowerBound(prefix) : m_packedEnd;
+    auto looseIt = loose.cbegin();
+    while (true) {
+        const bool hasPacked = record && record != m_packedEnd && recordName(record).startsWith(prefix);
+        const bool hasLoose = looseIt != loose.cend();
+        if (!hasPacked && !hasLoose) {
+            break;
+        }
+
+        const int order = !hasPacked ? 1 : (!hasLoose ? -1 : compareNames(recordName(record), looseIt.key()));
+        if (order < 0) {
+            Ref ref;
+            readRecord(record, &ref);
+            result.append(std::move(ref));
+            record = nextRecord(record);
+            continue;
+        }
+        if (order == 0) {
+            record = nextRecord(record);
+        }
+
+        Ref ref = looseIt.value();
+        if (!ref.symbolicTarget.isEmpty()) {
+            ref.oid = resolveDepth(ref.symbolicTarget, 1);
+        }
+        // 与git一样跳过指向不存在引用的符号引用
+        if (!ref.oid.isEmpty()) {
+            result.append(std::move(ref));
+        }
+        ++looseIt;
+    }
+    return result;
+}
+
+bool GitRefDatabase::isPerWorktreeRef(QByteArrayView name)
+{
+    // HEAD、ORIG_HEAD等伪引用以及下面几个目录属于每个工作树
+    return !name.startsWith("refs/")
+           || name.startsWith("refs/worktree/")
+           || name.startsWith("refs/bisect/")
+           || name.startsWith("refs/rewritten/");
+}
+
+QString GitRefDatabase::refPath(const QByteArray &name) const
+{
+    // main-worktree/和worktrees/<id>/用于访问其他工作树的引用
+    if (name.startsWith("main-worktree/")) {
+        return QDir(m_commonDir).filePath(QString::fromUtf8(name.mid(14)));
+    }
+    if (name.startsWith("worktrees/")) {
+        const int slash = name.indexOf('/', 10);
+        if (slash > 10 && !isPerWorktreeRef(name.mid(slash + 1))) {
+            return QDir(m_commonDir).filePath(QString::fromUtf8(name.mid(slash + 1)));
+        }
+        return QDir(m_commonDir).filePath(QString::fromUtf8(name));
+    }
+    return QDir(isPerWorktreeRef(name) ? m_gitDir : m_commonDir).filePath(QString::fromUtf8(name));
+}
+
+GitRefDatabase::LooseResult GitRefDatabase::readLooseRef(const QByteArray &name, QByteArray *value) const
+{
+    if (!m_supported || !isSafeRefName(name)) {
+        return LooseMissing;
+    }
+
+    QFile file(refPath(name));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return LooseMissing;
+    }
+    const QByteArray content = file.readAll().trimmed();
+    if (content.startsWith("ref:")) {
+        *value = content.mid(4).trimmed();
+        return value->isEmpty() ? LooseMissing : LooseSymbolic;
+    }
+    if (isObjectId(content)) {
+        *value = content;
+        return LooseObject;
+    }
+    return LooseMissing;
+}
+
+void GitRefDatabase::collectLooseRefs(const QString &dirPath, const QByteArray &name, const QByteArray &prefix,
+                                      WalkFilter filter, QMap<QByteArray, Ref> *loose) const
+{
+    const QFileInfoList entries = QDir(dirPath).entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot,
+                                                              QDir::Unsorted);
+    for (const QFileInfo &entry : entries) {
+        const QByteArray entryName = name + entry.fileName().toUtf8();
+        if (entry.isDir()) {
+            // 与prefix没有公共部分的目录不必进入
+            const QByteArray childName = entryName + '/';
+            if (childName.startsWith(prefix) || prefix.startsWith(childName)) {
+                collectLooseRefs(entry.filePath(), childName, prefix, filter, loose);
+            }
+            continue;
+        }
+        if (!entryName.startsWith(prefix) || entryName.endsWith(".lock")) {
+            continue;
+        }
+        if ((filter == SharedRefs && isPerWorktreeRef(entryName))
+            || (filter == WorktreeRefs && !isPerWorktreeRef(entryName))) {
+            continue;
+        }
+
+        QByteArray value;
+        Ref ref;
+        ref.name = entryName;
+        switch (readLooseRef(entryName, &value)) {
+        case LooseObject:
+            ref.oid = value;
+            break;
+        case LooseSymbolic:
+            ref.symbolicTarget = value;
+            break;
+        case LooseMissing:
+            continue;
+        }
+        loose->insert(entryName, ref);
+    }
+}
+
+bool GitRefDatabase::refreshPackedRefs() const
+{
+    if (!m_supported) {
+        return false;
+    }
+
+    // git通过改名替换packed-refs，大小和修改时间不变时映射仍然有效
+    const QString path = QDir(m_commonDir).filePath("packed-refs");
+    const QFileInfo info(path);
+    if (!info.exists()) {
+        releasePackedRefs();
+        return false;
+    }
+    if (m_packedFile && info.size() == m_packedSize && info.lastModified() == m_packedModified) {
+        return true;
+    }
+
+    releasePackedRefs();
+    m_packedFile = new QFile(path);
+    if (!m_packedFile->open(QIODevice::ReadOnly)) {
+        releasePackedRefs();
+        return false;
+    }
+    m_packedSize = info.size();
+    m_packedModified = info.lastModified();
+    if (m_packedSize == 0) {
+        return true;
+    }
+    const char *data = reinterpret_cast<const char *>(m_packedFile->map(0, m_packedSize));
+    if (!data) {
+        releasePackedRefs();
+        return false;
+    }
+
+    const char *begin = data;
+    const char *end = data + m_packedSize;
+    bool sorted = false;
+    if (QByteArrayView(begin, end).startsWith(PackedRefsHeader)) {
+        const char *headerEnd = lineEnd(begin, end);
+        const QByteArray traits = " " + QByteArray(begin + PackedRefsHeader.size(), headerEnd - begin - PackedRefsHeader.size()) + " ";
+        sorted = traits.contains(" sorted ");
+        begin = headerEnd == end ? end : headerEnd + 1;
+    }
+    if (sorted && end[-1] == '\n') {
+        m_packedBegin = begin;
+        m_packedEnd = end;
+        return true;
+    }
+
+    // 旧版本git写入的文件没有sorted标记，按记录（连同^行）排序后复制一份
+    std::vector<std::pair<const char *, const char *>> records;
+    for (const char *p = begin; p < end;) {
+        const char *next = lineEnd(p, end);
+        next = next == end ? end : next + 1;
+        if (*p == '^' && !records.empty()) {
+            records.back().second = next;
+        } else if (*p != '#' && *p != '\n') {
+            records.emplace_back(p, next);
+        }
+        p = next;
+    }
+    auto nameOf = [end](const std::pair<const char *, const char *> &record) {
+        const char *space = static_cast<const char *>(std::memchr(record.first, ' ', size_t(record.second - record.first)));
+        const char *nameBegin = space ? space + 1 : record.second;
+        return QByteArrayView(nameBegin, lineEnd(nameBegin, end));
+    };
+    std::stable_sort(records.begin(), records.end(), [&nameOf](const auto &a, const auto &b) {
+        return compareNames(nameOf(a), nameOf(b)) < 0;
+    });
+
+    m_sortedPacked.clear();
+    m_sortedPacked.reserve(end - begin + 1);
+    for (const auto &record : records) {
+        m_sortedPacked.append(record.first, record.second - record.first);
+        if (!m_sortedPacked.endsWith('\n')) {
+            m_sortedPacked.append('\n');
+        }
+    }
+    m_packedBegin = m_sortedPacked.constData();
+    m_packedEnd = m_packedBegin + m_sortedPacked.size();
+    return true;
+}
+
+void GitRefDatabase::releasePackedRefs() const
+{
+    delete m_packedFile;
+    m_packedFile = nullptr;
+    m_packedSize = -1;
+    m_packedModified = QDateTime();
+    m_sortedPacked.clear();
+    m_packedBegin = nullptr;
+    m_packedEnd = nullptr;
+}
+
+QByteArrayView GitRefDatabase::recordName(const char *record) const
+{
+    const char *end = lineEnd(record, m_packedEnd);
+    const char *space = static_cast<const char *>(std::memchr(record, ' ', size_t(end - record)));
+    return space ? QByteArrayView(space + 1, end) : QByteArrayView();
+}
+
+const char *GitRefDatabase::nextRecord(const char *record) const
+{
+    // 跳过本行以及后面的^行
+    const char *p = lineEnd(record, m_packedEnd);
+    p = p == m_packedEnd ? p : p + 1;
+    while (p < m_packedEnd && *p == '^') {
+        p = lineEnd(p, m_packedEnd);
+        p = p == m_packedEnd ? p : p + 1;
+    }
+    return p;
+}
+
+const char *GitRefDatabase::lowerBound(QByteArrayView name) const
+{
+    // 在字节区间上二分：low始终是记录的开头，取中点所在的记录比较
+    const char *low = m_packedBegin;
+    const char *high = m_packedEnd;
+    while (low < high) {
+        const char *record = lineStart(low, low + (high - low) / 2);
+        if (*record == '^' && record > low) {
+            record = lineStart(low, record - 1);
+        }
+        if (compareNames(recordName(record), name) < 0) {
+            low = nextRecord(record);
+        } else {
+            high = record;
+        }
+    }
+    return low;
+}
+
+void GitRefDatabase::readRecord(const char *record, Ref *ref) const
+{
+    const char *end = lineEnd(record, m_packedEnd);
+    const char *space = static_cast<const char *>(std::memchr(record, ' ', size_t(end - record)));
+    if (!space) {
+        return;
+    }
+    ref->oid = QByteArray(record, space - record);
+    ref->name = QByteArray(space + 1, end - space - 1);
+    if (end + 1 < m_packedEnd && end[1] == '^') {
+        const char *peeledEnd = lineEnd(end + 1, m_packedEnd);
+        ref->peeled = QByteArray(end + 2, peeledEnd - end - 2);
+    }
+}
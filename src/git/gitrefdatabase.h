@@ -0,0 +1,94 @@
+#ifndef GITREFDATABASE_H
+#define GITREFDATABASE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDateTime>
+#include <QList>
+#include <QMap>
+
+class QFile;
+
+// 只读的引用库：HEAD、松散引用和packed-refs，不启动git进程。
+// packed-refs通过mmap读取，记录已排序时直接在映射上二分查找，否则在内存中排序一次；
+// 文件大小或修改时间变化后重新映射。链接的工作树中HEAD等每个工作树独有的引用在gitDir，
+// 分支和标签在commondir指向的公共目录
+class GitRefDatabase
+{
+public:
+    struct Ref {
+        QByteArray name;           // 完整的引用名，如refs/heads/main
+        QByteArray oid;            // 十六进制对象ID，符号引用为最终指向的对象
+        QByteArray peeled;         // 附注标签指向的对象，只有packed-refs中带^行时才有
+        QByteArray symbolicTarget; // 符号引用指向的引用名
+    };
+
+    explicit GitRefDatabase(const QString &gitDir);
+    ~GitRefDatabase();
+
+    QString gitDir() const;
+    QString commonDir() const;
+    // 引用以文件形式保存时为true；reftable格式（extensions.refStorage=reftable）的仓库读不到引用，
+    // 下面的查询都返回空，调用方应改用git命令
+    bool isSupported() const;
+
+    // HEAD指向的对象ID，分支还没有提交时为空；target不为空时写入HEAD指向的引用名，分离HEAD时为空
+    QByteArray head(QByteArray *target = nullptr) const;
+    // HEAD是指向不存在的分支的符号引用（新仓库或git checkout --orphan之后）；
+    // head()为空而这里为false时是读取失败，不能当作还没有提交
+    bool isUnbornHead() const;
+    // 当前分支名（不含refs/heads/），只读取HEAD文件；分离HEAD时为空
+    QByteArray currentBranch() const;
+    // 跟随符号引用，松散引用优先于packed-refs；引用不存在时为空
+    QByteArray resolve(const QByteArray &refName) const;
+    // 以prefix开头的全部引用，按引用名的字节顺序排列
+    QList<Ref> refs(const QByteArray &prefix = "refs/") const;
+
+private:
+    enum LooseResult {
+        LooseMissing,
+        LooseObject,
+        LooseSymbolic
+    };
+
+    // 链接的工作树中公共目录和gitDir分别遍历，各取一部分引用
+    enum WalkFilter {
+        AllRefs,
+        SharedRefs,
+        WorktreeRefs
+    };
+
+    // 每个工作树独有的引用保存在gitDir，其余在公共目录
+    static bool isPerWorktreeRef(QByteArrayView name);
+    QString refPath(const QByteArray &name) const;
+    LooseResult readLooseRef(const QByteArray &name, QByteArray *value) const;
+    QByteArray resolveDepth(const QByteArray &refName, int depth) const;
+    // 递归列出目录中以prefix开头的松散引用，name为目录对应的引用名前缀
+    void collectLooseRefs(const QString &dirPath, const QByteArray &name, const QByteArray &prefix,
+                          WalkFilter filter, QMap<QByteArray, Ref> *loose) const;
+
+    // packed-refs未变化时直接返回，变化后重新映射；文件不存在时返回false
+    bool refreshPackedRefs() const;
+    void releasePackedRefs() const;
+    // 记录的引用名，record指向记录开头
+    QByteArrayView recordName(const char *record) const;
+    const char *nextRecord(const char *record) const;
+    // 第一个引用名不小于name的记录，没有时返回m_packedEnd
+    const char *lowerBound(QByteArrayView name) const;
+    void readRecord(const char *record, Ref *ref) const;
+
+    QString m_gitDir;
+    QString m_commonDir;
+    bool m_supported;
+
+    // packed-refs的映射；未排序的文件复制到m_sortedPacked后排序，记录范围指向副本
+    mutable QFile *m_packedFile;
+    mutable qint64 m_packedSize;
+    mutable QDateTime m_packedModified;
+    mutable QByteArray m_sortedPacked;
+    mutable const char *m_packedBegin;
+    mutable const char *m_packedEnd;
+};
+
+#endif // GITREFDATABASE_H
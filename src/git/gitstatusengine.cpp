@@ -0,0 +1,615 @@
+#include "gitstatusengine.h"
+#include "gitobjectdatabase.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QProcess>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace {
+// 树对象嵌套层数上限，防止损坏的对象导致无限递归
+const int MaxTreeDepth = 1024;
+
+template <typename T>
+QPair<int, int> pathRange(const QList<T> &items, const QByteArray &path)
+{
+    auto lessThan = [](const T &item, const QByteArray &value) { return item.path < value; };
+    if (path.isEmpty()) {
+        return qMakePair(0, int(items.size()));
+    }
+
+    auto first = std::lower_bound(items.begin(), items.end(), path, lessThan);
+    if (first != items.end() && first->path == path) {
+        return qMakePair(int(first - items.begin()), int(first - items.begin()) + 1);
+    }
+
+    QByteArray prefix = path + '/';
+    first = std::lower_bound(items.begin(), items.end(), prefix, lessThan);
+    auto last = first;
+    while (last != items.end() && last->path.startsWith(prefix)) {
+        ++last;
+    }
+    return qMakePair(int(first - items.begin()), int(last - items.begin()));
+}
+
+GitStatusEngine::Change &changeFor(QMap<QByteArray, GitStatusEngine::Change> *changes, const QByteArray &path)
+{
+    GitStatusEngine::Change &change = (*changes)[path];
+    change.path = path;
+    return change;
+}
+
+// 只影响git diff以外的输出、或与单个文件的差异正文无关的diff配置
+bool isHarmlessDiffKey(const QByteArray &key)
+{
+    static const QList<QByteArray> keys = {
+        "diff.renames", "diff.renamelimit", "diff.tool", "diff.guitool", "diff.submodule",
+        "diff.statgraphwidth", "diff.ignoresubmodules", "diff.colormoved", "diff.colormovedws",
+        "diff.autorefreshindex", "diff.dirstat", "diff.statnamewidth"
+    };
+    return keys.contains(key);
+}
+
+// 配置文件的修改时间和大小，文件不存在时同样记录
+void appendFileStamp(QByteArray *stamp, const QString &path)
+{
+    const QFileInfo info(path);
+    stamp->append(QFile::encodeName(path));
+    stamp->append(':');
+    stamp->append(QByteArray::number(info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1));
+    stamp->append(':');
+    stamp->append(QByteArray::number(info.size()));
+    stamp->append(';');
+}
+}
+
+GitStatusEngine::GitStatusEngine(const QString &workTree, const QString &gitDir, GitObjectDatabase *objectDatabase)
+    : m_workTree(workTree),
+      m_gitDir(gitDir),
+      m_objectDatabase(objectDatabase),
+      m_indexStatValid(false),
+      m_hasAttributes(false),
+      m_headTreeLoaded(false),
+      m_configValid(false),
+      m_hasGlobalAttributes(false),
+      m_hasDiffConfig(false),
+      m_convertsLineEndings(false),
+      m_trustFileMode(true),
+      m_trustCtime(true),
+      m_minimalStat(false)
+{
+}
+
+bool GitStatusEngine::isUsable()
+{
+    if (!reloadConfigIfChanged() || !reloadIndexIfChanged()) {
+        return false;
+    }
+    return !m_index.isSplit() && !m_index.isSparse() && !m_convertsLineEndings
+           && !m_hasAttributes && !m_hasGlobalAttributes;
+}
+
+bool GitStatusEngine::status(const QByteArray &headOid, bool unborn, const QStringList &paths, QList<Change> *changes)
+{
+    changes->clear();
+    m_statistics = Statistics();
+    if (!isUsable() || (headOid.isEmpty() && !unborn)) {
+        return false;
+    }
+
+    QByteArray treeOid;
+    if (!headOid.isEmpty() && !resolveHeadTree(headOid, &treeOid)) {
+        return false;
+    }
+
+    QList<QByteArray> filters;
+    for (const QString &path : paths) {
+        QByteArray filter = QDir::fromNativeSeparators(path).toUtf8();
+        while (filter.endsWith('/')) {
+            filter.chop(1);
+        }
+        if (filter.isEmpty() || filter == ".") {
+            filters.clear();
+            break;
+        }
+        filters.append(filter);
+    }
+    if (filters.isEmpty()) {
+        filters.append(QByteArray());
+    }
+
+    // 缓存树的根节点与HEAD树相同，说明暂存区没有任何变化，不必展开HEAD树
+    const bool wholeTree = filters.size() == 1 && filters.first().isEmpty();
+    const bool indexMatchesHead = wholeTree && !treeOid.isEmpty() && m_index.cacheTreeOid() == treeOid;
+    if (!indexMatchesHead && !loadHeadTree(treeOid)) {
+        return false;
+    }
+
+    QMap<QByteArray, Change> result;
+    const QList<GitIndex::Entry> &entries = m_index.entries();
+    for (const QByteArray &filter : filters) {
+        QPair<int, int> range = m_index.entryRange(filter);
+        if (!indexMatchesHead) {
+            compareWithHead(range.first, range.second, filter, &result);
+        }
+
+        for (int i = range.first; i < range.second; ++i) {
+            const GitIndex::Entry &entry = entries[i];
+            if (entry.stage() != 0) {
+                Change &change = changeFor(&result, entry.path);
+                change.index = 'U';
+                change.worktree = 'U';
+                continue;
+            }
+
+            char worktree = worktreeStatus(entry);
+            if (worktree != ' ') {
+                changeFor(&result, entry.path).worktree = worktree;
+            }
+        }
+    }
+
+    *changes = result.values();
+    return true;
+}
+
+bool GitStatusEngine::isTracked(const QStringList &paths)
+{
+    if (paths.isEmpty() || !isUsable()) {
+        return false;
+    }
+    for (const QString &path : paths) {
+        if (m_index.findEntry(QDir::fromNativeSeparators(path).toUtf8()) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GitStatusEngine::worktreeDiffEntry(const QString &path, GitIndex::Entry *entry)
+{
+    if (!isUsable() || m_hasDiffConfig) {
+        return false;
+    }
+    const int index = m_index.findEntry(QDir::fromNativeSeparators(path).toUtf8());
+    if (index < 0) {
+        return false;
+    }
+    const GitIndex::Entry &found = m_index.entries().at(index);
+    if (found.stage() != 0 || found.intentToAdd() || found.skipWorktree()
+        || (found.mode & GitIndex::TypeMask) != GitIndex::RegularFile) {
+        return false;
+    }
+
+    FileStat stat;
+    if (!statFile(QFile::encodeName(m_workTree) + '/' + found.path, &stat)
+        || (stat.mode & GitIndex::TypeMask) != GitIndex::RegularFile) {
+        return false;
+    }
+    if (m_trustFileMode && ((stat.mode ^ found.mode) & 0100)) {
+        return false;
+    }
+    *entry = found;
+    return true;
+}
+
+GitStatusEngine::Statistics GitStatusEngine::lastStatistics() const
+{
+    return m_statistics;
+}
+
+bool GitStatusEngine::statFile(const QByteArray &path, FileStat *stat)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::lstat(path.constData(), &st) != 0) {
+        return false;
+    }
+    stat->ctimeSeconds = st.st_ctime;
+    stat->mtimeSeconds = st.st_mtime;
+#if defined(Q_OS_DARWIN)
+    stat->ctimeNanoseconds = st.st_ctimespec.tv_nsec;
+    stat->mtimeNanoseconds = st.st_mtimespec.tv_nsec;
+#else
+    stat->ctimeNanoseconds = st.st_ctim.tv_nsec;
+    stat->mtimeNanoseconds = st.st_mtim.tv_nsec;
+#endif
+    stat->dev = st.st_dev;
+    stat->ino = st.st_ino;
+    stat->mode = st.st_mode;
+    stat->uid = st.st_uid;
+    stat->gid = st.st_gid;
+    stat->size = st.st_size;
+    return true;
+#else
+    // 没有lstat的平台只能比较修改时间和大小
+    QFileInfo info(QFile::decodeName(path));
+    if (!info.exists() && !info.isSymLink()) {
+        return false;
+    }
+    qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    stat->mtimeSeconds = mtime / 1000;
+    stat->mtimeNanoseconds = (mtime % 1000) * 1000000;
+    if (info.isSymLink()) {
+        stat->mode = GitIndex::Symlink;
+    } else if (info.isDir()) {
+        stat->mode = GitIndex::Directory;
+    } else {
+        stat->mode = GitIndex::RegularFile | (info.isExecutable() ? 0755 : 0644);
+    }
+    stat->size = info.isSymLink() ? info.symLinkTarget().toUtf8().size() : info.size();
+    return true;
+#endif
+}
+
+bool GitStatusEngine::reloadIndexIfChanged()
+{
+    QByteArray indexPath = QFile::encodeName(QDir(m_gitDir).filePath("index"));
+    FileStat stat;
+    if (m_gitDir.isEmpty() || !statFile(indexPath, &stat)) {
+        m_index.clear();
+        m_indexStatValid = false;
+        return false;
+    }
+
+    // git总是写入index.lock再重命名，内容变化时inode和修改时间都会变化
+    if (m_indexStatValid && m_index.isLoaded()
+        && stat.mtimeSeconds == m_indexStat.mtimeSeconds
+        && stat.mtimeNanoseconds == m_indexStat.mtimeNanoseconds
+        && stat.ino == m_indexStat.ino
+        && stat.size == m_indexStat.size) {
+        return true;
+    }
+
+    int hashSize = m_objectDatabase ? m_objectDatabase->hashSize() : 20;
+    m_indexStat = stat;
+    m_indexStatValid = m_index.load(QFile::decodeName(indexPath), hashSize);
+
+    m_hasAttributes = QFileInfo(QDir(m_gitDir).filePath("info/attributes")).size() > 0;
+    for (const GitIndex::Entry &entry : m_index.entries()) {
+        if (entry.path == ".gitattributes" || entry.path.endsWith("/.gitattributes")) {
+            m_hasAttributes = true;
+            break;
+        }
+    }
+    return m_indexStatValid;
+}
+
+bool GitStatusEngine::reloadConfigIfChanged()
+{
+    QString commonDir = m_gitDir;
+    QFile commonDirFile(QDir(m_gitDir).filePath("commondir"));
+    if (commonDirFile.open(QIODevice::ReadOnly)) {
+        commonDir = QDir::cleanPath(QDir(m_gitDir).absoluteFilePath(QString::fromUtf8(commonDirFile.readAll()).trimmed()));
+    }
+
+    // 各级配置文件和全局属性文件都没有变化时沿用上次读取的结果；include引入的文件不在其中
+    const QString xdgHome = qEnvironmentVariable("XDG_CONFIG_HOME", QDir::home().filePath(".config"));
+    const QString defaultAttributes = QDir(xdgHome).filePath("git/attributes");
+    QByteArray stamp;
+    appendFileStamp(&stamp, "/etc/gitconfig");
+    appendFileStamp(&stamp, "/etc/gitattributes");
+    appendFileStamp(&stamp, QDir(xdgHome).filePath("git/config"));
+    appendFileStamp(&stamp, QDir::home().filePath(".gitconfig"));
+    appendFileStamp(&stamp, QDir(commonDir).filePath("config"));
+    appendFileStamp(&stamp, QDir(m_gitDir).filePath("config.worktree"));
+    appendFileStamp(&stamp, defaultAttributes);
+    if (!m_attributesFile.isEmpty() && m_attributesFile != defaultAttributes) {
+        appendFileStamp(&stamp, m_attributesFile);
+    }
+    if (!m_configStamp.isEmpty() && stamp == m_configStamp) {
+        return m_configValid;
+    }
+    m_configStamp = stamp;
+    m_configValid = false;
+
+    // 由git给出生效的值：系统、全局、仓库配置以及include和includeIf都已合并
+    QProcess process;
+    process.setWorkingDirectory(m_workTree);
+    process.start("git", QStringList() << "config" << "--list" << "-z");
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        return false;
+    }
+
+    // 每项为"<键>\n<值>\0"，同一个键出现多次时后面的生效
+    QHash<QByteArray, QByteArray> values;
+    m_hasDiffConfig = false;
+    const QList<QByteArray> entries = process.readAllStandardOutput().split('\0');
+    for (const QByteArray &entry : entries) {
+        if (entry.isEmpty()) {
+            continue;
+        }
+        const int newline = entry.indexOf('\n');
+        const QByteArray key = (newline < 0 ? entry : entry.left(newline)).toLower();
+        values.insert(key, newline < 0 ? QByteArray("true") : entry.mid(newline + 1));
+        // diff.<驱动>.*只通过属性生效，两段的diff.*会改变git diff的输出
+        if (key.startsWith("diff.") && key.count('.') == 1 && !isHarmlessDiffKey(key)) {
+            m_hasDiffConfig = true;
+        }
+    }
+
+    const QByteArray autocrlf = values.value("core.autocrlf", "false").toLower();
+    m_convertsLineEndings = autocrlf == "true" || autocrlf == "input";
+    m_trustFileMode = values.value("core.filemode", "true").toLower() != "false";
+    m_trustCtime = values.value("core.trustctime", "true").toLower() != "false";
+#ifdef Q_OS_UNIX
+    m_minimalStat = values.value("core.checkstat").toLower() == "minimal";
+#else
+    m_minimalStat = true;
+#endif
+
+    // 全局属性文件可能给所有文件设置text、eol或过滤器，有内容时不在进程内比较
+    QString attributesFile = QString::fromUtf8(values.value("core.attributesfile"));
+    if (attributesFile.startsWith("~/")) {
+        attributesFile = QDir::home().filePath(attributesFile.mid(2));
+    }
+    const bool attributesFileChanged = attributesFile != m_attributesFile;
+    m_attributesFile = attributesFile;
+    m_hasGlobalAttributes = QFileInfo(attributesFile.isEmpty() ? defaultAttributes : attributesFile).size() > 0
+                            || QFileInfo("/etc/gitattributes").size() > 0;
+    if (attributesFileChanged) {
+        // 新的属性文件还不在指纹中，下次调用时重新计算
+        m_configStamp.clear();
+    }
+    m_configValid = true;
+    return true;
+}
+
+bool GitStatusEngine::resolveHeadTree(const QByteArray &headOid, QByteArray *treeOid)
+{
+    if (!m_objectDatabase || !m_objectDatabase->isOpen()) {
+        return false;
+    }
+
+    GitObjectDatabase::Object commit = m_objectDatabase->readObject(headOid);
+    GitObjectDatabase::CommitHeader header;
+    if (commit.type != GitObjectDatabase::Commit || !GitObjectDatabase::parseCommit(commit.data, &header)) {
+        return false;
+    }
+    *treeOid = header.tree;
+    return true;
+}
+
+bool GitStatusEngine::loadHeadTree(const QByteArray &treeOid)
+{
+    if (m_headTreeLoaded && m_headTreeOid == treeOid) {
+        return true;
+    }
+
+    m_headTree.clear();
+    m_headTreeOid.clear();
+    m_headTreeLoaded = false;
+
+    // 还没有提交时HEAD树为空，索引中的所有文件都是新增
+    if (!treeOid.isEmpty() && !flattenTree(treeOid, QByteArray(), 0)) {
+        m_headTree.clear();
+        return false;
+    }
+
+    // 树对象中目录按"name/"排序，展开后与索引的字节序一致，这里排序只是保险
+    std::sort(m_headTree.begin(), m_headTree.end(), [](const TreeEntry &a, const TreeEntry &b) {
+        return a.path < b.path;
+    });
+    m_headTreeOid = treeOid;
+    m_headTreeLoaded = true;
+    return true;
+}
+
+bool GitStatusEngine::flattenTree(const QByteArray &treeOid, const QByteArray &prefix, int depth)
+{
+    if (depth > MaxTreeDepth) {
+        return false;
+    }
+
+    GitObjectDatabase::Object tree = m_objectDatabase->readObject(treeOid);
+    if (tree.type != GitObjectDatabase::Tree) {
+        return false;
+    }
+
+    // 每个条目："<八进制模式> <名称>\0<二进制oid>"
+    const int hashSize = m_objectDatabase->hashSize();
+    const char *p = tree.data.constData();
+    const char *end = p + tree.data.size();
+    while (p < end) {
+        const char *space = static_cast<const char *>(memchr(p, ' ', size_t(end - p)));
+        if (!space) {
+            return false;
+        }
+        quint32 mode = 0;
+        for (const char *c = p; c < space; ++c) {
+            if (*c < '0' || *c > '7') {
+                return false;
+            }
+            mode = (mode << 3) | quint32(*c - '0');
+        }
+
+        const char *nameStart = space + 1;
+        const char *nul = static_cast<const char *>(memchr(nameStart, '\0', size_t(end - nameStart)));
+        if (!nul || end - (nul + 1) < hashSize) {
+            return false;
+        }
+
+        QByteArray name(nameStart, int(nul - nameStart));
+        QByteArray oid = QByteArray(nul + 1, hashSize).toHex();
+        QByteArray path = prefix.isEmpty() ? name : prefix + '/' + name;
+        p = nul + 1 + hashSize;
+
+        if ((mode & GitIndex::TypeMask) == GitIndex::Directory) {
+            if (!flattenTree(oid, path, depth + 1)) {
+                return false;
+            }
+        } else {
+            TreeEntry entry;
+            entry.path = path;
+            entry.mode = mode;
+            entry.oid = oid;
+            m_headTree.append(entry);
+        }
+    }
+    return true;
+}
+
+char GitStatusEngine::worktreeStatus(const GitIndex::Entry &entry)
+{
+    ++m_statistics.entriesChecked;
+
+    // 与git status --ignore-submodules一致，子模块不检查
+    if (entry.assumeValid() || entry.skipWorktree() || (entry.mode & GitIndex::TypeMask) == GitIndex::Gitlink) {
+        return ' ';
+    }
+
+    QByteArray fullPath = QFile::encodeName(m_workTree) + '/' + entry.path;
+    FileStat stat;
+    ++m_statistics.statCalls;
+    if (!statFile(fullPath, &stat)) {
+        return 'D';
+    }
+
+    const quint32 type = stat.mode & GitIndex::TypeMask;
+    if (type == GitIndex::Directory) {
+        return 'D';
+    }
+    if (entry.intentToAdd()) {
+        return 'A';
+    }
+    if (type != (entry.mode & GitIndex::TypeMask)) {
+        return 'T';
+    }
+    if (m_trustFileMode && type == GitIndex::RegularFile && ((stat.mode ^ entry.mode) & 0100)) {
+        return 'M';
+    }
+
+    // 索引中大小为0可能是racy条目被git主动清零，只能比较内容
+    if (entry.size != 0 && quint32(stat.size) != entry.size) {
+        return 'M';
+    }
+    if (statMatches(entry, stat) && !isRacy(entry)) {
+        return ' ';
+    }
+
+    // stat信息变化（如touch、checkout后）但内容可能未变，与git刷新索引时的判断相同
+    return contentMatches(entry, fullPath, stat) ? ' ' : 'M';
+}
+
+bool GitStatusEngine::statMatches(const GitIndex::Entry &entry, const FileStat &stat) const
+{
+    if (entry.size != quint32(stat.size) || entry.mtimeSeconds != quint32(stat.mtimeSeconds)) {
+        return false;
+    }
+    if (m_minimalStat) {
+        return true;
+    }
+
+    // 写入索引的git没有记录纳秒时，只比较秒
+    if (entry.mtimeNanoseconds != 0 && entry.mtimeNanoseconds != quint32(stat.mtimeNanoseconds)) {
+        return false;
+    }
+    if (m_trustCtime) {
+        if (entry.ctimeSeconds != quint32(stat.ctimeSeconds)) {
+            return false;
+        }
+        if (entry.ctimeNanoseconds != 0 && entry.ctimeNanoseconds != quint32(stat.ctimeNanoseconds)) {
+            return false;
+        }
+    }
+    return entry.ino == quint32(stat.ino) && entry.uid == stat.uid && entry.gid == stat.gid;
+}
+
+bool GitStatusEngine::isRacy(const GitIndex::Entry &entry) const
+{
+    // 文件在写入索引的同一秒内（或之后）被修改过，stat信息相同也不能说明内容没变
+    return m_indexStat.mtimeSeconds <= qint64(entry.mtimeSeconds);
+}
+
+bool GitStatusEngine::contentMatches(const GitIndex::Entry &entry, const QByteArray &fullPath, const FileStat &stat)
+{
+    ++m_statistics.hashedFiles;
+
+    QCryptographicHash hash(entry.oid.size() == 64 ? QCryptographicHash::Sha256 : QCryptographicHash::Sha1);
+    if ((stat.mode & GitIndex::TypeMask) == GitIndex::Symlink) {
+#ifdef Q_OS_UNIX
+        // 符号链接的内容是链接目标本身
+        char target[PATH_MAX];
+        ssize_t length = ::readlink(fullPath.constData(), target, sizeof(target));
+        if (length < 0) {
+            return false;
+        }
+        hash.addData("blob " + QByteArray::number(qint64(length)) + '\0');
+        hash.addData(QByteArray(target, int(length)));
+#else
+        return false;
+#endif
+    } else {
+        QFile file(QFile::decodeName(fullPath));
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        hash.addData("blob " + QByteArray::number(file.size()) + '\0');
+        if (!hash.addData(&file)) {
+            return false;
+        }
+    }
+    return hash.result().toHex() == entry.oid;
+}
+
+void GitStatusEngine::compareWithHead(int first, int last, const QByteArray &path, QMap<QByteArray, Change> *changes)
+{
+    // 索引和HEAD树都按路径排序，归并一次即可得到暂存区的变化
+    const QList<GitIndex::Entry> &entries = m_index.entries();
+    QPair<int, int> headRange = pathRange(m_headTree, path);
+    int i = first;
+    int j = headRange.first;
+
+    // 只识别内容完全相同的重命名（如git mv），相似度检测仍需交给git
+    QHash<QByteArray, QByteArray> deletedByOid;
+    QList<const GitIndex::Entry *> added;
+
+    while (i < last || j < headRange.second) {
+        if (j >= headRange.second || (i < last && entries[i].path < m_headTree[j].path)) {
+            const GitIndex::Entry &entry = entries[i++];
+            if (entry.stage() == 0 && !entry.intentToAdd()) {
+                changeFor(changes, entry.path).index = 'A';
+                added.append(&entry);
+            }
+        } else if (i >= last || m_headTree[j].path < entries[i].path) {
+            const TreeEntry &head = m_headTree[j++];
+            changeFor(changes, head.path).index = 'D';
+            deletedByOid.insert(head.oid, head.path);
+        } else {
+            const GitIndex::Entry &entry = entries[i];
+            const TreeEntry &head = m_headTree[j++];
+            if (entry.stage() == 0) {
+                if ((entry.mode & GitIndex::TypeMask) != (head.mode & GitIndex::TypeMask)) {
+                    changeFor(changes, entry.path).index = 'T';
+                } else if (entry.oid != head.oid || entry.mode != head.mode) {
+                    changeFor(changes, entry.path).index = 'M';
+                }
+            }
+            // 冲突条目的各个stage路径相同，一起跳过
+            while (i < last && entries[i].path == head.path) {
+                ++i;
+            }
+        }
+    }
+
+    for (const GitIndex::Entry *entry : added) {
+        QByteArray oldPath = deletedByOid.take(entry->oid);
+        if (oldPath.isEmpty()) {
+            continue;
+        }
+        changes->remove(oldPath);
+        Change &change = changeFor(changes, entry->path);
+        change.index = 'R';
+        change.oldPath = oldPath;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef GITSTATUSENGINE_H
+#define GITSTATUSENGINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include "gitindex.h"
+
+class GitObjectDatabase;
+
+// 进程内计算已跟踪文件的状态：用索引中缓存的stat信息比较工作树，
+// 只有stat不一致但大小相同、或时间戳处于racy区间的文件才需要计算哈希
+class GitStatusEngine
+{
+public:
+    // 与git status --porcelain的XY两列含义相同，' '表示没有变化
+    struct Change {
+        QByteArray path;
+        QByteArray oldPath;     // 暂存区中的重命名
+        char index = ' ';
+        char worktree = ' ';
+    };
+
+    struct Statistics {
+        int entriesChecked = 0;
+        int statCalls = 0;
+        int hashedFiles = 0;
+    };
+
+    GitStatusEngine(const QString &workTree, const QString &gitDir, GitObjectDatabase *objectDatabase);
+
+    // 索引不存在，或使用了拆分索引、稀疏索引、换行符转换、属性文件时不可用；
+    // 配置由git config --list读取生效的值，配置文件变化后重新读取
+    bool isUsable();
+
+    // unborn表示当前分支还没有提交，此时headOid为空；headOid为空而unborn为false时返回false，
+    // 不把所有文件都当作新增。paths为空时检查所有已跟踪文件，否则只检查这些文件或目录
+    bool status(const QByteArray &headOid, bool unborn, const QStringList &paths, QList<Change> *changes);
+
+    // 所有路径都是索引中的文件（而不是目录或未跟踪文件）时返回true
+    bool isTracked(const QStringList &paths);
+
+    // 工作树文件可以直接与索引中的blob逐行比较时返回该条目：只有stage 0、未设置intent-to-add和
+    // skip-worktree，两边都是普通文件且可执行位相同；模式变化等情况由git diff输出。
+    // 设置了影响git diff输出的diff.*配置时总是返回false
+    bool worktreeDiffEntry(const QString &path, GitIndex::Entry *entry);
+
+    Statistics lastStatistics() const;
+
+private:
+    struct FileStat {
+        qint64 ctimeSeconds = 0;
+        qint64 ctimeNanoseconds = 0;
+        qint64 mtimeSeconds = 0;
+        qint64 mtimeNanoseconds = 0;
+        quint64 dev = 0;
+        quint64 ino = 0;
+        quint32 mode = 0;
+        quint32 uid = 0;
+        quint32 gid = 0;
+        qint64 size = 0;
+    };
+
+    struct TreeEntry {
+        QByteArray path;
+        quint32 mode = 0;
+        QByteArray oid;
+    };
+
+    static bool statFile(const QByteArray &path, FileStat *stat);
+    bool reloadIndexIfChanged();
+    // 配置读取失败时返回false
+    bool reloadConfigIfChanged();
+    bool resolveHeadTree(const QByteArray &headOid, QByteArray *treeOid);
+    bool loadHeadTree(const QByteArray &treeOid);
+    bool flattenTree(const QByteArray &treeOid, const QByteArray &prefix, int depth);
+
+    char worktreeStatus(const GitIndex::Entry &entry);
+    bool statMatches(const GitIndex::Entry &entry, const FileStat &stat) const;
+    bool isRacy(const GitIndex::Entry &entry) const;
+    bool contentMatches(const GitIndex::Entry &entry, const QByteArray &fullPath, const FileStat &stat);
+    void compareWithHead(int first, int last, const QByteArray &path, QMap<QByteArray, Change> *changes);
+
+    QString m_workTree;
+    QString m_gitDir;
+    GitObjectDatabase *m_objectDatabase;
+
+    GitIndex m_index;
+    FileStat m_indexStat;
+    bool m_indexStatValid;
+    bool m_hasAttributes;   // 索引中有.gitattributes，内容可能经过过滤器转换
+
+    // HEAD树展开后的文件列表，按路径排序，HEAD不变时复用
+    QByteArray m_headTreeOid;
+    QList<TreeEntry> m_headTree;
+    bool m_headTreeLoaded;
+
+    QByteArray m_configStamp; // 各级配置文件的修改时间和大小
+    bool m_configValid;
+    QString m_attributesFile; // core.attributesFile
+    bool m_hasGlobalAttributes;
+    bool m_hasDiffConfig;
+    bool m_convertsLineEndings;
+    bool m_trustFileMode;
+    bool m_trustCtime;
+    bool m_minimalStat;
+
+    Statistics m_statistics;
+};
+
+#endif // GITSTATUSENGINE_H
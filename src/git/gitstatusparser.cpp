@@ -0,0 +1,161 @@
+#include "gitstatusparser.h"
+
+namespace {
+// 跳过记录开头的count个字段，返回下一个字段的起始位置；路径中可能有空格，只能按字段数定位
+qsizetype fieldOffset(QByteArrayView record, int count)
+{
+    qsizetype pos = 0;
+    for (int i = 0; i < count; ++i) {
+        pos = record.indexOf(' ', pos);
+        if (pos < 0) {
+            return -1;
+        }
+        ++pos;
+    }
+    return pos;
+}
+
+inline char statusChar(char c)
+{
+    return c == '.' ? ' ' : c;
+}
+}
+
+GitStatusParser::GitStatusParser(RecordCallback callback)
+    : m_callback(callback),
+      m_offset(0),
+      m_recordCount(0)
+{
+}
+
+void GitStatusParser::feed(const QByteArray &chunk)
+{
+    // 与cat-file的读取方式相同：已消费的数据超过一半时才整体前移
+    if (m_offset > 0 && m_offset * 2 > m_buffer.size()) {
+        m_buffer.remove(0, m_offset);
+        m_offset = 0;
+    }
+    m_buffer.append(chunk);
+
+    while (parseRecord()) {
+    }
+}
+
+bool GitStatusParser::finish()
+{
+    while (parseRecord()) {
+    }
+    bool complete = m_offset == m_buffer.size();
+    m_buffer.clear();
+    m_offset = 0;
+    return complete;
+}
+
+const GitStatusParser::BranchStatus &GitStatusParser::branchStatus() const
+{
+    return m_branch;
+}
+
+int GitStatusParser::recordCount() const
+{
+    return m_recordCount;
+}
+
+bool GitStatusParser::parseRecord()
+{
+    const qsizetype end = m_buffer.indexOf('\0', m_offset);
+    if (end < 0) {
+        return false;
+    }
+
+    QByteArrayView record(m_buffer.constData() + m_offset, end - m_offset);
+    qsizetype next = end + 1;
+    if (record.size() < 2) {
+        m_offset = next;
+        return true;
+    }
+    if (record[0] == '#') {
+        parseHeader(record);
+        m_offset = next;
+        return true;
+    }
+
+    Record entry;
+    qsizetype pathStart = -1;
+    switch (record[0]) {
+    case Ordinary:
+        // 1 <XY> <sub> <mH> <mI> <mW> <hH> <hI> <path>
+        pathStart = fieldOffset(record, 8);
+        break;
+    case RenamedOrCopied: {
+        // 2 <XY> <sub> <mH> <mI> <mW> <hH> <hI> <Xscore> <path>\0<origPath>
+        pathStart = fieldOffset(record, 9);
+        const qsizetype originalEnd = m_buffer.indexOf('\0', next);
+        if (originalEnd < 0) {
+            // 原路径还没有到达，等下一块数据
+            return false;
+        }
+        entry.originalPath = QByteArrayView(m_buffer.constData() + next, originalEnd - next);
+        next = originalEnd + 1;
+        break;
+    }
+    case Unmerged:
+        // u <XY> <sub> <m1> <m2> <m3> <mW> <h1> <h2> <h3> <path>
+        pathStart = fieldOffset(record, 10);
+        break;
+    case Untracked:
+    case Ignored:
+        pathStart = 2;
+        break;
+    default:
+        break;
+    }
+
+    m_offset = next;
+    if (pathStart < 0 || pathStart > record.size()) {
+        // 无法识别的记录，跳过
+        return true;
+    }
+
+    entry.type = RecordType(record[0]);
+    if (entry.type == Untracked || entry.type == Ignored) {
+        entry.index = record[0];
+        entry.worktree = record[0];
+    } else if (record.size() >= 4) {
+        entry.index = statusChar(record[2]);
+        entry.worktree = statusChar(record[3]);
+    }
+    entry.path = record.sliced(pathStart);
+
+    ++m_recordCount;
+    if (m_callback) m_callback(entry);
+    return true;
+}
+
+void GitStatusParser::parseHeader(QByteArrayView header)
+{
+    // # branch.oid <commit> | (initial)
+    // # branch.head <branch> | (detached)
+    // # branch.upstream <upstream>
+    // # branch.ab +<ahead> -<behind>
+    qsizetype valueStart = fieldOffset(header, 2);
+    if (valueStart < 0) {
+        return;
+    }
+    QByteArrayView key = header.sliced(2, valueStart - 3);
+    QByteArrayView value = header.sliced(valueStart);
+
+    if (key == "branch.oid") {
+        m_branch.oid = value == "(initial)" ? QString() : QString::fromUtf8(value);
+    } else if (key == "branch.head") {
+        m_branch.head = value == "(detached)" ? QString() : QString::fromUtf8(value);
+    } else if (key == "branch.upstream") {
+        m_branch.upstream = QString::fromUtf8(value);
+    } else if (key == "branch.ab") {
+        qsizetype space = value.indexOf(' ');
+        if (space > 1 && value.size() > space + 2) {
+            m_branch.ahead = value.sliced(1, space - 1).toInt();
+            m_branch.behind = value.sliced(space + 2).toInt();
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef GITSTATUSPARSER_H
+#define GITSTATUSPARSER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <functional>
+
+// git status --porcelain=v2 -z --branch的增量解析器：输出可以按任意边界分块传入，
+// 每条完整记录以指向内部缓冲区的视图回调，不为中间字段分配字符串
+class GitStatusParser
+{
+public:
+    enum RecordType {
+        Ordinary = '1',
+        RenamedOrCopied = '2',
+        Unmerged = 'u',
+        Untracked = '?',
+        Ignored = '!'
+    };
+
+    // 视图只在回调期间有效
+    struct Record {
+        RecordType type = Ordinary;
+        char index = ' ';       // 暂存区状态，'.'已转换为' '
+        char worktree = ' ';    // 工作树状态
+        QByteArrayView path;
+        QByteArrayView originalPath; // 重命名或复制前的路径
+    };
+
+    struct BranchStatus {
+        QString oid;            // 还没有提交时为空
+        QString head;           // 分离HEAD时为空
+        QString upstream;
+        int ahead = 0;
+        int behind = 0;
+    };
+
+    using RecordCallback = std::function<void(const Record &record)>;
+
+    explicit GitStatusParser(RecordCallback callback);
+
+    void feed(const QByteArray &chunk);
+    // 输出结束时调用，还有未完成的记录说明输出被截断
+    bool finish();
+
+    const BranchStatus &branchStatus() const;
+    int recordCount() const;
+
+private:
+    bool parseRecord();
+    void parseHeader(QByteArrayView header);
+
+    RecordCallback m_callback;
+    QByteArray m_buffer;
+    qsizetype m_offset;
+    BranchStatus m_branch;
+    int m_recordCount;
+};
+
+#endif // GITSTATUSPARSER_H
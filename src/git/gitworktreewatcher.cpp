@@ -0,0 +1,484 @@
+#include "gitworktreewatcher.h"
+#include <QTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <QSocketNotifier>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+// 合并事件的时间窗口：保存文件、切换分支等操作通常会在短时间内产生一连串事件
+const int DefaultDebounceInterval = 150;
+// 变化的路径超过该数量时，逐个刷新不如全量刷新
+const int MaxDirtyPaths = 1000;
+
+#ifdef Q_OS_LINUX
+// IN_MODIFY用于发现没有关闭文件的写入和truncate，fsmonitor需要不漏掉任何修改
+const uint32_t WorkTreeEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                              | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR;
+const uint32_t RepositoryEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                | IN_CLOSE_WRITE | IN_ONLYDIR;
+#endif
+}
+
+GitWorkTreeWatcher::GitWorkTreeWatcher(QObject *parent)
+    : QObject(parent),
+#ifdef Q_OS_LINUX
+      m_inotifyFd(-1),
+      m_notifier(nullptr),
+#endif
+      m_fallbackWatcher(nullptr),
+      m_active(false),
+      m_watchLimitReached(false),
+      m_watchFailed(false),
+      m_generation(0),
+      m_repositoryUpdateDepth(0),
+      m_repositoryDirty(false),
+      m_overflow(false),
+      m_flushTimer(new QTimer(this))
+{
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(DefaultDebounceInterval);
+    connect(m_flushTimer, &QTimer::timeout, this, &GitWorkTreeWatcher::flush);
+}
+
+GitWorkTreeWatcher::~GitWorkTreeWatcher()
+{
+    stop();
+}
+
+bool GitWorkTreeWatcher::start(const QString &workTree, const QString &gitDir, const QStringList &ignoredDirectories)
+{
+    stop();
+
+    m_workTree = QDir(workTree).absolutePath();
+    m_gitDir = QDir(gitDir).absolutePath();
+    for (QString directory : ignoredDirectories) {
+        while (directory.endsWith('/')) {
+            directory.chop(1);
+        }
+        if (!directory.isEmpty()) {
+            m_ignoredDirectories.insert(directory);
+        }
+    }
+
+#ifdef Q_OS_LINUX
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd < 0) {
+        qDebug() << "无法初始化inotify:" << strerror(errno);
+        return false;
+    }
+    m_notifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, [this]() {
+        readInotifyEvents(m_repositoryUpdateDepth > 0);
+    });
+#else
+    m_fallbackWatcher = new QFileSystemWatcher(this);
+    connect(m_fallbackWatcher, &QFileSystemWatcher::directoryChanged, this, &GitWorkTreeWatcher::onDirectoryChanged);
+#endif
+    m_active = true;
+
+    addWorkTreeDirectory(QString());
+
+    // 索引和HEAD在gitDir中；工作树的引用和packed-refs在commondir中
+    addRepositoryDirectory(m_gitDir, false);
+    QString commonDir = m_gitDir;
+    QFile commonDirFile(QDir(m_gitDir).filePath("commondir"));
+    if (commonDirFile.open(QIODevice::ReadOnly)) {
+        commonDir = QDir::cleanPath(QDir(m_gitDir).absoluteFilePath(QString::fromUtf8(commonDirFile.readAll()).trimmed()));
+        addRepositoryDirectory(commonDir, false);
+    }
+    addRepositoryDirectory(QDir(commonDir).filePath("refs"), true);
+
+    qDebug() << "开始监视工作树:" << m_workTree << "目录数" << m_watchedDirectories.size();
+    return true;
+}
+
+void GitWorkTreeWatcher::stop()
+{
+#ifdef Q_OS_LINUX
+    delete m_notifier;
+    m_notifier = nullptr;
+    if (m_inotifyFd >= 0) {
+        ::close(m_inotifyFd);
+        m_inotifyFd = -1;
+    }
+    m_watches.clear();
+#endif
+    delete m_fallbackWatcher;
+    m_fallbackWatcher = nullptr;
+    m_fallbackWatches.clear();
+    m_watchedDirectories.clear();
+    m_ignoredDirectories.clear();
+    m_nestedRepositories.clear();
+
+    m_flushTimer->stop();
+    m_dirtyPaths.clear();
+    m_repositoryDirty = false;
+    m_overflow = false;
+    m_watchLimitReached = false;
+    m_watchFailed = false;
+    m_repositoryUpdateDepth = 0;
+    m_active = false;
+    ++m_generation;
+}
+
+bool GitWorkTreeWatcher::isActive() const
+{
+    return m_active;
+}
+
+void GitWorkTreeWatcher::beginRepositoryUpdate()
+{
+#ifdef Q_OS_LINUX
+    // 开始之前已在内核队列中的事件来自外部的修改，先按正常方式读出，不随更新期间的事件一起丢弃
+    if (m_repositoryUpdateDepth == 0 && m_inotifyFd >= 0) {
+        readInotifyEvents(false);
+    }
+#endif
+    ++m_repositoryUpdateDepth;
+}
+
+void GitWorkTreeWatcher::endRepositoryUpdate()
+{
+    if (m_repositoryUpdateDepth > 0) {
+        --m_repositoryUpdateDepth;
+    }
+    if (m_repositoryUpdateDepth > 0) {
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    // git进程已经退出，它产生的事件都已在内核队列中，立即读出并丢弃其中.git目录的部分
+    if (m_inotifyFd >= 0) {
+        readInotifyEvents(true);
+    }
+#endif
+    // 更新期间的.git事件都没有记录；m_repositoryDirty只可能来自开始之前的外部修改，保留到下次刷新
+}
+
+void GitWorkTreeWatcher::setDebounceInterval(int msec)
+{
+    m_flushTimer->setInterval(qMax(0, msec));
+}
+
+void GitWorkTreeWatcher::synchronize()
+{
+#ifdef Q_OS_LINUX
+    if (m_inotifyFd >= 0) {
+        readInotifyEvents(m_repositoryUpdateDepth > 0);
+    }
+#endif
+}
+
+bool GitWorkTreeWatcher::isComplete() const
+{
+    return m_active && !m_watchLimitReached && !m_watchFailed;
+}
+
+bool GitWorkTreeWatcher::isExact() const
+{
+#ifdef Q_OS_LINUX
+    return isComplete();
+#else
+    return false;
+#endif
+}
+
+QStringList GitWorkTreeWatcher::nestedRepositories() const
+{
+    return m_nestedRepositories.values();
+}
+
+quint64 GitWorkTreeWatcher::generation() const
+{
+    return m_generation;
+}
+
+void GitWorkTreeWatcher::onDirectoryChanged(const QString &path)
+{
+    if (!m_fallbackWatches.contains(path)) {
+        return;
+    }
+    const Watch watch = m_fallbackWatches.value(path);
+    ++m_generation;
+
+    if (!QFileInfo(path).isDir()) {
+        m_fallbackWatcher->removePath(path);
+        m_fallbackWatches.remove(path);
+        m_watchedDirectories.remove(path);
+    } else if (watch.repository) {
+        if (watch.recursive) {
+            addRepositoryDirectory(path, true);
+        }
+    } else {
+        // 可能新建了子目录
+        addWorkTreeDirectory(watch.path);
+    }
+
+    if (watch.repository) {
+        if (m_repositoryUpdateDepth == 0) {
+            markRepositoryDirty();
+        }
+        return;
+    }
+
+    // 只知道目录内容变了，不知道具体是哪个文件，刷新整个目录
+    emit pathChanged(watch.path, true);
+    markDirty(watch.path.isEmpty() ? QString(".") : watch.path);
+}
+
+void GitWorkTreeWatcher::flush()
+{
+    // .git变化意味着索引或HEAD可能整体改变，由接收方全量刷新
+    if (m_repositoryDirty) {
+        m_repositoryDirty = false;
+        m_overflow = false;
+        m_dirtyPaths.clear();
+        emit repositoryChanged();
+        return;
+    }
+
+    if (m_overflow) {
+        m_overflow = false;
+        m_dirtyPaths.clear();
+        emit workTreeChanged(QStringList());
+        return;
+    }
+
+    if (m_dirtyPaths.isEmpty()) {
+        return;
+    }
+    QStringList paths = m_dirtyPaths.values();
+    paths.sort();
+    m_dirtyPaths.clear();
+    emit workTreeChanged(paths);
+}
+
+void GitWorkTreeWatcher::addWorkTreeDirectory(const QString &relativePath)
+{
+    QStringList pending;
+    pending.append(relativePath);
+
+    while (!pending.isEmpty() && !m_watchLimitReached) {
+        QString current = pending.takeLast();
+        QString absolute = current.isEmpty() ? m_workTree : m_workTree + '/' + current;
+        bool alreadyWatched = m_watchedDirectories.contains(absolute);
+
+        // 已监视的子目录不再递归，只有新出现的目录需要展开
+        if (alreadyWatched && current != relativePath) {
+            continue;
+        }
+        Watch watch;
+        watch.path = current;
+        if (!alreadyWatched && !addWatch(absolute, watch)) {
+            continue;
+        }
+
+        const QStringList children = QDir(absolute).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks);
+        for (const QString &child : children) {
+            QString childPath = current.isEmpty() ? child : current + '/' + child;
+            if (child == ".git" || isIgnored(childPath)) {
+                continue;
+            }
+            // 子模块和嵌套仓库由它们自己的git管理
+            if (QFileInfo::exists(m_workTree + '/' + childPath + "/.git")) {
+                m_nestedRepositories.insert(childPath);
+                continue;
+            }
+            pending.append(childPath);
+        }
+    }
+}
+
+void GitWorkTreeWatcher::addRepositoryDirectory(const QString &absolutePath, bool recursive)
+{
+    QStringList pending;
+    pending.append(absolutePath);
+
+    while (!pending.isEmpty() && !m_watchLimitReached) {
+        QString current = pending.takeLast();
+        if (!m_watchedDirectories.contains(current)) {
+            Watch watch;
+            watch.path = current;
+            watch.repository = true;
+            watch.recursive = recursive;
+            if (!addWatch(current, watch)) {
+                continue;
+            }
+        }
+        if (!recursive) {
+            continue;
+        }
+
+        const QStringList children = QDir(current).entryList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks);
+        for (const QString &child : children) {
+            QString childPath = current + '/' + child;
+            if (!m_watchedDirectories.contains(childPath)) {
+                pending.append(childPath);
+            }
+        }
+    }
+}
+
+bool GitWorkTreeWatcher::addWatch(const QString &absolutePath, const Watch &watch)
+{
+#ifdef Q_OS_LINUX
+    int wd = inotify_add_watch(m_inotifyFd, QFile::encodeName(absolutePath).constData(),
+                               watch.repository ? RepositoryEvents : WorkTreeEvents);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            m_watchLimitReached = true;
+            qDebug() << "inotify监视数量达到上限（fs.inotify.max_user_watches），部分目录的变化将无法发现";
+        } else if (errno != ENOENT && errno != ENOTDIR) {
+            // 目录在列出之后被删除不影响完整性，其他原因（如没有权限）会漏掉该目录下的变化
+            m_watchFailed = true;
+            qDebug() << "无法监视目录:" << absolutePath << strerror(errno);
+        }
+        return false;
+    }
+    m_watches.insert(wd, watch);
+#else
+    if (!m_fallbackWatcher->addPath(absolutePath)) {
+        if (QFileInfo(absolutePath).isDir()) {
+            m_watchFailed = true;
+            qDebug() << "无法监视目录:" << absolutePath;
+        }
+        return false;
+    }
+    m_fallbackWatches.insert(absolutePath, watch);
+#endif
+    m_watchedDirectories.insert(absolutePath);
+    return true;
+}
+
+void GitWorkTreeWatcher::markDirty(const QString &relativePath)
+{
+    if (!m_overflow) {
+        m_dirtyPaths.insert(relativePath);
+        if (m_dirtyPaths.size() > MaxDirtyPaths) {
+            m_overflow = true;
+            m_dirtyPaths.clear();
+        }
+    }
+    scheduleFlush();
+}
+
+void GitWorkTreeWatcher::markRepositoryDirty()
+{
+    m_repositoryDirty = true;
+    scheduleFlush();
+}
+
+void GitWorkTreeWatcher::scheduleFlush()
+{
+    // 不重新计时，持续有事件时也能按固定间隔刷新
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+bool GitWorkTreeWatcher::isIgnored(const QString &relativePath) const
+{
+    if (m_ignoredDirectories.isEmpty()) {
+        return false;
+    }
+    // 检查路径本身及其每一级父目录
+    int slash = relativePath.size();
+    while (slash > 0) {
+        if (m_ignoredDirectories.contains(relativePath.left(slash))) {
+            return true;
+        }
+        slash = relativePath.lastIndexOf('/', slash - 1);
+    }
+    return false;
+}
+
+#ifdef Q_OS_LINUX
+void GitWorkTreeWatcher::readInotifyEvents(bool dropRepositoryEvents)
+{
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    for (;;) {
+        ssize_t length = ::read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            ++m_generation;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 内核队列溢出，丢失了事件，只能全量刷新
+                m_overflow = true;
+                m_dirtyPaths.clear();
+                emit eventsLost();
+                scheduleFlush();
+                continue;
+            }
+
+            auto it = m_watches.find(event->wd);
+            if (it == m_watches.end()) {
+                continue;
+            }
+            const Watch watch = it.value();
+            if (event->mask & IN_IGNORED) {
+                // 目录已被删除，父目录会报告删除事件
+                m_watchedDirectories.remove(watch.repository ? watch.path
+                                            : (watch.path.isEmpty() ? m_workTree : m_workTree + '/' + watch.path));
+                m_watches.erase(it);
+                continue;
+            }
+
+            const QString name = event->len ? QFile::decodeName(event->name) : QString();
+            const bool newDirectory = (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO));
+
+            if (watch.repository) {
+                if (newDirectory && watch.recursive) {
+                    addRepositoryDirectory(watch.path + '/' + name, true);
+                }
+                // 锁文件只是中间状态，重命名为正式文件时还会有事件
+                if (!dropRepositoryEvents && !name.endsWith(".lock")) {
+                    markRepositoryDirty();
+                }
+                continue;
+            }
+
+            if (name.isEmpty() || (watch.path.isEmpty() && name == ".git")) {
+                continue;
+            }
+            QString relative = watch.path.isEmpty() ? name : watch.path + '/' + name;
+            if (isIgnored(relative)) {
+                continue;
+            }
+            if ((event->mask & IN_ISDIR) && (event->mask & IN_MOVED_FROM)) {
+                // 目录被移走后原有的监视仍然有效，但路径已经不对了，移到的位置会重新添加
+                for (auto w = m_watches.begin(); w != m_watches.end();) {
+                    if (!w->repository && (w->path == relative || w->path.startsWith(relative + '/'))) {
+                        inotify_rm_watch(m_inotifyFd, w.key());
+                        m_watchedDirectories.remove(m_workTree + '/' + w->path);
+                        w = m_watches.erase(w);
+                    } else {
+                        ++w;
+                    }
+                }
+            }
+            if (newDirectory) {
+                addWorkTreeDirectory(relative);
+            }
+            emit pathChanged(relative, (event->mask & IN_ISDIR) != 0);
+            markDirty(relative);
+        }
+    }
+}
+#endif
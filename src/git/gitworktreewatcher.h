@@ -0,0 +1,103 @@
+#ifndef GITWORKTREEWATCHER_H
+#define GITWORKTREEWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHash>
+
+class QTimer;
+class QSocketNotifier;
+class QFileSystemWatcher;
+
+// 监视工作树和.git目录的变化，合并一小段时间内的事件后报告变化的路径。
+// Linux上直接使用inotify以得到具体的文件名，其他平台使用QFileSystemWatcher，只能精确到目录
+class GitWorkTreeWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit GitWorkTreeWatcher(QObject *parent = nullptr);
+    ~GitWorkTreeWatcher();
+
+    // ignoredDirectories为相对于工作树的被忽略目录（如build、node_modules），不监视
+    bool start(const QString &workTree, const QString &gitDir, const QStringList &ignoredDirectories = QStringList());
+    void stop();
+    bool isActive() const;
+
+    // 本程序执行修改仓库的git命令期间忽略.git目录的事件，结束时丢弃内核中尚未读取的事件；
+    // 这些变化已由调用方自行刷新，不必再触发一次全量刷新；开始之前发生的外部变化仍会报告。可以嵌套调用
+    void beginRepositoryUpdate();
+    void endRepositoryUpdate();
+
+    void setDebounceInterval(int msec);
+
+    // 立即读取内核中已排队的事件，不等待事件循环；查询变化前调用可避免漏掉刚刚发生的修改
+    void synchronize();
+    // 监视数量达到系统上限或有目录无法监视（已删除的除外）时，无法保证发现所有变化
+    bool isComplete() const;
+    // 能否发现所有文件的修改：QFileSystemWatcher只报告目录内容的变化，原地修改文件不会被发现
+    bool isExact() const;
+    // 没有监视的嵌套仓库和子模块目录（相对路径）
+    QStringList nestedRepositories() const;
+    // 每收到一个事件（包括被丢弃的.git目录事件）加一，缓存据此判断期间是否发生过变化
+    quint64 generation() const;
+
+signals:
+    // 路径相对于工作树根目录，可能是文件也可能是目录；列表为空表示变化太多，需要全量刷新
+    void workTreeChanged(const QStringList &paths);
+    // 索引、HEAD或引用发生了变化（通常是在外部执行了git命令）
+    void repositoryChanged();
+    // 每个工作树事件立即发出，不经过合并；directory为true时目录下的所有内容都可能变化
+    void pathChanged(const QString &path, bool directory);
+    // 内核事件队列溢出，这之前的变化无法确定
+    void eventsLost();
+
+private slots:
+    void onDirectoryChanged(const QString &path);
+    void flush();
+
+private:
+    struct Watch {
+        QString path;       // 工作树目录为相对路径，.git目录为绝对路径
+        bool repository = false;
+        bool recursive = false;
+    };
+
+    void addWorkTreeDirectory(const QString &relativePath);
+    void addRepositoryDirectory(const QString &absolutePath, bool recursive);
+    bool addWatch(const QString &absolutePath, const Watch &watch);
+    void markDirty(const QString &relativePath);
+    void markRepositoryDirty();
+    void scheduleFlush();
+    bool isIgnored(const QString &relativePath) const;
+
+#ifdef Q_OS_LINUX
+    void readInotifyEvents(bool dropRepositoryEvents);
+
+    int m_inotifyFd;
+    QSocketNotifier *m_notifier;
+    QHash<int, Watch> m_watches;
+#endif
+    QFileSystemWatcher *m_fallbackWatcher;
+    QHash<QString, Watch> m_fallbackWatches;
+    QSet<QString> m_watchedDirectories; // 绝对路径
+
+    QString m_workTree;
+    QString m_gitDir;
+    QSet<QString> m_ignoredDirectories;
+    QSet<QString> m_nestedRepositories;
+    bool m_active;
+    bool m_watchLimitReached;
+    bool m_watchFailed;      // 有仍然存在的目录添加监视失败，不影响继续监视其他目录
+    quint64 m_generation;
+    int m_repositoryUpdateDepth;
+
+    QSet<QString> m_dirtyPaths;
+    bool m_repositoryDirty;
+    bool m_overflow;
+    QTimer *m_flushTimer;
+};
+
+#endif // GITWORKTREEWATCHER_H
@@ -0,0 +1,46 @@
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <QFile>
+#include <QByteArray>
+#include <cstdio>
+
+// git core.fsmonitor钩子：把查询转发给SummerCake进程内的fsmonitor服务，原样输出回答。
+// 用法：summercake-fsmonitor-hook <套接字路径> <协议版本> <令牌>，后两个参数由git追加。
+// SummerCake没有运行或回答不完整时以非0退出，git会自行扫描整个工作树
+int main(int argc, char *argv[])
+{
+    // 只支持协议版本2
+    if (argc < 4 || qstrcmp(argv[2], "2") != 0) {
+        return 1;
+    }
+
+    QCoreApplication app(argc, argv);
+
+    QLocalSocket socket;
+    socket.connectToServer(QFile::decodeName(argv[1]));
+    if (!socket.waitForConnected(1000)) {
+        return 1;
+    }
+
+    QByteArray request("2");
+    request.append('\0');
+    request.append(argv[3]);
+    request.append('\0');
+    socket.write(request);
+    if (!socket.waitForBytesWritten(1000)) {
+        return 1;
+    }
+
+    // 服务写完回答后断开连接；超时仍未断开说明回答不完整
+    QByteArray response;
+    while (socket.waitForReadyRead(5000)) {
+        response.append(socket.readAll());
+    }
+    response.append(socket.readAll());
+    if (socket.state() != QLocalSocket::UnconnectedState || response.isEmpty()) {
+        return 1;
+    }
+
+    fwrite(response.constData(), 1, response.size(), stdout);
+    return fflush(stdout) == 0 ? 0 : 1;
+}
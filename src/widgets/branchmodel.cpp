@@ -1,10 +1,22 @@
 #include "branchmodel.h"
 #include <QBrush>
 #include <QColor>
+#include <QFont>
+#include <QHash>
+#include <algorithm>
+
+namespace {
+// 一层中受影响的行超过这个数时整体替换子节点，逐行通知视图的代价与行数成正比
+const int RefetchThreshold = 256;
+
+const QString SymbolicSeparator = " -> ";
+}
 
 BranchModel::BranchModel(QObject *parent)
-    : QAbstractListModel(parent)
+    : QAbstractItemModel(parent),
+      m_root(new Node)
 {
+    m_root->fetched = true;
 }
 
 BranchModel::~BranchModel()
@@ -13,39 +25,202 @@ BranchModel::~BranchModel()
 
 void BranchModel::setBranches(const QList<GitManager::BranchInfo> &branches)
 {
-    beginResetModel();
-    m_branches = branches;
-    endResetModel();
+    QMap<QString, Entry> entries;
+    for (const GitManager::BranchInfo &branch : branches) {
+        const QString key = entryKey(branch);
+        // 没有变化的分支沿用之前拆分好的路径
+        auto existing = m_entries.constFind(key);
+        if (existing != m_entries.cend() && sameBranch(existing.value().info, branch)) {
+            entries.insert(key, existing.value());
+        } else {
+            entries.insert(key, makeEntry(branch));
+        }
+    }
+    m_entries = entries;
+    setVisible(filtered(m_entries, m_filter));
+}
+
+void BranchModel::setTracking(const QList<GitManager::BranchTracking> &tracking)
+{
+    QHash<QString, GitManager::BranchTracking> trackingByBranch;
+    for (const GitManager::BranchTracking &branchTracking : tracking) {
+        trackingByBranch.insert(branchTracking.branch, branchTracking);
+    }
+
+    // 新增、删除或数字变化的分支
+    QStringList changed;
+    for (auto it = trackingByBranch.cbegin(); it != trackingByBranch.cend(); ++it) {
+        auto previous = m_tracking.constFind(it.key());
+        if (previous == m_tracking.cend() || !sameTracking(previous.value(), it.value())) {
+            changed.append(it.key());
+        }
+    }
+    for (auto it = m_tracking.cbegin(); it != m_tracking.cend(); ++it) {
+        if (!trackingByBranch.contains(it.key())) {
+            changed.append(it.key());
+        }
+    }
+
+    m_tracking = trackingByBranch;
+    for (const QString &name : changed) {
+        const QModelIndex branchIndex = localBranchIndex(name);
+        if (branchIndex.isValid()) {
+            emit dataChanged(branchIndex, branchIndex);
+        }
+    }
+}
+
+void BranchModel::setFilter(const QString &filter)
+{
+    const QString query = filter.trimmed().toLower();
+    if (query == m_filter) {
+        return;
+    }
+    // 之前的查询是新查询的子序列时，新结果一定在之前的结果中
+    const bool narrowing = !m_filter.isEmpty() && fuzzyMatch(query, m_filter);
+    m_filter = query;
+    setVisible(filtered(narrowing ? m_visible : m_entries, m_filter));
+}
+
+QString BranchModel::filter() const
+{
+    return m_filter;
+}
+
+int BranchModel::branchCount() const
+{
+    return m_visible.size();
+}
+
+bool BranchModel::isBranch(const QModelIndex &index) const
+{
+    return index.isValid() && nodeFor(index)->isBranch;
 }
 
-GitManager::BranchInfo BranchModel::getBranchInfo(int row) const
+GitManager::BranchInfo BranchModel::getBranchInfo(const QModelIndex &index) const
 {
-    if (row >= 0 && row < m_branches.size()) {
-        return m_branches[row];
+    if (!isBranch(index)) {
+        return GitManager::BranchInfo();
     }
-    return GitManager::BranchInfo();
+    return nodeFor(index)->info;
+}
+
+QModelIndex BranchModel::localBranchesIndex() const
+{
+    int row = 0;
+    Node *group = findChild(m_root.get(), QString(), false, &row);
+    return group ? createIndex(row, 0, group) : QModelIndex();
+}
+
+QModelIndex BranchModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (column != 0 || (parent.isValid() && parent.column() != 0)) {
+        return QModelIndex();
+    }
+    const Node *node = nodeFor(parent);
+    if (row < 0 || row >= int(node->children.size())) {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, node->children[row].get());
+}
+
+QModelIndex BranchModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    return indexOf(nodeFor(child)->parent);
 }
 
 int BranchModel::rowCount(const QModelIndex &parent) const
 {
-    if (parent.isValid()) {
+    if (parent.isValid() && parent.column() != 0) {
         return 0;
     }
-    return m_branches.size();
+    const Node *node = nodeFor(parent);
+    return node->isBranch ? 0 : int(node->children.size());
+}
+
+int BranchModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+bool BranchModel::hasChildren(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    if (node->isBranch) {
+        return false;
+    }
+    return node->fetched ? !node->children.empty() : node->branchCount > 0;
+}
+
+bool BranchModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node *node = nodeFor(parent);
+    return !node->isBranch && !node->fetched;
+}
+
+void BranchModel::fetchMore(const QModelIndex &parent)
+{
+    fetch(nodeFor(parent));
 }
 
 QVariant BranchModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() >= m_branches.size()) {
+    if (!index.isValid()) {
         return QVariant();
     }
 
-    const GitManager::BranchInfo &branchInfo = m_branches[index.row()];
+    const Node *node = nodeFor(index);
+    if (!node->isBranch) {
+        switch (role) {
+        case Qt::DisplayRole: {
+            // 分组和目录显示其下的分支数
+            const QString name = node->parent == m_root.get() && node->name.isEmpty() ? QString("本地分支") : node->name;
+            return QString("%1 (%2)").arg(name).arg(node->branchCount);
+        }
+        case Qt::FontRole:
+            if (node->parent == m_root.get()) {
+                QFont font;
+                font.setBold(true);
+                return font;
+            }
+            break;
+        default:
+            break;
+        }
+        return QVariant();
+    }
+
+    const GitManager::BranchInfo &branchInfo = node->info;
 
     switch (role) {
-    case Qt::DisplayRole:
-        return branchInfo.name + (branchInfo.isCurrent ? " (当前)" : "");
-        break;
+    case Qt::DisplayRole: {
+        // 远程的HEAD在名称后显示它指向的分支
+        QString name = node->name;
+        const int arrow = branchInfo.name.indexOf(SymbolicSeparator);
+        if (arrow >= 0) {
+            name += branchInfo.name.mid(arrow);
+        }
+        if (!branchInfo.isRemote) {
+            name += trackingText(m_tracking.value(branchInfo.name));
+        }
+        return name + (branchInfo.isCurrent ? " (当前)" : "");
+    }
+
+    case Qt::ToolTipRole: {
+        auto tracking = m_tracking.constFind(branchInfo.name);
+        if (branchInfo.isRemote || tracking == m_tracking.cend()) {
+            return branchInfo.name;
+        }
+        if (tracking.value().gone) {
+            return QString("%1\n上游 %2 已不存在").arg(branchInfo.name, tracking.value().upstream);
+        }
+        return QString("%1\n跟踪 %2，领先 %3，落后 %4").arg(branchInfo.name, tracking.value().upstream)
+            .arg(tracking.value().ahead).arg(tracking.value().behind);
+    }
 
     case Qt::ForegroundRole:
         if (branchInfo.isCurrent) {
@@ -54,7 +229,6 @@ QVariant BranchModel::data(const QModelIndex &index, int role) const
             return QBrush(QColor(0, 0, 255)); // 远程分支显示为蓝色
         }
         return QBrush(QColor(0, 0, 0)); // 其他分支显示为黑色
-        break;
 
     case Qt::FontRole:
         if (branchInfo.isCurrent) {
@@ -73,8 +247,376 @@ QVariant BranchModel::data(const QModelIndex &index, int role) const
 
 QVariant BranchModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
+    Q_UNUSED(section);
     if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
         return "分支";
     }
     return QVariant();
 }
+
+BranchModel::Entry BranchModel::makeEntry(const GitManager::BranchInfo &info)
+{
+    Entry entry;
+    entry.info = info;
+    entry.searchText = info.name.toLower();
+
+    // 符号引用只按自身的名称放入树中
+    const QString path = info.name.section(SymbolicSeparator, 0, 0);
+    if (!info.isRemote) {
+        entry.segments << QString();
+        // 分离HEAD的说明文字中可能有/，不拆分
+        if (path.startsWith('(')) {
+            entry.segments << path;
+        } else {
+            entry.segments << path.split('/');
+        }
+    } else {
+        entry.segments = path.split('/');
+        if (entry.segments.size() < 2) {
+            entry.segments.prepend(path);
+        }
+    }
+    return entry;
+}
+
+QString BranchModel::entryKey(const GitManager::BranchInfo &info)
+{
+    // 与makeEntry拆分的路径对应：分组段之后用/连接其余各段
+    const QString path = info.name.section(SymbolicSeparator, 0, 0);
+    if (!info.isRemote) {
+        return "0" + path;
+    }
+    if (!path.contains('/')) {
+        return "1" + path + '/' + path;
+    }
+    return "1" + path;
+}
+
+bool BranchModel::fuzzyMatch(const QString &text, const QString &query)
+{
+    qsizetype position = 0;
+    for (const QChar c : query) {
+        position = text.indexOf(c, position);
+        if (position < 0) {
+            return false;
+        }
+        ++position;
+    }
+    return true;
+}
+
+bool BranchModel::sameBranch(const GitManager::BranchInfo &a, const GitManager::BranchInfo &b)
+{
+    return a.name == b.name && a.isCurrent == b.isCurrent && a.isRemote == b.isRemote;
+}
+
+bool BranchModel::sameTracking(const GitManager::BranchTracking &a, const GitManager::BranchTracking &b)
+{
+    return a.upstream == b.upstream && a.ahead == b.ahead && a.behind == b.behind && a.gone == b.gone;
+}
+
+QString BranchModel::trackingText(const GitManager::BranchTracking &tracking)
+{
+    if (tracking.gone) {
+        return " [上游已删除]";
+    }
+    QString text;
+    if (tracking.ahead > 0) {
+        text += QString(" ↑%1").arg(tracking.ahead);
+    }
+    if (tracking.behind > 0) {
+        text += QString(" ↓%1").arg(tracking.behind);
+    }
+    return text;
+}
+
+QMap<QString, BranchModel::Entry> BranchModel::filtered(const QMap<QString, Entry> &candidates, const QString &filter) const
+{
+    if (filter.isEmpty()) {
+        return candidates;
+    }
+    QMap<QString, Entry> result;
+    for (auto it = candidates.cbegin(); it != candidates.cend(); ++it) {
+        if (fuzzyMatch(it.value().searchText, filter)) {
+            // 按顺序插入，每次都在末尾
+            result.insert(result.cend(), it.key(), it.value());
+        }
+    }
+    return result;
+}
+
+void BranchModel::setVisible(const QMap<QString, Entry> &visible)
+{
+    // 两边都按键排序，一次合并得到增删和变化的分支
+    QList<Change> changes;
+    auto oldIt = m_visible.cbegin();
+    auto newIt = visible.cbegin();
+    while (oldIt != m_visible.cend() || newIt != visible.cend()) {
+        if (newIt == visible.cend() || (oldIt != m_visible.cend() && oldIt.key() < newIt.key())) {
+            changes.append({Change::Removed, oldIt.key(), oldIt.value().segments});
+            ++oldIt;
+        } else if (oldIt == m_visible.cend() || newIt.key() < oldIt.key()) {
+            changes.append({Change::Added, newIt.key(), newIt.value().segments});
+            ++newIt;
+        } else {
+            if (!sameBranch(oldIt.value().info, newIt.value().info)) {
+                changes.append({Change::Updated, newIt.key(), newIt.value().segments});
+            }
+            ++oldIt;
+            ++newIt;
+        }
+    }
+
+    m_visible = visible;
+    if (!changes.isEmpty()) {
+        applyChanges(m_root.get(), changes);
+    }
+}
+
+void BranchModel::applyChanges(Node *node, const QList<Change> &changes)
+{
+    for (const Change &change : changes) {
+        if (change.kind == Change::Added) {
+            ++node->branchCount;
+        } else if (change.kind == Change::Removed) {
+            --node->branchCount;
+        }
+    }
+    // 没有展开过的目录只需更新分支数，展开时从m_visible建立
+    if (!node->fetched) {
+        return;
+    }
+
+    QList<Change> branchChanges;
+    QMap<QString, QList<Change>> folderChanges;
+    for (const Change &change : changes) {
+        if (change.segments.size() == node->depth + 1) {
+            branchChanges.append(change);
+        } else {
+            folderChanges[change.segments.at(node->depth)].append(change);
+        }
+    }
+    if (branchChanges.size() + folderChanges.size() > RefetchThreshold) {
+        refetch(node);
+        return;
+    }
+
+    const QModelIndex parentIndex = indexOf(node);
+    for (const Change &change : branchChanges) {
+        const QString &name = change.segments.at(node->depth);
+        int row = 0;
+        Node *branch = findChild(node, name, true, &row);
+        switch (change.kind) {
+        case Change::Added: {
+            if (branch) {
+                break;
+            }
+            std::unique_ptr<Node> child = makeChild(node, name, true);
+            child->info = m_visible.value(change.key).info;
+            row = childPosition(node, name, true);
+            beginInsertRows(parentIndex, row, row);
+            node->children.insert(node->children.begin() + row, std::move(child));
+            endInsertRows();
+            break;
+        }
+        case Change::Removed:
+            if (branch) {
+                beginRemoveRows(parentIndex, row, row);
+                node->children.erase(node->children.begin() + row);
+                endRemoveRows();
+            }
+            break;
+        case Change::Updated:
+            if (branch) {
+                branch->info = m_visible.value(change.key).info;
+                const QModelIndex branchIndex = createIndex(row, 0, branch);
+                emit dataChanged(branchIndex, branchIndex);
+            }
+            break;
+        }
+    }
+
+    for (auto it = folderChanges.cbegin(); it != folderChanges.cend(); ++it) {
+        int row = 0;
+        Node *folder = findChild(node, it.key(), false, &row);
+        if (!folder) {
+            // 新目录先算好分支数再插入，视图取到的hasChildren是正确的
+            std::unique_ptr<Node> child = makeChild(node, it.key(), false);
+            applyChanges(child.get(), it.value());
+            if (child->branchCount <= 0) {
+                continue;
+            }
+            row = childPosition(node, it.key(), false);
+            beginInsertRows(parentIndex, row, row);
+            node->children.insert(node->children.begin() + row, std::move(child));
+            endInsertRows();
+            continue;
+        }
+
+        applyChanges(folder, it.value());
+        if (folder->branchCount <= 0) {
+            beginRemoveRows(parentIndex, row, row);
+            node->children.erase(node->children.begin() + row);
+            endRemoveRows();
+        } else {
+            const QModelIndex folderIndex = createIndex(row, 0, folder);
+            emit dataChanged(folderIndex, folderIndex);
+        }
+    }
+}
+
+void BranchModel::fetch(Node *node)
+{
+    if (node->isBranch || node->fetched) {
+        return;
+    }
+
+    // 节点下的键在m_visible中连续，第depth段相同的归入同一个子目录
+    std::vector<std::unique_ptr<Node>> children;
+    QHash<QString, Node *> folders;
+    int total = 0;
+    const bool isRoot = node == m_root.get();
+    auto it = isRoot ? m_visible.cbegin() : m_visible.lowerBound(node->key);
+    for (; it != m_visible.cend() && (isRoot || it.key().startsWith(node->key)); ++it) {
+        const Entry &entry = it.value();
+        const QString &name = entry.segments.at(node->depth);
+        ++total;
+        if (entry.segments.size() == node->depth + 1) {
+            std::unique_ptr<Node> child = makeChild(node, name, true);
+            child->info = entry.info;
+            children.push_back(std::move(child));
+            continue;
+        }
+        Node *&folder = folders[name];
+        if (!folder) {
+            std::unique_ptr<Node> child = makeChild(node, name, false);
+            folder = child.get();
+            children.push_back(std::move(child));
+        }
+        ++folder->branchCount;
+    }
+    std::sort(children.begin(), children.end(), [node](const std::unique_ptr<Node> &a, const std::unique_ptr<Node> &b) {
+        return lessThan(node, a.get(), b.get());
+    });
+
+    node->branchCount = total;
+    node->fetched = true;
+    if (children.empty()) {
+        return;
+    }
+    beginInsertRows(indexOf(node), 0, int(children.size()) - 1);
+    node->children = std::move(children);
+    endInsertRows();
+}
+
+void BranchModel::refetch(Node *node)
+{
+    if (!node->children.empty()) {
+        beginRemoveRows(indexOf(node), 0, int(node->children.size()) - 1);
+        node->children.clear();
+        endRemoveRows();
+    }
+    node->fetched = false;
+    fetch(node);
+}
+
+std::unique_ptr<BranchModel::Node> BranchModel::makeChild(Node *parent, const QString &name, bool isBranch) const
+{
+    std::unique_ptr<Node> child(new Node);
+    child->parent = parent;
+    child->name = name;
+    child->depth = parent->depth + 1;
+    child->isBranch = isBranch;
+    if (parent == m_root.get()) {
+        // 分组：本地分支在前，远程按名称排列
+        child->key = name.isEmpty() ? QString("0") : "1" + name + '/';
+    } else {
+        child->key = parent->key + name + (isBranch ? QString() : QString('/'));
+    }
+    return child;
+}
+
+int BranchModel::childPosition(const Node *parent, const QString &name, bool isBranch) const
+{
+    const bool isRoot = parent == m_root.get();
+    const QString key = isRoot ? (name.isEmpty() ? QString("0") : "1" + name + '/') : QString();
+    auto it = std::lower_bound(parent->children.begin(), parent->children.end(), name,
+                               [isRoot, &key, isBranch](const std::unique_ptr<Node> &child, const QString &value) {
+        if (isRoot) {
+            return child->key < key;
+        }
+        if (child->isBranch != isBranch) {
+            return !child->isBranch;
+        }
+        return child->name < value;
+    });
+    return int(it - parent->children.begin());
+}
+
+BranchModel::Node *BranchModel::findChild(const Node *parent, const QString &name, bool isBranch, int *row) const
+{
+    const int position = childPosition(parent, name, isBranch);
+    if (position >= int(parent->children.size())) {
+        return nullptr;
+    }
+    Node *child = parent->children[position].get();
+    if (child->name != name || child->isBranch != isBranch) {
+        return nullptr;
+    }
+    if (row) {
+        *row = position;
+    }
+    return child;
+}
+
+bool BranchModel::lessThan(const Node *parent, const Node *a, const Node *b)
+{
+    // 第一层是分组，按键排列使本地分支在前
+    if (!parent->parent) {
+        return a->key < b->key;
+    }
+    if (a->isBranch != b->isBranch) {
+        return !a->isBranch;
+    }
+    return a->name < b->name;
+}
+
+int BranchModel::rowOf(const Node *node) const
+{
+    return childPosition(node->parent, node->name, node->isBranch);
+}
+
+QModelIndex BranchModel::indexOf(Node *node) const
+{
+    if (!node || node == m_root.get()) {
+        return QModelIndex();
+    }
+    return createIndex(rowOf(node), 0, node);
+}
+
+BranchModel::Node *BranchModel::nodeFor(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : m_root.get();
+}
+
+QModelIndex BranchModel::localBranchIndex(const QString &name) const
+{
+    // 沿分支的路径向下查找，经过的目录都必须已经建立子节点
+    auto entry = m_visible.constFind("0" + name);
+    if (entry == m_visible.cend()) {
+        return QModelIndex();
+    }
+    const QStringList &segments = entry.value().segments;
+    Node *node = m_root.get();
+    int row = 0;
+    for (int depth = 0; depth < segments.size(); ++depth) {
+        if (!node->fetched) {
+            return QModelIndex();
+        }
+        node = findChild(node, segments.at(depth), depth == segments.size() - 1, &row);
+        if (!node) {
+            return QModelIndex();
+        }
+    }
+    return createIndex(row, 0, node);
+}
@@ -1,11 +1,19 @@
 #ifndef BRANCHMODEL_H
 #define BRANCHMODEL_H
 
-#include <QAbstractListModel>
+#include <QAbstractItemModel>
+#include <QHash>
 #include <QList>
+#include <QMap>
+#include <QStringList>
+#include <memory>
+#include <vector>
 #include "git/gitmanager.h"
 
-class BranchModel : public QAbstractListModel
+// 分支树：第一层为本地分支和各个远程，其下按/分隔的命名空间分成目录。
+// 目录在视图展开时才建立子节点（fetchMore），未展开的目录只记录分支数。
+// 分支列表变化或过滤条件改变时与之前的结果比较，只插入、删除或更新变化的行，不重置模型
+class BranchModel : public QAbstractItemModel
 {
     Q_OBJECT
 
@@ -14,15 +22,95 @@ public:
     ~BranchModel();
 
     void setBranches(const QList<GitManager::BranchInfo> &branches);
-    GitManager::BranchInfo getBranchInfo(int row) const;
+    // 本地分支名称后显示相对上游的领先/落后数，只更新数字变化的行
+    void setTracking(const QList<GitManager::BranchTracking> &tracking);
+    // 查询中的字符按顺序出现在分支名中即匹配（不区分大小写），连续出现即子串匹配；
+    // 新的查询包含之前的查询时只在之前的结果中查找
+    void setFilter(const QString &filter);
+    QString filter() const;
+    // 过滤后显示的分支数
+    int branchCount() const;
+
+    bool isBranch(const QModelIndex &index) const;
+    GitManager::BranchInfo getBranchInfo(const QModelIndex &index) const;
+    // 本地分支分组，分支列表中没有本地分支时无效
+    QModelIndex localBranchesIndex() const;
 
     // QAbstractItemModel interface
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
 private:
-    QList<GitManager::BranchInfo> m_branches;
+    // 预先计算的分支信息：树中的路径和过滤用的小写名称
+    struct Entry {
+        GitManager::BranchInfo info;
+        QStringList segments; // 第一段为分组：本地分支为空字符串，远程分支为远程名
+        QString searchText;
+    };
+
+    struct Node {
+        Node *parent = nullptr;
+        QString name;          // 分组名、目录名或分支名的最后一段
+        QString key;           // 分支为m_visible中的键，分组和目录为其下所有键共同的前缀
+        int depth = 0;         // 子节点的名称是segments中的第depth段
+        bool isBranch = false;
+        bool fetched = false;  // 已建立子节点
+        int branchCount = 0;   // 分组和目录下的分支数
+        GitManager::BranchInfo info;
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    struct Change {
+        enum Kind {
+            Added,
+            Removed,
+            Updated
+        };
+        Kind kind;
+        QString key;
+        QStringList segments;
+    };
+
+    static Entry makeEntry(const GitManager::BranchInfo &info);
+    // 键按分组排序（本地分支在前），同一目录下的分支在键的顺序中连续
+    static QString entryKey(const GitManager::BranchInfo &info);
+    static bool fuzzyMatch(const QString &text, const QString &query);
+    static bool sameBranch(const GitManager::BranchInfo &a, const GitManager::BranchInfo &b);
+    static bool sameTracking(const GitManager::BranchTracking &a, const GitManager::BranchTracking &b);
+    static QString trackingText(const GitManager::BranchTracking &tracking);
+
+    QMap<QString, Entry> filtered(const QMap<QString, Entry> &candidates, const QString &filter) const;
+    // 与当前显示的分支比较，把差异应用到已经建立的节点上
+    void setVisible(const QMap<QString, Entry> &visible);
+    void applyChanges(Node *node, const QList<Change> &changes);
+    // 从m_visible中该节点的键范围建立子节点
+    void fetch(Node *node);
+    // 变化太多时整体替换子节点，比逐行插入删除快
+    void refetch(Node *node);
+
+    std::unique_ptr<Node> makeChild(Node *parent, const QString &name, bool isBranch) const;
+    // 子节点按目录在前、分支在后、名称升序排列（第一层按键排列），返回name应在的位置
+    int childPosition(const Node *parent, const QString &name, bool isBranch) const;
+    Node *findChild(const Node *parent, const QString &name, bool isBranch, int *row = nullptr) const;
+    static bool lessThan(const Node *parent, const Node *a, const Node *b);
+    int rowOf(const Node *node) const;
+    QModelIndex indexOf(Node *node) const;
+    Node *nodeFor(const QModelIndex &index) const;
+    // 已经建立的本地分支节点的索引，所在目录还没有展开时无效
+    QModelIndex localBranchIndex(const QString &name) const;
+
+    QMap<QString, Entry> m_entries; // 全部分支
+    QMap<QString, Entry> m_visible; // 过滤后显示的分支
+    QString m_filter;
+    QHash<QString, GitManager::BranchTracking> m_tracking; // 键为本地分支名
+    std::unique_ptr<Node> m_root;
 };
 
 #endif // BRANCHMODEL_H
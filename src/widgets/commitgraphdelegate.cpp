@@ -0,0 +1,101 @@
+#include "commitgraphdelegate.h"
+#include "commithistorymodel.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <QApplication>
+#include <QStyle>
+
+namespace {
+const int LaneWidth = 14;
+const int NodeRadius = 4;
+
+QColor laneColor(int lane)
+{
+    static const QColor colors[] = {
+        QColor(0x1f, 0x77, 0xb4), QColor(0xff, 0x7f, 0x0e), QColor(0x2c, 0xa0, 0x2c), QColor(0xd6, 0x27, 0x28),
+        QColor(0x94, 0x67, 0xbd), QColor(0x8c, 0x56, 0x4b), QColor(0xe3, 0x77, 0xc2), QColor(0x17, 0xbe, 0xcf)
+    };
+    return colors[lane % (sizeof(colors) / sizeof(colors[0]))];
+}
+}
+
+CommitGraphDelegate::CommitGraphDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void CommitGraphDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    // 先按普通单元格画出选中和交替行背景
+    QStyleOptionViewItem opt(option);
+    initStyleOption(&opt, index);
+    opt.text.clear();
+    QStyle *style = opt.widget ? opt.widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, opt.widget);
+
+    const CommitHistoryModel *model = qobject_cast<const CommitHistoryModel *>(index.model());
+    if (!model || index.row() >= model->graphLayout().rowCount()) {
+        return;
+    }
+    const CommitGraphLayout &layout = model->graphLayout();
+    const CommitGraphLayout::Row &row = layout.row(index.row());
+
+    const QRect &rect = option.rect;
+    const qreal top = rect.top();
+    const qreal bottom = rect.top() + rect.height();
+    const qreal middle = rect.top() + rect.height() / 2.0;
+    auto laneX = [&rect](int lane) {
+        return rect.left() + LaneWidth * lane + LaneWidth / 2.0;
+    };
+
+    painter->save();
+    painter->setClipRect(rect);
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    // 穿过本行的泳道
+    for (int i = 0; i < row.passCount; ++i) {
+        const int lane = layout.passLane(row, i);
+        painter->setPen(QPen(laneColor(lane), 2));
+        painter->drawLine(QPointF(laneX(lane), top), QPointF(laneX(lane), bottom));
+    }
+
+    // 子提交连入节点
+    const qreal nodeX = laneX(row.lane);
+    if (row.incoming) {
+        painter->setPen(QPen(laneColor(row.lane), 2));
+        painter->drawLine(QPointF(nodeX, top), QPointF(nodeX, middle));
+    }
+
+    // 节点连到父提交所在的泳道，换道时画成曲线
+    for (int i = 0; i < row.edgeCount; ++i) {
+        const int lane = layout.edgeLane(row, i);
+        const qreal targetX = laneX(lane);
+        painter->setPen(QPen(laneColor(lane), 2));
+        if (lane == row.lane) {
+            painter->drawLine(QPointF(nodeX, middle), QPointF(nodeX, bottom));
+        } else {
+            QPainterPath path(QPointF(nodeX, middle));
+            path.cubicTo(QPointF(nodeX, bottom), QPointF(targetX, middle), QPointF(targetX, bottom));
+            painter->drawPath(path);
+        }
+    }
+
+    // 合并提交画成空心
+    const QColor nodeColor = laneColor(row.lane);
+    painter->setPen(QPen(nodeColor, 2));
+    painter->setBrush(row.parentCount > 1 ? opt.palette.base() : QBrush(nodeColor));
+    painter->drawEllipse(QPointF(nodeX, middle), NodeRadius, NodeRadius);
+
+    painter->restore();
+}
+
+QSize CommitGraphDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QSize size = QStyledItemDelegate::sizeHint(option, index);
+    const CommitHistoryModel *model = qobject_cast<const CommitHistoryModel *>(index.model());
+    if (model) {
+        const int lanes = qMin(model->graphLayout().maxLaneCount(), int(CommitGraphLayout::MaxDrawnLanes));
+        size.setWidth(qMax(lanes, 1) * LaneWidth);
+    }
+    return size;
+}
@@ -0,0 +1,18 @@
+#ifndef COMMITGRAPHDELEGATE_H
+#define COMMITGRAPHDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+// 绘制提交历史的图谱列：泳道由CommitHistoryModel中的CommitGraphLayout计算，这里只负责画线和节点
+class CommitGraphDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit CommitGraphDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+};
+
+#endif // COMMITGRAPHDELEGATE_H
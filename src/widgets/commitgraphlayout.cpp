@@ -0,0 +1,116 @@
+#include "commitgraphlayout.h"
+
+CommitGraphLayout::CommitGraphLayout()
+    : m_maxLaneCount(0)
+{
+}
+
+void CommitGraphLayout::clear()
+{
+    m_rows.clear();
+    m_edges.clear();
+    m_passLanes.clear();
+    m_occupied.clear();
+    m_freeLanes = decltype(m_freeLanes)();
+    m_waitingLane.clear();
+    m_maxLaneCount = 0;
+}
+
+void CommitGraphLayout::appendCommit(const QString &hash, const QStringList &parents)
+{
+    Row row;
+    row.parentCount = parents.size();
+
+    // 节点泳道：子提交已经为它预留了泳道时沿用，否则是新分支的顶端
+    const int waitingLane = m_waitingLane.value(hash, -1);
+    if (waitingLane >= 0) {
+        row.lane = waitingLane;
+        row.incoming = true;
+        m_waitingLane.remove(hash);
+    } else {
+        row.lane = allocateLane();
+    }
+
+    // 本行开始时占用的其他泳道都从上到下穿过；只看能画出来的部分
+    row.passBegin = m_passLanes.size();
+    const int drawn = qMin<int>(m_occupied.size(), MaxDrawnLanes);
+    for (int lane = 0; lane < drawn; ++lane) {
+        if (m_occupied[lane] && lane != row.lane) {
+            m_passLanes.append(lane);
+        }
+    }
+    row.passCount = m_passLanes.size() - row.passBegin;
+
+    // 第一个父提交优先留在节点泳道；如果它已经在别的泳道上等待，连过去并释放节点泳道
+    row.edgeBegin = m_edges.size();
+    bool laneContinues = false;
+    for (int i = 0; i < parents.size(); ++i) {
+        const QString &parent = parents[i];
+        const int existingLane = m_waitingLane.value(parent, -1);
+        if (existingLane >= 0) {
+            m_edges.append(existingLane);
+            continue;
+        }
+        int lane;
+        if (i == 0) {
+            lane = row.lane;
+            laneContinues = true;
+        } else {
+            lane = allocateLane();
+        }
+        m_waitingLane.insert(parent, lane);
+        m_edges.append(lane);
+    }
+    row.edgeCount = m_edges.size() - row.edgeBegin;
+
+    if (!laneContinues) {
+        releaseLane(row.lane);
+    }
+    m_rows.append(row);
+}
+
+int CommitGraphLayout::rowCount() const
+{
+    return m_rows.size();
+}
+
+const CommitGraphLayout::Row &CommitGraphLayout::row(int index) const
+{
+    return m_rows[index];
+}
+
+int CommitGraphLayout::edgeLane(const Row &row, int i) const
+{
+    return m_edges[row.edgeBegin + i];
+}
+
+int CommitGraphLayout::passLane(const Row &row, int i) const
+{
+    return m_passLanes[row.passBegin + i];
+}
+
+int CommitGraphLayout::maxLaneCount() const
+{
+    return m_maxLaneCount;
+}
+
+int CommitGraphLayout::allocateLane()
+{
+    int lane;
+    if (!m_freeLanes.empty()) {
+        lane = m_freeLanes.top();
+        m_freeLanes.pop();
+        m_occupied[lane] = true;
+    } else {
+        lane = m_occupied.size();
+        m_occupied.append(true);
+        m_maxLaneCount = qMax<int>(m_maxLaneCount, m_occupied.size());
+    }
+    return lane;
+}
+
+void CommitGraphLayout::releaseLane(int lane)
+{
+    m_occupied[lane] = false;
+    m_freeLanes.push(lane);
+}
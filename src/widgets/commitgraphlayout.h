@@ -0,0 +1,60 @@
+#ifndef COMMITGRAPHLAYOUT_H
+#define COMMITGRAPHLAYOUT_H
+
+#include <QList>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <queue>
+#include <vector>
+#include <functional>
+
+// 提交图的泳道分配：按历史顺序逐行追加提交，为每个提交分配一条泳道，记录画线需要的信息。
+// 每行的开销只与父提交数和绘制的泳道数有关，与同时存在的分支数量无关；分页加载时增量计算
+class CommitGraphLayout
+{
+public:
+    // 每行最多记录的直通泳道数，更右边的泳道不绘制
+    static const int MaxDrawnLanes = 64;
+
+    struct Row {
+        int lane = 0;          // 提交节点所在泳道
+        bool incoming = false; // 有子提交的线从上方进入节点
+        int parentCount = 0;
+        int edgeBegin = 0;     // 在edges中的位置：节点连到下方哪些泳道，每个父提交一条
+        int edgeCount = 0;
+        int passBegin = 0;     // 在passLanes中的位置：从上到下直接穿过本行的泳道
+        int passCount = 0;
+    };
+
+    CommitGraphLayout();
+
+    void clear();
+    // parents为提交的父提交哈希，按历史顺序（子提交在前）依次追加；
+    // 提交时间有偏差导致父提交先出现时，为它预留的泳道会一直保留到清空
+    void appendCommit(const QString &hash, const QStringList &parents);
+
+    int rowCount() const;
+    const Row &row(int index) const;
+    int edgeLane(const Row &row, int i) const;
+    int passLane(const Row &row, int i) const;
+    // 出现过的最大泳道数，用于计算图形列宽度
+    int maxLaneCount() const;
+
+private:
+    int allocateLane();
+    void releaseLane(int lane);
+
+    QList<Row> m_rows;
+    QList<int> m_edges;
+    QList<int> m_passLanes;
+
+    // 当前状态：每条泳道是否被占用，空闲泳道按编号从小到大复用
+    QList<bool> m_occupied;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> m_freeLanes;
+    // 已分配泳道但还没有出现的提交 -> 泳道
+    QHash<QString, int> m_waitingLane;
+    int m_maxLaneCount;
+};
+
+#endif // COMMITGRAPHLAYOUT_H
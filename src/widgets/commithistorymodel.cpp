@@ -1,7 +1,9 @@
 #include "commithistorymodel.h"
 
 CommitHistoryModel::CommitHistoryModel(QObject *parent)
-    : QAbstractTableModel(parent)
+    : QAbstractTableModel(parent),
+      m_hasMore(false),
+      m_fetching(false)
 {
 }
 
@@ -9,13 +11,38 @@ CommitHistoryModel::~CommitHistoryModel()
 {
 }
 
-void CommitHistoryModel::setCommitHistory(const QList<GitManager::CommitInfo> &commitHistory)
+void CommitHistoryModel::setCommitHistory(const QList<GitManager::CommitInfo> &commitHistory, bool hasMore)
 {
     beginResetModel();
     m_commitHistory = commitHistory;
+    m_graphLayout.clear();
+    for (const GitManager::CommitInfo &commit : commitHistory) {
+        m_graphLayout.appendCommit(commit.hash, commit.parents);
+    }
+    m_hasMore = hasMore;
+    m_fetching = false;
     endResetModel();
 }
 
+void CommitHistoryModel::appendCommitHistory(const QList<GitManager::CommitInfo> &commits, bool hasMore)
+{
+    m_fetching = false;
+    m_hasMore = hasMore;
+    if (commits.isEmpty()) {
+        return;
+    }
+
+    // 只插入新行，已显示的行和选中项保持不变
+    const int first = m_commitHistory.size();
+    beginInsertRows(QModelIndex(), first, first + commits.size() - 1);
+    m_commitHistory.append(commits);
+    // 泳道状态接着上一页继续计算
+    for (const GitManager::CommitInfo &commit : commits) {
+        m_graphLayout.appendCommit(commit.hash, commit.parents);
+    }
+    endInsertRows();
+}
+
 GitManager::CommitInfo CommitHistoryModel::getCommitInfo(int row) const
 {
     if (row >= 0 && row < m_commitHistory.size()) {
@@ -24,6 +51,11 @@ GitManager::CommitInfo CommitHistoryModel::getCommitInfo(int row) const
     return GitManager::CommitInfo();
 }
 
+const CommitGraphLayout &CommitHistoryModel::graphLayout() const
+{
+    return m_graphLayout;
+}
+
 int CommitHistoryModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid()) {
@@ -77,10 +109,29 @@ QVariant CommitHistoryModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+bool CommitHistoryModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return false;
+    }
+    return m_hasMore && !m_fetching;
+}
+
+void CommitHistoryModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent)) {
+        return;
+    }
+    m_fetching = true;
+    emit fetchMoreRequested();
+}
+
 QVariant CommitHistoryModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
         switch (section) {
+        case GraphColumn:
+            return "图谱";
         case HashColumn:
             return "哈希值";
         case AuthorColumn:
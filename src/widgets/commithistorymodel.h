@@ -4,6 +4,7 @@
 #include <QAbstractTableModel>
 #include <QList>
 #include "git/gitmanager.h"
+#include "commitgraphlayout.h"
 
 class CommitHistoryModel : public QAbstractTableModel
 {
@@ -11,6 +12,7 @@ class CommitHistoryModel : public QAbstractTableModel
 
 public:
     enum Column {
+        GraphColumn,
         HashColumn,
         AuthorColumn,
         DateColumn,
@@ -21,17 +23,29 @@ public:
     explicit CommitHistoryModel(QObject *parent = nullptr);
     ~CommitHistoryModel();
 
-    void setCommitHistory(const QList<GitManager::CommitInfo> &commitHistory);
+    // hasMore为true时视图滚动到底部会通过fetchMoreRequested请求下一页
+    void setCommitHistory(const QList<GitManager::CommitInfo> &commitHistory, bool hasMore = false);
+    void appendCommitHistory(const QList<GitManager::CommitInfo> &commits, bool hasMore);
     GitManager::CommitInfo getCommitInfo(int row) const;
+    // 与行一一对应的提交图泳道，由CommitGraphDelegate绘制
+    const CommitGraphLayout &graphLayout() const;
 
     // QAbstractItemModel interface
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     int columnCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+signals:
+    void fetchMoreRequested();
 
 private:
     QList<GitManager::CommitInfo> m_commitHistory;
+    CommitGraphLayout m_graphLayout;
+    bool m_hasMore;
+    bool m_fetching; // 已请求下一页，结果到达前不重复请求
 };
 
 #endif // COMMITHISTORYMODEL_H
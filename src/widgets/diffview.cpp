@@ -0,0 +1,836 @@
+#include "diffview.h"
+#include "syntaxhighlightengine.h"
+#include "intralinediff.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QScrollBar>
+#include <QFontDatabase>
+#include <algorithm>
+#include <climits>
+
+namespace {
+// 制表符按固定宽度展开
+const int TabWidth = 4;
+
+const QColor AddedBackground(230, 255, 237);
+const QColor RemovedBackground(255, 238, 240);
+// 行内真正改动的单词
+const QColor AddedWordBackground(172, 242, 189);
+const QColor RemovedWordBackground(253, 184, 192);
+const QColor HunkBackground(241, 248, 255);
+const QColor HunkForeground(0, 92, 197);
+const QColor GutterForeground(120, 120, 120);
+
+const QColor KeywordForeground(0, 51, 179);
+const QColor StringForeground(6, 125, 23);
+const QColor CommentForeground(140, 140, 140);
+const QColor NumberForeground(23, 80, 235);
+const QColor PreprocessorForeground(128, 0, 128);
+
+// 每隔多少行记录一次新旧文件的行号，任意行的行号最多向前推算这么多行
+const int LineNumberInterval = 256;
+// 超过这个长度的行不做高亮，避免压缩过的代码每次重绘都复制整行
+const qsizetype MaxHighlightLineLength = 4096;
+// 连续删除或添加的行超过这么多时不再逐行配对，整块替换做行内比较没有意义
+const int MaxPairedLines = 64;
+
+QColor tokenColor(SyntaxHighlightEngine::TokenKind kind)
+{
+    switch (kind) {
+    case SyntaxHighlightEngine::Keyword:
+        return KeywordForeground;
+    case SyntaxHighlightEngine::String:
+        return StringForeground;
+    case SyntaxHighlightEngine::Comment:
+        return CommentForeground;
+    case SyntaxHighlightEngine::Number:
+        return NumberForeground;
+    case SyntaxHighlightEngine::Preprocessor:
+        return PreprocessorForeground;
+    }
+    return QColor();
+}
+
+inline bool isContinuationByte(char c)
+{
+    return (static_cast<uchar>(c) & 0xc0) == 0x80;
+}
+
+// 返回第一个没有完全滚出左侧的字符的字节位置，*offset为它之前的文字宽度；
+// 与绘制时一样把制表符展开为TabWidth个空格，非ASCII字符按字体中的实际宽度计算
+qsizetype firstVisibleByte(QByteArrayView text, int scrollX, const QFontMetrics &metrics, int charWidth, int *offset)
+{
+    qsizetype position = 0;
+    int x = 0;
+    while (position < text.size()) {
+        qsizetype next = position + 1;
+        int advance = charWidth;
+        if (text[position] == '\t') {
+            advance = TabWidth * charWidth;
+        } else if (static_cast<uchar>(text[position]) >= 0x80) {
+            while (next < text.size() && isContinuationByte(text[next])) {
+                ++next;
+            }
+            advance = metrics.horizontalAdvance(QString::fromUtf8(text.data() + position, next - position));
+        }
+        if (x + advance > scrollX) {
+            break;
+        }
+        x += advance;
+        position = next;
+    }
+    *offset = x;
+    return position;
+}
+}
+
+DiffView::DiffView(QWidget *parent)
+    : QAbstractScrollArea(parent),
+      m_indexedOffset(0),
+      m_maxLineLength(0),
+      m_hunkOpen(false),
+      m_complete(false),
+      m_highlightEngine(nullptr)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setBackgroundRole(QPalette::Base);
+    viewport()->setAutoFillBackground(true);
+    m_hiddenBefore.append(0);
+}
+
+void DiffView::setDiff(const QByteArray &diff)
+{
+    clear();
+    appendDiff(diff);
+    finishDiff();
+}
+
+void DiffView::appendDiff(const QByteArray &chunk)
+{
+    if (chunk.isEmpty()) {
+        return;
+    }
+    // 只为新到达的完整行建立索引，滚动位置保持不变
+    m_data.append(chunk);
+    indexLines(false);
+    updateScrollBars();
+    viewport()->update();
+}
+
+void DiffView::finishDiff()
+{
+    indexLines(true);
+    m_complete = true;
+    updateScrollBars();
+    viewport()->update();
+}
+
+void DiffView::clear()
+{
+    m_data.clear();
+    m_lineOffsets.clear();
+    m_hunks.clear();
+    m_hiddenBefore = {0};
+    m_indexedOffset = 0;
+    m_maxLineLength = 0;
+    m_hunkOpen = false;
+    m_files.clear();
+    m_lineNumberCheckpoints.clear();
+    m_intraLineChanges.clear();
+    m_complete = false;
+    m_indexNumbers = LineNumbers();
+    updateScrollBars();
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    viewport()->update();
+}
+
+void DiffView::setPlaceholderText(const QString &text)
+{
+    m_placeholderText = text;
+    viewport()->update();
+}
+
+void DiffView::setHighlightEngine(SyntaxHighlightEngine *engine)
+{
+    if (m_highlightEngine) {
+        disconnect(m_highlightEngine, nullptr, viewport(), nullptr);
+    }
+    m_highlightEngine = engine;
+    if (m_highlightEngine) {
+        connect(m_highlightEngine, &SyntaxHighlightEngine::highlightingReady, viewport(), qOverload<>(&QWidget::update));
+    }
+    viewport()->update();
+}
+
+int DiffView::lineCount() const
+{
+    return m_lineOffsets.size();
+}
+
+int DiffView::hunkCount() const
+{
+    return m_hunks.size();
+}
+
+bool DiffView::isHunkFolded(int hunk) const
+{
+    return hunk >= 0 && hunk < m_hunks.size() && m_hunks[hunk].folded;
+}
+
+void DiffView::setHunkFolded(int hunk, bool folded)
+{
+    if (hunk < 0 || hunk >= m_hunks.size() || m_hunks[hunk].folded == folded) {
+        return;
+    }
+    m_hunks[hunk].folded = folded;
+    updateHiddenLines();
+    updateScrollBars();
+    viewport()->update();
+}
+
+void DiffView::setAllHunksFolded(bool folded)
+{
+    for (Hunk &hunk : m_hunks) {
+        hunk.folded = folded;
+    }
+    updateHiddenLines();
+    updateScrollBars();
+    viewport()->update();
+}
+
+void DiffView::jumpToHunk(int hunk)
+{
+    if (hunk < 0 || hunk >= m_hunks.size()) {
+        return;
+    }
+    verticalScrollBar()->setValue(rowForHunk(hunk));
+}
+
+void DiffView::nextHunk()
+{
+    // 第一个显示位置在当前顶部行之下的块
+    const int top = verticalScrollBar()->value();
+    int low = 0;
+    int high = m_hunks.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (rowForHunk(mid) <= top) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    jumpToHunk(low);
+}
+
+void DiffView::previousHunk()
+{
+    const int top = verticalScrollBar()->value();
+    int low = 0;
+    int high = m_hunks.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (rowForHunk(mid) < top) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    jumpToHunk(low - 1);
+}
+
+void DiffView::paintEvent(QPaintEvent *)
+{
+    QPainter painter(viewport());
+    painter.setFont(font());
+
+    if (m_lineOffsets.isEmpty()) {
+        if (!m_placeholderText.isEmpty()) {
+            painter.setPen(GutterForeground);
+            painter.drawText(viewport()->rect(), Qt::AlignCenter, m_placeholderText);
+        }
+        return;
+    }
+
+    const QFontMetrics metrics(font());
+    const int height = lineHeight();
+    const int charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char(' ')));
+    const int gutter = gutterWidth();
+    const int scrollX = horizontalScrollBar()->value();
+    const int width = viewport()->width();
+
+    // 超长的行（压缩过的js等）只取出可见范围附近的字节再解码
+    const int visibleColumns = width / charWidth + 2;
+    const QFont normalFont = font();
+    QFont boldFont = font();
+    boldFont.setBold(true);
+
+    const int firstRow = verticalScrollBar()->value();
+    const int rows = rowCount();
+    int row = firstRow;
+    int previousLine = -1;
+    LineNumbers numbers;
+    for (int y = 0; row < rows && y < viewport()->height(); ++row, y += height) {
+        const int line = lineForRow(row);
+        // 连续的行依次推算行号，跳过折叠的块后从最近的记录点重新推算
+        if (line == previousLine + 1) {
+            advanceLineNumbers(previousLine, &numbers);
+        } else {
+            numbers = lineNumbersAt(line);
+        }
+        previousLine = line;
+
+        QByteArrayView text = lineAt(line);
+        const int hunk = hunkForLine(line);
+        const QRect rowRect(0, y, width, height);
+
+        QColor foreground = palette().color(QPalette::Text);
+        painter.setFont(normalFont);
+        if (hunk < 0) {
+            // 块之外是文件头：diff --git、index、---、+++等
+            painter.setFont(boldFont);
+        } else if (line == m_hunks[hunk].start) {
+            painter.fillRect(rowRect, HunkBackground);
+            foreground = HunkForeground;
+            painter.setPen(GutterForeground);
+            painter.drawText(QRect(0, y, gutter, height), Qt::AlignCenter,
+                             m_hunks[hunk].folded ? QStringLiteral("▸") : QStringLiteral("▾"));
+        } else if (!text.isEmpty() && text[0] == '+') {
+            painter.fillRect(rowRect, AddedBackground);
+        } else if (!text.isEmpty() && text[0] == '-') {
+            painter.fillRect(rowRect, RemovedBackground);
+        }
+
+        // 字节位置与列不对应（制表符、多字节字符），从行首累计宽度找到可见部分的起点
+        int offset = 0;
+        const qsizetype begin = firstVisibleByte(text, scrollX, metrics, charWidth, &offset);
+        if (begin >= text.size()) {
+            continue;
+        }
+        // 多字节字符占的列数不少于字节数的三分之一，多取一些保证填满可见区域
+        const qsizetype end = begin + qMin<qsizetype>(text.size() - begin, qsizetype(visibleColumns) * 3);
+
+        // 还没有结果的行先按普通文字绘制，结果到达后重绘
+        SyntaxHighlightEngine::TokenList tokens;
+        HighlightKey key;
+        if (m_highlightEngine && highlightKey(line, text, numbers, &key)) {
+            m_highlightEngine->tokens(key.oid, key.line, &tokens);
+        }
+
+        // 只为可见的修改行计算行内差异，结果按行缓存
+        const QList<IntraLineDiff::Range> &changes = intraLineChanges(line);
+        const QColor changeBackground = !text.isEmpty() && text[0] == '+' ? AddedWordBackground : RemovedWordBackground;
+
+        // 按记号和行内修改把可见部分切成若干段，依次绘制；记号偏移不含差异前缀
+        int x = gutter + offset - scrollX;
+        qsizetype position = begin;
+        int tokenIndex = 0;
+        int changeIndex = 0;
+        while (position < end) {
+            while (tokenIndex < tokens.size() && tokens[tokenIndex].start + tokens[tokenIndex].length + 1 <= position) {
+                ++tokenIndex;
+            }
+            while (changeIndex < changes.size() && changes[changeIndex].start + changes[changeIndex].length <= position) {
+                ++changeIndex;
+            }
+            qsizetype segmentEnd = end;
+            QColor color = foreground;
+            if (tokenIndex < tokens.size()) {
+                const qsizetype tokenStart = tokens[tokenIndex].start + 1;
+                if (tokenStart <= position) {
+                    segmentEnd = qMin(end, tokenStart + qsizetype(tokens[tokenIndex].length));
+                    color = tokenColor(tokens[tokenIndex].kind);
+                } else {
+                    segmentEnd = qMin(end, tokenStart);
+                }
+            }
+            bool changed = false;
+            if (changeIndex < changes.size()) {
+                const IntraLineDiff::Range &change = changes[changeIndex];
+                if (change.start <= position) {
+                    segmentEnd = qMin(segmentEnd, change.start + change.length);
+                    changed = true;
+                } else {
+                    segmentEnd = qMin(segmentEnd, change.start);
+                }
+            }
+
+            QString segment = QString::fromUtf8(text.data() + position, segmentEnd - position);
+            segment.replace(QLatin1Char('\t'), QString(TabWidth, QLatin1Char(' ')));
+            const int advance = metrics.horizontalAdvance(segment);
+            if (changed) {
+                painter.fillRect(QRect(x, y, advance, height), changeBackground);
+            }
+            painter.setPen(color);
+            painter.drawText(QRect(x, y, width, height), Qt::AlignLeft | Qt::AlignVCenter | Qt::TextSingleLine, segment);
+            x += advance;
+            position = segmentEnd;
+            if (x >= width) {
+                break;
+            }
+        }
+    }
+
+    // 可见范围上下各多请求一页，滚动时结果多半已经准备好
+    const int pageRows = row - firstRow;
+    requestHighlighting(firstRow - pageRows, row + pageRows);
+}
+
+void DiffView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void DiffView::mousePressEvent(QMouseEvent *event)
+{
+    // 点击@@行切换折叠
+    if (event->button() == Qt::LeftButton) {
+        const int row = verticalScrollBar()->value() + int(event->position().y()) / lineHeight();
+        if (row < rowCount()) {
+            const int line = lineForRow(row);
+            const int hunk = hunkForLine(line);
+            if (hunk >= 0 && m_hunks[hunk].start == line) {
+                setHunkFolded(hunk, !m_hunks[hunk].folded);
+                return;
+            }
+        }
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void DiffView::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_N:
+        nextHunk();
+        return;
+    case Qt::Key_P:
+        previousHunk();
+        return;
+    case Qt::Key_Space: {
+        // 折叠或展开顶部行所在的块
+        const int hunk = hunkForLine(lineForRow(verticalScrollBar()->value()));
+        if (hunk >= 0) {
+            setHunkFolded(hunk, !m_hunks[hunk].folded);
+            jumpToHunk(hunk);
+        }
+        return;
+    }
+    case Qt::Key_Home:
+        verticalScrollBar()->setValue(0);
+        return;
+    case Qt::Key_End:
+        verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+        return;
+    default:
+        break;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+void DiffView::indexLines(bool final)
+{
+    const qsizetype size = m_data.size();
+    qsizetype offset = m_indexedOffset;
+    while (offset < size) {
+        qsizetype end = m_data.indexOf('\n', offset);
+        if (end < 0) {
+            // 没有换行符的行等到下一块数据或结束时再加入
+            if (!final) {
+                break;
+            }
+            end = size;
+        }
+        const int line = m_lineOffsets.size();
+        m_lineOffsets.append(offset);
+        // 滚动范围按列计算，制表符展开后占TabWidth列
+        const qsizetype tabs = std::count(m_data.constData() + offset, m_data.constData() + end, '\t');
+        m_maxLineLength = qMax(m_maxLineLength, end - offset + tabs * (TabWidth - 1));
+        if (line % LineNumberInterval == 0) {
+            m_lineNumberCheckpoints.append(m_indexNumbers);
+        }
+
+        // 块在下一个@@行、下一个文件头或结尾处结束；块内的行都有前缀，不会与两者混淆
+        QByteArrayView text(m_data.constData() + offset, end - offset);
+        if (text.startsWith("@@")) {
+            if (m_hunkOpen) {
+                m_hunks.last().end = line;
+                updateLastHunk();
+            }
+            // 新块都是展开的，前缀和只需要追加
+            m_hiddenBefore.append(m_hiddenBefore.last());
+            Hunk hunk;
+            hunk.start = line;
+            m_hunks.append(hunk);
+            m_hunkOpen = true;
+            parseHunkHeader(text, &m_indexNumbers);
+        } else if (text.startsWith("diff ")) {
+            if (m_hunkOpen) {
+                m_hunks.last().end = line;
+                updateLastHunk();
+                m_hunkOpen = false;
+            }
+            FileSection file;
+            file.startLine = line;
+            // 合并提交的组合差异（diff --cc）每行有多个前缀，不做高亮
+            const qsizetype pathPos = text.lastIndexOf(" b/");
+            if (text.startsWith("diff --git ") && pathPos >= 0) {
+                file.language = SyntaxHighlightEngine::languageForPath(
+                    QString::fromUtf8(text.sliced(pathPos + 3).toByteArray().trimmed()));
+            }
+            m_files.append(file);
+        } else if (m_hunkOpen) {
+            advanceContentLine(text, &m_indexNumbers);
+        } else if (!m_files.isEmpty()) {
+            parseFileHeader(text, &m_files.last());
+        }
+        offset = qMin(end + 1, size);
+    }
+    m_indexedOffset = offset;
+
+    // 仍在接收的块延伸到目前的最后一行
+    if (m_hunkOpen) {
+        m_hunks.last().end = m_lineOffsets.size();
+        updateLastHunk();
+        if (final) {
+            m_hunkOpen = false;
+        }
+    }
+}
+
+void DiffView::updateLastHunk()
+{
+    // 只有最后一个块还在变化，它被折叠时只需要更新最后一项前缀和
+    const int last = m_hunks.size() - 1;
+    const Hunk &hunk = m_hunks[last];
+    m_hiddenBefore[last + 1] = m_hiddenBefore[last] + (hunk.folded ? hunk.end - hunk.start - 1 : 0);
+}
+
+void DiffView::updateHiddenLines()
+{
+    m_hiddenBefore.resize(m_hunks.size() + 1);
+    m_hiddenBefore[0] = 0;
+    for (int i = 0; i < m_hunks.size(); ++i) {
+        const Hunk &hunk = m_hunks[i];
+        m_hiddenBefore[i + 1] = m_hiddenBefore[i] + (hunk.folded ? hunk.end - hunk.start - 1 : 0);
+    }
+}
+
+void DiffView::updateScrollBars()
+{
+    const int height = lineHeight();
+    const int pageRows = qMax(1, viewport()->height() / height);
+    verticalScrollBar()->setRange(0, qMax(0, rowCount() - pageRows));
+    verticalScrollBar()->setPageStep(pageRows);
+    verticalScrollBar()->setSingleStep(1);
+
+    const int charWidth = qMax(1, fontMetrics().horizontalAdvance(QLatin1Char(' ')));
+    const qint64 contentWidth = gutterWidth() + m_maxLineLength * charWidth;
+    const int pageWidth = viewport()->width();
+    horizontalScrollBar()->setRange(0, int(qBound<qint64>(0, contentWidth - pageWidth, INT_MAX)));
+    horizontalScrollBar()->setPageStep(pageWidth);
+    horizontalScrollBar()->setSingleStep(charWidth * 4);
+}
+
+void DiffView::parseHunkHeader(QByteArrayView text, LineNumbers *numbers)
+{
+    // "@@ -12,5 +13,7 @@"，省略行数时为"@@ -12 +13 @@"
+    auto numberAfter = [text](char marker) {
+        const qsizetype pos = text.indexOf(marker);
+        int value = 0;
+        for (qsizetype i = pos + 1; pos >= 0 && i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    };
+    numbers->oldLine = numberAfter('-');
+    numbers->newLine = numberAfter('+');
+}
+
+void DiffView::advanceContentLine(QByteArrayView text, LineNumbers *numbers)
+{
+    const char prefix = text.isEmpty() ? ' ' : text[0];
+    if (prefix == ' ' || prefix == '-') {
+        ++numbers->oldLine;
+    }
+    if (prefix == ' ' || prefix == '+') {
+        ++numbers->newLine;
+    }
+}
+
+void DiffView::parseFileHeader(QByteArrayView text, FileSection *file)
+{
+    if (text.startsWith("index ")) {
+        // "index 1a2b3c4..5d6e7f8 100644"
+        const qsizetype dots = text.indexOf("..");
+        if (dots < 0) {
+            return;
+        }
+        qsizetype end = text.indexOf(' ', dots);
+        if (end < 0) {
+            end = text.size();
+        }
+        file->oldOid = text.sliced(6, dots - 6).toByteArray();
+        file->newOid = text.sliced(dots + 2, end - dots - 2).toByteArray().trimmed();
+    } else if (text.startsWith("+++ b/")) {
+        file->language = SyntaxHighlightEngine::languageForPath(QString::fromUtf8(text.sliced(6).toByteArray().trimmed()));
+    }
+}
+
+void DiffView::advanceLineNumbers(int line, LineNumbers *numbers) const
+{
+    const int hunk = hunkForLine(line);
+    if (hunk < 0) {
+        return;
+    }
+    if (line == m_hunks[hunk].start) {
+        parseHunkHeader(lineAt(line), numbers);
+    } else {
+        advanceContentLine(lineAt(line), numbers);
+    }
+}
+
+DiffView::LineNumbers DiffView::lineNumbersAt(int line) const
+{
+    const int checkpoint = line / LineNumberInterval;
+    if (checkpoint >= m_lineNumberCheckpoints.size()) {
+        return LineNumbers();
+    }
+    LineNumbers numbers = m_lineNumberCheckpoints[checkpoint];
+    for (int i = checkpoint * LineNumberInterval; i < line; ++i) {
+        advanceLineNumbers(i, &numbers);
+    }
+    return numbers;
+}
+
+int DiffView::fileForLine(int line) const
+{
+    int low = 0;
+    int high = m_files.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (m_files[mid].startLine <= line) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low - 1;
+}
+
+bool DiffView::highlightKey(int line, QByteArrayView text, const LineNumbers &numbers, HighlightKey *key) const
+{
+    const int hunk = hunkForLine(line);
+    if (hunk < 0 || line == m_hunks[hunk].start || text.isEmpty() || text.size() > MaxHighlightLineLength) {
+        return false;
+    }
+    const int file = fileForLine(line);
+    if (file < 0 || m_files[file].language == 0) {
+        return false;
+    }
+
+    // 删除的行属于旧blob，其余的行属于新blob
+    const char prefix = text[0];
+    if (prefix != ' ' && prefix != '+' && prefix != '-') {
+        return false;
+    }
+    const FileSection &section = m_files[file];
+    key->oid = prefix == '-' ? section.oldOid : section.newOid;
+    key->line = prefix == '-' ? numbers.oldLine : numbers.newLine;
+    key->language = section.language;
+    // 全0的对象ID表示git没有计算哈希，无法作为缓存键
+    return !key->oid.isEmpty() && key->oid.count('0') != key->oid.size();
+}
+
+const QList<IntraLineDiff::Range> &DiffView::intraLineChanges(int line)
+{
+    static const QList<IntraLineDiff::Range> none;
+    if (m_intraLineChanges.contains(line)) {
+        return m_intraLineChanges[line];
+    }
+
+    const QByteArrayView text = lineAt(line);
+    const int hunk = hunkForLine(line);
+    if (hunk < 0 || line == m_hunks[hunk].start || text.isEmpty() || (text[0] != '-' && text[0] != '+')) {
+        return none;
+    }
+
+    // 找到包含这一行的"连续删除行+紧随的连续添加行"，按顺序一一配对
+    const Hunk &range = m_hunks[hunk];
+    auto prefixAt = [this, &range](int i) {
+        if (i <= range.start || i >= range.end) {
+            return '\0';
+        }
+        const QByteArrayView lineText = lineAt(i);
+        return lineText.isEmpty() ? ' ' : lineText[0];
+    };
+    int removedBegin = line;
+    int addedBegin = line;
+    if (text[0] == '-') {
+        while (prefixAt(removedBegin - 1) == '-' && line - removedBegin < MaxPairedLines) {
+            --removedBegin;
+        }
+        addedBegin = line + 1;
+        while (prefixAt(addedBegin) == '-' && addedBegin - line < MaxPairedLines) {
+            ++addedBegin;
+        }
+    } else {
+        while (prefixAt(addedBegin - 1) == '+' && line - addedBegin < MaxPairedLines) {
+            --addedBegin;
+        }
+        removedBegin = addedBegin;
+        while (prefixAt(removedBegin - 1) == '-' && addedBegin - removedBegin < MaxPairedLines) {
+            --removedBegin;
+        }
+    }
+    int addedEnd = addedBegin;
+    while (prefixAt(addedEnd) == '+' && addedEnd - addedBegin < MaxPairedLines) {
+        ++addedEnd;
+    }
+    const int removedCount = addedBegin - removedBegin;
+    const int addedCount = addedEnd - addedBegin;
+    // 太长的块不配对；还在接收的块等全部到达后再计算，以免配对变化
+    if (removedCount == 0 || addedCount == 0 || removedCount >= MaxPairedLines || addedCount >= MaxPairedLines
+        || prefixAt(removedBegin - 1) == '-' || (!m_complete && addedEnd >= m_lineOffsets.size())) {
+        return none;
+    }
+
+    const int index = text[0] == '-' ? line - removedBegin : line - addedBegin;
+    if (index >= qMin(removedCount, addedCount)) {
+        m_intraLineChanges.insert(line, QList<IntraLineDiff::Range>());
+        return m_intraLineChanges[line];
+    }
+    const int removedLine = removedBegin + index;
+    const int addedLine = addedBegin + index;
+
+    // 结果的偏移不含差异前缀，换算为行内偏移后两行一起缓存
+    QList<IntraLineDiff::Range> removedChanges;
+    QList<IntraLineDiff::Range> addedChanges;
+    IntraLineDiff::compute(lineAt(removedLine).sliced(1), lineAt(addedLine).sliced(1), &removedChanges, &addedChanges);
+    for (IntraLineDiff::Range &change : removedChanges) {
+        ++change.start;
+    }
+    for (IntraLineDiff::Range &change : addedChanges) {
+        ++change.start;
+    }
+    m_intraLineChanges.insert(removedLine, removedChanges);
+    m_intraLineChanges.insert(addedLine, addedChanges);
+    return m_intraLineChanges[line];
+}
+
+void DiffView::requestHighlighting(int firstRow, int lastRow)
+{
+    if (!m_highlightEngine) {
+        return;
+    }
+    firstRow = qMax(0, firstRow);
+    lastRow = qMin(rowCount(), lastRow);
+
+    QList<SyntaxHighlightEngine::LineRequest> requests;
+    int previousLine = -1;
+    LineNumbers numbers;
+    for (int row = firstRow; row < lastRow; ++row) {
+        const int line = lineForRow(row);
+        if (line == previousLine + 1) {
+            advanceLineNumbers(previousLine, &numbers);
+        } else {
+            numbers = lineNumbersAt(line);
+        }
+        previousLine = line;
+
+        QByteArrayView text = lineAt(line);
+        HighlightKey key;
+        SyntaxHighlightEngine::TokenList tokens;
+        if (!highlightKey(line, text, numbers, &key) || m_highlightEngine->tokens(key.oid, key.line, &tokens)) {
+            continue;
+        }
+        SyntaxHighlightEngine::LineRequest request;
+        request.oid = key.oid;
+        request.line = key.line;
+        request.language = key.language;
+        request.text = text.sliced(1).toByteArray();
+        requests.append(request);
+    }
+    m_highlightEngine->request(requests);
+}
+
+int DiffView::rowCount() const
+{
+    return m_lineOffsets.size() - m_hiddenBefore.last();
+}
+
+int DiffView::lineForRow(int row) const
+{
+    // 最后一个显示位置不大于row的块
+    int low = 0;
+    int high = m_hunks.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (rowForHunk(mid) <= row) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    const int hunk = low - 1;
+    if (hunk < 0) {
+        return row;
+    }
+    // 折叠的块只显示@@行，之后的行要跳过整个块
+    if (row > rowForHunk(hunk)) {
+        return row + m_hiddenBefore[hunk + 1];
+    }
+    return row + m_hiddenBefore[hunk];
+}
+
+int DiffView::rowForHunk(int hunk) const
+{
+    return m_hunks[hunk].start - m_hiddenBefore[hunk];
+}
+
+int DiffView::hunkForLine(int line) const
+{
+    int low = 0;
+    int high = m_hunks.size();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        if (m_hunks[mid].start <= line) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    const int hunk = low - 1;
+    if (hunk >= 0 && line < m_hunks[hunk].end) {
+        return hunk;
+    }
+    return -1;
+}
+
+QByteArrayView DiffView::lineAt(int line) const
+{
+    const qsizetype begin = m_lineOffsets[line];
+    qsizetype end = line + 1 < m_lineOffsets.size() ? m_lineOffsets[line + 1] : m_indexedOffset;
+    if (end > begin && m_data[end - 1] == '\n') {
+        --end;
+    }
+    if (end > begin && m_data[end - 1] == '\r') {
+        --end;
+    }
+    return QByteArrayView(m_data.constData() + begin, end - begin);
+}
+
+int DiffView::lineHeight() const
+{
+    return qMax(1, fontMetrics().lineSpacing());
+}
+
+int DiffView::gutterWidth() const
+{
+    return fontMetrics().horizontalAdvance(QLatin1Char(' ')) * 2;
+}
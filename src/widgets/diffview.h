@@ -0,0 +1,121 @@
+#ifndef DIFFVIEW_H
+#define DIFFVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include "intralinediff.h"
+
+class SyntaxHighlightEngine;
+
+// 只读的统一差异视图：保存原始字节和每行的起始偏移，只绘制可见的行，不建立QTextDocument。
+// 每个@@块可以折叠，折叠状态用前缀和记录，行号与显示行之间的换算是对块的二分查找，
+// 跳到某个块是常数时间；内存与差异大小成正比
+class DiffView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit DiffView(QWidget *parent = nullptr);
+
+    void setDiff(const QByteArray &diff);
+    // 流式显示：数据到达时追加，已经显示的行和滚动位置不变；全部到达后调用finishDiff
+    void appendDiff(const QByteArray &chunk);
+    void finishDiff();
+    void clear();
+    // 没有差异时居中显示的文字
+    void setPlaceholderText(const QString &text);
+    // 多个视图可以共用一个引擎及其缓存；为空时不高亮
+    void setHighlightEngine(SyntaxHighlightEngine *engine);
+
+    int lineCount() const;
+    int hunkCount() const;
+    bool isHunkFolded(int hunk) const;
+    void setHunkFolded(int hunk, bool folded);
+    void setAllHunksFolded(bool folded);
+
+public slots:
+    void jumpToHunk(int hunk);
+    void nextHunk();
+    void previousHunk();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    struct Hunk {
+        int start = 0;   // @@行的行号
+        int end = 0;     // 块结束后的第一行，仍在接收的块为目前的行数
+        bool folded = false;
+    };
+
+    // diff --git开始的一个文件，index行给出新旧blob，用作高亮缓存的键
+    struct FileSection {
+        int startLine = 0;
+        QByteArray oldOid;
+        QByteArray newOid;
+        int language = 0;
+    };
+
+    // 一行在旧文件和新文件中的行号
+    struct LineNumbers {
+        int oldLine = 0;
+        int newLine = 0;
+    };
+
+    struct HighlightKey {
+        QByteArray oid;
+        int line = 0;
+        int language = 0;
+    };
+
+    // 从m_indexedOffset开始为完整的行建立索引，final时最后一行可以没有换行符
+    void indexLines(bool final);
+    void updateHiddenLines();
+    void updateLastHunk();
+    static void parseHunkHeader(QByteArrayView text, LineNumbers *numbers);
+    static void advanceContentLine(QByteArrayView text, LineNumbers *numbers);
+    static void parseFileHeader(QByteArrayView text, FileSection *file);
+    // 把行号从line之前推进到line之后
+    void advanceLineNumbers(int line, LineNumbers *numbers) const;
+    // line之前的行号，从最近的记录点推算
+    LineNumbers lineNumbersAt(int line) const;
+    int fileForLine(int line) const;
+    bool highlightKey(int line, QByteArrayView text, const LineNumbers &numbers, HighlightKey *key) const;
+    // 为这些显示行中还没有结果的行发起高亮请求
+    void requestHighlighting(int firstRow, int lastRow);
+    // 修改行中与配对的行不同的部分（行内偏移），第一次绘制时计算
+    const QList<IntraLineDiff::Range> &intraLineChanges(int line);
+    void updateScrollBars();
+    int rowCount() const;
+    int lineForRow(int row) const;
+    int rowForHunk(int hunk) const;
+    // 包含该行的块，行不在任何块内时返回-1
+    int hunkForLine(int line) const;
+    QByteArrayView lineAt(int line) const;
+    int lineHeight() const;
+    int gutterWidth() const;
+
+    QByteArray m_data;
+    QList<qsizetype> m_lineOffsets;
+    qsizetype m_indexedOffset; // 已建立索引的字节数
+    QList<Hunk> m_hunks;
+    // m_hiddenBefore[i]为前i个块中折叠隐藏的行数，最后一项为总数
+    QList<int> m_hiddenBefore;
+    qsizetype m_maxLineLength; // 最长的行展开制表符后的列数（按字节估计），决定水平滚动范围
+    bool m_hunkOpen; // 最后一个块还没有遇到结束行
+    QList<FileSection> m_files;
+    // 第i项为第i * LineNumberInterval行之前的行号
+    QList<LineNumbers> m_lineNumberCheckpoints;
+    LineNumbers m_indexNumbers; // 建立索引时的当前行号
+    bool m_complete; // finishDiff之后不会再有新的行
+    QHash<int, QList<IntraLineDiff::Range>> m_intraLineChanges;
+    SyntaxHighlightEngine *m_highlightEngine;
+    QString m_placeholderText;
+};
+
+#endif // DIFFVIEW_H
@@ -2,6 +2,8 @@
 #include <QIcon>
 #include <QBrush>
 #include <QColor>
+#include <QHash>
+#include <algorithm>
 
 FileStatusModel::FileStatusModel(QObject *parent)
     : QAbstractTableModel(parent)
@@ -16,9 +18,91 @@ void FileStatusModel::setFileStatus(const QList<GitManager::FileInfo> &fileStatu
 {
     beginResetModel();
     m_fileStatus = fileStatus;
+    // git status先输出已跟踪的文件再输出未跟踪的文件，整体按路径排序，增量更新时才能按路径二分插入
+    std::sort(m_fileStatus.begin(), m_fileStatus.end(),
+              [](const GitManager::FileInfo &a, const GitManager::FileInfo &b) {
+        return a.path < b.path;
+    });
     endResetModel();
 }
 
+void FileStatusModel::updateFileStatus(const QStringList &paths, const QList<GitManager::FileInfo> &fileStatus)
+{
+    QHash<QString, GitManager::FileInfo> updated;
+    for (const GitManager::FileInfo &fileInfo : fileStatus) {
+        updated.insert(fileInfo.path, fileInfo);
+    }
+    // 批量操作时路径可能有上千个，按集合查找
+    QSet<QString> pathSet;
+    for (const QString &path : paths) {
+        pathSet.insert(path.endsWith('/') ? path.chopped(1) : path);
+    }
+
+    // 已有的行：仍有变化的原地更新，变干净的删除；相邻的删除行合并为一次删除
+    int removeEnd = -1;
+    auto flushRemoved = [this, &removeEnd](int first) {
+        if (removeEnd >= first) {
+            beginRemoveRows(QModelIndex(), first, removeEnd);
+            m_fileStatus.remove(first, removeEnd - first + 1);
+            endRemoveRows();
+        }
+        removeEnd = -1;
+    };
+    for (int row = m_fileStatus.size() - 1; row >= 0; --row) {
+        const GitManager::FileInfo &current = m_fileStatus[row];
+        if (!isCovered(current.path, pathSet) && !isCovered(current.oldPath, pathSet)) {
+            flushRemoved(row + 1);
+            continue;
+        }
+
+        auto it = updated.find(current.path);
+        if (it != updated.end()) {
+            flushRemoved(row + 1);
+            m_fileStatus[row] = it.value();
+            updated.erase(it);
+            emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+        } else if (removeEnd < 0) {
+            removeEnd = row;
+        }
+    }
+    flushRemoved(0);
+
+    // 新出现的文件按路径顺序插入，与setFileStatus排序后的顺序一致
+    for (const GitManager::FileInfo &fileInfo : fileStatus) {
+        if (!updated.contains(fileInfo.path)) {
+            continue;
+        }
+        auto position = std::lower_bound(m_fileStatus.begin(), m_fileStatus.end(), fileInfo.path,
+                                         [](const GitManager::FileInfo &item, const QString &path) {
+            return item.path < path;
+        });
+        int row = int(position - m_fileStatus.begin());
+        beginInsertRows(QModelIndex(), row, row);
+        m_fileStatus.insert(row, fileInfo);
+        endInsertRows();
+    }
+}
+
+bool FileStatusModel::isCovered(const QString &path, const QSet<QString> &paths)
+{
+    if (path.isEmpty()) {
+        return false;
+    }
+    if (paths.contains(".")) {
+        return true;
+    }
+    // 路径本身或它所在的任一上级目录
+    QString prefix = path;
+    while (!paths.contains(prefix)) {
+        int slash = prefix.lastIndexOf('/');
+        if (slash < 0) {
+            return false;
+        }
+        prefix.truncate(slash);
+    }
+    return true;
+}
+
 GitManager::FileInfo FileStatusModel::getFileInfo(int row) const
 {
     if (row >= 0 && row < m_fileStatus.size()) {
@@ -71,6 +155,15 @@ QVariant FileStatusModel::data(const QModelIndex &index, int role) const
         }
         break;
 
+    case Qt::ToolTipRole:
+        if (index.column() == StatusColumn) {
+            // 暂存区和工作树的状态分开显示，例如"MM"表示部分修改已暂存
+            return QString("暂存区: %1\n工作树: %2")
+                .arg(QLatin1Char(fileInfo.indexStatus == ' ' ? '-' : fileInfo.indexStatus))
+                .arg(QLatin1Char(fileInfo.worktreeStatus == ' ' ? '-' : fileInfo.worktreeStatus));
+        }
+        break;
+
     case Qt::ForegroundRole:
         switch (fileInfo.status) {
         case GitManager::Modified:
@@ -3,6 +3,7 @@
 
 #include <QAbstractTableModel>
 #include <QList>
+#include <QSet>
 #include "git/gitmanager.h"
 
 class FileStatusModel : public QAbstractTableModel
@@ -20,7 +21,10 @@ public:
     explicit FileStatusModel(QObject *parent = nullptr);
     ~FileStatusModel();
 
+    // 行按路径排序，不保留git status的输出顺序
     void setFileStatus(const QList<GitManager::FileInfo> &fileStatus);
+    // 只替换paths范围内（路径本身或其下的文件）的行，其他行和选中状态保持不变
+    void updateFileStatus(const QStringList &paths, const QList<GitManager::FileInfo> &fileStatus);
     GitManager::FileInfo getFileInfo(int row) const;
 
     // QAbstractItemModel interface
@@ -30,6 +34,7 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
 private:
+    static bool isCovered(const QString &path, const QSet<QString> &paths);
     QString statusToString(GitManager::FileStatus status) const;
     QIcon statusToIcon(GitManager::FileStatus status) const;
 
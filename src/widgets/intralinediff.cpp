@@ -0,0 +1,297 @@
+#include "intralinediff.h"
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INTRALINEDIFF_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+inline int lowestSetBit(unsigned value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return int(index);
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+inline int highestSetBit(unsigned value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return int(index);
+#else
+    return 31 - __builtin_clz(value);
+#endif
+}
+
+inline bool isWordChar(char c)
+{
+    // 非ASCII字节（UTF-8多字节字符）也算作单词的一部分，不会被拆开
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'
+           || (static_cast<uchar>(c) & 0x80);
+}
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+}
+
+qsizetype IntraLineDiff::commonPrefix(const char *a, const char *b, qsizetype length)
+{
+    qsizetype i = 0;
+#ifdef INTRALINEDIFF_SSE2
+    // 每次比较16字节，第一个不同字节的位置来自比较掩码的最低位
+    for (; i + 16 <= length; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        const unsigned mismatch = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) ^ 0xffffu;
+        if (mismatch) {
+            return i + lowestSetBit(mismatch);
+        }
+    }
+#else
+    // 没有SSE2时按8字节整体比较，找到不同的块后再逐字节确认
+    for (; i + 8 <= length; i += 8) {
+        quint64 x;
+        quint64 y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            break;
+        }
+    }
+#endif
+    while (i < length && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+qsizetype IntraLineDiff::commonSuffix(const char *aEnd, const char *bEnd, qsizetype length)
+{
+    qsizetype i = 0;
+#ifdef INTRALINEDIFF_SSE2
+    // 从末尾向前每次比较16字节，最后一个不同字节对应掩码的最高位
+    for (; i + 16 <= length; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(aEnd - i - 16));
+        const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bEnd - i - 16));
+        const unsigned mismatch = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) ^ 0xffffu;
+        if (mismatch) {
+            return i + 15 - highestSetBit(mismatch);
+        }
+    }
+#else
+    for (; i + 8 <= length; i += 8) {
+        quint64 x;
+        quint64 y;
+        memcpy(&x, aEnd - i - 8, 8);
+        memcpy(&y, bEnd - i - 8, 8);
+        if (x != y) {
+            break;
+        }
+    }
+#endif
+    while (i < length && aEnd[-1 - i] == bEnd[-1 - i]) {
+        ++i;
+    }
+    return i;
+}
+
+bool IntraLineDiff::compute(QByteArrayView oldText, QByteArrayView newText,
+                            QList<Range> *oldRanges, QList<Range> *newRanges)
+{
+    oldRanges->clear();
+    newRanges->clear();
+
+    const qsizetype shorter = qMin(oldText.size(), newText.size());
+    const qsizetype prefix = commonPrefix(oldText.data(), newText.data(), shorter);
+    if (prefix == oldText.size() && prefix == newText.size()) {
+        return false;
+    }
+    const qsizetype suffix = commonSuffix(oldText.data() + oldText.size(), newText.data() + newText.size(),
+                                          shorter - prefix);
+
+    const QList<Token> oldTokens = tokenize(oldText);
+    const QList<Token> newTokens = tokenize(newText);
+
+    // 单词的边界只取决于相邻的两个字节：结束位置在相同开头之内的单词两边完全一致，结尾同理
+    qsizetype oldFirst = 0;
+    while (oldFirst < oldTokens.size() && oldTokens[oldFirst].start + oldTokens[oldFirst].length < prefix) {
+        ++oldFirst;
+    }
+    qsizetype newFirst = oldFirst;
+    qsizetype oldLast = oldTokens.size();
+    qsizetype newLast = newTokens.size();
+    while (oldLast > oldFirst && newLast > newFirst
+           && oldTokens[oldLast - 1].start > oldText.size() - suffix
+           && newTokens[newLast - 1].start > newText.size() - suffix) {
+        --oldLast;
+        --newLast;
+    }
+
+    QList<bool> oldChanged(oldTokens.size(), false);
+    QList<bool> newChanged(newTokens.size(), false);
+    const bool trimmed = oldFirst > 0 || oldLast < oldTokens.size();
+    if (!diffTokens(oldText, oldTokens, oldFirst, oldLast, newText, newTokens, newFirst, newLast,
+                    &oldChanged, &newChanged)) {
+        // 中间部分差别太大：只有去掉开头和结尾之后才值得标出
+        if (!trimmed) {
+            return false;
+        }
+        for (qsizetype i = oldFirst; i < oldLast; ++i) {
+            oldChanged[i] = true;
+        }
+        for (qsizetype i = newFirst; i < newLast; ++i) {
+            newChanged[i] = true;
+        }
+    }
+
+    collectRanges(oldTokens, oldChanged, oldRanges);
+    collectRanges(newTokens, newChanged, newRanges);
+
+    // 除空白外没有相同的单词时整行都是修改
+    auto coversAll = [](QByteArrayView text, const QList<Token> &tokens, const QList<bool> &changed) {
+        for (qsizetype i = 0; i < tokens.size(); ++i) {
+            if (!changed[i] && !isSpace(text[tokens[i].start])) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (coversAll(oldText, oldTokens, oldChanged) && coversAll(newText, newTokens, newChanged)) {
+        oldRanges->clear();
+        newRanges->clear();
+        return false;
+    }
+    return true;
+}
+
+QList<IntraLineDiff::Token> IntraLineDiff::tokenize(QByteArrayView text)
+{
+    // 单词、连续的空白和单个标点各为一个记号
+    QList<Token> tokens;
+    const qsizetype size = text.size();
+    qsizetype i = 0;
+    while (i < size) {
+        qsizetype end = i + 1;
+        if (isWordChar(text[i])) {
+            while (end < size && isWordChar(text[end])) {
+                ++end;
+            }
+        } else if (isSpace(text[i])) {
+            while (end < size && isSpace(text[end])) {
+                ++end;
+            }
+        }
+
+        // FNV-1a，比较前先比较哈希
+        uint hash = 2166136261u;
+        for (qsizetype j = i; j < end; ++j) {
+            hash = (hash ^ static_cast<uchar>(text[j])) * 16777619u;
+        }
+        tokens.append({i, end - i, hash});
+        i = end;
+    }
+    return tokens;
+}
+
+bool IntraLineDiff::diffTokens(QByteArrayView oldText, const QList<Token> &oldTokens, qsizetype oldFirst, qsizetype oldLast,
+                               QByteArrayView newText, const QList<Token> &newTokens, qsizetype newFirst, qsizetype newLast,
+                               QList<bool> *oldChanged, QList<bool> *newChanged)
+{
+    const int n = int(oldLast - oldFirst);
+    const int m = int(newLast - newFirst);
+    auto equal = [&](int x, int y) {
+        const Token &a = oldTokens[oldFirst + x];
+        const Token &b = newTokens[newFirst + y];
+        return a.hash == b.hash && a.length == b.length
+               && memcmp(oldText.data() + a.start, newText.data() + b.start, size_t(a.length)) == 0;
+    };
+
+    // 贪心的Myers算法：V[k]为对角线k上能到达的最远x，每一步的V都保存下来用于回溯
+    const int maxCost = qMin(n + m, int(MaxEditCost));
+    const int offset = maxCost + 1;
+    std::vector<int> v(2 * maxCost + 3, 0);
+    std::vector<std::vector<int>> trace;
+    int cost = -1;
+    for (int d = 0; d <= maxCost && cost < 0; ++d) {
+        trace.push_back(v);
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+            int y = x - k;
+            while (x < n && y < m && equal(x, y)) {
+                ++x;
+                ++y;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                cost = d;
+                break;
+            }
+        }
+    }
+    if (cost < 0) {
+        return false;
+    }
+
+    // 从终点沿保存的V回溯，非对角线的一步对应删除或插入一个单词
+    int x = n;
+    int y = m;
+    for (int d = cost; d > 0; --d) {
+        const std::vector<int> &previous = trace[d];
+        const int k = x - y;
+        int previousK;
+        if (k == -d || (k != d && previous[offset + k - 1] < previous[offset + k + 1])) {
+            previousK = k + 1;
+        } else {
+            previousK = k - 1;
+        }
+        const int previousX = previous[offset + previousK];
+        const int previousY = previousX - previousK;
+        while (x > previousX && y > previousY) {
+            --x;
+            --y;
+        }
+        if (x == previousX) {
+            (*newChanged)[newFirst + previousY] = true;
+        } else {
+            (*oldChanged)[oldFirst + previousX] = true;
+        }
+        x = previousX;
+        y = previousY;
+    }
+    return true;
+}
+
+void IntraLineDiff::collectRanges(const QList<Token> &tokens, const QList<bool> &changed, QList<Range> *ranges)
+{
+    // 相邻的修改合并为一个范围
+    for (qsizetype i = 0; i < tokens.size(); ++i) {
+        if (!changed[i]) {
+            continue;
+        }
+        if (!ranges->isEmpty() && ranges->last().start + ranges->last().length == tokens[i].start) {
+            ranges->last().length += tokens[i].length;
+        } else {
+            Range range;
+            range.start = tokens[i].start;
+            range.length = tokens[i].length;
+            ranges->append(range);
+        }
+    }
+}
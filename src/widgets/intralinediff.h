@@ -0,0 +1,45 @@
+#ifndef INTRALINEDIFF_H
+#define INTRALINEDIFF_H
+
+#include <QByteArrayView>
+#include <QList>
+
+// 一对修改前后的行之间按单词比较，找出行内真正改动的部分。
+// 先用SIMD比较去掉相同的开头和结尾，只对中间剩下的单词做Myers差异；
+// 编辑距离超过上限时把中间部分整体视为修改，几万字符的生成代码行也能在绘制时计算
+class IntraLineDiff
+{
+public:
+    // 行内的字节范围
+    struct Range {
+        qsizetype start = 0;
+        qsizetype length = 0;
+    };
+
+    // Myers算法的编辑距离上限（以单词计）
+    static const int MaxEditCost = 200;
+
+    // 两行完全不同或完全相同时返回false，此时整行高亮没有意义
+    static bool compute(QByteArrayView oldText, QByteArrayView newText,
+                        QList<Range> *oldRanges, QList<Range> *newRanges);
+
+    static qsizetype commonPrefix(const char *a, const char *b, qsizetype length);
+    // aEnd、bEnd指向末尾之后，向前比较
+    static qsizetype commonSuffix(const char *aEnd, const char *bEnd, qsizetype length);
+
+private:
+    struct Token {
+        qsizetype start;
+        qsizetype length;
+        uint hash;
+    };
+
+    static QList<Token> tokenize(QByteArrayView text);
+    // 在[first, last)范围内比较两组单词，标出被删除和插入的单词；超过编辑距离上限时返回false
+    static bool diffTokens(QByteArrayView oldText, const QList<Token> &oldTokens, qsizetype oldFirst, qsizetype oldLast,
+                           QByteArrayView newText, const QList<Token> &newTokens, qsizetype newFirst, qsizetype newLast,
+                           QList<bool> *oldChanged, QList<bool> *newChanged);
+    static void collectRanges(const QList<Token> &tokens, const QList<bool> &changed, QList<Range> *ranges);
+};
+
+#endif // INTRALINEDIFF_H
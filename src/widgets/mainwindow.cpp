@@ -2,13 +2,33 @@
 #include "ui_mainwindow.h"
 #include "filestatusmodel.h"
 #include "commithistorymodel.h"
+#include "commitgraphdelegate.h"
 #include "branchmodel.h"
 #include "remotemodel.h"
+#include "tagmodel.h"
 #include "aifloatwidget.h"
+#include "syntaxhighlightengine.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+
+namespace {
+// 提交历史每页的提交数，滚动到底部时再加载下一页
+const int CommitHistoryPageSize = 200;
+// 生成提交信息时发给AI的补丁总字节数上限，超出的文件只列出路径和大小
+const qsizetype CommitMessageDiffBudget = 48 * 1024;
+// 超过这个大小的文件先显示--stat摘要，完整差异由用户手动加载
+const qint64 LargeDiffFileSize = 4 * 1024 * 1024;
+// 搜索框停止输入这么久（毫秒）后开始搜索
+const int CommitSearchDelay = 150;
+// 搜索结果最多显示的提交数
+const int CommitSearchLimit = 1000;
+// 筛选后的分支不超过这个数时展开全部目录
+const int BranchAutoExpandLimit = 200;
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
@@ -19,7 +39,12 @@ MainWindow::MainWindow(QWidget *parent)
       m_privacyModeEnabled(false),
       m_currentAIRequestType(AIProvider::GenerateCommitMessage),
       m_aiCommitSuggestion(""),
-      m_aiFloatWidget(nullptr)
+      m_commitMessagePending(false),
+      m_pendingDiffStaged(false),
+      m_diffJob(0),
+      m_aiFloatWidget(nullptr),
+      m_commitSearchTimer(new QTimer(this)),
+      m_commitSearchActive(false)
 {
     ui->setupUi(this);
     setupUI();
@@ -54,13 +79,16 @@ void MainWindow::setupUI()
     
     // 设置文件状态表格视图属性
     ui->fileStatusView->setSelectionBehavior(QAbstractItemView::SelectRows);
-    ui->fileStatusView->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui->fileStatusView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     ui->fileStatusView->setAlternatingRowColors(true);
     ui->fileStatusView->resizeColumnsToContents();
     
     // 连接文件状态右键菜单
     ui->fileStatusView->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(ui->fileStatusView, &QTableView::customContextMenuRequested, this, &MainWindow::onFileStatusContextMenu);
+    // 选中另一个文件时取消正在读取的差异，改为显示新文件的差异
+    connect(ui->fileStatusView->selectionModel(), &QItemSelectionModel::currentRowChanged,
+            this, &MainWindow::onFileSelectionChanged);
     
     // 初始化提交历史模型
     m_commitHistoryModel = new CommitHistoryModel(this);
@@ -70,19 +98,50 @@ void MainWindow::setupUI()
     ui->commitHistoryView->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->commitHistoryView->setSelectionMode(QAbstractItemView::SingleSelection);
     ui->commitHistoryView->setAlternatingRowColors(true);
+    ui->commitHistoryView->setItemDelegateForColumn(CommitHistoryModel::GraphColumn, new CommitGraphDelegate(this));
     ui->commitHistoryView->resizeColumnsToContents();
-    ui->commitHistoryView->setColumnWidth(HashColumn, 100);
-    ui->commitHistoryView->setColumnWidth(AuthorColumn, 150);
-    ui->commitHistoryView->setColumnWidth(DateColumn, 120);
+    ui->commitHistoryView->setColumnWidth(CommitHistoryModel::HashColumn, 100);
+    ui->commitHistoryView->setColumnWidth(CommitHistoryModel::AuthorColumn, 150);
+    ui->commitHistoryView->setColumnWidth(CommitHistoryModel::DateColumn, 120);
     ui->commitHistoryView->horizontalHeader()->setStretchLastSection(true);
     
+    // 搜索框：有索引时在全部已索引的提交中查找，结果替换历史列表
+    m_commitSearchTimer->setSingleShot(true);
+    m_commitSearchTimer->setInterval(CommitSearchDelay);
+    connect(m_commitSearchTimer, &QTimer::timeout, this, &MainWindow::applyCommitSearch);
+    connect(ui->commitSearchEdit, &QLineEdit::textChanged, m_commitSearchTimer, qOverload<>(&QTimer::start));
+
+    // 选中提交时显示提交详情
+    connect(ui->commitHistoryView->selectionModel(), &QItemSelectionModel::currentRowChanged,
+            this, &MainWindow::onCommitSelectionChanged);
+    
     // 初始化分支模型
     m_branchModel = new BranchModel(this);
     ui->branchListView->setModel(m_branchModel);
     
-    // 设置分支列表视图属性
+    // 设置分支列表视图属性：目录展开时才建立子节点，筛选在预先计算的小写名称上进行
+    ui->branchListView->setHeaderHidden(true);
+    ui->branchListView->setUniformRowHeights(true);
     ui->branchListView->setSelectionMode(QAbstractItemView::SingleSelection);
     ui->branchListView->setAlternatingRowColors(true);
+    connect(ui->branchFilterEdit, &QLineEdit::textChanged, this, &MainWindow::applyBranchFilter);
+    
+    // 初始化标签模型：默认最新的标签在前，点击表头按名称（版本号）、日期等排序
+    m_tagModel = new TagModel(this);
+    ui->tagListView->setModel(m_tagModel);
+    ui->tagListView->setRootIsDecorated(false);
+    ui->tagListView->setUniformRowHeights(true);
+    ui->tagListView->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui->tagListView->setAlternatingRowColors(true);
+    ui->tagListView->sortByColumn(TagModel::DateColumn, Qt::DescendingOrder);
+    ui->tagListView->setSortingEnabled(true);
+    
+    // 差异视图只绘制可见行，点击@@行折叠，n/p跳到下一个/上一个块
+    ui->diffView->setPlaceholderText("没有差异");
+    m_highlightEngine = new SyntaxHighlightEngine(this);
+    ui->diffView->setHighlightEngine(m_highlightEngine);
+    ui->commitDetailView->setHighlightEngine(m_highlightEngine);
+    ui->largeDiffBar->hide();
     
     // 设置分割器比例
     ui->mainSplitter->setSizes(QList<int>({250, 500, 250}));
@@ -122,6 +181,20 @@ void MainWindow::setupMenus()
     ui->menuRepository->addAction(m_actionPush);
     ui->menuRepository->addAction(m_actionPull);
     
+    // 内置fsmonitor，按仓库开关
+    m_actionFsmonitor = new QAction("文件系统监视加速", this);
+    m_actionFsmonitor->setCheckable(true);
+    m_actionFsmonitor->setEnabled(false);
+    m_actionFsmonitor->setToolTip("让git命令只检查变化过的文件，不再遍历整个工作树");
+    
+    // 仓库快照的命中情况
+    m_actionSnapshotStatistics = new QAction("查询缓存统计", this);
+    m_actionSnapshotStatistics->setToolTip("仓库状态没有变化时，重复的分支、远程和文件状态查询直接使用快照");
+    
+    ui->menuRepository->addSeparator();
+    ui->menuRepository->addAction(m_actionFsmonitor);
+    ui->menuRepository->addAction(m_actionSnapshotStatistics);
+    
     // AI菜单
     m_actionAIConfig = new QAction("AI配置", this);
     
@@ -171,12 +244,28 @@ void MainWindow::setupConnections()
     connect(m_actionSettings, &QAction::triggered, this, &MainWindow::onActionSettings);
     connect(m_actionAIConfig, &QAction::triggered, this, &MainWindow::onActionAIConfig);
     connect(m_actionAbout, &QAction::triggered, this, &MainWindow::onActionAbout);
+    connect(m_actionFsmonitor, &QAction::triggered, this, &MainWindow::onActionToggleFsmonitor);
+    connect(m_actionSnapshotStatistics, &QAction::triggered, this, &MainWindow::onActionSnapshotStatistics);
     
     // Git管理器连接
     connect(m_gitManager, &GitManager::repositoryOpened, this, &MainWindow::onRepositoryOpened);
     connect(m_gitManager, &GitManager::repositoryClosed, this, &MainWindow::onRepositoryClosed);
     connect(m_gitManager, &GitManager::commandExecuted, this, &MainWindow::onCommandExecuted);
     connect(m_gitManager, &GitManager::errorOccurred, this, &MainWindow::onGitError);
+    connect(m_gitManager, &GitManager::fileStatusReady, this, &MainWindow::onFileStatusReady);
+    connect(m_gitManager, &GitManager::commitHistoryPageReady, this, &MainWindow::onCommitHistoryPageReady);
+    connect(m_commitHistoryModel, &CommitHistoryModel::fetchMoreRequested, this, [this]() {
+        m_gitManager->getCommitHistoryPageAsync(CommitHistoryPageSize, false);
+    });
+    connect(m_gitManager, &GitManager::branchesReady, this, &MainWindow::onBranchesReady);
+    connect(m_gitManager, &GitManager::branchTrackingReady, m_branchModel, &BranchModel::setTracking);
+    connect(m_gitManager, &GitManager::branchStatusReady, this, &MainWindow::onBranchStatusReady);
+    connect(m_gitManager, &GitManager::fileStatusUpdated, this, &MainWindow::onFileStatusUpdated);
+    connect(m_gitManager, &GitManager::repositoryStateChanged, this, &MainWindow::onRepositoryStateChanged);
+    connect(m_gitManager, &GitManager::fsmonitorStateChanged, m_actionFsmonitor, &QAction::setChecked);
+    connect(m_gitManager, &GitManager::fsmonitorSpeedupMeasured, this, &MainWindow::onFsmonitorSpeedupMeasured);
+    connect(m_gitManager, &GitManager::remotesReady, this, &MainWindow::onRemotesReady);
+    connect(m_gitManager, &GitManager::tagsReady, this, &MainWindow::onTagsReady);
     
     // AI管理器连接
     connect(m_aiManager, &AIManager::responseReady, this, &MainWindow::onAIResponse);
@@ -189,6 +278,9 @@ void MainWindow::setupConnections()
     connect(m_actionUnstageFile, &QAction::triggered, this, &MainWindow::onActionUnstageFile);
     connect(m_actionDiscardChanges, &QAction::triggered, this, &MainWindow::onActionDiscardChanges);
     connect(m_actionViewDiff, &QAction::triggered, this, &MainWindow::onActionViewDiff);
+    connect(ui->loadFullDiffButton, &QPushButton::clicked, this, [this]() {
+        loadDiff(m_pendingDiffPath, m_pendingDiffStaged);
+    });
     
     // AI悬浮窗连接
     connect(m_actionToggleAIFloatWidget, &QAction::triggered, this, [this](bool checked) {
@@ -242,9 +334,15 @@ void MainWindow::onActionCloneRepository()
             
             QString fullDestPath = destPath + QDir::separator() + repoName;
             
-            if (m_gitManager->cloneRepository(url, fullDestPath)) {
-                onRepositoryOpened(fullDestPath);
-            }
+            // 异步克隆，成功后GitManager会发出repositoryOpened信号
+            m_actionCloneRepo->setEnabled(false);
+            ui->repoStatusLabel->setText("状态: 正在克隆 " + url);
+            m_gitManager->cloneRepositoryAsync(url, fullDestPath, [this](bool success) {
+                m_actionCloneRepo->setEnabled(true);
+                if (!success) {
+                    updateStatusBar();
+                }
+            });
         }
     }
 }
@@ -261,110 +359,186 @@ void MainWindow::onActionInitRepository()
 
 void MainWindow::onActionCommit()
 {
-    // 生成AI提交信息建议
-    QString aiSuggestion;
-    if (m_aiEnabled && m_aiManager->getCurrentProvider()) {
-        // 获取当前文件状态，用于生成提交信息
-        QList<GitManager::FileInfo> fileStatus = m_gitManager->getFileStatus();
-        QString diffContent;
-        
-        // 收集所有已修改文件的差异
-        for (const GitManager::FileInfo &file : fileStatus) {
-            if (file.status == GitManager::Modified || file.status == GitManager::Staged) {
-                QString diff = m_gitManager->getDiff(file.path);
-                if (!diff.isEmpty()) {
-                    diffContent += "文件: " + file.path + "\n";
-                    diffContent += diff + "\n\n";
-                }
-            }
+    if (m_commitMessagePending) {
+        return;
+    }
+    if (!m_aiEnabled || !m_aiManager->getCurrentProvider()) {
+        showCommitDialog(QString());
+        return;
+    }
+
+    // 一次读取全部暂存的差异，AI返回后再弹出提交对话框
+    m_commitMessagePending = true;
+    statusBar()->showMessage("正在生成提交信息...");
+    m_gitManager->getStagedDiffAsync([this](bool ok, const GitDiff &diff) {
+        if (!ok || diff.files.isEmpty()) {
+            m_commitMessagePending = false;
+            statusBar()->clearMessage();
+            showCommitDialog(QString());
+            return;
         }
-        
-        if (!diffContent.isEmpty()) {
-            // 调用AI生成提交信息
-            AIProvider::AIRequest request;
-            request.type = AIProvider::GenerateCommitMessage;
-            request.content = diffContent;
-            
-            // 使用信号槽机制异步获取AI响应
-            // 这里简化处理，直接使用默认提交信息
-            aiSuggestion = "更新文件";
+
+        AIProvider::AIRequest request;
+        request.type = AIProvider::GenerateCommitMessage;
+        request.content = commitMessagePrompt(diff);
+        m_currentAIRequestType = AIProvider::GenerateCommitMessage;
+        m_aiManager->sendRequest(request);
+    });
+}
+
+QString MainWindow::commitMessagePrompt(const GitDiff &diff)
+{
+    // 先列出全部文件，再按顺序放入预算内能容纳的补丁；放不下的补丁跳过，
+    // 后面较小的补丁仍可能放得下
+    QString content = "文件列表:\n";
+    for (const GitDiff::File &file : diff.files) {
+        content += QString("%1 %2").arg(QChar(file.status), file.path);
+        if (!file.oldPath.isEmpty()) {
+            content += QString(" (原%1)").arg(file.oldPath);
         }
+        content += "\n";
     }
-    
+
+    qsizetype remaining = CommitMessageDiffBudget;
+    QStringList omitted;
+    for (const GitDiff::File &file : diff.files) {
+        if (file.size > remaining) {
+            omitted << QString("%1 (%2字节)").arg(file.path).arg(file.size);
+            continue;
+        }
+        QByteArrayView patch = diff.patch(file);
+        content += "\n" + QString::fromUtf8(patch.data(), patch.size());
+        remaining -= file.size;
+    }
+    if (!omitted.isEmpty()) {
+        content += "\n以下文件的差异过大，已省略:\n" + omitted.join("\n") + "\n";
+    }
+    return content;
+}
+
+void MainWindow::showCommitDialog(const QString &suggestion)
+{
     bool ok;
-    QString message = QInputDialog::getText(this, "提交", "请输入提交信息:", QLineEdit::Normal, aiSuggestion, &ok);
+    QString message = QInputDialog::getText(this, "提交", "请输入提交信息:", QLineEdit::Normal, suggestion, &ok);
     if (ok && !message.isEmpty()) {
-        if (m_gitManager->commit(message)) {
-            QMessageBox::information(this, "提交成功", "提交已完成");
-            updateFileStatus();
-            updateCommitHistory();
-        }
+        m_gitManager->commitAsync(message, [this](bool success) {
+            if (success) {
+                QMessageBox::information(this, "提交成功", "提交已完成");
+                updateFileStatus();
+                updateCommitHistory();
+            }
+        });
     }
 }
 
 void MainWindow::onActionPush()
 {
-    // 获取当前分支
-    QList<GitManager::BranchInfo> branches = m_gitManager->getBranches();
-    QString currentBranch;
-    for (const GitManager::BranchInfo &branch : branches) {
-        if (branch.isCurrent) {
-            currentBranch = branch.name;
-            break;
-        }
-    }
-    
+    // 当前分支直接从HEAD文件读取，分离HEAD时无法推送
+    const QString currentBranch = m_gitManager->currentBranch();
     if (currentBranch.isEmpty()) {
         QMessageBox::warning(this, "推送失败", "无法获取当前分支");
         return;
     }
     
-    // 获取远程仓库
-    QList<GitManager::RemoteInfo> remotes = m_gitManager->getRemotes();
-    if (remotes.isEmpty()) {
-        QMessageBox::warning(this, "推送失败", "没有配置远程仓库");
-        return;
-    }
+    m_actionPush->setEnabled(false);
     
-    QString remoteName = remotes.first().name;
-    
-    if (m_gitManager->push(remoteName, currentBranch)) {
-        QMessageBox::information(this, "推送成功", "推送已完成");
-    }
+    // 异步获取远程仓库后再推送
+    m_gitManager->getRemotesAsync([this, currentBranch](const QList<GitManager::RemoteInfo> &remotes) {
+        if (remotes.isEmpty()) {
+            m_actionPush->setEnabled(true);
+            QMessageBox::warning(this, "推送失败", "没有配置远程仓库");
+            return;
+        }
+        
+        QString remoteName = remotes.first().name;
+        QString upstream = remoteName + "/" + currentBranch;
+        if (upstream != m_branchUpstream) {
+            pushBranch(remoteName, currentBranch);
+            return;
+        }
+        
+        // 先在本地与上游比较：没有新提交时不必推送，上游有本地没有的提交时推送会被拒绝
+        m_gitManager->getAheadBehindAsync("HEAD", upstream, [this, remoteName, currentBranch, upstream](bool ok, int ahead, int behind) {
+            if (ok && ahead == 0) {
+                m_actionPush->setEnabled(true);
+                QMessageBox::information(this, "推送", "没有需要推送的提交");
+                return;
+            }
+            if (ok && behind > 0) {
+                QString message = QString("%1 有%2个本地没有的提交，推送可能被拒绝。是否仍要推送？").arg(upstream).arg(behind);
+                if (QMessageBox::question(this, "推送", message) != QMessageBox::Yes) {
+                    m_actionPush->setEnabled(true);
+                    return;
+                }
+            }
+            pushBranch(remoteName, currentBranch);
+        });
+    });
 }
 
-void MainWindow::onActionPull()
+void MainWindow::pushBranch(const QString &remoteName, const QString &branchName)
 {
-    // 获取当前分支
-    QList<GitManager::BranchInfo> branches = m_gitManager->getBranches();
-    QString currentBranch;
-    for (const GitManager::BranchInfo &branch : branches) {
-        if (branch.isCurrent) {
-            currentBranch = branch.name;
-            break;
+    m_gitManager->pushAsync(remoteName, branchName, [this](bool success) {
+        m_actionPush->setEnabled(true);
+        if (success) {
+            QMessageBox::information(this, "推送成功", "推送已完成");
         }
-    }
-    
+    });
+}
+
+void MainWindow::onActionPull()
+{
+    // 当前分支直接从HEAD文件读取，分离HEAD时无法拉取
+    const QString currentBranch = m_gitManager->currentBranch();
     if (currentBranch.isEmpty()) {
         QMessageBox::warning(this, "拉取失败", "无法获取当前分支");
         return;
     }
     
-    // 获取远程仓库
-    QList<GitManager::RemoteInfo> remotes = m_gitManager->getRemotes();
-    if (remotes.isEmpty()) {
-        QMessageBox::warning(this, "拉取失败", "没有配置远程仓库");
-        return;
-    }
+    m_actionPull->setEnabled(false);
     
-    QString remoteName = remotes.first().name;
-    
-    if (m_gitManager->pull(remoteName, currentBranch)) {
-        QMessageBox::information(this, "拉取成功", "拉取已完成");
-        updateFileStatus();
-        updateCommitHistory();
-        updateBranchList();
-    }
+    // 异步获取远程仓库后再拉取
+    m_gitManager->getRemotesAsync([this, currentBranch](const QList<GitManager::RemoteInfo> &remotes) {
+        if (remotes.isEmpty()) {
+            m_actionPull->setEnabled(true);
+            QMessageBox::warning(this, "拉取失败", "没有配置远程仓库");
+            return;
+        }
+        
+        QString remoteName = remotes.first().name;
+        QString upstream = remoteName + "/" + currentBranch;
+        if (upstream != m_branchUpstream) {
+            pullBranch(remoteName, currentBranch);
+            return;
+        }
+        
+        // 本地分支与上游已经分叉时，拉取不能快进，先让用户确认
+        m_gitManager->getAheadBehindAsync("HEAD", upstream, [this, remoteName, currentBranch, upstream](bool ok, int ahead, int behind) {
+            if (ok && ahead > 0 && behind > 0) {
+                QString message = QString("本地分支与 %1 已分叉（领先%2，落后%3），拉取需要合并或变基。是否继续？")
+                                      .arg(upstream).arg(ahead).arg(behind);
+                if (QMessageBox::question(this, "拉取", message) != QMessageBox::Yes) {
+                    m_actionPull->setEnabled(true);
+                    return;
+                }
+            }
+            pullBranch(remoteName, currentBranch);
+        });
+    });
+}
+
+void MainWindow::pullBranch(const QString &remoteName, const QString &branchName)
+{
+    m_gitManager->pullAsync(remoteName, branchName, [this](bool success) {
+        m_actionPull->setEnabled(true);
+        if (success) {
+            QMessageBox::information(this, "拉取成功", "拉取已完成");
+            updateFileStatus();
+            updateCommitHistory();
+            updateBranchList();
+            updateTagList();
+        }
+    });
 }
 
 void MainWindow::onActionSettings()
@@ -383,9 +557,51 @@ void MainWindow::onActionAbout()
     QMessageBox::about(this, "关于SummerCake", "SummerCake Git GUI\n版本: 0.1.0\n基于Qt 6.10.0开发\n\n一个简单易用的Git GUI客户端，集成AI助手功能。");
 }
 
+void MainWindow::onActionToggleFsmonitor(bool checked)
+{
+    m_actionFsmonitor->setEnabled(false);
+    m_gitManager->setFsmonitorEnabledAsync(checked, [this, checked](bool success) {
+        m_actionFsmonitor->setEnabled(true);
+        if (success && checked) {
+            // 启用后测量一次实际效果
+            statusBar()->showMessage("正在测量文件系统监视的效果...");
+            m_gitManager->measureFsmonitorSpeedupAsync();
+        }
+    });
+}
+
+void MainWindow::onFsmonitorSpeedupMeasured(qint64 withoutMonitorMs, qint64 withMonitorMs)
+{
+    if (withoutMonitorMs < 0 || withMonitorMs < 0) {
+        statusBar()->showMessage("无法测量文件系统监视的效果：git status执行失败", 10000);
+        return;
+    }
+    QString message = QString("git status耗时：未启用 %1 ms，启用后 %2 ms").arg(withoutMonitorMs).arg(withMonitorMs);
+    if (withMonitorMs > 0) {
+        message += QString("（%1倍）").arg(double(withoutMonitorMs) / withMonitorMs, 0, 'f', 1);
+    }
+    statusBar()->showMessage(message, 10000);
+    QMessageBox::information(this, "文件系统监视", message);
+}
+
+void MainWindow::onActionSnapshotStatistics()
+{
+    const GitManager::SnapshotStatistics statistics = m_gitManager->snapshotStatistics();
+    QString message = QString("命中 %1 次，未命中 %2 次").arg(statistics.hits).arg(statistics.misses);
+    const quint64 total = statistics.hits + statistics.misses;
+    if (total > 0) {
+        message += QString("（命中率 %1%）").arg(100.0 * statistics.hits / total, 0, 'f', 1);
+    }
+    message += QString("\n仓库状态变化 %1 次").arg(statistics.epochs);
+    QMessageBox::information(this, "查询缓存统计", message);
+}
+
 void MainWindow::onRepositoryOpened(const QString &path)
 {
     m_currentRepository = path;
+    // 切换仓库后旧仓库的差异结果会被丢弃，不再等待
+    m_commitMessagePending = false;
+    m_diffJob = 0;
     
     // 更新文件系统模型根路径
     ui->repoTreeView->setRootIndex(m_fileSystemModel->index(path));
@@ -394,12 +610,14 @@ void MainWindow::onRepositoryOpened(const QString &path)
     ui->actionCommit->setEnabled(true);
     ui->actionPush->setEnabled(true);
     ui->actionPull->setEnabled(true);
+    m_actionFsmonitor->setEnabled(m_gitManager->isFsmonitorSupported());
     
     // 更新UI
     updateFileStatus();
     updateCommitHistory();
     updateBranchList();
     updateRemoteList();
+    updateTagList();
     updateStatusBar();
     
     // 显示成功消息
@@ -409,11 +627,17 @@ void MainWindow::onRepositoryOpened(const QString &path)
 void MainWindow::onRepositoryClosed()
 {
     m_currentRepository.clear();
+    m_currentBranch.clear();
+    m_branchUpstream.clear();
+    m_branchTracking.clear();
+    m_commitMessagePending = false;
+    m_diffJob = 0;
     
     // 禁用仓库相关功能
     ui->actionCommit->setEnabled(false);
     ui->actionPush->setEnabled(false);
     ui->actionPull->setEnabled(false);
+    m_actionFsmonitor->setEnabled(false);
     
     // 更新UI
     updateStatusBar();
@@ -469,6 +693,11 @@ void MainWindow::onAIResponse(const AIProvider::AIResponse &response)
         if (m_aiFloatWidget && m_aiFloatWidget->isVisible()) {
             m_aiFloatWidget->onErrorReceived(response.errorMessage);
         }
+        if (m_commitMessagePending) {
+            m_commitMessagePending = false;
+            statusBar()->clearMessage();
+            showCommitDialog(QString());
+        }
     }
 }
 
@@ -477,14 +706,26 @@ void MainWindow::onAIGenerateCommitMessage(const AIProvider::AIResponse &respons
     // AI生成提交信息成功，更新建议
     m_aiCommitSuggestion = response.content;
     
-    // 可以在这里添加通知用户AI建议已生成的逻辑
     qDebug() << "AI生成提交信息: " << m_aiCommitSuggestion;
+
+    if (m_commitMessagePending) {
+        m_commitMessagePending = false;
+        statusBar()->clearMessage();
+        showCommitDialog(m_aiCommitSuggestion);
+    }
 }
 
 void MainWindow::onAIError(const QString &error)
 {
     QMessageBox::warning(this, "AI错误", error);
     ui->aiSuggestionView->setText("AI错误: " + error);
+
+    // 生成提交信息失败时仍然让用户手动输入
+    if (m_commitMessagePending) {
+        m_commitMessagePending = false;
+        statusBar()->clearMessage();
+        showCommitDialog(QString());
+    }
 }
 
 void MainWindow::onAIEnabledChanged(bool enabled)
@@ -501,9 +742,12 @@ void MainWindow::onPrivacyModeChanged(bool enabled)
 
 void MainWindow::updateFileStatus()
 {
-    // 获取文件状态
-    QList<GitManager::FileInfo> fileStatus = m_gitManager->getFileStatus();
-    
+    // 异步获取文件状态，结果在onFileStatusReady中处理
+    m_gitManager->getFileStatusAsync();
+}
+
+void MainWindow::onFileStatusReady(const QList<GitManager::FileInfo> &fileStatus)
+{
     // 更新模型
     m_fileStatusModel->setFileStatus(fileStatus);
     
@@ -513,36 +757,171 @@ void MainWindow::updateFileStatus()
     qDebug() << "更新文件状态完成，共" << fileStatus.size() << "个文件";
 }
 
+void MainWindow::onFileStatusUpdated(const QStringList &paths, const QList<GitManager::FileInfo> &fileStatus)
+{
+    // 增量更新，保留其他文件的行和当前选中项
+    m_fileStatusModel->updateFileStatus(paths, fileStatus);
+}
+
+void MainWindow::onRepositoryStateChanged()
+{
+    // 在外部执行了git命令（提交、切换分支等），全部刷新
+    updateFileStatus();
+    updateCommitHistory();
+    updateBranchList();
+    updateTagList();
+}
+
 void MainWindow::updateCommitHistory()
 {
-    // 获取提交历史
-    QList<GitManager::CommitInfo> commitHistory = m_gitManager->getCommitHistory();
-    
-    // 更新模型
-    m_commitHistoryModel->setCommitHistory(commitHistory);
-    
-    // 调整列宽
-    ui->commitHistoryView->resizeColumnsToContents();
+    // 异步获取第一页提交历史，结果在onCommitHistoryPageReady中处理；之后的页在滚动到底部时加载
+    m_gitManager->getCommitHistoryPageAsync(CommitHistoryPageSize, true);
+}
+
+void MainWindow::onCommitHistoryPageReady(const QList<GitManager::CommitInfo> &commits, bool restart, bool hasMore)
+{
+    if (m_commitSearchActive) {
+        // 新加载的提交已经加入索引；历史刷新时重新搜索，其余的页不显示
+        if (restart) {
+            applyCommitSearch();
+        }
+        return;
+    }
+
+    if (restart) {
+        // 第一页替换整个模型并调整列宽
+        m_commitHistoryModel->setCommitHistory(commits, hasMore);
+        ui->commitHistoryView->resizeColumnsToContents();
+    } else {
+        m_commitHistoryModel->appendCommitHistory(commits, hasMore);
+        // 新的一页可能出现更多泳道
+        ui->commitHistoryView->resizeColumnToContents(CommitHistoryModel::GraphColumn);
+    }
     
-    qDebug() << "更新提交历史完成，共" << commitHistory.size() << "个提交";
+    qDebug() << "加载提交历史" << commits.size() << "个，共" << m_commitHistoryModel->rowCount() << "个提交";
+
+    // 没有索引时搜索框只过滤已经加载的行，新的一页也要过滤
+    if (!ui->commitSearchEdit->text().trimmed().isEmpty()) {
+        applyCommitSearch();
+    }
+}
+
+void MainWindow::applyCommitSearch()
+{
+    const QString query = ui->commitSearchEdit->text().trimmed();
+    if (query.isEmpty()) {
+        for (int row = 0; row < m_commitHistoryModel->rowCount(); ++row) {
+            ui->commitHistoryView->setRowHidden(row, false);
+        }
+        if (m_commitSearchActive) {
+            // 回到完整的历史，从第一页重新加载
+            m_commitSearchActive = false;
+            updateCommitHistory();
+        }
+        return;
+    }
+
+    QList<GitManager::CommitInfo> results;
+    if (m_gitManager->searchCommits(query, CommitSearchLimit, &results)) {
+        // 搜索结果在历史中不相邻，不画提交之间的连线
+        for (GitManager::CommitInfo &commit : results) {
+            commit.parents.clear();
+        }
+        m_commitSearchActive = true;
+        m_commitHistoryModel->setCommitHistory(results, false);
+        statusBar()->showMessage(QString("找到%1个提交").arg(results.size()), 3000);
+        return;
+    }
+
+    // 没有索引时只在已经加载的提交中按标题、作者和哈希值过滤
+    for (int row = 0; row < m_commitHistoryModel->rowCount(); ++row) {
+        const GitManager::CommitInfo commit = m_commitHistoryModel->getCommitInfo(row);
+        const bool matches = commit.message.contains(query, Qt::CaseInsensitive)
+                             || commit.author.contains(query, Qt::CaseInsensitive)
+                             || commit.hash.startsWith(query, Qt::CaseInsensitive);
+        ui->commitHistoryView->setRowHidden(row, !matches);
+    }
 }
 
 void MainWindow::updateBranchList()
 {
-    // 获取分支列表
-    QList<GitManager::BranchInfo> branches = m_gitManager->getBranches();
-    
-    // 更新模型
+    // 异步获取分支列表，结果在onBranchesReady中处理
+    m_gitManager->getBranchesAsync();
+}
+
+void MainWindow::applyBranchFilter(const QString &text)
+{
+    m_branchModel->setFilter(text);
+    // 匹配的分支不多时全部展开，直接显示结果
+    if (!m_branchModel->filter().isEmpty() && m_branchModel->branchCount() <= BranchAutoExpandLimit) {
+        expandBranchTree(QModelIndex());
+    }
+}
+
+void MainWindow::expandBranchTree(const QModelIndex &parent)
+{
+    const int rows = m_branchModel->rowCount(parent);
+    for (int row = 0; row < rows; ++row) {
+        const QModelIndex index = m_branchModel->index(row, 0, parent);
+        if (!m_branchModel->hasChildren(index)) {
+            continue;
+        }
+        if (m_branchModel->canFetchMore(index)) {
+            m_branchModel->fetchMore(index);
+        }
+        ui->branchListView->expand(index);
+        expandBranchTree(index);
+    }
+}
+
+void MainWindow::onBranchesReady(const QList<GitManager::BranchInfo> &branches)
+{
+    // 更新模型：只插入、删除变化的行，已展开的目录保持展开
+    const bool hadLocalBranches = m_branchModel->localBranchesIndex().isValid();
     m_branchModel->setBranches(branches);
+    if (!hadLocalBranches) {
+        ui->branchListView->expand(m_branchModel->localBranchesIndex());
+    }
+    if (!m_branchModel->filter().isEmpty() && m_branchModel->branchCount() <= BranchAutoExpandLimit) {
+        expandBranchTree(QModelIndex());
+    }
+    // 各分支相对上游的领先/落后数，提交没有变化的分支直接使用缓存
+    m_gitManager->getBranchTrackingAsync();
+    
+    // 记录当前分支，供状态栏使用
+    m_currentBranch.clear();
+    for (const GitManager::BranchInfo &branch : branches) {
+        if (branch.isCurrent) {
+            m_currentBranch = branch.name;
+            break;
+        }
+    }
+    updateStatusBar();
     
     qDebug() << "更新分支列表完成，共" << branches.size() << "个分支";
 }
 
 void MainWindow::updateRemoteList()
 {
-    // 获取远程仓库列表
-    QList<GitManager::RemoteInfo> remotes = m_gitManager->getRemotes();
-    
+    // 异步获取远程仓库列表，结果在onRemotesReady中处理
+    m_gitManager->getRemotesAsync();
+}
+
+void MainWindow::updateTagList()
+{
+    // 异步获取标签列表，结果在onTagsReady中处理
+    m_gitManager->getTagsAsync();
+}
+
+void MainWindow::onTagsReady(const QList<GitManager::TagInfo> &tags)
+{
+    // 排序键在模型中计算一次，视图只取第一页，滚动到底部时再加载
+    m_tagModel->setTags(tags);
+    qDebug() << "更新标签列表完成，共" << tags.size() << "个标签";
+}
+
+void MainWindow::onRemotesReady(const QList<GitManager::RemoteInfo> &remotes)
+{
     // 这里可以将远程仓库信息显示在UI上，例如在状态栏或专门的视图中
     // 目前我们只记录日志
     qDebug() << "更新远程列表完成，共" << remotes.size() << "个远程仓库";
@@ -551,24 +930,41 @@ void MainWindow::updateRemoteList()
     }
 }
 
+void MainWindow::onBranchStatusReady(const QString &branch, const QString &upstream, int ahead, int behind)
+{
+    // 文件状态输出中带有分支信息，分离HEAD时branch为空，保留onBranchesReady的结果
+    if (!branch.isEmpty()) {
+        m_currentBranch = branch;
+    }
+    m_branchUpstream = upstream;
+    m_branchTracking = upstream.isEmpty() ? QString() : QString("领先%1, 落后%2").arg(ahead).arg(behind);
+    updateStatusBar();
+}
+
 void MainWindow::updateStatusBar()
 {
     if (m_currentRepository.isEmpty()) {
         ui->branchLabel->setText("分支: 未打开仓库");
         ui->repoStatusLabel->setText("状态: 未打开仓库");
     } else {
-        // 获取当前分支
-        QList<GitManager::BranchInfo> branches = m_gitManager->getBranches();
-        QString currentBranch = "未知";
-        for (const GitManager::BranchInfo &branch : branches) {
-            if (branch.isCurrent) {
-                currentBranch = branch.name;
-                break;
-            }
+        // 当前分支直接读取HEAD；分离HEAD时使用分支列表中的说明
+        QString currentBranch = m_gitManager->currentBranch();
+        if (currentBranch.isEmpty()) {
+            currentBranch = m_currentBranch.isEmpty() ? "未知" : m_currentBranch;
+        }
+        
+        if (!m_branchTracking.isEmpty()) {
+            currentBranch += " (" + m_branchTracking + ")";
         }
         
         ui->branchLabel->setText("分支: " + currentBranch);
-        ui->repoStatusLabel->setText("状态: 已打开仓库");
+        
+        QString repoStatus = "状态: 已打开仓库";
+        const int stashes = m_gitManager->stashCount();
+        if (stashes > 0) {
+            repoStatus += QString("，%1个贮藏").arg(stashes);
+        }
+        ui->repoStatusLabel->setText(repoStatus);
     }
     
     ui->aiStatusLabel->setText("AI: " + (m_aiEnabled ? "已启用" : "已禁用") + 
@@ -584,87 +980,141 @@ void MainWindow::onFileStatusContextMenu(const QPoint &pos)
     
     QMenu contextMenu(this);
     
-    const GitManager::FileInfo &fileInfo = m_fileStatusModel->getFileInfo(index.row());
-    
-    // 根据文件状态添加不同的菜单项
-    switch (fileInfo.status) {
-    case GitManager::Modified:
-        contextMenu.addAction(m_actionStageFile);
-        contextMenu.addAction(m_actionDiscardChanges);
-        contextMenu.addAction(m_actionViewDiff);
-        break;
-    case GitManager::Staged:
-        contextMenu.addAction(m_actionUnstageFile);
-        contextMenu.addAction(m_actionViewDiff);
-        break;
-    case GitManager::Untracked:
-        contextMenu.addAction(m_actionStageFile);
-        contextMenu.addAction(m_actionDiscardChanges);
-        break;
-    case GitManager::Deleted:
-        contextMenu.addAction(m_actionStageFile);
-        contextMenu.addAction(m_actionUnstageFile);
-        break;
-    case GitManager::Renamed:
-        contextMenu.addAction(m_actionStageFile);
-        contextMenu.addAction(m_actionUnstageFile);
-        contextMenu.addAction(m_actionViewDiff);
-        break;
-    default:
-        break;
+    // 根据选中文件的状态添加菜单项，多选时取各文件可用操作的并集
+    const QList<GitManager::FileInfo> files = selectedFiles();
+    bool canStage = false;
+    bool canUnstage = false;
+    bool canDiscard = false;
+    bool canViewDiff = false;
+    for (const GitManager::FileInfo &fileInfo : files) {
+        switch (fileInfo.status) {
+        case GitManager::Modified:
+            canStage = canDiscard = canViewDiff = true;
+            break;
+        case GitManager::Staged:
+            canUnstage = canViewDiff = true;
+            break;
+        case GitManager::Untracked:
+            canStage = canDiscard = true;
+            break;
+        case GitManager::Deleted:
+            canStage = canUnstage = true;
+            break;
+        case GitManager::Renamed:
+            canStage = canUnstage = canViewDiff = true;
+            break;
+        default:
+            break;
+        }
+    }
+    
+    if (canStage) contextMenu.addAction(m_actionStageFile);
+    if (canUnstage) contextMenu.addAction(m_actionUnstageFile);
+    if (canDiscard) contextMenu.addAction(m_actionDiscardChanges);
+    // 差异一次只显示一个文件
+    if (canViewDiff && files.size() == 1) contextMenu.addAction(m_actionViewDiff);
+    if (contextMenu.isEmpty()) {
+        return;
     }
     
     contextMenu.exec(ui->fileStatusView->viewport()->mapToGlobal(pos));
 }
 
+QList<GitManager::FileInfo> MainWindow::selectedFiles() const
+{
+    QList<GitManager::FileInfo> files;
+    const QModelIndexList selectedIndexes = ui->fileStatusView->selectionModel()->selectedRows();
+    for (const QModelIndex &index : selectedIndexes) {
+        files.append(m_fileStatusModel->getFileInfo(index.row()));
+    }
+    return files;
+}
+
+QStringList MainWindow::refreshPaths(const QList<GitManager::FileInfo> &files)
+{
+    // 重命名时原路径的状态也会变化
+    QStringList paths;
+    for (const GitManager::FileInfo &fileInfo : files) {
+        paths.append(fileInfo.path);
+        if (!fileInfo.oldPath.isEmpty()) {
+            paths.append(fileInfo.oldPath);
+        }
+    }
+    return paths;
+}
+
 void MainWindow::onActionStageFile()
 {
-    QModelIndexList selectedIndexes = ui->fileStatusView->selectionModel()->selectedRows();
-    if (selectedIndexes.isEmpty()) {
+    const QList<GitManager::FileInfo> files = selectedFiles();
+    if (files.isEmpty()) {
         return;
     }
     
-    const GitManager::FileInfo &fileInfo = m_fileStatusModel->getFileInfo(selectedIndexes.first().row());
-    
-    if (m_gitManager->stageFile(fileInfo.path)) {
-        updateFileStatus();
-        QMessageBox::information(this, "操作成功", "文件已暂存");
+    QStringList paths;
+    for (const GitManager::FileInfo &fileInfo : files) {
+        paths.append(fileInfo.path);
     }
+    
+    // 一次暂存所有选中的文件，之后只刷新这些路径，模型原地更新
+    m_gitManager->stageFilesAsync(paths, [this, refresh = refreshPaths(files), count = paths.size()](bool success) {
+        if (success) {
+            m_gitManager->refreshFileStatusAsync(refresh);
+            statusBar()->showMessage(QString("已暂存%1个文件").arg(count), 3000);
+        }
+    });
 }
 
 void MainWindow::onActionUnstageFile()
 {
-    QModelIndexList selectedIndexes = ui->fileStatusView->selectionModel()->selectedRows();
-    if (selectedIndexes.isEmpty()) {
+    const QList<GitManager::FileInfo> files = selectedFiles();
+    if (files.isEmpty()) {
         return;
     }
     
-    const GitManager::FileInfo &fileInfo = m_fileStatusModel->getFileInfo(selectedIndexes.first().row());
-    
-    if (m_gitManager->unstageFile(fileInfo.path)) {
-        updateFileStatus();
-        QMessageBox::information(this, "操作成功", "文件已取消暂存");
+    QStringList paths;
+    for (const GitManager::FileInfo &fileInfo : files) {
+        paths.append(fileInfo.path);
     }
+    
+    m_gitManager->unstageFilesAsync(paths, [this, refresh = refreshPaths(files), count = paths.size()](bool success) {
+        if (success) {
+            m_gitManager->refreshFileStatusAsync(refresh);
+            statusBar()->showMessage(QString("已取消暂存%1个文件").arg(count), 3000);
+        }
+    });
 }
 
 void MainWindow::onActionDiscardChanges()
 {
-    QModelIndexList selectedIndexes = ui->fileStatusView->selectionModel()->selectedRows();
-    if (selectedIndexes.isEmpty()) {
+    // 未跟踪的文件没有可以恢复的版本，不在丢弃范围内
+    QList<GitManager::FileInfo> files;
+    for (const GitManager::FileInfo &fileInfo : selectedFiles()) {
+        if (fileInfo.status != GitManager::Untracked) {
+            files.append(fileInfo);
+        }
+    }
+    if (files.isEmpty()) {
+        QMessageBox::information(this, "丢弃修改", "未跟踪的文件没有可以丢弃的修改");
         return;
     }
     
-    const GitManager::FileInfo &fileInfo = m_fileStatusModel->getFileInfo(selectedIndexes.first().row());
-    
+    QString target = files.size() == 1 ? "文件 \"" + files.first().path + "\"" : QString("%1个文件").arg(files.size());
     QMessageBox::StandardButton reply;
-    reply = QMessageBox::question(this, "确认丢弃", "确定要丢弃对文件 \"" + fileInfo.path + "\" 的修改吗？此操作不可恢复。",
+    reply = QMessageBox::question(this, "确认丢弃", "确定要丢弃对" + target + "的修改吗？此操作不可恢复。",
                                   QMessageBox::Yes | QMessageBox::No);
     
     if (reply == QMessageBox::Yes) {
-        if (m_gitManager->discardChanges(fileInfo.path)) {
-            updateFileStatus();
-            QMessageBox::information(this, "操作成功", "修改已丢弃");
+        QStringList paths;
+        for (const GitManager::FileInfo &fileInfo : files) {
+            paths.append(fileInfo.path);
         }
+        
+        m_gitManager->discardFilesAsync(paths, [this, refresh = refreshPaths(files), count = paths.size()](bool success) {
+            if (success) {
+                m_gitManager->refreshFileStatusAsync(refresh);
+                statusBar()->showMessage(QString("已丢弃%1个文件的修改").arg(count), 3000);
+            }
+        });
     }
 }
 
@@ -674,20 +1124,90 @@ void MainWindow::onActionViewDiff()
     if (selectedIndexes.isEmpty()) {
         return;
     }
-    
-    const GitManager::FileInfo &fileInfo = m_fileStatusModel->getFileInfo(selectedIndexes.first().row());
-    QString diff;
-    
-    if (fileInfo.status == GitManager::Staged) {
-        diff = m_gitManager->getStagedDiff(fileInfo.path);
-    } else {
-        diff = m_gitManager->getDiff(fileInfo.path);
+    showFileDiff(selectedIndexes.first().row());
+}
+
+void MainWindow::onFileSelectionChanged(const QModelIndex &current)
+{
+    if (!current.isValid()) {
+        m_gitManager->cancelJob(m_diffJob);
+        m_diffJob = 0;
+        m_pendingDiffPath.clear();
+        return;
     }
+    showFileDiff(current.row());
+}
+
+void MainWindow::showFileDiff(int row)
+{
+    const GitManager::FileInfo fileInfo = m_fileStatusModel->getFileInfo(row);
+    bool staged = fileInfo.status == GitManager::Staged;
     
-    if (diff.isEmpty()) {
-        diff = "没有差异";
+    // 只显示最后一次请求的差异，之前选择的文件还在读取时直接取消
+    m_pendingDiffPath = fileInfo.path;
+    m_pendingDiffStaged = staged;
+    ui->rightTabWidget->setCurrentWidget(ui->diffTab);
+
+    const qint64 size = QFileInfo(QDir(m_currentRepository).filePath(fileInfo.path)).size();
+    if (size <= LargeDiffFileSize) {
+        loadDiff(fileInfo.path, staged);
+        return;
+    }
+
+    m_gitManager->cancelJob(m_diffJob);
+    m_diffJob = 0;
+    ui->diffView->clear();
+    ui->largeDiffLabel->setText(QString("文件较大（%1 MB），只显示了统计信息")
+                                .arg(double(size) / (1024 * 1024), 0, 'f', 1));
+    ui->largeDiffBar->show();
+    m_gitManager->getDiffStatAsync(fileInfo.path, staged, [this, path = fileInfo.path](const QByteArray &stat) {
+        if (path != m_pendingDiffPath || ui->largeDiffBar->isHidden()) {
+            return;
+        }
+        ui->diffView->setDiff(stat);
+    });
+}
+
+void MainWindow::loadDiff(const QString &path, bool staged)
+{
+    // 差异边读取边显示，第一个块不必等git退出
+    m_gitManager->cancelJob(m_diffJob);
+    ui->largeDiffBar->hide();
+    ui->diffView->clear();
+    m_diffJob = m_gitManager->getDiffStreamAsync(path, staged, [this](const QByteArray &chunk) {
+        ui->diffView->appendDiff(chunk);
+    }, [this](bool) {
+        m_diffJob = 0;
+        ui->diffView->finishDiff();
+    });
+}
+
+void MainWindow::onCommitSelectionChanged(const QModelIndex &current)
+{
+    if (!current.isValid()) {
+        return;
     }
     
-    ui->diffView->setPlainText(diff);
-    ui->rightTabWidget->setCurrentWidget(ui->diffTab);
+    const GitManager::CommitInfo &selected = m_commitHistoryModel->getCommitInfo(current.row());
+    m_pendingCommitHash = selected.hash;
+    
+    // 提交信息来自常驻的cat-file进程，差异随后追加
+    m_gitManager->getCommitInfoAsync(selected.hash, [this, hash = selected.hash](const GitManager::CommitInfo &commit) {
+        if (hash != m_pendingCommitHash) {
+            return;
+        }
+        
+        QString header = "提交: " + commit.hash + "\n"
+                       + "作者: " + commit.author + "\n"
+                       + "日期: " + commit.date + "\n\n"
+                       + commit.message + "\n";
+        ui->commitDetailView->setDiff(header.toUtf8());
+        
+        m_gitManager->getCommitDiffAsync(hash, [this, hash, header](const QString &diff) {
+            if (hash != m_pendingCommitHash) {
+                return;
+            }
+            ui->commitDetailView->setDiff((header + "\n" + diff).toUtf8());
+        });
+    });
 }
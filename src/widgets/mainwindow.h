@@ -23,6 +23,10 @@ class MainWindow;
 }
 QT_END_NAMESPACE
 
+class SyntaxHighlightEngine;
+class TagModel;
+class QTimer;
+
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
@@ -49,12 +53,25 @@ private slots:
     void onActionUnstageFile();
     void onActionDiscardChanges();
     void onActionViewDiff();
+    void onFileSelectionChanged(const QModelIndex &current);
+    void onCommitSelectionChanged(const QModelIndex &current);
 
     // Git事件处理
     void onRepositoryOpened(const QString &path);
     void onRepositoryClosed();
     void onCommandExecuted(const QString &command, const QString &output);
     void onGitError(const QString &error);
+    void onFileStatusReady(const QList<GitManager::FileInfo> &fileStatus);
+    void onFileStatusUpdated(const QStringList &paths, const QList<GitManager::FileInfo> &fileStatus);
+    void onRepositoryStateChanged();
+    void onCommitHistoryPageReady(const QList<GitManager::CommitInfo> &commits, bool restart, bool hasMore);
+    void onBranchesReady(const QList<GitManager::BranchInfo> &branches);
+    void onBranchStatusReady(const QString &branch, const QString &upstream, int ahead, int behind);
+    void onActionToggleFsmonitor(bool checked);
+    void onFsmonitorSpeedupMeasured(qint64 withoutMonitorMs, qint64 withMonitorMs);
+    void onActionSnapshotStatistics();
+    void onRemotesReady(const QList<GitManager::RemoteInfo> &remotes);
+    void onTagsReady(const QList<GitManager::TagInfo> &tags);
 
     // AI事件处理
     void onAIResponse(const AIProvider::AIResponse &response);
@@ -66,8 +83,11 @@ private slots:
     // UI更新
     void updateFileStatus();
     void updateCommitHistory();
+    void applyCommitSearch();
     void updateBranchList();
+    void applyBranchFilter(const QString &text);
     void updateRemoteList();
+    void updateTagList();
 
 private:
     void setupUI();
@@ -75,6 +95,16 @@ private:
     void setupToolBar();
     void setupConnections();
     void updateStatusBar();
+    void expandBranchTree(const QModelIndex &parent);
+    void pushBranch(const QString &remoteName, const QString &branchName);
+    QList<GitManager::FileInfo> selectedFiles() const;
+    static QStringList refreshPaths(const QList<GitManager::FileInfo> &files);
+    void pullBranch(const QString &remoteName, const QString &branchName);
+    void showCommitDialog(const QString &suggestion);
+    // 显示文件状态列表中第row行的差异，大文件先显示统计信息
+    void showFileDiff(int row);
+    void loadDiff(const QString &path, bool staged);
+    static QString commitMessagePrompt(const GitDiff &diff);
 
     Ui::MainWindow *ui;
     
@@ -91,7 +121,7 @@ private:
     QTabWidget *m_leftTabWidget;
     QTreeView *m_repoTreeView;
     QListView *m_branchListView;
-    QListView *m_tagListView;
+    QTreeView *m_tagListView;
     
     // 中间面板
     QTabWidget *m_centerTabWidget;
@@ -115,6 +145,8 @@ private:
     CommitHistoryModel *m_commitHistoryModel;
     BranchModel *m_branchModel;
     RemoteModel *m_remoteModel;
+    TagModel *m_tagModel;
+    SyntaxHighlightEngine *m_highlightEngine; // 差异视图和提交详情共用，缓存在两者之间共享
     
     // 菜单和工具栏
     QMenu *m_fileMenu;
@@ -144,15 +176,27 @@ private:
     QAction *m_actionDiscardChanges;
     QAction *m_actionViewDiff;
     QAction *m_actionToggleAIFloatWidget;
+    QAction *m_actionFsmonitor;
+    QAction *m_actionSnapshotStatistics;
     
     // AI悬浮窗
     AIFloatWidget *m_aiFloatWidget;
     
     // 状态
     QString m_currentRepository;
+    QString m_currentBranch;
+    QString m_branchUpstream; // 当前分支的上游，例如origin/main
+    QString m_branchTracking; // 当前分支相对上游的领先/落后提交数
+    QString m_pendingDiffPath;
+    bool m_pendingDiffStaged;
+    quint64 m_diffJob; // 正在流式读取的差异任务，选择其他文件时取消
+    QString m_pendingCommitHash;
     bool m_aiEnabled;
     bool m_privacyModeEnabled;
     AIProvider::AIRequestType m_currentAIRequestType;
     QString m_aiCommitSuggestion;
+    bool m_commitMessagePending; // 已发出生成提交信息的请求，等待AI返回后弹出提交对话框
+    QTimer *m_commitSearchTimer; // 输入停顿后再搜索
+    bool m_commitSearchActive;   // 历史视图中显示的是搜索结果而不是完整的历史
 };
 #endif // MAINWINDOW_H
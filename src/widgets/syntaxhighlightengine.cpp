@@ -0,0 +1,328 @@
+#include "syntaxhighlightengine.h"
+#include <QThread>
+#include <QFileInfo>
+
+namespace {
+// 最多缓存的blob数
+const int MaxCachedBlobs = 256;
+
+struct LanguageDefinition {
+    QStringList suffixes;
+    QSet<QByteArray> keywords;
+    QByteArray lineComment;
+    QByteArray blockCommentStart;
+    QByteArray blockCommentEnd;
+    QByteArray quotes;
+    bool preprocessor = false;
+};
+
+QSet<QByteArray> keywordSet(const char *words)
+{
+    QSet<QByteArray> set;
+    for (const QByteArray &word : QByteArray(words).split(' ')) {
+        if (!word.isEmpty()) {
+            set.insert(word);
+        }
+    }
+    return set;
+}
+
+// 语言编号为下标加1；局部静态变量的初始化是线程安全的，两个线程都会读取
+const QList<LanguageDefinition> &languages()
+{
+    static const QList<LanguageDefinition> definitions = [] {
+        QList<LanguageDefinition> list;
+
+        LanguageDefinition cpp;
+        cpp.suffixes = {"c", "cc", "cpp", "cxx", "h", "hh", "hpp", "hxx", "m", "mm"};
+        cpp.keywords = keywordSet(
+            "auto bool break case catch char class const constexpr continue default delete do double else enum "
+            "explicit extern false float for friend goto if inline int long mutable namespace new noexcept nullptr "
+            "operator override private protected public return short signed sizeof static static_cast struct switch "
+            "template this throw true try typedef typename union unsigned using virtual void volatile while "
+            "dynamic_cast reinterpret_cast const_cast final slots signals emit");
+        cpp.lineComment = "//";
+        cpp.blockCommentStart = "/*";
+        cpp.blockCommentEnd = "*/";
+        cpp.quotes = "\"'";
+        cpp.preprocessor = true;
+        list.append(cpp);
+
+        LanguageDefinition java;
+        java.suffixes = {"java", "kt", "kts", "cs", "swift", "scala", "dart"};
+        java.keywords = keywordSet(
+            "abstract boolean break byte case catch char class const continue default do double else enum extends "
+            "final finally float for fun if implements import in int interface internal is let long namespace new "
+            "null object override package private protected public return short static super switch this throw "
+            "throws true false try using val var void when while");
+        java.lineComment = "//";
+        java.blockCommentStart = "/*";
+        java.blockCommentEnd = "*/";
+        java.quotes = "\"'";
+        list.append(java);
+
+        LanguageDefinition js;
+        js.suffixes = {"js", "jsx", "mjs", "cjs", "ts", "tsx", "qml"};
+        js.keywords = keywordSet(
+            "async await break case catch class const continue default delete do else export extends false "
+            "finally for from function if import in instanceof interface let new null of return static super "
+            "switch this throw true try type typeof undefined var void while yield property signal readonly");
+        js.lineComment = "//";
+        js.blockCommentStart = "/*";
+        js.blockCommentEnd = "*/";
+        js.quotes = "\"'`";
+        list.append(js);
+
+        LanguageDefinition go;
+        go.suffixes = {"go"};
+        go.keywords = keywordSet(
+            "break case chan const continue default defer else fallthrough false for func go goto if import "
+            "interface map nil package range return select struct switch true type var");
+        go.lineComment = "//";
+        go.blockCommentStart = "/*";
+        go.blockCommentEnd = "*/";
+        go.quotes = "\"'`";
+        list.append(go);
+
+        LanguageDefinition rust;
+        rust.suffixes = {"rs"};
+        rust.keywords = keywordSet(
+            "as async await break const continue crate dyn else enum extern false fn for if impl in let loop "
+            "match mod move mut pub ref return self Self static struct super trait true type unsafe use where while");
+        rust.lineComment = "//";
+        rust.blockCommentStart = "/*";
+        rust.blockCommentEnd = "*/";
+        rust.quotes = "\"";
+        list.append(rust);
+
+        LanguageDefinition python;
+        python.suffixes = {"py", "pyw", "pyi"};
+        python.keywords = keywordSet(
+            "and as assert async await break class continue def del elif else except False finally for from "
+            "global if import in is lambda None nonlocal not or pass raise return True try while with yield self");
+        python.lineComment = "#";
+        python.quotes = "\"'";
+        list.append(python);
+
+        LanguageDefinition shell;
+        shell.suffixes = {"sh", "bash", "zsh", "cmake", "txt", "pl", "rb", "yml", "yaml", "toml"};
+        shell.keywords = keywordSet(
+            "if then else elif fi for while do done case esac in function return local export "
+            "set unset add_executable add_library target_link_libraries find_package include_directories "
+            "endif endforeach foreach endfunction macro endmacro def end class module require true false");
+        shell.lineComment = "#";
+        shell.quotes = "\"'";
+        list.append(shell);
+
+        return list;
+    }();
+    return definitions;
+}
+
+inline bool isIdentifierStart(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+inline bool isIdentifierChar(char c)
+{
+    return isIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+inline bool startsAt(const QByteArray &text, qsizetype pos, const QByteArray &prefix)
+{
+    return !prefix.isEmpty() && QByteArrayView(text).sliced(pos).startsWith(prefix);
+}
+}
+
+int SyntaxHighlightEngine::languageForPath(const QString &path)
+{
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    const QString fileName = QFileInfo(path).fileName();
+    const QList<LanguageDefinition> &definitions = languages();
+    for (int i = 0; i < definitions.size(); ++i) {
+        if (definitions[i].suffixes.contains(suffix)) {
+            // .txt只对CMakeLists.txt生效
+            if (suffix == "txt" && fileName != "CMakeLists.txt") {
+                return 0;
+            }
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+SyntaxHighlightEngine::SyntaxHighlightEngine(QObject *parent)
+    : QObject(parent),
+      m_thread(new QThread(this)),
+      m_worker(new QObject),
+      m_cache(MaxCachedBlobs),
+      m_generation(0)
+{
+    m_thread->setObjectName("SyntaxHighlight");
+    m_worker->moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    m_thread->start(QThread::LowPriority);
+}
+
+SyntaxHighlightEngine::~SyntaxHighlightEngine()
+{
+    // 让进行中的请求尽快结束
+    m_generation.fetchAndAddRelaxed(1);
+    m_thread->quit();
+    m_thread->wait();
+}
+
+bool SyntaxHighlightEngine::tokens(const QByteArray &oid, int line, TokenList *tokens) const
+{
+    const QHash<int, TokenList> *lines = m_cache.object(oid);
+    if (!lines || !lines->contains(line)) {
+        return false;
+    }
+    *tokens = lines->value(line);
+    return true;
+}
+
+void SyntaxHighlightEngine::request(const QList<LineRequest> &lines)
+{
+    QList<LineRequest> missing;
+    bool changed = false;
+    for (const LineRequest &line : lines) {
+        const QHash<int, TokenList> *cached = m_cache.object(line.oid);
+        if (cached && cached->contains(line.line)) {
+            continue;
+        }
+        missing.append(line);
+        if (!m_inFlight.contains(requestKey(line.oid, line.line))) {
+            changed = true;
+        }
+    }
+    // 进行中的请求已经覆盖这些行，等待它完成
+    if (missing.isEmpty() || !changed) {
+        return;
+    }
+
+    m_inFlight.clear();
+    for (const LineRequest &line : missing) {
+        m_inFlight.insert(requestKey(line.oid, line.line));
+    }
+
+    const quint64 generation = m_generation.fetchAndAddRelaxed(1) + 1;
+    QMetaObject::invokeMethod(m_worker, [this, generation, missing]() {
+        QList<Result> results;
+        results.reserve(missing.size());
+        for (const LineRequest &line : missing) {
+            // 视图已经滚动到别处，放弃剩下的行
+            if (m_generation.loadRelaxed() != generation) {
+                return;
+            }
+            results.append({line.oid, line.line, tokenize(line.language, line.text)});
+        }
+        // 回到GUI线程写入缓存；引擎析构时会先等待工作线程结束
+        QMetaObject::invokeMethod(this, [this, generation, results]() {
+            if (m_generation.loadRelaxed() == generation) {
+                m_inFlight.clear();
+            }
+            storeResults(results);
+        }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+}
+
+void SyntaxHighlightEngine::storeResults(const QList<Result> &results)
+{
+    for (const Result &result : results) {
+        QHash<int, TokenList> *lines = m_cache.object(result.oid);
+        if (!lines) {
+            lines = new QHash<int, TokenList>;
+            m_cache.insert(result.oid, lines);
+        }
+        lines->insert(result.line, result.tokens);
+    }
+    emit highlightingReady();
+}
+
+QByteArray SyntaxHighlightEngine::requestKey(const QByteArray &oid, int line)
+{
+    return oid + ':' + QByteArray::number(line);
+}
+
+SyntaxHighlightEngine::TokenList SyntaxHighlightEngine::tokenize(int language, const QByteArray &text)
+{
+    TokenList tokens;
+    if (language <= 0 || language > languages().size()) {
+        return tokens;
+    }
+    const LanguageDefinition &definition = languages()[language - 1];
+    const qsizetype size = text.size();
+
+    auto add = [&tokens](qsizetype start, qsizetype end, TokenKind kind) {
+        Token token;
+        token.start = quint32(start);
+        token.length = quint32(end - start);
+        token.kind = kind;
+        tokens.append(token);
+    };
+
+    qsizetype i = 0;
+    while (i < size && (text[i] == ' ' || text[i] == '\t')) {
+        ++i;
+    }
+    // 逐行切分看不到跨行的注释，以*开头的行按块注释的延续处理
+    if (!definition.blockCommentStart.isEmpty() && i < size && text[i] == '*'
+        && (i + 1 == size || text[i + 1] == ' ' || text[i + 1] == '/')) {
+        add(i, size, Comment);
+        return tokens;
+    }
+    if (definition.preprocessor && i < size && text[i] == '#') {
+        add(i, size, Preprocessor);
+        return tokens;
+    }
+
+    while (i < size) {
+        const char c = text[i];
+        if (startsAt(text, i, definition.lineComment)) {
+            add(i, size, Comment);
+            break;
+        }
+        if (startsAt(text, i, definition.blockCommentStart)) {
+            qsizetype end = text.indexOf(definition.blockCommentEnd, i + definition.blockCommentStart.size());
+            end = end < 0 ? size : end + definition.blockCommentEnd.size();
+            add(i, end, Comment);
+            i = end;
+            continue;
+        }
+        if (definition.quotes.contains(c)) {
+            qsizetype end = i + 1;
+            while (end < size && text[end] != c) {
+                end += text[end] == '\\' ? 2 : 1;
+            }
+            end = qMin(end + 1, size);
+            add(i, end, String);
+            i = end;
+            continue;
+        }
+        if (c >= '0' && c <= '9') {
+            qsizetype end = i + 1;
+            while (end < size && (isIdentifierChar(text[end]) || text[end] == '.')) {
+                ++end;
+            }
+            add(i, end, Number);
+            i = end;
+            continue;
+        }
+        if (isIdentifierStart(c)) {
+            qsizetype end = i + 1;
+            while (end < size && isIdentifierChar(text[end])) {
+                ++end;
+            }
+            // fromRawData不复制，查找关键字不分配内存
+            if (definition.keywords.contains(QByteArray::fromRawData(text.constData() + i, end - i))) {
+                add(i, end, Keyword);
+            }
+            i = end;
+            continue;
+        }
+        ++i;
+    }
+    return tokens;
+}
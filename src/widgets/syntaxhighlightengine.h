@@ -0,0 +1,80 @@
+#ifndef SYNTAXHIGHLIGHTENGINE_H
+#define SYNTAXHIGHLIGHTENGINE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QCache>
+#include <QAtomicInteger>
+
+class QThread;
+
+// 差异视图的语法高亮：按文件扩展名选择语言，在工作线程中逐行切分记号。
+// 结果按(blob对象ID, 行号)缓存，同一个blob在不同提交和视图中只计算一次；
+// 视图只为可见范围附近的行发起请求，新的请求到达后未完成的旧请求被放弃
+class SyntaxHighlightEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum TokenKind : quint8 {
+        Keyword,
+        String,
+        Comment,
+        Number,
+        Preprocessor
+    };
+
+    // 位置为行内的字节偏移，不包括差异的+/-/空格前缀
+    struct Token {
+        quint32 start = 0;
+        quint32 length = 0;
+        TokenKind kind = Keyword;
+    };
+    using TokenList = QList<Token>;
+
+    struct LineRequest {
+        QByteArray oid;   // 行所在的blob，可以是缩写
+        int line = 0;     // blob中的行号
+        int language = 0;
+        QByteArray text;
+    };
+
+    // 不支持的语言为0
+    static int languageForPath(const QString &path);
+
+    explicit SyntaxHighlightEngine(QObject *parent = nullptr);
+    ~SyntaxHighlightEngine();
+
+    bool tokens(const QByteArray &oid, int line, TokenList *tokens) const;
+    // 跳过已缓存的行，其余交给工作线程；与进行中的请求相同时不重复提交
+    void request(const QList<LineRequest> &lines);
+
+signals:
+    // 有新结果写入缓存，视图据此重绘
+    void highlightingReady();
+
+private:
+    struct Result {
+        QByteArray oid;
+        int line;
+        TokenList tokens;
+    };
+
+    static TokenList tokenize(int language, const QByteArray &text);
+    void storeResults(const QList<Result> &results);
+    static QByteArray requestKey(const QByteArray &oid, int line);
+
+    QThread *m_thread;
+    QObject *m_worker; // 在工作线程中执行任务的上下文对象
+    // blob对象ID -> 行号 -> 记号；按blob淘汰
+    QCache<QByteArray, QHash<int, TokenList>> m_cache;
+    QSet<QByteArray> m_inFlight;
+    // 工作线程据此放弃已经过时的请求
+    QAtomicInteger<quint64> m_generation;
+};
+
+#endif // SYNTAXHIGHLIGHTENGINE_H
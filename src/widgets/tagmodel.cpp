@@ -0,0 +1,236 @@
+#include "tagmodel.h"
+#include <QDateTime>
+#include <algorithm>
+#include <numeric>
+
+namespace {
+// 每次交给视图的行数，滚动到底部时再加载下一页
+const int TagPageSize = 500;
+
+// 版本排序键中的标记，都小于名称中可能出现的可见字符：
+// 预发布（-）< 名称结束 < 数字段 < 其他字符
+const char PrereleaseMarker = '\x01';
+const char EndMarker = '\x02';
+const char NumberMarker = '\x03';
+}
+
+TagModel::TagModel(QObject *parent)
+    : QAbstractTableModel(parent),
+      m_loadedRows(0),
+      m_sortColumn(DateColumn),
+      m_sortOrder(Qt::DescendingOrder)
+{
+}
+
+TagModel::~TagModel()
+{
+}
+
+void TagModel::setTags(const QList<GitManager::TagInfo> &tags)
+{
+    beginResetModel();
+    m_tags = tags;
+    m_versionKeys.clear();
+    m_versionKeys.reserve(m_tags.size());
+    for (const GitManager::TagInfo &tag : m_tags) {
+        m_versionKeys.append(versionKey(tag.name));
+    }
+    sortTags();
+    m_loadedRows = qMin(TagPageSize, int(m_tags.size()));
+    endResetModel();
+}
+
+GitManager::TagInfo TagModel::getTagInfo(int row) const
+{
+    if (row >= 0 && row < m_loadedRows) {
+        return m_tags[m_order[row]];
+    }
+    return GitManager::TagInfo();
+}
+
+int TagModel::tagCount() const
+{
+    return m_tags.size();
+}
+
+int TagModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_loadedRows;
+}
+
+int TagModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return ColumnCount;
+}
+
+QVariant TagModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_loadedRows || index.column() >= ColumnCount) {
+        return QVariant();
+    }
+
+    const GitManager::TagInfo &tagInfo = m_tags[m_order[index.row()]];
+
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case NameColumn:
+            return tagInfo.name;
+        case DateColumn:
+            // 指向树或文件的轻量标签没有日期
+            if (tagInfo.date > 0) {
+                return QDateTime::fromSecsSinceEpoch(tagInfo.date).toString("yyyy-MM-dd");
+            }
+            return QString();
+        case SubjectColumn:
+            return tagInfo.subject;
+        case TargetColumn:
+            return tagInfo.target.left(7); // 只显示前7个字符
+        default:
+            return QVariant();
+        }
+        break;
+
+    case Qt::ToolTipRole:
+        if (index.column() == TargetColumn) {
+            return tagInfo.target;
+        }
+        return (tagInfo.annotated ? "附注标签: " : "轻量标签: ") + tagInfo.name;
+
+    default:
+        return QVariant();
+    }
+
+    return QVariant();
+}
+
+QVariant TagModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case NameColumn:
+            return "标签";
+        case DateColumn:
+            return "日期";
+        case SubjectColumn:
+            return "说明";
+        case TargetColumn:
+            return "指向";
+        default:
+            return QVariant();
+        }
+    }
+    return QVariant();
+}
+
+bool TagModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return false;
+    }
+    return m_loadedRows < m_tags.size();
+}
+
+void TagModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent)) {
+        return;
+    }
+    const int count = qMin(TagPageSize, int(m_tags.size()) - m_loadedRows);
+    beginInsertRows(QModelIndex(), m_loadedRows, m_loadedRows + count - 1);
+    m_loadedRows += count;
+    endInsertRows();
+}
+
+void TagModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= ColumnCount) {
+        return;
+    }
+    if (column == m_sortColumn && order == m_sortOrder) {
+        return;
+    }
+    // 排序后从第一页重新开始，之前加载的行不再对应排序结果的前部
+    beginResetModel();
+    m_sortColumn = column;
+    m_sortOrder = order;
+    sortTags();
+    m_loadedRows = qMin(TagPageSize, int(m_tags.size()));
+    endResetModel();
+}
+
+QByteArray TagModel::versionKey(const QString &name)
+{
+    const QByteArray text = name.toLower().toUtf8();
+    QByteArray key;
+    key.reserve(text.size() + 8);
+    qsizetype position = 0;
+    while (position < text.size()) {
+        const char c = text.at(position);
+        if (c >= '0' && c <= '9') {
+            // 去掉前导零后先比较位数再比较数字
+            qsizetype end = position;
+            while (end < text.size() && text.at(end) >= '0' && text.at(end) <= '9') {
+                ++end;
+            }
+            while (position < end - 1 && text.at(position) == '0') {
+                ++position;
+            }
+            key += NumberMarker;
+            key += char(qMin<qsizetype>(end - position, 0xff));
+            key.append(text.constData() + position, end - position);
+            position = end;
+        } else {
+            key += c == '-' ? PrereleaseMarker : c;
+            ++position;
+        }
+    }
+    key += EndMarker;
+    return key;
+}
+
+void TagModel::sortTags()
+{
+    m_order.resize(m_tags.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+
+    // 主键相同时按名称，结果与输入顺序无关
+    const auto byName = [this](int a, int b) {
+        return m_versionKeys[a] < m_versionKeys[b];
+    };
+    switch (m_sortColumn) {
+    case DateColumn:
+        std::sort(m_order.begin(), m_order.end(), [this, &byName](int a, int b) {
+            if (m_tags[a].date != m_tags[b].date) {
+                return m_tags[a].date < m_tags[b].date;
+            }
+            return byName(a, b);
+        });
+        break;
+    case SubjectColumn:
+        std::sort(m_order.begin(), m_order.end(), [this, &byName](int a, int b) {
+            const int result = m_tags[a].subject.compare(m_tags[b].subject);
+            return result != 0 ? result < 0 : byName(a, b);
+        });
+        break;
+    case TargetColumn:
+        std::sort(m_order.begin(), m_order.end(), [this, &byName](int a, int b) {
+            const int result = m_tags[a].target.compare(m_tags[b].target);
+            return result != 0 ? result < 0 : byName(a, b);
+        });
+        break;
+    default:
+        std::sort(m_order.begin(), m_order.end(), byName);
+        break;
+    }
+
+    if (m_sortOrder == Qt::DescendingOrder) {
+        std::reverse(m_order.begin(), m_order.end());
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef TAGMODEL_H
+#define TAGMODEL_H
+
+#include <QAbstractTableModel>
+#include <QByteArray>
+#include <QList>
+#include <vector>
+#include "git/gitmanager.h"
+
+// 标签列表：排序用的键在设置标签时计算一次，排序只比较这些键；
+// 排序后的行按页交给视图（fetchMore），十万个标签也只建立可见附近的行
+class TagModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NameColumn,
+        DateColumn,
+        SubjectColumn,
+        TargetColumn,
+        ColumnCount
+    };
+
+    explicit TagModel(QObject *parent = nullptr);
+    ~TagModel();
+
+    void setTags(const QList<GitManager::TagInfo> &tags);
+    GitManager::TagInfo getTagInfo(int row) const;
+    int tagCount() const;
+
+    // QAbstractItemModel interface
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+    // 名称按版本号排序（v1.10在v1.9之后，1.0.0-rc1在1.0.0之前），日期相同时按名称
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+    // 数字段按数值比较、-之后的部分视为预发布版本的排序键，按字节比较即可
+    static QByteArray versionKey(const QString &name);
+    void sortTags();
+
+    QList<GitManager::TagInfo> m_tags;
+    QList<QByteArray> m_versionKeys; // 与m_tags一一对应
+    std::vector<int> m_order;        // 排序后第几行对应m_tags中的下标
+    int m_loadedRows;                // 已经交给视图的行数
+    int m_sortColumn;
+    Qt::SortOrder m_sortOrder;
+};
+
+#endif // TAGMODEL_H